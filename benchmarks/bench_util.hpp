@@ -0,0 +1,113 @@
+#ifndef LAMBDASTEW_BENCH_UTIL_HPP
+#define LAMBDASTEW_BENCH_UTIL_HPP
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace LambdaStew
+{
+namespace bench
+{
+
+///
+/// \brief The Reporter class
+///
+/// Prints benchmark results in a long, machine readable format: one line
+/// per metric, either as CSV (the default) or as JSON lines when the
+/// program is run with --json. Every line names the benchmark, the
+/// configuration it ran with, the metric and its value, so results from
+/// different programs and versions can be concatenated and compared.
+///
+/// Run with --quick to ask the benchmark for a shorter run.
+///
+class Reporter
+{
+  public:
+    Reporter( int argc, char *argv[] ) : m_json( false ), m_quick( false )
+    {
+        for ( int i = 1; i < argc; ++i )
+        {
+            if ( strcmp( argv[i], "--json" ) == 0 )
+            {
+                m_json = true;
+            }
+            else if ( strcmp( argv[i], "--quick" ) == 0 )
+            {
+                m_quick = true;
+            }
+        }
+        if ( !m_json )
+        {
+            std::cout << "benchmark,config,metric,value" << std::endl;
+        }
+    }
+
+    ///
+    /// \brief quick
+    ///
+    /// \return true if --quick was given
+    ///
+    bool quick() const { return m_quick; }
+
+    ///
+    /// \brief report
+    ///
+    /// Print one metric
+    ///
+    /// \param benchmark the name of the benchmark
+    /// \param config the parameters, as key=value pairs separated by ';'
+    /// \param metric the name of the metric including its unit
+    /// \param value the measured value
+    ///
+    void report( std::string const &benchmark,
+                 std::string const &config,
+                 std::string const &metric,
+                 double value ) const
+    {
+        if ( m_json )
+        {
+            std::cout << "{\"benchmark\":\"" << benchmark << "\",\"config\":\""
+                      << config << "\",\"metric\":\"" << metric
+                      << "\",\"value\":" << value << "}" << std::endl;
+        }
+        else
+        {
+            std::cout << benchmark << "," << config << "," << metric << ","
+                      << value << std::endl;
+        }
+    }
+
+  private:
+    bool m_json;
+    bool m_quick;
+};
+
+///
+/// \brief elapsed_seconds
+///
+/// \return the seconds between start and now on the steady clock
+///
+inline double elapsed_seconds( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration_cast<std::chrono::duration<double> >(
+               std::chrono::steady_clock::now() - start ).count();
+}
+
+///
+/// \brief Payload
+///
+/// A capture of N bytes, used to measure the effect of closure size
+///
+template <size_t N>
+struct Payload
+{
+    unsigned char bytes[N];
+};
+}
+}
+
+#endif // LAMBDASTEW_BENCH_UTIL_HPP
@@ -0,0 +1,149 @@
+#include "LambdaStew/Channel.hpp"
+#include "LambdaStew/MessageQueue.hpp"
+#include "bench_util.hpp"
+
+using namespace LambdaStew;
+using namespace LambdaStew::bench;
+
+using std::vector;
+using std::thread;
+
+static uint64_t t_sink;
+
+///
+/// \brief run_channel
+///
+/// Send items integers through a Channel to consumers which sum them a
+/// batch at a time
+///
+static void run_channel( Reporter const &reporter,
+                         int consumers,
+                         size_t items,
+                         size_t batch )
+{
+    Channel<uint64_t> channel;
+    std::atomic<uint64_t> total( 0 );
+
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    vector<thread> threads;
+    for ( int i = 0; i < consumers; ++i )
+    {
+        threads.emplace_back( [&channel, &total, batch]()
+                              {
+            vector<uint64_t> values;
+            uint64_t sum = 0;
+            while ( channel.wait_and_receive(
+                        values, batch, std::chrono::seconds( 1 ) )
+                    != Channel<uint64_t>::Status::closed )
+            {
+                for ( auto value : values )
+                {
+                    sum += value;
+                }
+                values.clear();
+            }
+            total += sum;
+        } );
+    }
+
+    vector<uint64_t> values;
+    values.reserve( batch );
+    for ( size_t n = 0; n < items; n += batch )
+    {
+        for ( size_t i = n; i < n + batch && i < items; ++i )
+        {
+            values.push_back( i );
+        }
+        channel.send_bulk( values.begin(), values.end() );
+        values.clear();
+    }
+    channel.close();
+    for ( auto &consumer : threads )
+    {
+        consumer.join();
+    }
+    double seconds = elapsed_seconds( start );
+    t_sink += total;
+
+    std::ostringstream config;
+    config << "mode=channel;consumers=" << consumers << ";batch=" << batch;
+    reporter.report( "channel_throughput",
+                     config.str(),
+                     "items_per_second",
+                     items / seconds );
+}
+
+///
+/// \brief run_queue
+///
+/// The same work as run_channel(), with every integer wrapped in a task
+/// pushed to a MessageQueue
+///
+static void run_queue( Reporter const &reporter,
+                       int consumers,
+                       size_t items,
+                       size_t batch )
+{
+    MessageQueue q;
+    std::atomic<uint64_t> total( 0 );
+
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    vector<thread> threads;
+    for ( int i = 0; i < consumers; ++i )
+    {
+        threads.emplace_back( [&q]()
+                              {
+            while ( q.wait_and_invoke( std::chrono::seconds( 1 ) )
+                    != MessageQueue::Status::closed )
+            {
+            }
+        } );
+    }
+
+    vector<Task> tasks;
+    tasks.reserve( batch );
+    for ( size_t n = 0; n < items; n += batch )
+    {
+        for ( size_t i = n; i < n + batch && i < items; ++i )
+        {
+            tasks.emplace_back( [&total, i]()
+                                {
+                total.fetch_add( i, std::memory_order_relaxed );
+            } );
+        }
+        q.push_back_bulk( tasks );
+        tasks.clear();
+    }
+    q.close();
+    for ( auto &consumer : threads )
+    {
+        consumer.join();
+    }
+    double seconds = elapsed_seconds( start );
+    t_sink += total;
+
+    std::ostringstream config;
+    config << "mode=message_queue;consumers=" << consumers
+           << ";batch=" << batch;
+    reporter.report( "channel_throughput",
+                     config.str(),
+                     "items_per_second",
+                     items / seconds );
+}
+
+int main( int argc, char *argv[] )
+{
+    Reporter reporter( argc, argv );
+    size_t const items = reporter.quick() ? 1000000 : 10000000;
+    size_t const batch = 256;
+
+    int const consumer_counts[] = {1, 4};
+    for ( auto consumers : consumer_counts )
+    {
+        run_channel( reporter, consumers, items, batch );
+        run_queue( reporter, consumers, items, batch );
+    }
+    return 0;
+}
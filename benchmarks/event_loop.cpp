@@ -0,0 +1,126 @@
+#include "LambdaStew/EventLoop.hpp"
+#include "bench_util.hpp"
+
+#include <unistd.h>
+
+using namespace LambdaStew;
+using namespace LambdaStew::bench;
+
+using std::vector;
+using std::thread;
+
+static uint64_t t_sink;
+
+///
+/// \brief run_post
+///
+/// Post items functions from producer threads to a running EventLoop
+///
+static void run_post( Reporter const &reporter, int producers, size_t items )
+{
+    EventLoop loop;
+    thread runner( [&loop]() { loop.run(); } );
+
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    vector<thread> threads;
+    for ( int i = 0; i < producers; ++i )
+    {
+        threads.emplace_back( [&loop, items]()
+                              {
+            for ( size_t n = 0; n < items; ++n )
+            {
+                loop.post( [n]()
+                           {
+                    t_sink += n;
+                } );
+            }
+        } );
+    }
+    for ( auto &producer : threads )
+    {
+        producer.join();
+    }
+
+    // Wait for the loop to catch up
+    std::promise<void> done;
+    loop.post( [&done]() { done.set_value(); } );
+    done.get_future().wait();
+    double seconds = elapsed_seconds( start );
+    loop.stop();
+    runner.join();
+
+    std::ostringstream config;
+    config << "mode=post;producers=" << producers;
+    reporter.report( "event_loop",
+                     config.str(),
+                     "items_per_second",
+                     producers * items / seconds );
+}
+
+///
+/// \brief run_ping_pong
+///
+/// Bounce a byte between this thread and a handler on the loop thread over
+/// a pair of pipes
+///
+static void run_ping_pong( Reporter const &reporter, size_t round_trips )
+{
+    int ping[2];
+    int pong[2];
+    if ( pipe( ping ) != 0 || pipe( pong ) != 0 )
+    {
+        return;
+    }
+
+    EventLoop loop;
+    loop.add_fd( ping[0],
+                 EPOLLIN,
+                 [&ping, &pong]( uint32_t )
+                 {
+        char byte;
+        if ( read( ping[0], &byte, 1 ) == 1 )
+        {
+            t_sink += write( pong[1], &byte, 1 );
+        }
+    } );
+    thread runner( [&loop]() { loop.run(); } );
+
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    char byte = 0;
+    for ( size_t n = 0; n < round_trips; ++n )
+    {
+        if ( write( ping[1], &byte, 1 ) != 1 || read( pong[0], &byte, 1 ) != 1 )
+        {
+            break;
+        }
+    }
+    double seconds = elapsed_seconds( start );
+    loop.stop();
+    runner.join();
+    loop.remove_fd( ping[0] );
+    for ( int fd : {ping[0], ping[1], pong[0], pong[1]} )
+    {
+        close( fd );
+    }
+
+    reporter.report( "event_loop",
+                     "mode=ping_pong",
+                     "round_trip_ns",
+                     seconds * 1e9 / round_trips );
+}
+
+int main( int argc, char *argv[] )
+{
+    Reporter reporter( argc, argv );
+    size_t const items = reporter.quick() ? 100000 : 1000000;
+
+    int const producer_counts[] = {1, 4};
+    for ( auto producers : producer_counts )
+    {
+        run_post( reporter, producers, items );
+    }
+    run_ping_pong( reporter, items / 10 );
+    return 0;
+}
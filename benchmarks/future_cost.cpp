@@ -0,0 +1,161 @@
+#include "LambdaStew/Future.hpp"
+#include "bench_util.hpp"
+
+#include <future>
+#include <memory>
+
+using namespace LambdaStew;
+using namespace LambdaStew::bench;
+
+using std::vector;
+using std::thread;
+
+///
+/// \brief The Consumer class
+///
+/// A queue with one consumer thread for the duration of a benchmark
+///
+class Consumer
+{
+  public:
+    Consumer()
+        : m_thread( [this]()
+                    {
+            while ( m_queue.wait_and_invoke( std::chrono::seconds( 1 ) )
+                    != MessageQueue::Status::closed )
+            {
+            }
+        } )
+    {
+    }
+
+    ~Consumer()
+    {
+        m_queue.close();
+        m_thread.join();
+    }
+
+    MessageQueue &queue() { return m_queue; }
+
+  private:
+    MessageQueue m_queue;
+    thread m_thread;
+};
+
+///
+/// \brief run_submit
+///
+/// Submit count functions with submit() and then get() every result
+///
+static void run_submit( Reporter const &reporter, size_t count )
+{
+    Consumer consumer;
+    vector<Future<size_t> > futures;
+    futures.reserve( count );
+
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        futures.push_back( submit( consumer.queue(),
+                                   [i]()
+                                   {
+                                       return i;
+                                   } ) );
+    }
+    size_t sum = 0;
+    for ( auto &future : futures )
+    {
+        sum += future.get();
+    }
+    double seconds = elapsed_seconds( start );
+
+    reporter.report( "future_submit_get",
+                     "mode=future",
+                     "ns_per_result",
+                     seconds * 1e9 / count );
+}
+
+///
+/// \brief run_packaged_task
+///
+/// The same as run_submit(), with a std::packaged_task in each Task
+///
+static void run_packaged_task( Reporter const &reporter, size_t count )
+{
+    Consumer consumer;
+    vector<std::future<size_t> > futures;
+    futures.reserve( count );
+
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        std::packaged_task<size_t()> task( [i]()
+                                           {
+                                               return i;
+                                           } );
+        futures.push_back( task.get_future() );
+        consumer.queue().push_back( std::move( task ) );
+    }
+    size_t sum = 0;
+    for ( auto &future : futures )
+    {
+        sum += future.get();
+    }
+    double seconds = elapsed_seconds( start );
+
+    reporter.report( "future_submit_get",
+                     "mode=packaged_task",
+                     "ns_per_result",
+                     seconds * 1e9 / count );
+}
+
+///
+/// \brief run_then
+///
+/// Submit count functions, each with a then() continuation on the same
+/// queue, and get() the results of the continuations
+///
+static void run_then( Reporter const &reporter, size_t count )
+{
+    Consumer consumer;
+    vector<Future<size_t> > futures;
+    futures.reserve( count );
+
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        futures.push_back( submit( consumer.queue(),
+                                   [i]()
+                                   {
+                                       return i;
+                                   } )
+                               .then( consumer.queue(),
+                                      []( Future<size_t> in )
+                                      {
+                                          return in.get() + 1;
+                                      } ) );
+    }
+    size_t sum = 0;
+    for ( auto &future : futures )
+    {
+        sum += future.get();
+    }
+    double seconds = elapsed_seconds( start );
+
+    reporter.report(
+        "future_then", "mode=future", "ns_per_result", seconds * 1e9 / count );
+}
+
+int main( int argc, char *argv[] )
+{
+    Reporter reporter( argc, argv );
+    size_t const count = reporter.quick() ? 100000 : 1000000;
+
+    run_submit( reporter, count );
+    run_packaged_task( reporter, count );
+    run_then( reporter, count );
+    return 0;
+}
@@ -0,0 +1,213 @@
+#include "LambdaStew/BinaryLog.hpp"
+#include "LambdaStew/Log.hpp"
+#include "LambdaStew/LogCategory.hpp"
+#include "LambdaStew/LogFile.hpp"
+#include "bench_util.hpp"
+
+#include <cstdio>
+#include <streambuf>
+
+using namespace LambdaStew;
+using namespace LambdaStew::bench;
+
+using std::chrono::steady_clock;
+
+///
+/// \brief The NullBuffer class
+///
+/// A streambuf which accepts and discards everything, so that only the cost
+/// of formatting and locking is measured
+///
+class NullBuffer : public std::streambuf
+{
+  protected:
+    int overflow( int c ) override { return traits_type::not_eof( c ); }
+
+    std::streamsize xsputn( char const *, std::streamsize n ) override
+    {
+        return n;
+    }
+};
+
+///
+/// \brief run_log_info
+///
+/// Call log_info() with a few typical arguments and report the cost per call
+///
+/// \param reporter where to print the result
+/// \param config the name of the configuration being measured
+/// \param count the number of calls
+///
+static void
+    run_log_info( Reporter const &reporter, char const *config, size_t count )
+{
+    steady_clock::time_point start = steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        log_info( "log_cost: item ", i, " of ", count, " value ", 3.25 );
+    }
+    double seconds = elapsed_seconds( start );
+    reporter.report( "log_info", config, "ns_per_call", seconds * 1e9 / count );
+}
+
+///
+/// \brief run_trace_macro
+///
+/// Call LAMBDASTEW_LOG_TRACE(), whose arguments are only evaluated when
+/// trace logging is enabled, and report the cost per call
+///
+static void run_trace_macro( Reporter const &reporter,
+                             char const *config,
+                             size_t count )
+{
+    steady_clock::time_point start = steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        LAMBDASTEW_LOG_TRACE(
+            "log_cost: item ", i, " of ", count, " value ", 3.25 );
+    }
+    double seconds = elapsed_seconds( start );
+    reporter.report(
+        "LAMBDASTEW_LOG_TRACE", config, "ns_per_call", seconds * 1e9 / count );
+}
+
+///
+/// \brief run_category
+///
+/// Log a debug line of a category with each kind of call site and report
+/// the cost per call
+///
+static void
+    run_category( Reporter const &reporter, char const *config, size_t count )
+{
+    static LogCategory &category = log_category( "log_cost.category" );
+
+    steady_clock::time_point start = steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        LAMBDASTEW_LOG_CATEGORY(
+            category, LogLevel::debug, "log_cost: item ", i, " of ", count );
+    }
+    reporter.report( "LAMBDASTEW_LOG_CATEGORY",
+                     config,
+                     "ns_per_call",
+                     elapsed_seconds( start ) * 1e9 / count );
+
+    start = steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        LAMBDASTEW_LOG_SAMPLED(
+            category, LogLevel::debug, 100, "log_cost: item ", i, " of ", count );
+    }
+    reporter.report( "LAMBDASTEW_LOG_SAMPLED",
+                     config,
+                     "ns_per_call",
+                     elapsed_seconds( start ) * 1e9 / count );
+
+    start = steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        LAMBDASTEW_LOG_RATE_LIMITED( category,
+                                     LogLevel::debug,
+                                     1000,
+                                     100,
+                                     "log_cost: item ",
+                                     i,
+                                     " of ",
+                                     count );
+    }
+    reporter.report( "LAMBDASTEW_LOG_RATE_LIMITED",
+                     config,
+                     "ns_per_call",
+                     elapsed_seconds( start ) * 1e9 / count );
+}
+
+///
+/// \brief run_binary
+///
+/// Call LAMBDASTEW_LOG_BINARY() with the arguments of run_log_info() and
+/// report the cost per call
+///
+static void
+    run_binary( Reporter const &reporter, char const *config, size_t count )
+{
+    steady_clock::time_point start = steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        LAMBDASTEW_LOG_BINARY( LogLevel::info,
+                               "log_cost: item {} of {} value {}",
+                               i,
+                               count,
+                               3.25 );
+    }
+    double seconds = elapsed_seconds( start );
+    reporter.report(
+        "LAMBDASTEW_LOG_BINARY", config, "ns_per_call", seconds * 1e9 / count );
+}
+
+int main( int argc, char *argv[] )
+{
+    Reporter reporter( argc, argv );
+    size_t const count = reporter.quick() ? 20000 : 500000;
+
+    std::ostream *original = log_ostream();
+    bool original_enable = log_info_enable();
+
+    NullBuffer null_buffer;
+    std::ostream null_stream( &null_buffer );
+    log_ostream( true, &null_stream );
+
+    log_info_enable( true, true );
+    run_log_info( reporter, "sink=null;enabled=1", count );
+
+    log_info_enable( true, false );
+    run_log_info( reporter, "sink=null;enabled=0", count );
+
+    run_trace_macro( reporter, "level=trace;enabled=0", count );
+    log_trace_enable( true, true );
+    run_trace_macro( reporter, "sink=null;level=trace;enabled=1", count );
+    log_trace_enable( true, false );
+
+    run_category( reporter, "level=debug;enabled=0", count );
+    log_category_levels( "log_cost", log_level_mask( LogLevel::debug ) );
+    run_category( reporter, "sink=null;level=debug;enabled=1", count );
+    log_category_inherit( "log_cost" );
+
+    log_info_enable( true, true );
+    log_async( true, true, LogOverflow::block );
+    run_log_info( reporter, "sink=null;enabled=1;async=block", count );
+    log_flush();
+
+    log_async( true, true, LogOverflow::drop );
+    run_log_info( reporter, "sink=null;enabled=1;async=drop", count );
+    log_async( true, false );
+    reporter.report( "log_info",
+                     "sink=null;enabled=1;async=drop",
+                     "dropped",
+                     log_dropped() );
+
+    LogFileOptions file_options;
+    file_options.path = "log_cost.log";
+    file_options.keep = 0;
+    log_to_file( true, true, file_options );
+    run_log_info( reporter, "sink=mmap;enabled=1", count );
+    log_async( true, true, LogOverflow::block );
+    run_log_info( reporter, "sink=mmap;enabled=1;async=block", count );
+    log_flush();
+    log_async( true, false );
+    log_to_file( true, false );
+    std::remove( file_options.path.c_str() );
+
+    char const *binary_path = "log_cost.blog";
+    log_binary( true, true, binary_path );
+    log_async( true, true, LogOverflow::block );
+    run_binary( reporter, "file=binary;enabled=1;async=block", count );
+    log_flush();
+    log_binary( true, false );
+    log_async( true, false );
+    std::remove( binary_path );
+
+    log_info_enable( true, original_enable );
+    log_ostream( true, original );
+    return 0;
+}
@@ -0,0 +1,463 @@
+#include "LambdaStew/MessageQueue.hpp"
+#include "LambdaStew/ShardedMessageQueue.hpp"
+#include "bench_util.hpp"
+
+#include <atomic>
+
+using namespace LambdaStew;
+using namespace LambdaStew::bench;
+
+using std::string;
+using std::vector;
+using std::thread;
+
+///
+/// \brief t_sink
+///
+/// Written by every benchmark task so that the payload is not optimized away
+///
+static thread_local unsigned t_sink = 0;
+
+///
+/// \brief backend_name
+///
+static char const *backend_name( MessageQueue::Backend backend )
+{
+    return backend == MessageQueue::Backend::lock_free_ring ? "lock_free_ring"
+                                                            : "locked_queue";
+}
+
+///
+/// \brief run_throughput
+///
+/// Push items from producers to consumers through one MessageQueue and
+/// report the number of items per second, from the first push to the last
+/// item executed
+///
+/// \param reporter where to print the result
+/// \param backend the queue backend
+/// \param producers number of producer threads
+/// \param consumers number of consumer threads
+/// \param items total number of items pushed
+///
+template <size_t PayloadSize>
+static void run_throughput( Reporter const &reporter,
+                            MessageQueue::Backend backend,
+                            int producers,
+                            int consumers,
+                            size_t items )
+{
+    MessageQueue q( backend );
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+
+    vector<thread> consumer_threads;
+    for ( int i = 0; i < consumers; ++i )
+    {
+        consumer_threads.emplace_back( [&q]()
+                                       {
+            while ( q.wait_and_invoke( std::chrono::seconds( 1 ) )
+                    != MessageQueue::Status::closed )
+            {
+            }
+        } );
+    }
+
+    vector<thread> producer_threads;
+    for ( int i = 0; i < producers; ++i )
+    {
+        size_t count = items / producers;
+        producer_threads.emplace_back( [&q, count]()
+                                       {
+            Payload<PayloadSize> payload;
+            memset( payload.bytes, 1, sizeof( payload.bytes ) );
+            for ( size_t n = 0; n < count; ++n )
+            {
+                q.push_back( [payload]()
+                             {
+                    t_sink += payload.bytes[0];
+                } );
+            }
+        } );
+    }
+
+    for ( auto &producer : producer_threads )
+    {
+        producer.join();
+    }
+    q.close();
+    for ( auto &consumer : consumer_threads )
+    {
+        consumer.join();
+    }
+
+    double seconds = elapsed_seconds( start );
+    size_t pushed = ( items / producers ) * producers;
+
+    std::ostringstream config;
+    config << "backend=" << backend_name( backend ) << ";producers="
+           << producers << ";consumers=" << consumers
+           << ";payload_bytes=" << PayloadSize;
+    reporter.report( "queue_throughput",
+                     config.str(),
+                     "items_per_second",
+                     pushed / seconds );
+}
+
+///
+/// \brief run_batch_throughput
+///
+/// Push items in batches with push_back_bulk() and consume them with
+/// invoke_batch(), from one producer to one consumer
+///
+static void run_batch_throughput( Reporter const &reporter,
+                                  size_t batch_size,
+                                  size_t items )
+{
+    MessageQueue q;
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+
+    thread consumer( [&q, batch_size]()
+                     {
+        while ( true )
+        {
+            if ( q.invoke_batch( batch_size ) == 0 )
+            {
+                if ( q.wait_and_invoke( std::chrono::seconds( 1 ) )
+                     == MessageQueue::Status::closed )
+                {
+                    break;
+                }
+            }
+        }
+    } );
+
+    vector<Task> tasks;
+    for ( size_t n = 0; n < items; n += batch_size )
+    {
+        for ( size_t i = 0; i < batch_size; ++i )
+        {
+            tasks.emplace_back( []()
+                                {
+                t_sink++;
+            } );
+        }
+        q.push_back_bulk( tasks );
+    }
+    q.close();
+    consumer.join();
+
+    double seconds = elapsed_seconds( start );
+    std::ostringstream config;
+    config << "batch_size=" << batch_size;
+    reporter.report( "queue_batch_throughput",
+                     config.str(),
+                     "items_per_second",
+                     ( ( items + batch_size - 1 ) / batch_size ) * batch_size
+                     / seconds );
+}
+
+///
+/// \brief run_control_latency
+///
+/// Keep backlog bulk items queued in lane 0 while one consumer works
+/// through them, push a control item to the highest lane and report how
+/// many bulk items ran before it and how long it waited. With one lane the
+/// control item queues behind the whole backlog
+///
+static void run_control_latency( Reporter const &reporter,
+                                 unsigned lanes,
+                                 size_t backlog )
+{
+    MessageQueue q( MessageQueue::Backend::locked_queue,
+                    MessageQueue::default_ring_capacity,
+                    lanes );
+    std::atomic<size_t> executed( 0 );
+    thread consumer( [&q]()
+                     {
+        while ( q.invoke_batch( 16 ) > 0
+                || q.wait_and_invoke( std::chrono::seconds( 1 ) )
+                       != MessageQueue::Status::closed )
+        {
+        }
+    } );
+
+    size_t const samples = 100;
+    double total_us = 0;
+    size_t total_ahead = 0;
+    for ( size_t n = 0; n < samples; ++n )
+    {
+        while ( q.size() < backlog )
+        {
+            q.push_back( [&executed]()
+                         {
+                executed.fetch_add( 1, std::memory_order_relaxed );
+            } );
+        }
+
+        std::atomic<size_t> ran_at( SIZE_MAX );
+        size_t const pushed_at = executed.load();
+        std::chrono::steady_clock::time_point start
+            = std::chrono::steady_clock::now();
+        q.push_back_lane( lanes - 1,
+                          [&executed, &ran_at]()
+                          {
+            ran_at.store( executed.load() );
+        } );
+        while ( ran_at.load() == SIZE_MAX )
+        {
+            std::this_thread::yield();
+        }
+        total_us += elapsed_seconds( start ) * 1e6;
+        total_ahead += ran_at.load() - pushed_at;
+    }
+    q.close();
+    consumer.join();
+
+    std::ostringstream config;
+    config << "lanes=" << lanes << ";backlog=" << backlog;
+    reporter.report(
+        "queue_control_latency", config.str(), "mean_us", total_us / samples );
+    reporter.report( "queue_control_latency",
+                     config.str(),
+                     "items_ahead",
+                     double( total_ahead ) / samples );
+}
+
+///
+/// \brief run_sharded_throughput
+///
+/// run_throughput() with 8 byte payloads through a ShardedMessageQueue, to
+/// compare with one locked_queue MessageQueue under the same contention
+///
+static void run_sharded_throughput( Reporter const &reporter,
+                                    size_t shards,
+                                    ShardedMessageQueue::Dispatch dispatch,
+                                    int producers,
+                                    int consumers,
+                                    size_t items )
+{
+    ShardedMessageQueue q( shards, dispatch );
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+
+    vector<thread> consumer_threads;
+    for ( int i = 0; i < consumers; ++i )
+    {
+        consumer_threads.emplace_back( [&q]()
+                                       {
+            while ( q.wait_and_invoke( std::chrono::seconds( 1 ) )
+                    != MessageQueue::Status::closed )
+            {
+            }
+        } );
+    }
+
+    vector<thread> producer_threads;
+    for ( int i = 0; i < producers; ++i )
+    {
+        size_t count = items / producers;
+        producer_threads.emplace_back( [&q, count]()
+                                       {
+            Payload<8> payload;
+            memset( payload.bytes, 1, sizeof( payload.bytes ) );
+            for ( size_t n = 0; n < count; ++n )
+            {
+                q.push_back( [payload]()
+                             {
+                    t_sink += payload.bytes[0];
+                } );
+            }
+        } );
+    }
+
+    for ( auto &producer : producer_threads )
+    {
+        producer.join();
+    }
+    q.close();
+    for ( auto &consumer : consumer_threads )
+    {
+        consumer.join();
+    }
+
+    double seconds = elapsed_seconds( start );
+    size_t pushed = ( items / producers ) * producers;
+
+    std::ostringstream config;
+    config << "shards=" << q.shards() << ";dispatch="
+           << ( dispatch == ShardedMessageQueue::Dispatch::thread_affinity
+                    ? "thread_affinity"
+                    : "two_choices" )
+           << ";producers=" << producers << ";consumers=" << consumers;
+    reporter.report( "sharded_queue_throughput",
+                     config.str(),
+                     "items_per_second",
+                     pushed / seconds );
+}
+
+///
+/// \brief overflow_name
+///
+static char const *overflow_name( MessageQueue::Overflow overflow )
+{
+    switch ( overflow )
+    {
+    case MessageQueue::Overflow::block:
+        return "block";
+    case MessageQueue::Overflow::reject:
+        return "reject";
+    case MessageQueue::Overflow::drop_oldest:
+        return "drop_oldest";
+    case MessageQueue::Overflow::drop_newest:
+        return "drop_newest";
+    }
+    return "";
+}
+
+///
+/// \brief run_overload
+///
+/// Push items from producers faster than one slow consumer can call them,
+/// into a queue bounded to capacity items, and report the rate items were
+/// called at, the deepest the queue got and the share of items which were
+/// dropped or rejected. A capacity of 0 leaves the queue unbounded
+///
+static void run_overload( Reporter const &reporter,
+                          size_t capacity,
+                          MessageQueue::Overflow overflow,
+                          int producers,
+                          size_t items )
+{
+    MessageQueue q;
+    q.enable_stats();
+    if ( capacity )
+    {
+        q.set_capacity( capacity, overflow );
+    }
+
+    std::atomic<size_t> executed( 0 );
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    thread consumer( [&q]()
+                     {
+        while ( q.wait_and_invoke( std::chrono::seconds( 1 ) )
+                != MessageQueue::Status::closed )
+        {
+        }
+    } );
+
+    vector<thread> producer_threads;
+    for ( int i = 0; i < producers; ++i )
+    {
+        producer_threads.emplace_back( [&q, &executed, items, producers]()
+                                       {
+            for ( size_t n = 0; n < items / producers; ++n )
+            {
+                q.push_back( [&executed]()
+                             {
+                    // A consumer several times slower than a producer
+                    for ( unsigned j = 0; j < 200; ++j )
+                    {
+                        t_sink += j;
+                    }
+                    executed.fetch_add( 1, std::memory_order_relaxed );
+                } );
+            }
+        } );
+    }
+    for ( auto &t : producer_threads )
+    {
+        t.join();
+    }
+    q.close();
+    consumer.join();
+    double seconds = elapsed_seconds( start );
+
+    QueueStatsSnapshot stats = q.stats_snapshot();
+    std::ostringstream config;
+    config << "capacity=" << capacity
+           << ";overflow=" << ( capacity ? overflow_name( overflow ) : "none" )
+           << ";producers=" << producers;
+    reporter.report( "queue_overload",
+                     config.str(),
+                     "items_per_second",
+                     executed.load() / seconds );
+    reporter.report(
+        "queue_overload", config.str(), "high_water", double( stats.high_water ) );
+    reporter.report( "queue_overload",
+                     config.str(),
+                     "lost_fraction",
+                     double( stats.dropped + stats.rejected ) / items );
+}
+
+///
+/// \brief run_all_payloads
+///
+/// run_throughput() for every payload size
+///
+static void run_all_payloads( Reporter const &reporter,
+                              MessageQueue::Backend backend,
+                              int producers,
+                              int consumers,
+                              size_t items )
+{
+    run_throughput<8>( reporter, backend, producers, consumers, items );
+    run_throughput<32>( reporter, backend, producers, consumers, items );
+    run_throughput<64>( reporter, backend, producers, consumers, items );
+    run_throughput<128>( reporter, backend, producers, consumers, items );
+}
+
+int main( int argc, char *argv[] )
+{
+    Reporter reporter( argc, argv );
+    size_t const items = reporter.quick() ? 20000 : 200000;
+    int const many = 4;
+
+    MessageQueue::Backend const backends[]
+        = {MessageQueue::Backend::locked_queue,
+           MessageQueue::Backend::lock_free_ring};
+
+    for ( auto backend : backends )
+    {
+        run_all_payloads( reporter, backend, 1, 1, items );
+        run_all_payloads( reporter, backend, many, 1, items );
+        run_all_payloads( reporter, backend, 1, many, items );
+        run_all_payloads( reporter, backend, many, many, items );
+    }
+
+    run_sharded_throughput( reporter,
+                            many,
+                            ShardedMessageQueue::Dispatch::thread_affinity,
+                            many,
+                            many,
+                            items );
+    run_sharded_throughput( reporter,
+                            many,
+                            ShardedMessageQueue::Dispatch::two_choices,
+                            many,
+                            many,
+                            items );
+
+    size_t const batch_sizes[] = {1, 16, 256};
+    for ( auto batch_size : batch_sizes )
+    {
+        run_batch_throughput( reporter, batch_size, items );
+    }
+
+    run_control_latency( reporter, 1, 10000 );
+    run_control_latency( reporter, 2, 10000 );
+
+    MessageQueue::Overflow const overflows[]
+        = {MessageQueue::Overflow::block,
+           MessageQueue::Overflow::reject,
+           MessageQueue::Overflow::drop_oldest,
+           MessageQueue::Overflow::drop_newest};
+    run_overload( reporter, 0, MessageQueue::Overflow::block, many, items );
+    for ( auto overflow : overflows )
+    {
+        run_overload( reporter, 1024, overflow, many, items );
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "LambdaStew/Signaler.hpp"
+#include "bench_util.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using namespace LambdaStew::bench;
+
+using std::vector;
+using std::thread;
+using std::chrono::steady_clock;
+using std::chrono::nanoseconds;
+
+///
+/// \brief run_ping_pong
+///
+/// Two threads take turns waking each other through a pair of Signalers.
+/// Reports the one way wakeup latency, which is half of each round trip
+///
+/// \param reporter where to print the results
+/// \param spin_count the spin count given to both Signalers
+/// \param yield_count the yield count given to both Signalers
+/// \param round_trips the number of round trips to measure
+///
+static void run_ping_pong( Reporter const &reporter,
+                           unsigned spin_count,
+                           unsigned yield_count,
+                           size_t round_trips )
+{
+    Signaler ping( spin_count, yield_count );
+    Signaler pong( spin_count, yield_count );
+
+    thread responder( [&]()
+                      {
+        Signaler::signal_count_type last_ping = 0;
+        for ( size_t i = 0; i < round_trips; ++i )
+        {
+            while ( ping.get_count() == last_ping )
+            {
+                ping.wait_for_signal_for( last_ping, std::chrono::seconds( 1 ) );
+            }
+            last_ping = ping.get_count();
+            pong.send_signal_one();
+        }
+    } );
+
+    vector<int64_t> latencies;
+    latencies.reserve( round_trips );
+
+    Signaler::signal_count_type last_pong = 0;
+    for ( size_t i = 0; i < round_trips; ++i )
+    {
+        steady_clock::time_point sent = steady_clock::now();
+        ping.send_signal_one();
+        while ( pong.get_count() == last_pong )
+        {
+            pong.wait_for_signal_for( last_pong, std::chrono::seconds( 1 ) );
+        }
+        last_pong = pong.get_count();
+        latencies.push_back(
+            std::chrono::duration_cast<nanoseconds>( steady_clock::now() - sent )
+                .count() / 2 );
+    }
+    responder.join();
+
+    std::sort( latencies.begin(), latencies.end() );
+
+    std::ostringstream config;
+    config << "spin_count=" << spin_count << ";yield_count=" << yield_count;
+    reporter.report( "signaler_wakeup",
+                     config.str(),
+                     "p50_ns",
+                     latencies[latencies.size() / 2] );
+    reporter.report( "signaler_wakeup",
+                     config.str(),
+                     "p99_ns",
+                     latencies[( latencies.size() - 1 ) * 99 / 100] );
+    reporter.report(
+        "signaler_wakeup", config.str(), "max_ns", latencies.back() );
+}
+
+///
+/// \brief run_send_without_waiters
+///
+/// The cost of send_signal_one() when nobody is waiting, which is the cost
+/// every push_back() pays on a busy queue
+///
+static void run_send_without_waiters( Reporter const &reporter, size_t count )
+{
+    Signaler signaler;
+    steady_clock::time_point start = steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        signaler.send_signal_one();
+    }
+    double seconds = elapsed_seconds( start );
+    reporter.report(
+        "signaler_send", "waiters=0", "ns_per_call", seconds * 1e9 / count );
+}
+
+int main( int argc, char *argv[] )
+{
+    Reporter reporter( argc, argv );
+    size_t const round_trips = reporter.quick() ? 2000 : 20000;
+
+    // Parked only, the default, and spinning for a long time before parking
+    run_ping_pong( reporter, 0, 0, round_trips );
+    run_ping_pong( reporter, 64, 4, round_trips );
+    run_ping_pong( reporter, 4096, 16, round_trips );
+
+    run_send_without_waiters( reporter, round_trips * 100 );
+    return 0;
+}
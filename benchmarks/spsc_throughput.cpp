@@ -0,0 +1,94 @@
+#include "LambdaStew/SPSCMessageQueue.hpp"
+#include "bench_util.hpp"
+
+using namespace LambdaStew;
+using namespace LambdaStew::bench;
+
+using std::vector;
+using std::thread;
+
+static uint64_t t_sink;
+
+///
+/// \brief run_pair
+///
+/// Push items tasks from one producer thread to one consumer thread, either
+/// one at a time or batch at a time through push_back_bulk()
+///
+template <typename QueueT>
+static void run_pair( Reporter const &reporter,
+                      char const *queue_name,
+                      QueueT &q,
+                      size_t items,
+                      size_t batch )
+{
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    thread consumer( [&q]()
+                     {
+        while ( q.wait_and_invoke( std::chrono::seconds( 1 ) )
+                != MessageQueue::Status::closed )
+        {
+        }
+    } );
+
+    if ( batch <= 1 )
+    {
+        for ( size_t n = 0; n < items; ++n )
+        {
+            q.push_back( [n]()
+                         {
+                t_sink += n;
+            } );
+        }
+    }
+    else
+    {
+        vector<Task> tasks;
+        tasks.reserve( batch );
+        for ( size_t n = 0; n < items; n += batch )
+        {
+            for ( size_t i = n; i < n + batch && i < items; ++i )
+            {
+                tasks.emplace_back( [i]()
+                                    {
+                    t_sink += i;
+                } );
+            }
+            q.push_back_bulk( tasks );
+            tasks.clear();
+        }
+    }
+    q.close();
+    consumer.join();
+    double seconds = elapsed_seconds( start );
+
+    std::ostringstream config;
+    config << "queue=" << queue_name << ";batch=" << batch;
+    reporter.report(
+        "spsc_throughput", config.str(), "items_per_second", items / seconds );
+}
+
+int main( int argc, char *argv[] )
+{
+    Reporter reporter( argc, argv );
+    size_t const items = reporter.quick() ? 1000000 : 10000000;
+
+    size_t const batches[] = {1, 64};
+    for ( auto batch : batches )
+    {
+        {
+            SPSCMessageQueue q;
+            run_pair( reporter, "spsc", q, items, batch );
+        }
+        {
+            MessageQueue q;
+            run_pair( reporter, "locked_queue", q, items, batch );
+        }
+        {
+            MessageQueue q( MessageQueue::Backend::lock_free_ring );
+            run_pair( reporter, "lock_free_ring", q, items, batch );
+        }
+    }
+    return 0;
+}
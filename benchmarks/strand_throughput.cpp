@@ -0,0 +1,147 @@
+#include "LambdaStew/Strand.hpp"
+#include "bench_util.hpp"
+
+#include <memory>
+#include <mutex>
+
+using namespace LambdaStew;
+using namespace LambdaStew::bench;
+
+using std::vector;
+using std::thread;
+
+///
+/// \brief The Object struct
+///
+/// Per-object state which tasks update, padded to its own cache lines
+///
+struct Object
+{
+    Object() : value( 0 ) {}
+
+    std::mutex mutex;
+    uint64_t value;
+    char pad[cache_line_size];
+};
+
+///
+/// \brief run_consumers
+///
+/// Start consumers threads which run q until it is closed
+///
+static vector<thread> run_consumers( MessageQueue &q, int consumers )
+{
+    vector<thread> threads;
+    for ( int i = 0; i < consumers; ++i )
+    {
+        threads.emplace_back( [&q]()
+                              {
+            while ( q.wait_and_invoke( std::chrono::seconds( 1 ) )
+                    != MessageQueue::Status::closed )
+            {
+            }
+        } );
+    }
+    return threads;
+}
+
+///
+/// \brief run_strands
+///
+/// Post items tasks, round robin over one Strand per object, to a queue
+/// with several consumers. The tasks update their object without a lock
+///
+static void run_strands( Reporter const &reporter,
+                         size_t objects,
+                         int consumers,
+                         size_t items )
+{
+    MessageQueue q;
+    vector<Object> state( objects );
+    vector<std::unique_ptr<Strand> > strands;
+    for ( size_t i = 0; i < objects; ++i )
+    {
+        strands.emplace_back( new Strand( q ) );
+    }
+
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    vector<thread> threads = run_consumers( q, consumers );
+    for ( size_t n = 0; n < items; ++n )
+    {
+        Object *object = &state[n % objects];
+        strands[n % objects]->post( [object]()
+                                    {
+            ++object->value;
+        } );
+    }
+    q.close();
+    for ( auto &consumer : threads )
+    {
+        consumer.join();
+    }
+    double seconds = elapsed_seconds( start );
+
+    std::ostringstream config;
+    config << "mode=strand;objects=" << objects << ";consumers=" << consumers;
+    reporter.report( "strand_throughput",
+                     config.str(),
+                     "items_per_second",
+                     items / seconds );
+}
+
+///
+/// \brief run_mutexes
+///
+/// The same work as run_strands(), pushed straight to the queue, with every
+/// task locking the mutex of its object
+///
+static void run_mutexes( Reporter const &reporter,
+                         size_t objects,
+                         int consumers,
+                         size_t items )
+{
+    MessageQueue q;
+    vector<Object> state( objects );
+
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    vector<thread> threads = run_consumers( q, consumers );
+    for ( size_t n = 0; n < items; ++n )
+    {
+        Object *object = &state[n % objects];
+        q.push_back( [object]()
+                     {
+            std::lock_guard<std::mutex> guard( object->mutex );
+            ++object->value;
+        } );
+    }
+    q.close();
+    for ( auto &consumer : threads )
+    {
+        consumer.join();
+    }
+    double seconds = elapsed_seconds( start );
+
+    std::ostringstream config;
+    config << "mode=mutex;objects=" << objects << ";consumers=" << consumers;
+    reporter.report( "strand_throughput",
+                     config.str(),
+                     "items_per_second",
+                     items / seconds );
+}
+
+int main( int argc, char *argv[] )
+{
+    Reporter reporter( argc, argv );
+    size_t const items = reporter.quick() ? 100000 : 1000000;
+    int const consumers = 4;
+
+    size_t const object_counts[] = {1, 16, 1024};
+    for ( auto objects : object_counts )
+    {
+        run_strands( reporter, objects, consumers, items );
+        run_mutexes( reporter, objects, consumers, items );
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+#include "LambdaStew/MessageQueue.hpp"
+#include "LambdaStew/TimerWheel.hpp"
+#include "bench_util.hpp"
+
+#include <atomic>
+#include <random>
+#include <vector>
+
+using namespace LambdaStew;
+using namespace LambdaStew::bench;
+
+using std::vector;
+using std::chrono::steady_clock;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+///
+/// \brief run_wheel
+///
+/// Fill a TimerWheel with pending timers spread over an hour of 1 ms ticks,
+/// then report the cost of insert(), cancel() and of advancing the wheel
+/// through a second of ticks
+///
+/// \param reporter where to print the results
+/// \param pending the number of timers in the wheel
+///
+static void run_wheel( Reporter const &reporter, size_t pending )
+{
+    TimerWheel<int> wheel;
+    std::mt19937 rng( 1 );
+    vector<TimerId> ids;
+    ids.reserve( pending );
+
+    steady_clock::time_point start = steady_clock::now();
+    for ( size_t i = 0; i < pending; ++i )
+    {
+        ids.push_back( wheel.insert( 1 + rng() % 3600000, 0 ) );
+    }
+    double seconds = elapsed_seconds( start );
+
+    std::ostringstream config;
+    config << "pending=" << pending;
+    reporter.report( "timer_wheel_insert",
+                     config.str(),
+                     "ns_per_call",
+                     seconds * 1e9 / pending );
+
+    // Cancel and re-insert every other timer, so the wheel stays this full
+    size_t const changes = pending / 2;
+    start = steady_clock::now();
+    for ( size_t i = 0; i < changes; ++i )
+    {
+        int value;
+        wheel.cancel( ids[i * 2], value );
+        ids[i * 2] = wheel.insert( 1 + rng() % 3600000, 0 );
+    }
+    seconds = elapsed_seconds( start );
+    reporter.report( "timer_wheel_cancel_insert",
+                     config.str(),
+                     "ns_per_call",
+                     seconds * 1e9 / changes );
+
+    size_t fired = 0;
+    start = steady_clock::now();
+    wheel.advance( 1000,
+                   [&fired]( int &, uint64_t & )
+                   {
+                       ++fired;
+                       return false;
+                   } );
+    seconds = elapsed_seconds( start );
+    reporter.report(
+        "timer_wheel_advance_1000_ticks", config.str(), "us", seconds * 1e6 );
+    reporter.report(
+        "timer_wheel_advance_1000_ticks", config.str(), "fired", fired );
+}
+
+///
+/// \brief run_push_back_after
+///
+/// Schedule count functions through MessageQueue::push_back_after() with
+/// delays spread over spread_ms, run them as they arrive and report the
+/// cost of scheduling and how late they ran
+///
+static void
+    run_push_back_after( Reporter const &reporter, size_t count, int spread_ms )
+{
+    MessageQueue queue;
+    std::atomic<size_t> done( 0 );
+    vector<int64_t> lateness( count );
+
+    steady_clock::time_point start = steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        steady_clock::time_point due
+            = start + milliseconds( 50 + i % spread_ms );
+        queue.push_back_at(
+            due,
+            [&lateness, &done, i, due]()
+            {
+                lateness[i] = std::chrono::duration_cast<microseconds>(
+                                  steady_clock::now() - due ).count();
+                ++done;
+            } );
+    }
+    double seconds = elapsed_seconds( start );
+
+    while ( done.load() < count )
+    {
+        queue.wait_and_invoke( milliseconds( 100 ) );
+    }
+
+    std::sort( lateness.begin(), lateness.end() );
+
+    std::ostringstream config;
+    config << "timers=" << count << ";spread_ms=" << spread_ms;
+    reporter.report(
+        "push_back_after", config.str(), "ns_per_call", seconds * 1e9 / count );
+    reporter.report(
+        "push_back_after", config.str(), "p50_late_us", lateness[count / 2] );
+    reporter.report( "push_back_after",
+                     config.str(),
+                     "p99_late_us",
+                     lateness[( count - 1 ) * 99 / 100] );
+}
+
+int main( int argc, char *argv[] )
+{
+    Reporter reporter( argc, argv );
+
+    run_wheel( reporter, 1000 );
+    run_wheel( reporter, 100000 );
+    if ( !reporter.quick() )
+    {
+        run_wheel( reporter, 1000000 );
+    }
+
+    run_push_back_after( reporter, reporter.quick() ? 10000 : 200000, 1000 );
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include "LambdaStew/WaitSet.hpp"
+#include "bench_util.hpp"
+
+#include <memory>
+
+using namespace LambdaStew;
+using namespace LambdaStew::bench;
+
+using std::vector;
+using std::thread;
+
+static uint64_t t_sink;
+
+///
+/// \brief produce
+///
+/// Start one producer thread per queue, each pushing items tasks to its
+/// queue and closing it
+///
+static vector<thread> produce( vector<std::unique_ptr<MessageQueue> > &queues,
+                               size_t items )
+{
+    vector<thread> threads;
+    for ( auto &queue : queues )
+    {
+        MessageQueue *q = queue.get();
+        threads.emplace_back( [q, items]()
+                              {
+            for ( size_t n = 0; n < items; ++n )
+            {
+                q->push_back( [n]()
+                              {
+                    t_sink += n;
+                } );
+            }
+            q->close();
+        } );
+    }
+    return threads;
+}
+
+///
+/// \brief run_wait_set
+///
+/// One consumer serving every queue through a WaitSet
+///
+static void run_wait_set( Reporter const &reporter,
+                          WaitSet::Order order,
+                          size_t queue_count,
+                          size_t items )
+{
+    vector<std::unique_ptr<MessageQueue> > queues;
+    WaitSet wait_set( order );
+    for ( size_t i = 0; i < queue_count; ++i )
+    {
+        queues.emplace_back( new MessageQueue );
+        wait_set.add( *queues.back() );
+    }
+
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    vector<thread> producers = produce( queues, items );
+    while ( wait_set.wait_and_invoke( std::chrono::seconds( 1 ) )
+            != WaitSet::Status::closed )
+    {
+    }
+    double seconds = elapsed_seconds( start );
+    for ( auto &producer : producers )
+    {
+        producer.join();
+    }
+
+    std::ostringstream config;
+    config << "mode=wait_set;order="
+           << ( order == WaitSet::Order::priority ? "priority" : "round_robin" )
+           << ";queues=" << queue_count;
+    reporter.report( "wait_set",
+                     config.str(),
+                     "items_per_second",
+                     queue_count * items / seconds );
+}
+
+///
+/// \brief run_polling
+///
+/// One consumer serving every queue by polling each in turn and yielding
+/// when all are empty
+///
+static void run_polling( Reporter const &reporter,
+                         size_t queue_count,
+                         size_t items )
+{
+    vector<std::unique_ptr<MessageQueue> > queues;
+    for ( size_t i = 0; i < queue_count; ++i )
+    {
+        queues.emplace_back( new MessageQueue );
+    }
+
+    std::chrono::steady_clock::time_point start
+        = std::chrono::steady_clock::now();
+    vector<thread> producers = produce( queues, items );
+    while ( true )
+    {
+        bool invoked = false;
+        bool open = false;
+        for ( auto &queue : queues )
+        {
+            invoked = queue->invoke() || invoked;
+            open = open || !queue->is_closed() || !queue->empty();
+        }
+        if ( !open )
+        {
+            break;
+        }
+        if ( !invoked )
+        {
+            std::this_thread::yield();
+        }
+    }
+    double seconds = elapsed_seconds( start );
+    for ( auto &producer : producers )
+    {
+        producer.join();
+    }
+
+    std::ostringstream config;
+    config << "mode=polling;queues=" << queue_count;
+    reporter.report( "wait_set",
+                     config.str(),
+                     "items_per_second",
+                     queue_count * items / seconds );
+}
+
+int main( int argc, char *argv[] )
+{
+    Reporter reporter( argc, argv );
+    size_t const items = reporter.quick() ? 100000 : 1000000;
+
+    size_t const queue_counts[] = {2, 8};
+    for ( auto queue_count : queue_counts )
+    {
+        run_wait_set( reporter, WaitSet::Order::priority, queue_count, items );
+        run_wait_set(
+            reporter, WaitSet::Order::round_robin, queue_count, items );
+        run_polling( reporter, queue_count, items );
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+#include "LambdaStew/MessageQueue.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace LambdaStew;
+
+using std::string;
+using std::vector;
+using std::atomic;
+using std::thread;
+using std::chrono::steady_clock;
+using std::chrono::nanoseconds;
+using std::this_thread::sleep_for;
+
+///
+/// \brief The ConsumerStyle enum
+///
+/// How the consumer threads wait for work
+///
+enum class ConsumerStyle
+{
+    /// The hand written loop of examples/example1.cpp: check empty(), then
+    /// wait_for_signal_for() with the last signal count seen
+    signaler_loop,
+    /// MessageQueue::wait_and_invoke()
+    wait_and_invoke
+};
+
+///
+/// \brief The StressParameters struct
+///
+struct StressParameters
+{
+    int consumers;
+    int producers;
+    int bursts;
+    int burst_size;
+    std::chrono::microseconds burst_gap;
+};
+
+///
+/// \brief consumer_signaler_loop
+///
+/// Consume until stop is set, waiting on the queue's Signaler directly
+///
+static void consumer_signaler_loop( MessageQueue &q, atomic<bool> &stop )
+{
+    Signaler::signal_count_type last_signal_count = 0;
+    while ( !stop )
+    {
+        if ( q.empty() )
+        {
+            last_signal_count = q.signaler().wait_for_signal_for(
+                last_signal_count, std::chrono::milliseconds( 100 ) );
+        }
+        q.invoke();
+    }
+}
+
+///
+/// \brief consumer_wait_and_invoke
+///
+/// Consume until stop is set, using MessageQueue::wait_and_invoke()
+///
+static void consumer_wait_and_invoke( MessageQueue &q, atomic<bool> &stop )
+{
+    while ( !stop )
+    {
+        if ( q.wait_and_invoke( std::chrono::milliseconds( 100 ) )
+             == MessageQueue::Status::stopped )
+        {
+            break;
+        }
+    }
+}
+
+///
+/// \brief percentile
+///
+/// \param sorted sorted latencies
+/// \param p fraction between 0 and 1
+/// \return the latency at that percentile in microseconds
+///
+static double percentile( vector<int64_t> const &sorted, double p )
+{
+    if ( sorted.empty() )
+    {
+        return 0.0;
+    }
+    size_t index = (size_t)( p * ( sorted.size() - 1 ) );
+    return sorted[index] / 1000.0;
+}
+
+///
+/// \brief run_stress
+///
+/// Producers push bursts of items which record the time from push_back() to
+/// the start of their execution. Prints one CSV line of latency percentiles
+///
+static void run_stress( ConsumerStyle style, StressParameters const &params )
+{
+    MessageQueue q;
+    atomic<bool> stop( false );
+
+    size_t const total
+        = (size_t)params.producers * params.bursts * params.burst_size;
+    vector<int64_t> latencies( total, 0 );
+    atomic<size_t> next_slot( 0 );
+
+    vector<thread> consumers;
+    for ( int i = 0; i < params.consumers; ++i )
+    {
+        consumers.emplace_back( style == ConsumerStyle::signaler_loop
+                                    ? consumer_signaler_loop
+                                    : consumer_wait_and_invoke,
+                                std::ref( q ),
+                                std::ref( stop ) );
+    }
+
+    vector<thread> producers;
+    for ( int i = 0; i < params.producers; ++i )
+    {
+        producers.emplace_back( [&]()
+                                {
+            for ( int burst = 0; burst < params.bursts; ++burst )
+            {
+                for ( int item = 0; item < params.burst_size; ++item )
+                {
+                    size_t slot = next_slot++;
+                    steady_clock::time_point pushed = steady_clock::now();
+                    int64_t *latency = &latencies[slot];
+                    q.push_back( [pushed, latency]()
+                                 {
+                        *latency = std::chrono::duration_cast<nanoseconds>(
+                                       steady_clock::now() - pushed ).count();
+                    } );
+                }
+                sleep_for( params.burst_gap );
+            }
+        } );
+    }
+
+    for ( auto &producer : producers )
+    {
+        producer.join();
+    }
+    while ( !q.empty() )
+    {
+        sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    stop = true;
+    q.stop();
+    for ( auto &consumer : consumers )
+    {
+        consumer.join();
+    }
+
+    std::sort( latencies.begin(), latencies.end() );
+
+    std::cout << ( style == ConsumerStyle::signaler_loop ? "signaler_loop"
+                                                         : "wait_and_invoke" )
+              << "," << params.consumers << "," << params.producers << ","
+              << params.burst_size << "," << total << ","
+              << percentile( latencies, 0.50 ) << ","
+              << percentile( latencies, 0.99 ) << ","
+              << percentile( latencies, 0.999 ) << ","
+              << percentile( latencies, 1.0 ) << std::endl;
+}
+
+int main( int argc, char *argv[] )
+{
+    StressParameters params;
+    params.consumers = 8;
+    params.producers = 2;
+    params.bursts = 200;
+    params.burst_size = 32;
+    params.burst_gap = std::chrono::microseconds( 500 );
+
+    for ( int i = 1; i + 1 < argc; i += 2 )
+    {
+        if ( strcmp( argv[i], "--consumers" ) == 0 )
+        {
+            params.consumers = atoi( argv[i + 1] );
+        }
+        else if ( strcmp( argv[i], "--producers" ) == 0 )
+        {
+            params.producers = atoi( argv[i + 1] );
+        }
+        else if ( strcmp( argv[i], "--bursts" ) == 0 )
+        {
+            params.bursts = atoi( argv[i + 1] );
+        }
+        else if ( strcmp( argv[i], "--burst-size" ) == 0 )
+        {
+            params.burst_size = atoi( argv[i + 1] );
+        }
+    }
+
+    std::cout << "style,consumers,producers,burst_size,items,p50_us,p99_us,"
+                 "p999_us,max_us" << std::endl;
+    run_stress( ConsumerStyle::signaler_loop, params );
+    run_stress( ConsumerStyle::wait_and_invoke, params );
+    return 0;
+}
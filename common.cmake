@@ -5,6 +5,7 @@ option(TESTS "Enable building of extended test code in library" ON)
 option(EXAMPLES "Enable building of example programs" ON)
 option(TOOLS "Enable building of tools" ON)
 option(TOOLS_DEV "Enable building of tools-dev" ON)
+option(BENCHMARKS "Enable building of benchmark programs" ON)
 
 enable_testing()
 
@@ -110,6 +111,38 @@ if(TOOLS_DEV MATCHES "ON")
     endforeach(item)
 endif()
 
+if(BENCHMARKS MATCHES "ON")
+    # 'make bench' runs every benchmark, writing one result file per program
+    # to bench/ in the build directory. Set BENCH_ARGS to --quick or --json;
+    # the files are .json with --json and .csv otherwise
+    set(BENCH_ARGS "" CACHE STRING "Arguments given to every benchmark by the bench target")
+    separate_arguments(BENCH_ARG_LIST UNIX_COMMAND "${BENCH_ARGS}")
+    list(FIND BENCH_ARG_LIST "--json" BENCH_JSON_INDEX)
+    if(BENCH_JSON_INDEX EQUAL -1)
+      set(BENCH_EXTENSION csv)
+    else()
+      set(BENCH_EXTENSION json)
+    endif()
+
+    file(GLOB PROJECT_BENCHMARKS "benchmarks/*.c" "benchmarks/*.cpp")
+    foreach(item ${PROJECT_BENCHMARKS})
+      GET_FILENAME_COMPONENT(benchname ${item} NAME_WE )
+      add_executable(${benchname} ${item})
+      target_link_libraries(${benchname} ${LIBS} )
+      set(PROJECT_BENCHMARK_TARGETS ${PROJECT_BENCHMARK_TARGETS} ${benchname})
+      set(PROJECT_BENCHMARK_COMMANDS ${PROJECT_BENCHMARK_COMMANDS}
+          COMMAND ${benchname} ${BENCH_ARG_LIST} > ${PROJECT_BINARY_DIR}/bench/${benchname}.${BENCH_EXTENSION})
+    endforeach(item)
+
+    add_custom_target(bench
+        COMMAND ${CMAKE_COMMAND} -E make_directory ${PROJECT_BINARY_DIR}/bench
+        ${PROJECT_BENCHMARK_COMMANDS}
+        DEPENDS ${PROJECT_BENCHMARK_TARGETS}
+        WORKING_DIRECTORY ${PROJECT_BINARY_DIR}
+        COMMENT "Running benchmarks, results in ${PROJECT_BINARY_DIR}/bench"
+        VERBATIM)
+endif()
+
 if(TESTS MATCHES "ON")
    file(GLOB PROJECT_TESTS "tests/*.c" "tests/*.cpp")
    foreach(item ${PROJECT_TESTS})
@@ -122,40 +122,40 @@ void
 {
     log_info( name, " thread: ", get_id() );
 
-    log_trace(
+    LAMBDASTEW_LOG_TRACE(
         name, " thread: ", get_id(), " consumed_count: ", consumed_count );
 
-    Signaler::signal_count_type last_signal_count = 0;
-
-    // Consume until the PleaseStopException is thrown by a function
+    // Consume until the queue is closed and drained, or stopped
     try
     {
         while ( true )
         {
-            // if the queue is empty, wait for up to 10 seconds
-            if ( q.empty() )
-            {
-                log_trace( name,
-                           " thread: ",
-                           get_id(),
-                           " waiting, last_signal_count: ",
-                           last_signal_count );
-                last_signal_count = q.signaler().wait_for_signal_for(
-                    last_signal_count, std::chrono::seconds( 10 ) );
-            }
-
             try
             {
-                // invoke the next function in the queue
-                if ( q.invoke() )
+                // invoke the next function in the queue, waiting for up to
+                // 10 seconds if the queue is empty
+                MessageQueue::Status status
+                    = q.wait_and_invoke( std::chrono::seconds( 10 ) );
+
+                if ( status == MessageQueue::Status::invoked )
                 {
                     // increment the consumed_count counter
                     consumed_count++;
-                    log_trace( name,
-                               " thread: ",
-                               get_id(),
-                               " consumed_count: ",
-                               consumed_count );
+                    LAMBDASTEW_LOG_TRACE( name,
+                                          " thread: ",
+                                          get_id(),
+                                          " consumed_count: ",
+                                          consumed_count );
+                }
+                else if ( status == MessageQueue::Status::timeout )
+                {
+                    LAMBDASTEW_LOG_TRACE(
+                        name, " thread: ", get_id(), " idle" );
+                }
+                else
+                {
+                    log_info( name, " thread: ", get_id(), " Asked to stop" );
+                    break;
                 }
             }
             catch ( std::runtime_error &e )
@@ -171,12 +171,6 @@ void
             }
         }
     }
-    catch ( MessageQueue::PleaseStopException )
-    {
-        // a PleaseStopException is not consumed. Log the info and re-throw it.
-        log_info( name, " thread: ", get_id(), " Asked to stop" );
-        throw;
-    }
     catch ( const std::exception &e )
     {
         // any other unknown exception is logged and re-thrown
@@ -205,12 +199,12 @@ void producer_a( string name, MessageQueue &q, atomic_uint &produced_count )
 
     for ( int i = 0; i < 100; ++i )
     {
-        log_trace(
+        LAMBDASTEW_LOG_TRACE(
             name, " thread: ", get_id(), " produced_count: ", produced_count );
 
         sleep_for( std::chrono::milliseconds( 150 ) );
 
-        log_trace( name, " thread: ", get_id(), " pushing red" );
+        LAMBDASTEW_LOG_TRACE( name, " thread: ", get_id(), " pushing red" );
         q.push_back( [name]()
                      {
                          consumer_red( name );
@@ -218,7 +212,7 @@ void producer_a( string name, MessageQueue &q, atomic_uint &produced_count )
         produced_count++;
 
         sleep_for( std::chrono::milliseconds( 180 ) );
-        log_trace( name, " thread: ", get_id(), " pushing green" );
+        LAMBDASTEW_LOG_TRACE( name, " thread: ", get_id(), " pushing green" );
         q.push_back( [name]()
                      {
                          consumer_green( name );
@@ -226,7 +220,7 @@ void producer_a( string name, MessageQueue &q, atomic_uint &produced_count )
         produced_count++;
 
         sleep_for( std::chrono::milliseconds( 290 ) );
-        log_trace( name, " thread: ", get_id(), " pushing blue" );
+        LAMBDASTEW_LOG_TRACE( name, " thread: ", get_id(), " pushing blue" );
         q.push_back( [name]()
                      {
                          consumer_blue( name );
@@ -255,7 +249,7 @@ void producer_b( string name, MessageQueue &q, atomic_uint &produced_count )
     for ( int i = 0; i < 100; ++i )
     {
         sleep_for( std::chrono::milliseconds( 75 ) );
-        log_trace( name, " thread: ", get_id(), " pushing blue" );
+        LAMBDASTEW_LOG_TRACE( name, " thread: ", get_id(), " pushing blue" );
         q.push_back( [name]()
                      {
                          consumer_blue( name );
@@ -263,7 +257,7 @@ void producer_b( string name, MessageQueue &q, atomic_uint &produced_count )
         produced_count++;
 
         sleep_for( std::chrono::milliseconds( 110 ) );
-        log_trace( name, " thread: ", get_id(), " pushing green" );
+        LAMBDASTEW_LOG_TRACE( name, " thread: ", get_id(), " pushing green" );
         q.push_back( [name]()
                      {
                          consumer_green( name );
@@ -271,7 +265,7 @@ void producer_b( string name, MessageQueue &q, atomic_uint &produced_count )
         produced_count++;
 
         sleep_for( std::chrono::milliseconds( 90 ) );
-        log_trace( name, " thread: ", get_id(), " pushing red" );
+        LAMBDASTEW_LOG_TRACE( name, " thread: ", get_id(), " pushing red" );
         q.push_back( [name]()
                      {
                          consumer_red( name );
@@ -366,8 +360,12 @@ bool test_producers_and_consumers( int num_consumers, int num_producers )
         }
     }
 
-    log_debug( "Sending please stop to MessageQueue" );
-    q.push_back_please_stop();
+    log_debug( "Draining and stopping MessageQueue" );
+    if ( !q.drain_and_stop( std::chrono::steady_clock::now()
+                            + std::chrono::seconds( 10 ) ) )
+    {
+        log_error( "MessageQueue was not drained within 10 seconds" );
+    }
 
     log_debug( "Waiting for consumers to end" );
     for ( auto &consumer : consumers )
@@ -407,12 +405,11 @@ bool test_producers_and_consumers( int num_consumers, int num_producers )
     log_info( "Green count", green_count );
     log_info( "Blue Count:", blue_count );
 
-    log_info( "Items in queue (should be 1):", q.size() );
+    log_info( "Items in queue (should be 0):", q.size() );
 
-    if ( q.size() != 1 )
+    if ( q.size() != 0 )
     {
-        log_error(
-            "FAILURE: items in queue is not 1 (the PleaseStopException)" );
+        log_error( "FAILURE: items in queue is not 0" );
         return false;
     }
 
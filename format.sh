@@ -5,4 +5,5 @@ clang-format -i tests/*.c*
 clang-format -i tools/*.c*
 clang-format -i tools-dev/*.c*
 clang-format -i examples/*.c*
+clang-format -i benchmarks/*.c*
 
@@ -0,0 +1,483 @@
+#ifndef LAMBDASTEW_BINARYLOG_HPP
+#define LAMBDASTEW_BINARYLOG_HPP
+
+#include "Log.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief Binary log file format
+///
+/// A binary log file starts with binary_log_magic, followed by the steady
+/// clock and the system clock at the time the file was opened, each as an
+/// int64_t count of nanoseconds. Then come records, each starting with a
+/// one byte kind:
+///
+/// binary_log_site: uint32_t id, uint8_t level, uint32_t line, then the
+/// file name, the format and the argument type tags, each as a uint32_t
+/// length followed by the characters. Written once per call site, before
+/// the first entry of that site.
+///
+/// binary_log_entry: uint32_t site id, uint32_t argument bytes, int64_t
+/// steady clock nanoseconds, then the arguments, encoded according to the
+/// type tags of the site.
+///
+/// All values are in the byte order of the machine which wrote the file.
+///
+static char const binary_log_magic[8] = {'L', 'S', 'B', 'L', 'O', 'G', '0', '1'};
+static const uint8_t binary_log_site = 1;
+static const uint8_t binary_log_entry = 2;
+
+///
+/// \brief Binary log argument type tags
+///
+/// Integers, bool and pointers are written as 8 bytes, doubles as 8 bytes,
+/// char as 1 byte, and strings as a uint32_t length and the characters.
+/// Arguments of any other type are formatted with operator<< on the calling
+/// thread and written as strings
+///
+static const char binary_log_tag_signed = 'i';
+static const char binary_log_tag_unsigned = 'u';
+static const char binary_log_tag_bool = 'b';
+static const char binary_log_tag_char = 'c';
+static const char binary_log_tag_double = 'd';
+static const char binary_log_tag_pointer = 'p';
+static const char binary_log_tag_string = 's';
+
+///
+/// \brief The BinaryLogSite struct
+///
+/// The static description of one LAMBDASTEW_LOG_BINARY call site. It gets
+/// its id when it is first used
+///
+struct BinaryLogSite
+{
+    constexpr BinaryLogSite( LogLevel level_, char const *file_, int line_ )
+        : level( level_ ), file( file_ ), line( line_ ), id( 0 )
+    {
+    }
+
+    LogLevel const level;
+    char const *const file;
+    int const line;
+
+    /// 0 until registered
+    std::atomic<uint32_t> id;
+};
+
+///
+/// \brief The BinaryLogSiteInfo struct
+///
+/// What the registry knows about a call site
+///
+struct BinaryLogSiteInfo
+{
+    LogLevel level;
+    std::string file;
+    int line;
+    std::string format;
+    std::string arg_types;
+};
+
+///
+/// \brief log_binary
+///
+/// get or change the binary logging mode
+///
+/// In binary mode LAMBDASTEW_LOG_BINARY lines are not formatted at all: the
+/// calling thread copies the raw arguments and a timestamp into its log
+/// buffer, and the log writer thread appends them to a binary file, which
+/// tools/log_decode turns back into text. When binary mode is off those
+/// lines are formatted and logged as text.
+///
+/// \param set set to true to change the mode via new_value
+/// \param new_value binary logging enable flag
+/// \param path the file to write, replaced if it exists
+/// \return current binary logging enable flag, false if the file could not
+/// be opened
+///
+bool log_binary( bool set = false,
+                 bool new_value = false,
+                 std::string const &path = std::string() );
+
+///
+/// \brief binary_log_register
+///
+/// Give a call site its id, the first time it logs
+///
+/// \return the id of the site
+///
+uint32_t binary_log_register( BinaryLogSite &site,
+                              char const *format,
+                              char const *arg_types );
+
+///
+/// \brief binary_log_sites
+///
+/// Copy the registered sites with an id of first_id or more
+///
+/// \param first_id the first id wanted
+/// \param sites the sites are appended here, in id order
+///
+void binary_log_sites( uint32_t first_id,
+                       std::vector<BinaryLogSiteInfo> &sites );
+
+///
+/// \brief binary_log_reserve
+///
+/// Reserve a binary record in the calling thread's log buffer
+///
+/// \return where to write the record, or nullptr if it was dropped by the
+/// overflow policy or binary logging is off
+///
+char *binary_log_reserve( LogLevel level, size_t size );
+
+///
+/// \brief binary_log_commit
+///
+/// Publish the record returned by binary_log_reserve()
+///
+void binary_log_commit();
+
+///
+/// \brief binary_log_max_size
+///
+/// \return the largest binary record the calling thread can log
+///
+size_t binary_log_max_size();
+
+///
+/// \brief print_format
+///
+/// Print format up to its next "{}" placeholder and skip the placeholder
+///
+/// \return true if a placeholder was found
+///
+bool print_format( ostream &dest, char const *&format );
+
+///
+/// \brief print_formatted
+///
+/// Print format, with "{}" placeholders replaced by the arguments in order.
+/// Arguments without a placeholder are appended
+///
+inline ostream &print_formatted( ostream &dest, char const *format )
+{
+    while ( print_format( dest, format ) )
+    {
+        dest << "{}";
+    }
+    return dest;
+}
+
+template <typename FirstT, typename... RestT>
+ostream &print_formatted( ostream &dest,
+                          char const *format,
+                          FirstT const &first,
+                          RestT const &... rest )
+{
+    print_format( dest, format );
+    dest << first;
+    return print_formatted( dest, format, rest... );
+}
+
+///
+/// \brief The BinaryLogScalar struct
+///
+/// A fixed size binary log argument
+///
+template <typename T, char Tag>
+struct BinaryLogScalar
+{
+    static const char tag = Tag;
+
+    size_t size() const { return sizeof( T ); }
+
+    char *write( char *p ) const
+    {
+        memcpy( p, &value, sizeof( T ) );
+        return p + sizeof( T );
+    }
+
+    T value;
+};
+
+///
+/// \brief The BinaryLogString struct
+///
+/// A string binary log argument, which refers to the caller's characters
+///
+struct BinaryLogString
+{
+    static const char tag = binary_log_tag_string;
+
+    size_t size() const { return sizeof( uint32_t ) + length; }
+
+    char *write( char *p ) const
+    {
+        memcpy( p, &length, sizeof( length ) );
+        memcpy( p + sizeof( length ), data, length );
+        return p + size();
+    }
+
+    char const *data;
+    uint32_t length;
+};
+
+///
+/// \brief The BinaryLogFormatted struct
+///
+/// An argument of a type without a binary encoding, formatted as text
+///
+struct BinaryLogFormatted
+{
+    static const char tag = binary_log_tag_string;
+
+    size_t size() const { return sizeof( uint32_t ) + text.size(); }
+
+    char *write( char *p ) const
+    {
+        uint32_t length = (uint32_t)text.size();
+        memcpy( p, &length, sizeof( length ) );
+        memcpy( p + sizeof( length ), text.data(), length );
+        return p + size();
+    }
+
+    std::string text;
+};
+
+///
+/// \brief is_binary_log_char
+///
+/// True for the character types, which are logged as characters rather
+/// than numbers, as operator<< does
+///
+template <typename T>
+struct is_binary_log_char
+    : std::integral_constant<bool,
+                             std::is_same<T, char>::value
+                                 || std::is_same<T, signed char>::value
+                                 || std::is_same<T, unsigned char>::value>
+{
+};
+
+///
+/// \brief binary_log_arg
+///
+/// Convert a log argument to its binary encoding
+///
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value
+                            && !is_binary_log_char<T>::value,
+                        BinaryLogScalar<int64_t, binary_log_tag_signed> >::type
+    binary_log_arg( T v )
+{
+    BinaryLogScalar<int64_t, binary_log_tag_signed> r = {v};
+    return r;
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value
+                            && std::is_unsigned<T>::value
+                            && !std::is_same<T, bool>::value
+                            && !is_binary_log_char<T>::value,
+                        BinaryLogScalar<uint64_t, binary_log_tag_unsigned> >::type
+    binary_log_arg( T v )
+{
+    BinaryLogScalar<uint64_t, binary_log_tag_unsigned> r = {v};
+    return r;
+}
+
+template <typename T>
+typename std::enable_if<is_binary_log_char<T>::value,
+                        BinaryLogScalar<char, binary_log_tag_char> >::type
+    binary_log_arg( T v )
+{
+    BinaryLogScalar<char, binary_log_tag_char> r = {char( v )};
+    return r;
+}
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value,
+                        BinaryLogScalar<double, binary_log_tag_double> >::type
+    binary_log_arg( T v )
+{
+    // long double is stored, and decoded, with the precision of a double
+    BinaryLogScalar<double, binary_log_tag_double> r
+        = {static_cast<double>( v )};
+    return r;
+}
+
+inline BinaryLogScalar<uint8_t, binary_log_tag_bool> binary_log_arg( bool v )
+{
+    BinaryLogScalar<uint8_t, binary_log_tag_bool> r = {uint8_t( v )};
+    return r;
+}
+
+inline BinaryLogString binary_log_arg( char const *v )
+{
+    BinaryLogString r = {v, v ? (uint32_t)strlen( v ) : 0};
+    return r;
+}
+
+inline BinaryLogString binary_log_arg( char *v )
+{
+    return binary_log_arg( (char const *)v );
+}
+
+inline BinaryLogString binary_log_arg( std::string const &v )
+{
+    BinaryLogString r = {v.data(), (uint32_t)v.size()};
+    return r;
+}
+
+template <typename T>
+BinaryLogScalar<uint64_t, binary_log_tag_pointer> binary_log_arg( T *v )
+{
+    BinaryLogScalar<uint64_t, binary_log_tag_pointer> r
+        = {(uint64_t)(uintptr_t)v};
+    return r;
+}
+
+template <typename T>
+typename std::enable_if<!std::is_arithmetic<T>::value
+                            && !std::is_pointer<T>::value
+                            && !std::is_array<T>::value
+                            && !std::is_convertible<T, std::string>::value,
+                        BinaryLogFormatted>::type
+    binary_log_arg( T const &v )
+{
+    BinaryLogFormatted r = {print_to_string( v )};
+    return r;
+}
+
+///
+/// \brief binary_log_size
+///
+/// \return the total encoded size of the arguments
+///
+inline size_t binary_log_size() { return 0; }
+
+template <typename FirstT, typename... RestT>
+size_t binary_log_size( FirstT const &first, RestT const &... rest )
+{
+    return first.size() + binary_log_size( rest... );
+}
+
+///
+/// \brief binary_log_write
+///
+/// Encode the arguments at p
+///
+inline void binary_log_write( char * ) {}
+
+template <typename FirstT, typename... RestT>
+void binary_log_write( char *p, FirstT const &first, RestT const &... rest )
+{
+    binary_log_write( first.write( p ), rest... );
+}
+
+///
+/// \brief binary_log_record
+///
+/// Write one binary record of already converted arguments
+///
+/// \return false if the record does not fit in the calling thread's log
+/// buffer, and has to be logged as text
+///
+template <typename... EncodedT>
+bool binary_log_record( BinaryLogSite &site,
+                        char const *format,
+                        EncodedT const &... encoded )
+{
+    uint32_t const args_size = (uint32_t)binary_log_size( encoded... );
+    size_t const size = 2 * sizeof( uint32_t ) + sizeof( int64_t ) + args_size;
+    if ( size > binary_log_max_size() )
+    {
+        return false;
+    }
+
+    uint32_t id = site.id.load( std::memory_order_acquire );
+    if ( id == 0 )
+    {
+        static char const arg_types[] = {EncodedT::tag..., 0};
+        id = binary_log_register( site, format, arg_types );
+    }
+
+    int64_t const timestamp
+        = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now().time_since_epoch() ).count();
+
+    char *p = binary_log_reserve( site.level, size );
+    if ( p )
+    {
+        memcpy( p, &id, sizeof( id ) );
+        memcpy( p + sizeof( id ), &args_size, sizeof( args_size ) );
+        memcpy( p + 2 * sizeof( id ), &timestamp, sizeof( timestamp ) );
+        binary_log_write( p + 2 * sizeof( id ) + sizeof( timestamp ),
+                          encoded... );
+        binary_log_commit();
+    }
+    return true;
+}
+
+///
+/// \brief log_binary_message
+///
+/// Log one line of a call site, in binary form if binary logging is on and
+/// the line fits in a record, otherwise as text
+///
+template <typename... ArgsT>
+void log_binary_message( BinaryLogSite &site,
+                         char const *format,
+                         ArgsT const &... args )
+{
+    if ( log_binary()
+         && binary_log_record( site, format, binary_log_arg( args )... ) )
+    {
+        return;
+    }
+
+    FormatBuffer buffer;
+    FormatStreambuf streambuf( &buffer );
+    std::ostream o( &streambuf );
+    print_formatted( o, format, args... );
+    log_write( site.level, buffer.data(), buffer.size() );
+}
+}
+
+///
+/// \brief LAMBDASTEW_LOG_BINARY
+///
+/// Log a line of the given LogLevel from a format string with "{}"
+/// placeholders and its arguments, for example
+///
+///     LAMBDASTEW_LOG_BINARY( LogLevel::info, "pushed {} items", count );
+///
+/// With log_binary() on, the call costs a timestamp and a copy of the
+/// arguments. Like LAMBDASTEW_LOG, nothing is evaluated when the level is
+/// disabled or compiled out
+///
+#define LAMBDASTEW_LOG_BINARY( level, ... )                                   \
+    do                                                                         \
+    {                                                                          \
+        if ( ::LambdaStew::log_level_compiled( level )                         \
+             && ::LambdaStew::log_enabled( level ) )                           \
+        {                                                                      \
+            static ::LambdaStew::BinaryLogSite lambdastew_log_site(            \
+                level, __FILE__, __LINE__ );                                   \
+            ::LambdaStew::log_binary_message( lambdastew_log_site,             \
+                                              __VA_ARGS__ );                   \
+        }                                                                      \
+    } while ( 0 )
+
+#endif // LAMBDASTEW_BINARYLOG_HPP
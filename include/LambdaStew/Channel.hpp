@@ -0,0 +1,533 @@
+#ifndef LAMBDASTEW_CHANNEL_HPP
+#define LAMBDASTEW_CHANNEL_HPP
+
+#include "Signaler.hpp"
+#include "StopToken.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The Channel class
+///
+/// A queue of values of one type T from any number of producers to any
+/// number of consumers.
+///
+/// Where a MessageQueue wraps every item in a type erased Task, a Channel
+/// stores the values themselves, contiguously, in a ring which grows as
+/// needed. Consumers take them out in batches with receive(), so a
+/// consumer loop runs over a plain array of T with no allocation and no
+/// indirect call per message.
+///
+/// Blocking uses a Signaler in the same way as MessageQueue: senders only
+/// signal when a consumer has announced that it is waiting.
+///
+template <typename T>
+class Channel
+{
+  public:
+    ///
+    /// \brief The Status enum
+    ///
+    /// The result of waiting on a Channel
+    ///
+    enum class Status
+    {
+        /// At least one value was received
+        received,
+        /// No value arrived before the timeout
+        timeout,
+        /// The channel was closed and every value has been received
+        closed,
+        /// The channel was stopped, or the consumer's StopToken was
+        /// triggered
+        stopped
+    };
+
+    ///
+    /// \brief default_capacity
+    ///
+    /// The number of slots allocated when no capacity is given
+    ///
+    static const size_t default_capacity = 64;
+
+    ///
+    /// \brief Channel
+    ///
+    /// \param capacity the number of slots to allocate up front, rounded up
+    /// to a power of two. The ring doubles when a send finds it full
+    ///
+    explicit Channel( size_t capacity = default_capacity )
+        : m_mask( round_up_to_power_of_two( capacity ) - 1 )
+        , m_slots( new Slot[m_mask + 1] )
+        , m_head( 0 )
+        , m_size( 0 )
+        , m_idle_consumers( 0 )
+        , m_state( state_open )
+    {
+    }
+
+    Channel( Channel const & ) = delete;
+    Channel &operator=( Channel const & ) = delete;
+
+    ~Channel()
+    {
+        size_t const count = m_size.load( std::memory_order_relaxed );
+        for ( size_t i = 0; i < count; ++i )
+        {
+            m_slots[( m_head + i ) & m_mask].item()->~T();
+        }
+    }
+
+    ///
+    /// \brief send
+    ///
+    /// Add a copy of value to the back of the channel
+    ///
+    /// \return false if the channel is closed
+    ///
+    bool send( T const &value ) { return emplace( value ); }
+
+    ///
+    /// \brief send
+    ///
+    /// Move value to the back of the channel
+    ///
+    /// \return false if the channel is closed, in which case value is left
+    /// untouched
+    ///
+    bool send( T &&value ) { return emplace( std::move( value ) ); }
+
+    ///
+    /// \brief emplace
+    ///
+    /// Construct a value in place at the back of the channel
+    ///
+    /// \return false if the channel is closed
+    ///
+    template <typename... Args>
+    bool emplace( Args &&... args )
+    {
+        {
+            std::lock_guard<std::mutex> guard( m_mutex );
+            if ( m_state.load( std::memory_order_relaxed ) != state_open )
+            {
+                return false;
+            }
+            size_t const count = m_size.load( std::memory_order_relaxed );
+            reserve_locked( count + 1 );
+            new ( m_slots[( m_head + count ) & m_mask].item() )
+                T( std::forward<Args>( args )... );
+            m_size.store( count + 1 );
+        }
+        values_added( 1 );
+        return true;
+    }
+
+    ///
+    /// \brief send_bulk
+    ///
+    /// Move the values in [first, last) to the back of the channel under
+    /// one lock, waking at most one consumer per value
+    ///
+    /// \return false if the channel is closed, in which case no value is
+    /// moved
+    ///
+    template <typename IteratorT>
+    bool send_bulk( IteratorT first, IteratorT last )
+    {
+        size_t const n = (size_t)std::distance( first, last );
+        if ( n == 0 )
+        {
+            return !is_closed();
+        }
+        {
+            std::lock_guard<std::mutex> guard( m_mutex );
+            if ( m_state.load( std::memory_order_relaxed ) != state_open )
+            {
+                return false;
+            }
+            size_t const count = m_size.load( std::memory_order_relaxed );
+            reserve_locked( count + n );
+            size_t tail = m_head + count;
+            for ( ; first != last; ++first, ++tail )
+            {
+                new ( m_slots[tail & m_mask].item() ) T( std::move( *first ) );
+            }
+            m_size.store( count + n );
+        }
+        values_added( n );
+        return true;
+    }
+
+    ///
+    /// \brief receive
+    ///
+    /// Move up to max_n values from the front of the channel into out,
+    /// without waiting
+    ///
+    /// \return the number of values received
+    ///
+    size_t receive( T *out, size_t max_n )
+    {
+        return take( max_n,
+                     [out]( T *first, size_t count ) mutable
+                     {
+            for ( size_t i = 0; i < count; ++i )
+            {
+                out[i] = std::move( first[i] );
+            }
+            out += count;
+        } );
+    }
+
+    ///
+    /// \brief receive
+    ///
+    /// Move up to max_n values from the front of the channel onto the back
+    /// of out, without waiting
+    ///
+    /// \return the number of values received
+    ///
+    size_t receive( std::vector<T> &out, size_t max_n )
+    {
+        out.reserve( out.size() + std::min( max_n, size() ) );
+        return take( max_n,
+                     [&out]( T *first, size_t count )
+                     {
+            out.insert( out.end(),
+                        std::make_move_iterator( first ),
+                        std::make_move_iterator( first + count ) );
+        } );
+    }
+
+    ///
+    /// \brief wait_and_receive
+    ///
+    /// Move up to max_n values onto the back of out, waiting up to timeout
+    /// for one to be sent if the channel is empty
+    ///
+    /// \return Status::received if at least one value was received
+    ///
+    template <typename TimeT>
+    Status wait_and_receive( std::vector<T> &out, size_t max_n, TimeT timeout )
+    {
+        return wait_and_receive_ns(
+            out,
+            max_n,
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ),
+            nullptr );
+    }
+
+    template <typename TimeT>
+    Status wait_and_receive( std::vector<T> &out,
+                             size_t max_n,
+                             TimeT timeout,
+                             StopToken const &stop_token )
+    {
+        return wait_and_receive_ns(
+            out,
+            max_n,
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ),
+            &stop_token );
+    }
+
+    ///
+    /// \brief close
+    ///
+    /// Reject all new values. Consumers keep receiving the values which are
+    /// already in the channel, and wait_and_receive() returns Status::closed
+    /// once it is empty
+    ///
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> guard( m_mutex );
+            int expected = state_open;
+            m_state.compare_exchange_strong( expected, state_closed );
+        }
+        m_signaler.send_signal_all();
+    }
+
+    ///
+    /// \brief stop
+    ///
+    /// Reject all new values and release every waiting consumer at once
+    /// with Status::stopped
+    ///
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> guard( m_mutex );
+            m_state.store( state_stopped );
+        }
+        m_signaler.send_signal_all();
+    }
+
+    ///
+    /// \brief request_stop
+    ///
+    /// Trigger stop_source and wake the waiting consumers so that those
+    /// holding one of its tokens return Status::stopped
+    ///
+    void request_stop( StopSource &stop_source )
+    {
+        stop_source.request_stop();
+        m_signaler.send_signal_all();
+    }
+
+    bool is_closed() const { return m_state.load() != state_open; }
+
+    bool is_stopped() const { return m_state.load() == state_stopped; }
+
+    ///
+    /// \brief empty
+    ///
+    /// \return true if the channel appeared empty at the time of the call
+    ///
+    bool empty() const { return m_size.load() == 0; }
+
+    ///
+    /// \brief size
+    ///
+    /// \return the number of values in the channel. This is a snapshot only
+    ///
+    size_t size() const { return m_size.load(); }
+
+  private:
+    static const int state_open = 0;
+    static const int state_closed = 1;
+    static const int state_stopped = 2;
+
+    struct Slot
+    {
+        typename std::aligned_storage<sizeof( T ), alignof( T )>::type storage;
+
+        T *item() { return reinterpret_cast<T *>( &storage ); }
+    };
+
+    static size_t round_up_to_power_of_two( size_t v )
+    {
+        size_t r = 2;
+        while ( r < v )
+        {
+            r <<= 1;
+        }
+        return r;
+    }
+
+    ///
+    /// \brief reserve_locked
+    ///
+    /// Grow the ring so that it holds at least count values, keeping them
+    /// in order. m_mutex must be held
+    ///
+    void reserve_locked( size_t count )
+    {
+        if ( count <= m_mask + 1 )
+        {
+            return;
+        }
+        size_t const mask = round_up_to_power_of_two( count ) - 1;
+        std::unique_ptr<Slot[]> slots( new Slot[mask + 1] );
+        size_t const size = m_size.load( std::memory_order_relaxed );
+        for ( size_t i = 0; i < size; ++i )
+        {
+            T *from = m_slots[( m_head + i ) & m_mask].item();
+            new ( slots[i].item() ) T( std::move( *from ) );
+            from->~T();
+        }
+        m_slots.swap( slots );
+        m_mask = mask;
+        m_head = 0;
+    }
+
+    ///
+    /// \brief take
+    ///
+    /// Remove up to max_n values from the front of the ring, handing each
+    /// contiguous run of them to consume( T *first, size_t count ) to move
+    /// out. The moved from values are destroyed afterwards
+    ///
+    /// \return the number of values removed
+    ///
+    template <typename ConsumeT>
+    size_t take( size_t max_n, ConsumeT consume )
+    {
+        std::lock_guard<std::mutex> guard( m_mutex );
+        size_t const count
+            = std::min( max_n, m_size.load( std::memory_order_relaxed ) );
+        size_t r = 0;
+        while ( r < count )
+        {
+            // The values wrap at most once, so this runs at most twice
+            size_t const head = m_head & m_mask;
+            size_t const run = std::min( count - r, m_mask + 1 - head );
+            T *first = m_slots[head].item();
+            consume( first, run );
+            for ( size_t i = 0; i < run; ++i )
+            {
+                first[i].~T();
+            }
+            m_head += run;
+            r += run;
+        }
+        if ( r )
+        {
+            m_size.store( m_size.load( std::memory_order_relaxed ) - r );
+        }
+        return r;
+    }
+
+    ///
+    /// \brief values_added
+    ///
+    /// Wake up to count waiting consumers
+    ///
+    void values_added( size_t count )
+    {
+        // m_size was stored before this load, and a consumer increments
+        // m_idle_consumers before it loads m_size, so either it sees the
+        // values or this sees it
+        if ( m_idle_consumers.load() == 0 )
+        {
+            return;
+        }
+        if ( count == 1 )
+        {
+            m_signaler.send_signal_one();
+        }
+        else
+        {
+            m_signaler.send_signal_n(
+                (uint32_t)std::min<size_t>( count, UINT32_MAX ) );
+        }
+    }
+
+    ///
+    /// \brief wait_and_receive_ns
+    ///
+    /// The implementation of wait_and_receive()
+    ///
+    Status wait_and_receive_ns( std::vector<T> &out,
+                                size_t max_n,
+                                std::chrono::nanoseconds timeout,
+                                StopToken const *stop_token )
+    {
+        typedef std::chrono::steady_clock clock;
+        clock::time_point const start = clock::now();
+        clock::time_point const deadline
+            = timeout >= clock::time_point::max() - start
+                  ? clock::time_point::max()
+                  : start + timeout;
+
+        while ( true )
+        {
+            if ( m_state.load() == state_stopped
+                 || ( stop_token && stop_token->stop_requested() ) )
+            {
+                return Status::stopped;
+            }
+
+            if ( receive( out, max_n ) )
+            {
+                return Status::received;
+            }
+
+            // Read the signal count before the final emptiness check. A
+            // send, close() or stop() after this point changes the count,
+            // so the wait below returns immediately instead of missing it
+            Signaler::signal_count_type last_signal_count
+                = m_signaler.get_count();
+            m_idle_consumers.fetch_add( 1 );
+
+            if ( !empty() )
+            {
+                m_idle_consumers.fetch_sub( 1 );
+                continue;
+            }
+
+            int state = m_state.load();
+            if ( state != state_open
+                 || ( stop_token && stop_token->stop_requested() ) )
+            {
+                m_idle_consumers.fetch_sub( 1 );
+                if ( state == state_closed && !empty() )
+                {
+                    // A send landed just before the channel was closed
+                    continue;
+                }
+                return state == state_closed ? Status::closed
+                                             : Status::stopped;
+            }
+
+            clock::time_point now = clock::now();
+            if ( now >= deadline )
+            {
+                m_idle_consumers.fetch_sub( 1 );
+                return Status::timeout;
+            }
+
+            m_signaler.wait_for_signal_for( last_signal_count, deadline - now );
+            m_idle_consumers.fetch_sub( 1 );
+        }
+    }
+
+    ///
+    /// \brief m_mutex
+    ///
+    /// Guards the ring: m_slots, m_mask, m_head and writes to m_size
+    ///
+    std::mutex m_mutex;
+
+    size_t m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+
+    ///
+    /// \brief m_head
+    ///
+    /// The unmasked index of the oldest value
+    ///
+    size_t m_head;
+
+    ///
+    /// \brief m_size
+    ///
+    /// The number of values in the ring. Atomic so that empty() and size()
+    /// can read it without the lock
+    ///
+    std::atomic<size_t> m_size;
+
+    ///
+    /// \brief m_idle_consumers
+    ///
+    /// The number of consumers waiting, or about to wait, on m_signaler
+    ///
+    std::atomic<size_t> m_idle_consumers;
+
+    ///
+    /// \brief m_state
+    ///
+    /// One of state_open, state_closed or state_stopped
+    ///
+    std::atomic<int> m_state;
+
+    Signaler m_signaler;
+};
+
+template <typename T>
+const size_t Channel<T>::default_capacity;
+}
+
+#endif // LAMBDASTEW_CHANNEL_HPP
@@ -0,0 +1,347 @@
+#ifndef LAMBDASTEW_EVENTLOOP_HPP
+#define LAMBDASTEW_EVENTLOOP_HPP
+
+#include "MessageQueue.hpp"
+#include "TimerWheel.hpp"
+
+#include <sys/epoll.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The EventLoop class
+///
+/// A reactor which runs, on one thread, the functions posted to its
+/// MessageQueue, the handlers of file descriptors which became ready and
+/// the functions of its timers.
+///
+/// The thread blocks in epoll_wait() alone. The queue wakes it through an
+/// eventfd, which is only written when the thread is about to block or
+/// blocked and no wakeup is pending, and timers are kept in a TimerWheel
+/// behind a timerfd. A function posted from another thread, a ready
+/// socket and an expired timer are all handled without any other thread
+/// or hop between queues.
+///
+/// post(), the timer functions, the fd functions and stop() may be called
+/// from any thread; run() and run_once() from one thread at a time.
+///
+class EventLoop
+{
+  public:
+    typedef std::chrono::steady_clock clock;
+
+    ///
+    /// \brief FdHandler
+    ///
+    /// Called on the loop thread with the epoll events of a ready file
+    /// descriptor
+    ///
+    typedef std::function<void( uint32_t events )> FdHandler;
+
+    ///
+    /// \brief max_events
+    ///
+    /// The most file descriptor events handled per pass
+    ///
+    static const int max_events = 64;
+
+    ///
+    /// \brief max_batch
+    ///
+    /// The most queued functions called per pass, so that a busy queue can
+    /// not starve the file descriptors and timers
+    ///
+    static const size_t max_batch = 256;
+
+    ///
+    /// \brief EventLoop
+    ///
+    /// \param backend the storage backend of the queue
+    /// \param ring_capacity the ring size of the queue, see MessageQueue
+    /// \param lanes the number of priority lanes of the queue
+    /// \throws std::system_error if the epoll, eventfd or timerfd can not
+    /// be created
+    ///
+    explicit EventLoop(
+        MessageQueue::Backend backend = MessageQueue::Backend::locked_queue,
+        size_t ring_capacity = MessageQueue::default_ring_capacity,
+        unsigned lanes = 1 );
+
+    EventLoop( EventLoop const & ) = delete;
+    EventLoop &operator=( EventLoop const & ) = delete;
+
+    ~EventLoop();
+
+    ///
+    /// \brief queue
+    ///
+    /// \return the queue whose functions the loop calls, for example to
+    /// give to a Strand or to submit()
+    ///
+    MessageQueue &queue() { return m_queue; }
+
+    ///
+    /// \brief post
+    ///
+    /// Call a function on the loop thread
+    ///
+    /// \return false if the queue is closed
+    ///
+    template <typename F>
+    bool post( F &&func )
+    {
+        return m_queue.push_back( std::forward<F>( func ) );
+    }
+
+    ///
+    /// \brief add_fd
+    ///
+    /// Watch a file descriptor and call handler on the loop thread when it
+    /// is ready
+    ///
+    /// \param fd the file descriptor, which stays owned by the caller
+    /// \param events the epoll events to watch for, such as EPOLLIN
+    /// \param handler called with the events which are ready
+    /// \return false with errno set if epoll_ctl() failed
+    ///
+    bool add_fd( int fd, uint32_t events, FdHandler handler );
+
+    ///
+    /// \brief modify_fd
+    ///
+    /// Change the events watched for on a file descriptor
+    ///
+    /// \return false with errno set if epoll_ctl() failed
+    ///
+    bool modify_fd( int fd, uint32_t events );
+
+    ///
+    /// \brief remove_fd
+    ///
+    /// Stop watching a file descriptor. Its handler is not called after
+    /// this returns on the loop thread; from another thread, a call already
+    /// under way may still finish
+    ///
+    /// \return false if the file descriptor was not watched
+    ///
+    bool remove_fd( int fd );
+
+    ///
+    /// \brief run_at
+    ///
+    /// Call task on the loop thread at time when
+    ///
+    /// \return the id of the timer
+    ///
+    TimerId run_at( clock::time_point when, Task &&task );
+
+    ///
+    /// \brief run_after
+    ///
+    /// Call task on the loop thread after delay
+    ///
+    /// \return the id of the timer
+    ///
+    template <typename DurationT>
+    TimerId run_after( DurationT delay, Task &&task )
+    {
+        return run_at( clock::now()
+                           + std::chrono::duration_cast<clock::duration>( delay ),
+                       std::move( task ) );
+    }
+
+    ///
+    /// \brief run_every
+    ///
+    /// Call func on the loop thread at time first and then every period,
+    /// until the timer is cancelled
+    ///
+    /// \return the id of the timer
+    ///
+    TimerId run_every( clock::time_point first,
+                       std::chrono::nanoseconds period,
+                       std::function<void()> const &func );
+
+    ///
+    /// \brief cancel
+    ///
+    /// Cancel a pending timer
+    ///
+    /// \return false if the timer already fired or was cancelled
+    ///
+    bool cancel( TimerId id );
+
+    ///
+    /// \brief run
+    ///
+    /// Handle functions, file descriptors and timers on the calling thread
+    /// until stop() is called
+    ///
+    void run();
+
+    ///
+    /// \brief run_once
+    ///
+    /// Make one pass: wait up to timeout for something to do if there is
+    /// nothing already, then handle what is ready
+    ///
+    /// \return the number of functions, handlers and timers called
+    ///
+    template <typename TimeT>
+    size_t run_once( TimeT timeout )
+    {
+        return run_once_ns(
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ) );
+    }
+
+    ///
+    /// \brief stop
+    ///
+    /// Make run() return after its current pass. The queue stays open, and
+    /// run() may be called again
+    ///
+    void stop();
+
+    ///
+    /// \brief in_loop_thread
+    ///
+    /// \return true if called from the thread running the loop
+    ///
+    bool in_loop_thread() const
+    {
+        return m_thread_id.load( std::memory_order_relaxed )
+               == std::this_thread::get_id();
+    }
+
+  private:
+    friend class MessageQueue;
+
+    ///
+    /// \brief The Timer struct
+    ///
+    /// The work of one timer
+    ///
+    struct Timer
+    {
+        Timer() : period_ticks( 0 ) {}
+
+        /// The task of a one shot timer
+        Task task;
+
+        /// The function a periodic timer calls a copy of
+        std::function<void()> repeat;
+
+        /// The period, or 0 for a one shot timer
+        uint64_t period_ticks;
+    };
+
+    ///
+    /// \brief The Registration struct
+    ///
+    /// A watched file descriptor
+    ///
+    struct Registration
+    {
+        /// Tells a stale event from one for a new registration of the fd
+        uint32_t generation;
+        std::shared_ptr<FdHandler> handler;
+    };
+
+    ///
+    /// \brief wake
+    ///
+    /// Called by the queue after a push, close() or stop(). Writes the
+    /// eventfd if the loop thread may be blocked and no wakeup is pending
+    ///
+    void wake();
+
+    ///
+    /// \brief tick_at
+    ///
+    /// \return the first tick at or after time when
+    ///
+    uint64_t tick_at( clock::time_point when ) const;
+
+    ///
+    /// \brief insert_timer
+    ///
+    /// Add a timer to the wheel, rearming the timerfd if it is due first
+    ///
+    TimerId insert_timer( uint64_t tick, Timer &&timer );
+
+    ///
+    /// \brief arm_locked
+    ///
+    /// Set the timerfd to expire at the next tick with work.
+    /// m_timer_mutex must be held
+    ///
+    void arm_locked();
+
+    ///
+    /// \brief run_timers
+    ///
+    /// Call the functions of the timers which expired
+    ///
+    /// \return the number called
+    ///
+    size_t run_timers();
+
+    ///
+    /// \brief run_once_ns
+    ///
+    /// The implementation of run_once()
+    ///
+    size_t run_once_ns( std::chrono::nanoseconds timeout );
+
+    MessageQueue m_queue;
+
+    int m_epoll_fd;
+    int m_wake_fd;
+    int m_timer_fd;
+
+    ///
+    /// \brief m_polling
+    ///
+    /// Set by the loop thread while it is in, or about to enter,
+    /// epoll_wait()
+    ///
+    std::atomic<bool> m_polling;
+
+    ///
+    /// \brief m_wake_pending
+    ///
+    /// Set when the eventfd has been written and not yet read, so that
+    /// concurrent pushes write it only once
+    ///
+    std::atomic<bool> m_wake_pending;
+
+    std::atomic<bool> m_stop;
+    std::atomic<std::thread::id> m_thread_id;
+
+    std::mutex m_fd_mutex;
+    std::unordered_map<int, Registration> m_fds;
+    uint32_t m_next_generation;
+
+    clock::time_point const m_epoch;
+    std::mutex m_timer_mutex;
+    TimerWheel<Timer> m_wheel;
+
+    /// The tick the timerfd is set for, guarded by m_timer_mutex
+    uint64_t m_armed_tick;
+
+    /// Loop thread only: the functions of the timers expired in this pass
+    std::vector<Task> m_expired;
+};
+}
+
+#endif // LAMBDASTEW_EVENTLOOP_HPP
@@ -0,0 +1,600 @@
+#ifndef LAMBDASTEW_FUTURE_HPP
+#define LAMBDASTEW_FUTURE_HPP
+
+#include "MessageQueue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The FutureError class
+///
+/// Thrown by Future::get() for a promise which was destroyed without a
+/// result, and by the members of a Future which has no shared state
+///
+class FutureError : public std::logic_error
+{
+  public:
+    explicit FutureError( char const *what ) : std::logic_error( what ) {}
+};
+
+///
+/// \brief future_state_allocate
+///
+/// Allocate a Future shared state from the pool. Freed blocks are kept in a
+/// cache of the freeing thread and in a shared free list, so a steady
+/// stream of results does not touch the heap
+///
+void *future_state_allocate( size_t size );
+
+///
+/// \brief future_state_deallocate
+///
+/// Return a block of future_state_allocate() to the pool
+///
+void future_state_deallocate( void *p, size_t size ) noexcept;
+
+///
+/// \brief The FutureStateBase class
+///
+/// The part of a Future shared state which does not depend on the result
+/// type.
+///
+/// The state word is the only thing the producer, the consumer and a
+/// continuation synchronize on. The producer stores the result and then
+/// sets ready with one fetch_or; then() stores its continuation and sets
+/// continuation with one fetch_or. Whichever comes second sees the other's
+/// flag and sends the continuation to its queue. A thread blocking in
+/// wait() sets waiting, so the producer only signals when someone waits.
+///
+class FutureStateBase
+{
+  public:
+    static const uint32_t flag_ready = 1;
+    static const uint32_t flag_continuation = 2;
+    static const uint32_t flag_waiting = 4;
+
+    FutureStateBase()
+        : m_state( 0 ), m_refs( 1 ), m_continuation_queue( nullptr )
+    {
+    }
+
+    FutureStateBase( FutureStateBase const & ) = delete;
+    FutureStateBase &operator=( FutureStateBase const & ) = delete;
+
+    bool is_ready() const
+    {
+        return m_state.load( std::memory_order_acquire ) & flag_ready;
+    }
+
+    void add_ref() { m_refs.fetch_add( 1, std::memory_order_relaxed ); }
+
+    ///
+    /// \brief remove_ref
+    ///
+    /// \return true if that was the last reference
+    ///
+    bool remove_ref()
+    {
+        return m_refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1;
+    }
+
+    ///
+    /// \brief complete
+    ///
+    /// Publish the result, after it has been stored, to the consumer and
+    /// the continuation
+    ///
+    void complete();
+
+    ///
+    /// \brief set_continuation
+    ///
+    /// Have task pushed to queue once the result is ready, or push it now
+    /// if it is. There is at most one continuation
+    ///
+    void set_continuation( MessageQueue &queue, Task &&task );
+
+    ///
+    /// \brief wait
+    ///
+    /// Block until the result is ready
+    ///
+    void wait();
+
+    ///
+    /// \brief wait_for_ns
+    ///
+    /// Block until the result is ready or timeout has passed
+    ///
+    /// \return true if the result is ready
+    ///
+    bool wait_for_ns( std::chrono::nanoseconds timeout );
+
+    /// The exception of the producer, set before complete()
+    std::exception_ptr m_exception;
+
+  private:
+    ///
+    /// \brief dispatch
+    ///
+    /// Push the continuation to its queue. If the queue is closed the
+    /// continuation is destroyed, which breaks the promise of its Future
+    ///
+    void dispatch();
+
+    std::atomic<uint32_t> m_state;
+    std::atomic<uint32_t> m_refs;
+    MessageQueue *m_continuation_queue;
+    Task m_continuation;
+};
+
+///
+/// \brief The FutureVoid struct
+///
+/// The stored result of a Future<void>
+///
+struct FutureVoid
+{
+};
+
+///
+/// \brief The FutureState class
+///
+/// The shared state of a Promise and its Future, allocated from the pool
+///
+template <typename T>
+class FutureState : public FutureStateBase
+{
+  public:
+    typedef typename std::conditional<std::is_void<T>::value, FutureVoid, T>::
+        type value_type;
+
+    FutureState() : m_has_value( false ) {}
+
+    ~FutureState()
+    {
+        if ( m_has_value )
+        {
+            value().~value_type();
+        }
+    }
+
+    // The pool hands out blocks with the alignment of ::operator new only
+    static_assert( alignof( value_type ) <= alignof( std::max_align_t ),
+                   "Future does not support over-aligned result types" );
+
+    static void *operator new( size_t size )
+    {
+        return future_state_allocate( size );
+    }
+
+    static void operator delete( void *p, size_t size )
+    {
+        future_state_deallocate( p, size );
+    }
+
+    void release()
+    {
+        if ( remove_ref() )
+        {
+            delete this;
+        }
+    }
+
+    ///
+    /// \brief emplace_value
+    ///
+    /// Construct the result, without publishing it. Nothing changes if the
+    /// constructor throws
+    ///
+    template <typename... ArgsT>
+    void emplace_value( ArgsT &&... args )
+    {
+        new ( &m_storage ) value_type( std::forward<ArgsT>( args )... );
+        m_has_value = true;
+    }
+
+    void set_exception( std::exception_ptr e )
+    {
+        m_exception = e;
+        complete();
+    }
+
+    value_type &value()
+    {
+        return *reinterpret_cast<value_type *>( &m_storage );
+    }
+
+  private:
+    typename std::aligned_storage<sizeof( value_type ),
+                                  alignof( value_type )>::type m_storage;
+    bool m_has_value;
+};
+
+template <typename T>
+class Promise;
+
+///
+/// \brief The Future class
+///
+/// The result of a function run on a MessageQueue, see submit(). A Future
+/// is move-only; get() and then() consume it
+///
+template <typename T>
+class Future
+{
+  public:
+    typedef T value_type;
+
+    Future() noexcept : m_state( nullptr ) {}
+
+    Future( Future &&other ) noexcept : m_state( other.m_state )
+    {
+        other.m_state = nullptr;
+    }
+
+    Future &operator=( Future &&other ) noexcept
+    {
+        if ( this != &other )
+        {
+            reset();
+            m_state = other.m_state;
+            other.m_state = nullptr;
+        }
+        return *this;
+    }
+
+    Future( Future const & ) = delete;
+    Future &operator=( Future const & ) = delete;
+
+    ~Future() { reset(); }
+
+    ///
+    /// \brief valid
+    ///
+    /// \return true if the future has a shared state, so it was obtained
+    /// from a Promise and neither get() nor then() has been called
+    ///
+    bool valid() const noexcept { return m_state != nullptr; }
+
+    ///
+    /// \brief is_ready
+    ///
+    /// \return true if get() will not block
+    ///
+    bool is_ready() const { return state().is_ready(); }
+
+    ///
+    /// \brief wait
+    ///
+    /// Block until the result is ready
+    ///
+    void wait() const { state().wait(); }
+
+    ///
+    /// \brief wait_for
+    ///
+    /// Block until the result is ready or timeout has passed
+    ///
+    /// \return true if the result is ready
+    ///
+    template <typename DurationT>
+    bool wait_for( DurationT timeout ) const
+    {
+        return state().wait_for_ns(
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ) );
+    }
+
+    ///
+    /// \brief get
+    ///
+    /// Wait for the result and move it out, leaving the future invalid
+    ///
+    /// \return the value set by the promise
+    /// \throw the exception set by the promise, or FutureError if the
+    /// promise was destroyed without a result
+    ///
+    T get()
+    {
+        // Let go of the state whichever way this returns
+        struct Release
+        {
+            ~Release() { state->release(); }
+            FutureState<T> *state;
+        } release = {&state()};
+        m_state = nullptr;
+
+        release.state->wait();
+        if ( release.state->m_exception )
+        {
+            std::rethrow_exception( release.state->m_exception );
+        }
+        return static_cast<T>( std::move( release.state->value() ) );
+    }
+
+    ///
+    /// \brief then
+    ///
+    /// Once the result is ready, push a task to queue which calls
+    /// func( Future<T> ) with this future, ready. Leaves this future invalid
+    ///
+    /// \param queue the queue to run func on
+    /// \param func callable taking a Future<T>
+    /// \return the future of the result of func. If queue is closed when
+    /// the result is ready, it gets a FutureError instead
+    ///
+    template <typename F>
+    Future<typename std::result_of<F( Future<T> )>::type>
+        then( MessageQueue &queue, F &&func );
+
+  private:
+    friend class Promise<T>;
+
+    explicit Future( FutureState<T> *state ) : m_state( state ) {}
+
+    FutureState<T> &state() const
+    {
+        if ( !m_state )
+        {
+            throw FutureError( "future has no state" );
+        }
+        return *m_state;
+    }
+
+    void reset()
+    {
+        if ( m_state )
+        {
+            m_state->release();
+            m_state = nullptr;
+        }
+    }
+
+    FutureState<T> *m_state;
+};
+
+///
+/// \brief The Promise class
+///
+/// The producing side of a Future. Destroying a Promise which has no result
+/// yet completes its Future with a FutureError
+///
+template <typename T>
+class Promise
+{
+  public:
+    Promise() : m_state( new FutureState<T> ), m_future_taken( false ) {}
+
+    Promise( Promise &&other ) noexcept
+        : m_state( other.m_state ), m_future_taken( other.m_future_taken )
+    {
+        other.m_state = nullptr;
+    }
+
+    Promise &operator=( Promise &&other ) noexcept
+    {
+        if ( this != &other )
+        {
+            abandon();
+            m_state = other.m_state;
+            m_future_taken = other.m_future_taken;
+            other.m_state = nullptr;
+        }
+        return *this;
+    }
+
+    Promise( Promise const & ) = delete;
+    Promise &operator=( Promise const & ) = delete;
+
+    ~Promise() { abandon(); }
+
+    ///
+    /// \brief valid
+    ///
+    /// \return true if the promise has a shared state which has no result
+    /// yet
+    ///
+    bool valid() const noexcept { return m_state != nullptr; }
+
+    ///
+    /// \brief get_future
+    ///
+    /// \return the future of this promise. Can be called once
+    ///
+    Future<T> get_future()
+    {
+        if ( !m_state || m_future_taken )
+        {
+            throw FutureError( "future already retrieved" );
+        }
+        m_future_taken = true;
+        m_state->add_ref();
+        return Future<T>( m_state );
+    }
+
+    ///
+    /// \brief set_value
+    ///
+    /// Store the result and make the future ready
+    ///
+    template <typename... ArgsT>
+    void set_value( ArgsT &&... args )
+    {
+        if ( !m_state )
+        {
+            throw FutureError( "promise already satisfied" );
+        }
+        // Construct the value while the promise still owns the state, so
+        // that if it throws the promise can still be completed
+        m_state->emplace_value( std::forward<ArgsT>( args )... );
+        FutureState<T> *state = take_state();
+        state->complete();
+        state->release();
+    }
+
+    ///
+    /// \brief set_exception
+    ///
+    /// Store an exception for get() to throw and make the future ready
+    ///
+    void set_exception( std::exception_ptr e )
+    {
+        FutureState<T> *state = take_state();
+        state->set_exception( e );
+        state->release();
+    }
+
+  private:
+    FutureState<T> *take_state()
+    {
+        if ( !m_state )
+        {
+            throw FutureError( "promise already satisfied" );
+        }
+        FutureState<T> *state = m_state;
+        m_state = nullptr;
+        return state;
+    }
+
+    void abandon()
+    {
+        if ( m_state )
+        {
+            set_exception(
+                std::make_exception_ptr( FutureError( "broken promise" ) ) );
+        }
+    }
+
+    FutureState<T> *m_state;
+    bool m_future_taken;
+};
+
+///
+/// \brief future_fulfil
+///
+/// Call func( args... ) and complete promise with its result or exception
+///
+template <typename R, typename F, typename... ArgsT>
+typename std::enable_if<!std::is_void<R>::value>::type
+    future_fulfil( Promise<R> &promise, F &func, ArgsT &&... args )
+{
+    try
+    {
+        promise.set_value( func( std::forward<ArgsT>( args )... ) );
+    }
+    catch ( ... )
+    {
+        if ( promise.valid() )
+        {
+            promise.set_exception( std::current_exception() );
+        }
+    }
+}
+
+template <typename R, typename F, typename... ArgsT>
+typename std::enable_if<std::is_void<R>::value>::type
+    future_fulfil( Promise<R> &promise, F &func, ArgsT &&... args )
+{
+    try
+    {
+        func( std::forward<ArgsT>( args )... );
+        promise.set_value();
+    }
+    catch ( ... )
+    {
+        if ( promise.valid() )
+        {
+            promise.set_exception( std::current_exception() );
+        }
+    }
+}
+
+///
+/// \brief The FutureCall struct
+///
+/// The task submit() queues: call func and complete the promise
+///
+template <typename R, typename F>
+struct FutureCall
+{
+    void operator()() { future_fulfil( promise, func ); }
+
+    Promise<R> promise;
+    F func;
+};
+
+///
+/// \brief The FutureContinuation struct
+///
+/// The task then() queues: call func with the ready input and complete the
+/// promise
+///
+template <typename T, typename R, typename F>
+struct FutureContinuation
+{
+    void operator()() { future_fulfil( promise, func, std::move( input ) ); }
+
+    Future<T> input;
+    Promise<R> promise;
+    F func;
+};
+
+template <typename T>
+template <typename F>
+Future<typename std::result_of<F( Future<T> )>::type>
+    Future<T>::then( MessageQueue &queue, F &&func )
+{
+    typedef typename std::result_of<F( Future<T> )>::type R;
+    typedef typename std::decay<F>::type Callable;
+
+    FutureState<T> &input = state();
+    Promise<R> promise;
+    Future<R> r = promise.get_future();
+
+    // The continuation owns this future until it runs
+    FutureContinuation<T, R, Callable> continuation
+        = {std::move( *this ), std::move( promise ), std::forward<F>( func )};
+    input.set_continuation( queue, Task( std::move( continuation ) ) );
+    return r;
+}
+
+///
+/// \brief submit
+///
+/// Push func to the back of queue and return the future of its result.
+///
+/// Unlike std::packaged_task with std::future, the shared state comes from
+/// a pool and completing it costs one atomic operation, plus a wakeup only
+/// if a thread is blocked in get()
+///
+/// \param queue the queue to run func on
+/// \param func callable function which takes no parameters
+/// \return the future of the result of func. If queue is closed it is ready
+/// at once with a FutureError
+///
+template <typename F>
+Future<typename std::result_of<typename std::decay<F>::type()>::type>
+    submit( MessageQueue &queue, F &&func )
+{
+    typedef typename std::decay<F>::type Callable;
+    typedef typename std::result_of<Callable()>::type R;
+
+    Promise<R> promise;
+    Future<R> r = promise.get_future();
+    FutureCall<R, Callable> call
+        = {std::move( promise ), std::forward<F>( func )};
+    queue.push_back( std::move( call ) );
+    return r;
+}
+}
+
+#endif // LAMBDASTEW_FUTURE_HPP
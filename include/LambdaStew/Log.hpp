@@ -6,6 +6,10 @@
 #include <iomanip>
 #include <mutex>
 #include <atomic>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
 
 #define ENABLE_SYSLOG
 
@@ -13,6 +17,34 @@
 #include <syslog.h>
 #endif
 
+#include "LogFormat.hpp"
+
+///
+/// \brief LAMBDASTEW_LOG_LEVEL_CRIT ... LAMBDASTEW_LOG_LEVEL_TRACE
+///
+/// The values of LogLevel, for use in LAMBDASTEW_LOG_MIN_LEVEL
+///
+#define LAMBDASTEW_LOG_LEVEL_CRIT 0
+#define LAMBDASTEW_LOG_LEVEL_ERROR 1
+#define LAMBDASTEW_LOG_LEVEL_WARNING 2
+#define LAMBDASTEW_LOG_LEVEL_NOTICE 3
+#define LAMBDASTEW_LOG_LEVEL_INFO 4
+#define LAMBDASTEW_LOG_LEVEL_DEBUG 5
+#define LAMBDASTEW_LOG_LEVEL_TRACE 6
+
+///
+/// \brief LAMBDASTEW_LOG_MIN_LEVEL
+///
+/// The least severe level which is compiled in. Log calls of less severe
+/// levels compile to nothing; with the LAMBDASTEW_LOG_* macros their
+/// arguments are not even evaluated. For example build release code with
+/// -DLAMBDASTEW_LOG_MIN_LEVEL=LAMBDASTEW_LOG_LEVEL_INFO to remove all debug
+/// and trace logging
+///
+#ifndef LAMBDASTEW_LOG_MIN_LEVEL
+#define LAMBDASTEW_LOG_MIN_LEVEL LAMBDASTEW_LOG_LEVEL_TRACE
+#endif
+
 namespace LambdaStew
 {
 using std::mutex;
@@ -42,15 +74,53 @@ ostream &print( ostream &dest, FirstT &&first, RestT &&... rest )
     return print( dest, rest... );
 }
 
+///
+/// \brief format_args
+///
+/// Append a list of parameters which are all fast formattable to a
+/// FormatBuffer, without an ostream
+///
+template <typename... ArgsT>
+void format_args( std::true_type, FormatBuffer &dest, ArgsT &&... args )
+{
+    format_values( dest, args... );
+}
+
+///
+/// \brief format_args
+///
+/// Append a list of parameters to a FormatBuffer with the calling thread's
+/// FormatStream
+///
+template <typename... ArgsT>
+void format_args( std::false_type, FormatBuffer &dest, ArgsT &&... args )
+{
+    FormatStream stream( dest );
+    print( stream.stream(), args... );
+}
+
+///
+/// \brief format_to
+///
+/// Append a list of parameters to a FormatBuffer, the way print() prints
+/// them to an ostream. Lines of numbers, strings and pointers are converted
+/// directly, any other parameter type goes through operator<<
+///
+template <typename... ArgsT>
+void format_to( FormatBuffer &dest, ArgsT &&... args )
+{
+    format_args( are_fast_formattable<ArgsT...>(), dest, args... );
+}
+
 ///
 /// template helper function to print a list of parameters to a string
 ///
 template <typename... FirstT>
 std::string print_to_string( FirstT &&... args )
 {
-    std::ostringstream ostr;
-    print( ostr, args... );
-    return ostr.str();
+    FormatBuffer buffer;
+    format_to( buffer, args... );
+    return buffer.str();
 }
 
 /// \brief log_mutex
@@ -63,6 +133,58 @@ mutex &log_mutex();
 
 std::ostream *log_ostream( bool set = false, std::ostream *o = &std::clog );
 
+///
+/// \brief The LogLevel enum
+///
+/// The severity of a log line, from the most to the least severe
+///
+enum class LogLevel : uint8_t
+{
+    crit,
+    error,
+    warning,
+    notice,
+    info,
+    debug,
+    trace
+};
+
+static_assert( int( LogLevel::crit ) == LAMBDASTEW_LOG_LEVEL_CRIT
+                   && int( LogLevel::trace ) == LAMBDASTEW_LOG_LEVEL_TRACE,
+               "LogLevel must match the LAMBDASTEW_LOG_LEVEL_* macros" );
+
+///
+/// \brief log_level_compiled
+///
+/// \return true if lines of this level are compiled in, according to
+/// LAMBDASTEW_LOG_MIN_LEVEL
+///
+constexpr bool log_level_compiled( LogLevel level )
+{
+    return int( level ) <= LAMBDASTEW_LOG_MIN_LEVEL;
+}
+
+///
+/// \brief log_enabled_levels
+///
+/// One bit per LogLevel, set when that level is enabled at runtime. Changed
+/// through log_error_enable() and friends
+///
+extern std::atomic<uint32_t> log_enabled_levels;
+
+///
+/// \brief log_enabled
+///
+/// \return true if lines of this level are compiled in and enabled. Costs
+/// one relaxed load, or nothing for levels which are compiled out
+///
+inline bool log_enabled( LogLevel level )
+{
+    return log_level_compiled( level )
+           && ( ( log_enabled_levels.load( std::memory_order_relaxed )
+                  >> int( level ) ) & 1 ) != 0;
+}
+
 bool log_error_enable( bool set = false, bool new_value = true );
 
 bool log_warning_enable( bool set = false, bool new_value = true );
@@ -77,6 +199,101 @@ bool log_notice_enable( bool set = false, bool new_value = true );
 
 bool log_crit_enable( bool set = false, bool new_value = true );
 
+///
+/// \brief log_level_prefix
+///
+/// \return the prefix written before a line of this level on an ostream,
+/// such as "INFO   :"
+///
+char const *log_level_prefix( LogLevel level );
+
+///
+/// \brief The LogOverflow enum
+///
+/// What an asynchronous log call does when its thread's buffer is full
+///
+enum class LogOverflow
+{
+    /// Wait for the log writer thread to make room
+    block,
+    /// Discard the line and count it in log_dropped()
+    drop
+};
+
+///
+/// \brief log_async
+///
+/// get or change the asynchronous logging mode
+///
+/// In asynchronous mode each thread formats its log lines into its own
+/// lock-free buffer and a background writer thread writes them in batches
+/// to the log ostream or syslog, so logging threads neither share a lock
+/// nor wait for the output. Lines from one thread keep their order.
+///
+/// call with set=true to change the mode. Turning it off writes everything
+/// already buffered first
+///
+/// \param set set to true to change the logging mode via new_value
+/// \param new_value asynchronous logging enable flag
+/// \param overflow what to do when a thread's buffer is full
+/// \param buffer_size the size in bytes of the buffer of each thread which
+/// logs after this call
+/// \return current asynchronous logging enable flag
+///
+bool log_async( bool set = false,
+                bool new_value = false,
+                LogOverflow overflow = LogOverflow::block,
+                size_t buffer_size = 64 * 1024 );
+
+///
+/// \brief log_flush
+///
+/// Wait until every line logged before this call has been written and the
+/// log ostream flushed. Call before shutting down in asynchronous mode
+///
+void log_flush();
+
+///
+/// \brief log_dropped
+///
+/// \return the number of lines discarded with LogOverflow::drop
+///
+uint64_t log_dropped();
+
+///
+/// \brief log_write
+///
+/// Write one formatted line, without prefix or line ending, to the log
+/// ostream or syslog, or hand it to the log writer thread in asynchronous
+/// mode
+///
+/// \param level the severity of the line
+/// \param text the message
+/// \param length the length of the message in bytes
+///
+void log_write( LogLevel level, char const *text, size_t length );
+
+///
+/// \brief log_write_now
+///
+/// Write one formatted line on the calling thread to the log_to_file()
+/// file, or else to syslog or the log ostream under log_mutex()
+///
+void log_write_now( LogLevel level, char const *text, size_t length );
+
+///
+/// \brief log_message
+///
+/// format a list of parameters and write them as one line of the given level
+///
+template <typename... ArgsT>
+void log_message( LogLevel level, ArgsT &&... args )
+{
+    FormatBuffer buffer;
+    format_to( buffer, args... );
+    log_write( level, buffer.data(), buffer.size() );
+}
+
 #ifdef ENABLE_SYSLOG
 /// \brief log_to_syslog
 ///
@@ -109,22 +326,9 @@ bool log_to_syslog( bool set = false,
 template <typename FirstT, typename... RestT>
 void log_info( FirstT &&first, RestT &&... rest )
 {
-    if ( log_info_enable() )
+    if ( log_enabled( LogLevel::info ) )
     {
-#ifdef ENABLE_SYSLOG
-        if ( log_to_syslog() )
-        {
-            std::stringstream o;
-            print( o, first, rest... );
-            lock_guard<mutex> guard( log_mutex() );
-            syslog( LOG_INFO, "%s", o.str().c_str() );
-        }
-        else
-#endif
-        {
-            lock_guard<mutex> guard( log_mutex() );
-            print( *log_ostream(), "INFO   :", first, rest... ) << std::endl;
-        }
+        log_message( LogLevel::info, first, rest... );
     }
 }
 
@@ -136,22 +340,9 @@ void log_info( FirstT &&first, RestT &&... rest )
 template <typename FirstT, typename... RestT>
 void log_trace( FirstT &&first, RestT &&... rest )
 {
-    if ( log_trace_enable() )
+    if ( log_enabled( LogLevel::trace ) )
     {
-#ifdef ENABLE_SYSLOG
-        if ( log_to_syslog() )
-        {
-            std::stringstream o;
-            print( o, first, rest... );
-            lock_guard<mutex> guard( log_mutex() );
-            syslog( LOG_DEBUG, "%s", o.str().c_str() );
-        }
-        else
-#endif
-        {
-            lock_guard<mutex> guard( log_mutex() );
-            print( *log_ostream(), "trace  :", first, rest... ) << std::endl;
-        }
+        log_message( LogLevel::trace, first, rest... );
     }
 }
 
@@ -163,22 +354,9 @@ void log_trace( FirstT &&first, RestT &&... rest )
 template <typename FirstT, typename... RestT>
 void log_debug( FirstT &&first, RestT &&... rest )
 {
-    if ( log_debug_enable() )
+    if ( log_enabled( LogLevel::debug ) )
     {
-#ifdef ENABLE_SYSLOG
-        if ( log_to_syslog() )
-        {
-            std::stringstream o;
-            print( o, first, rest... );
-            lock_guard<mutex> guard( log_mutex() );
-            syslog( LOG_DEBUG, "%s", o.str().c_str() );
-        }
-        else
-#endif
-        {
-            lock_guard<mutex> guard( log_mutex() );
-            print( *log_ostream(), "DEBUG  :", first, rest... ) << std::endl;
-        }
+        log_message( LogLevel::debug, first, rest... );
     }
 }
 
@@ -190,22 +368,9 @@ void log_debug( FirstT &&first, RestT &&... rest )
 template <typename FirstT, typename... RestT>
 void log_error( FirstT &&first, RestT &&... rest )
 {
-    if ( log_error_enable() )
+    if ( log_enabled( LogLevel::error ) )
     {
-#ifdef ENABLE_SYSLOG
-        if ( log_to_syslog() )
-        {
-            std::stringstream o;
-            print( o, first, rest... );
-            lock_guard<mutex> guard( log_mutex() );
-            syslog( LOG_ERR, "%s", o.str().c_str() );
-        }
-        else
-#endif
-        {
-            lock_guard<mutex> guard( log_mutex() );
-            print( *log_ostream(), "ERROR  :", first, rest... ) << std::endl;
-        }
+        log_message( LogLevel::error, first, rest... );
     }
 }
 
@@ -218,22 +383,9 @@ void log_error( FirstT &&first, RestT &&... rest )
 template <typename FirstT, typename... RestT>
 void log_crit( FirstT &&first, RestT &&... rest )
 {
-    if ( log_crit_enable() )
+    if ( log_enabled( LogLevel::crit ) )
     {
-#ifdef ENABLE_SYSLOG
-        if ( log_to_syslog() )
-        {
-            std::stringstream o;
-            print( o, first, rest... );
-            lock_guard<mutex> guard( log_mutex() );
-            syslog( LOG_CRIT, "%s", o.str().c_str() );
-        }
-        else
-#endif
-        {
-            lock_guard<mutex> guard( log_mutex() );
-            print( *log_ostream(), "CRIT   :", first, rest... ) << std::endl;
-        }
+        log_message( LogLevel::crit, first, rest... );
     }
 }
 
@@ -246,22 +398,9 @@ void log_crit( FirstT &&first, RestT &&... rest )
 template <typename FirstT, typename... RestT>
 void log_notice( FirstT &&first, RestT &&... rest )
 {
-    if ( log_notice_enable() )
+    if ( log_enabled( LogLevel::notice ) )
     {
-#ifdef ENABLE_SYSLOG
-        if ( log_to_syslog() )
-        {
-            std::stringstream o;
-            print( o, first, rest... );
-            lock_guard<mutex> guard( log_mutex() );
-            syslog( LOG_NOTICE, "%s", o.str().c_str() );
-        }
-        else
-#endif
-        {
-            lock_guard<mutex> guard( log_mutex() );
-            print( *log_ostream(), "NOTICE :", first, rest... ) << std::endl;
-        }
+        log_message( LogLevel::notice, first, rest... );
     }
 }
 
@@ -274,24 +413,80 @@ void log_notice( FirstT &&first, RestT &&... rest )
 template <typename FirstT, typename... RestT>
 void log_warning( FirstT &&first, RestT &&... rest )
 {
-    if ( log_warning_enable() )
+    if ( log_enabled( LogLevel::warning ) )
     {
-#ifdef ENABLE_SYSLOG
-        if ( log_to_syslog() )
-        {
-            std::stringstream o;
-            print( o, first, rest... );
-            lock_guard<mutex> guard( log_mutex() );
-            syslog( LOG_WARNING, "%s", o.str().c_str() );
-        }
-        else
-#endif
-        {
-            lock_guard<mutex> guard( log_mutex() );
-            print( *log_ostream(), "WARNING:", first, rest... ) << std::endl;
-        }
+        log_message( LogLevel::warning, first, rest... );
+    }
+}
+
+///
+/// \brief The LogLazy class
+///
+/// A log argument which is only computed when the line is formatted, see
+/// log_lazy()
+///
+template <typename F>
+class LogLazy
+{
+  public:
+    explicit LogLazy( F f ) : m_f( std::move( f ) ) {}
+
+    friend ostream &operator<<( ostream &o, LogLazy const &v )
+    {
+        return o << v.m_f();
     }
+
+  private:
+    F m_f;
+};
+
+///
+/// \brief log_lazy
+///
+/// Wrap a function returning a printable value so that it is only called
+/// if the log line is enabled, for example
+///
+///     log_debug( "state: ", log_lazy( [&]() { return dump_state(); } ) );
+///
+template <typename F>
+LogLazy<typename std::decay<F>::type> log_lazy( F &&f )
+{
+    return LogLazy<typename std::decay<F>::type>( std::forward<F>( f ) );
 }
 }
 
+///
+/// \brief LAMBDASTEW_LOG
+///
+/// Log a line of the given LogLevel, evaluating the arguments only if the
+/// level is enabled. For levels below LAMBDASTEW_LOG_MIN_LEVEL the whole
+/// statement is compiled out. Prefer the LAMBDASTEW_LOG_TRACE etc. forms
+/// on hot paths: the log_trace() etc. functions have to evaluate their
+/// arguments before checking the level
+///
+#define LAMBDASTEW_LOG( level, ... )                                          \
+    do                                                                         \
+    {                                                                          \
+        if ( ::LambdaStew::log_level_compiled( level )                         \
+             && ::LambdaStew::log_enabled( level ) )                           \
+        {                                                                      \
+            ::LambdaStew::log_message( level, __VA_ARGS__ );                   \
+        }                                                                      \
+    } while ( 0 )
+
+#define LAMBDASTEW_LOG_CRIT( ... )                                            \
+    LAMBDASTEW_LOG( ::LambdaStew::LogLevel::crit, __VA_ARGS__ )
+#define LAMBDASTEW_LOG_ERROR( ... )                                           \
+    LAMBDASTEW_LOG( ::LambdaStew::LogLevel::error, __VA_ARGS__ )
+#define LAMBDASTEW_LOG_WARNING( ... )                                         \
+    LAMBDASTEW_LOG( ::LambdaStew::LogLevel::warning, __VA_ARGS__ )
+#define LAMBDASTEW_LOG_NOTICE( ... )                                          \
+    LAMBDASTEW_LOG( ::LambdaStew::LogLevel::notice, __VA_ARGS__ )
+#define LAMBDASTEW_LOG_INFO( ... )                                            \
+    LAMBDASTEW_LOG( ::LambdaStew::LogLevel::info, __VA_ARGS__ )
+#define LAMBDASTEW_LOG_DEBUG( ... )                                           \
+    LAMBDASTEW_LOG( ::LambdaStew::LogLevel::debug, __VA_ARGS__ )
+#define LAMBDASTEW_LOG_TRACE( ... )                                           \
+    LAMBDASTEW_LOG( ::LambdaStew::LogLevel::trace, __VA_ARGS__ )
+
 #endif // LAMBDASTEW_LOG_HPP
@@ -0,0 +1,316 @@
+#ifndef LAMBDASTEW_LOGCATEGORY_HPP
+#define LAMBDASTEW_LOGCATEGORY_HPP
+
+#include "Log.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace LambdaStew
+{
+
+///
+/// \brief log_level_mask
+///
+/// \return the mask of the levels at least as severe as level, for example
+/// log_level_mask( LogLevel::info ) enables crit to info
+///
+constexpr uint32_t log_level_mask( LogLevel level )
+{
+    return ( 2u << int( level ) ) - 1;
+}
+
+///
+/// \brief The LogCategory class
+///
+/// A named log category with its own set of enabled levels.
+///
+/// Names are hierarchical, with '.' separating the parts, such as
+/// "net.tcp". A category which has not been given levels of its own with
+/// log_category_levels() inherits those of its parent, and a top level
+/// category inherits the global levels set with log_info_enable() etc.
+///
+/// The levels are kept as one packed mask, so checking a level is a single
+/// relaxed load. Changing levels recomputes the masks of all categories
+/// under a configuration mutex which log calls never take.
+///
+/// Categories are created by log_category() and live until the process
+/// exits.
+///
+class LogCategory
+{
+  public:
+    LogCategory( std::string const &name, LogCategory *parent );
+
+    LogCategory( LogCategory const & ) = delete;
+    LogCategory &operator=( LogCategory const & ) = delete;
+
+    ///
+    /// \brief enabled
+    ///
+    /// \return true if lines of this level are enabled in this category
+    ///
+    bool enabled( LogLevel level ) const
+    {
+        return ( ( m_levels.load( std::memory_order_relaxed ) >> int( level ) )
+                 & 1 ) != 0;
+    }
+
+    ///
+    /// \brief levels
+    ///
+    /// \return the mask of enabled levels, one bit per LogLevel
+    ///
+    uint32_t levels() const { return m_levels.load( std::memory_order_relaxed ); }
+
+    ///
+    /// \brief name
+    ///
+    std::string const &name() const { return m_name; }
+
+    ///
+    /// \brief parent
+    ///
+    /// \return the parent category, or nullptr for a top level category
+    ///
+    LogCategory *parent() const { return m_parent; }
+
+  private:
+    friend void log_category_levels( std::string const &name, uint32_t levels );
+    friend void log_category_inherit( std::string const &name );
+    friend void log_categories_update();
+
+    ///
+    /// \brief refresh_all
+    ///
+    /// Recompute the levels of every category, with the configuration
+    /// mutex held
+    ///
+    static void refresh_all();
+
+    std::string const m_name;
+    LogCategory *const m_parent;
+
+    /// The effective levels, read by log calls
+    std::atomic<uint32_t> m_levels;
+
+    /// Guarded by the configuration mutex: whether levels were set for this
+    /// category itself, and to what
+    bool m_explicit;
+    uint32_t m_explicit_levels;
+};
+
+///
+/// \brief log_category
+///
+/// Find or create a category and its parents. Call it once and keep the
+/// reference, for example in a static variable
+///
+/// \param name the dotted name of the category
+/// \return the category
+///
+LogCategory &log_category( std::string const &name );
+
+///
+/// \brief log_category_levels
+///
+/// Set the enabled levels of a category, creating it if needed. Categories
+/// under it which do not have levels of their own follow
+///
+/// \param name the dotted name of the category
+/// \param levels the mask of enabled levels, see log_level_mask()
+///
+void log_category_levels( std::string const &name, uint32_t levels );
+
+///
+/// \brief log_category_inherit
+///
+/// Make a category follow its parent's levels again
+///
+void log_category_inherit( std::string const &name );
+
+///
+/// \brief log_categories_update
+///
+/// Recompute the levels of every category which inherits them, after the
+/// global levels changed
+///
+void log_categories_update();
+
+///
+/// \brief The LogRateLimiter class
+///
+/// A lock-free token bucket for one log call site: allows burst lines at
+/// once, and on average per_second lines per second after that.
+///
+/// The bucket is kept as the time at which it will be full again, so that
+/// allow() is one clock read and one compare-and-swap
+///
+class LogRateLimiter
+{
+  public:
+    LogRateLimiter( double per_second, unsigned burst )
+        : m_interval_ns( int64_t( 1e9 / per_second ) )
+        , m_burst_ns( m_interval_ns * int64_t( burst > 0 ? burst : 1 ) )
+        , m_full_at( 0 )
+        , m_suppressed( 0 )
+    {
+    }
+
+    LogRateLimiter( LogRateLimiter const & ) = delete;
+    LogRateLimiter &operator=( LogRateLimiter const & ) = delete;
+
+    ///
+    /// \brief allow
+    ///
+    /// Take a token from the bucket
+    ///
+    /// \param suppressed set to the number of lines refused since the last
+    /// allowed one
+    /// \return true if the line may be logged
+    ///
+    bool allow( uint64_t &suppressed )
+    {
+        int64_t const now
+            = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now().time_since_epoch() ).count();
+
+        int64_t full_at = m_full_at.load( std::memory_order_relaxed );
+        while ( true )
+        {
+            int64_t const next = ( full_at > now ? full_at : now ) + m_interval_ns;
+            if ( next - now > m_burst_ns )
+            {
+                m_suppressed.fetch_add( 1, std::memory_order_relaxed );
+                return false;
+            }
+            if ( m_full_at.compare_exchange_weak(
+                     full_at, next, std::memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+
+        suppressed = m_suppressed.exchange( 0, std::memory_order_relaxed );
+        return true;
+    }
+
+  private:
+    int64_t const m_interval_ns;
+    int64_t const m_burst_ns;
+    std::atomic<int64_t> m_full_at;
+    std::atomic<uint64_t> m_suppressed;
+};
+
+///
+/// \brief log_category_message
+///
+/// Log a line of a category, prefixed with the category name
+///
+template <typename... ArgsT>
+void log_category_message( LogCategory const &category,
+                           LogLevel level,
+                           ArgsT &&... args )
+{
+    log_message( level, "[", category.name(), "] ", args... );
+}
+
+///
+/// \brief log_rate_limited_message
+///
+/// Log a line of a rate limited call site, noting how many lines of the
+/// site were suppressed before it
+///
+template <typename... ArgsT>
+void log_rate_limited_message( LogCategory const &category,
+                               LogLevel level,
+                               uint64_t suppressed,
+                               ArgsT &&... args )
+{
+    if ( suppressed )
+    {
+        log_message( level,
+                     "[",
+                     category.name(),
+                     "] ",
+                     args...,
+                     " (",
+                     suppressed,
+                     " similar lines suppressed)" );
+    }
+    else
+    {
+        log_category_message( category, level, args... );
+    }
+}
+}
+
+///
+/// \brief LAMBDASTEW_LOG_CATEGORY
+///
+/// Log a line of a LogCategory, evaluating the arguments only if the level
+/// is compiled in and enabled for the category
+///
+#define LAMBDASTEW_LOG_CATEGORY( category, level, ... )                       \
+    do                                                                         \
+    {                                                                          \
+        if ( ::LambdaStew::log_level_compiled( level )                         \
+             && ( category ).enabled( level ) )                                \
+        {                                                                      \
+            ::LambdaStew::log_category_message(                                \
+                ( category ), level, __VA_ARGS__ );                            \
+        }                                                                      \
+    } while ( 0 )
+
+///
+/// \brief LAMBDASTEW_LOG_SAMPLED
+///
+/// Like LAMBDASTEW_LOG_CATEGORY, but only every n-th enabled call of this
+/// call site is logged
+///
+#define LAMBDASTEW_LOG_SAMPLED( category, level, n, ... )                     \
+    do                                                                         \
+    {                                                                          \
+        if ( ::LambdaStew::log_level_compiled( level )                         \
+             && ( category ).enabled( level ) )                                \
+        {                                                                      \
+            static std::atomic<uint32_t> lambdastew_log_count( 0 );            \
+            if ( lambdastew_log_count.fetch_add(                               \
+                     1, std::memory_order_relaxed ) % ( n ) == 0 )             \
+            {                                                                  \
+                ::LambdaStew::log_category_message(                            \
+                    ( category ), level, __VA_ARGS__ );                        \
+            }                                                                  \
+        }                                                                      \
+    } while ( 0 )
+
+///
+/// \brief LAMBDASTEW_LOG_RATE_LIMITED
+///
+/// Like LAMBDASTEW_LOG_CATEGORY, but this call site logs at most burst
+/// lines at once and per_second lines per second on average. The next line
+/// logged after some were refused says how many
+///
+#define LAMBDASTEW_LOG_RATE_LIMITED( category, level, per_second, burst, ... ) \
+    do                                                                         \
+    {                                                                          \
+        if ( ::LambdaStew::log_level_compiled( level )                         \
+             && ( category ).enabled( level ) )                                \
+        {                                                                      \
+            static ::LambdaStew::LogRateLimiter lambdastew_log_limiter(        \
+                per_second, burst );                                           \
+            uint64_t lambdastew_log_suppressed;                                \
+            if ( lambdastew_log_limiter.allow( lambdastew_log_suppressed ) )   \
+            {                                                                  \
+                ::LambdaStew::log_rate_limited_message(                        \
+                    ( category ),                                              \
+                    level,                                                     \
+                    lambdastew_log_suppressed,                                 \
+                    __VA_ARGS__ );                                             \
+            }                                                                  \
+        }                                                                      \
+    } while ( 0 )
+
+#endif // LAMBDASTEW_LOGCATEGORY_HPP
@@ -0,0 +1,265 @@
+#ifndef LAMBDASTEW_LOGFILE_HPP
+#define LAMBDASTEW_LOGFILE_HPP
+
+#include "Log.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The LogFileSync enum
+///
+/// How a LogFile flushes its mapped pages to disk, on sync(), rotation and
+/// close. Between those the kernel writes them back on its own schedule
+///
+enum class LogFileSync
+{
+    /// Leave write back to the kernel
+    none,
+    /// Start writing back without waiting, msync( MS_ASYNC )
+    async,
+    /// Wait until the pages are on disk, msync( MS_SYNC )
+    sync
+};
+
+///
+/// \brief The LogFileOptions struct
+///
+/// The settings of a LogFile
+///
+struct LogFileOptions
+{
+    LogFileOptions()
+        : segment_size( 64 * 1024 * 1024 )
+        , rotate_interval( 0 )
+        , keep( 5 )
+        , sync( LogFileSync::async )
+        , prefault( false )
+    {
+    }
+
+    /// The file to write. Rotated files are renamed to path.1, path.2 etc.
+    std::string path;
+
+    /// The size of the mapped region, and so the size at which the file is
+    /// rotated
+    size_t segment_size;
+
+    /// Also rotate the file when it has been open this long, if not zero
+    std::chrono::seconds rotate_interval;
+
+    /// The number of rotated files kept, the oldest is removed
+    unsigned keep;
+
+    /// When to msync() the written pages
+    LogFileSync sync;
+
+    /// Fault in every page of the region when it is mapped, so that writing
+    /// a line never takes a page fault. Otherwise the region is advised as
+    /// sequential and pages are faulted in as the file grows
+    bool prefault;
+};
+
+///
+/// \brief The LogFile class
+///
+/// A log file written through a memory mapped region of the file.
+///
+/// The file is extended to segment_size and mapped when it is opened. A
+/// write reserves its range of the region with one atomic add on the write
+/// offset and copies the text in, so any number of threads append lines
+/// concurrently without a lock or a system call.
+///
+/// The write which runs past the end of the region rotates the file: it
+/// maps a new file, switches writers over to it, waits for the writes still
+/// copying into the old region, then truncates the old file to the length
+/// written and renames it. Writers which also ran out of room wait for the
+/// switch. A write which finds the rotate_interval has passed rotates the
+/// file too, unless another rotation is in progress.
+///
+/// Until it is rotated or closed, the file is segment_size long and the
+/// part not yet written reads as NUL bytes.
+///
+class LogFile
+{
+  public:
+    LogFile();
+    ~LogFile();
+
+    LogFile( LogFile const & ) = delete;
+    LogFile &operator=( LogFile const & ) = delete;
+
+    ///
+    /// \brief open
+    ///
+    /// Close the current file and open options.path, appending to it if it
+    /// already has room
+    ///
+    /// \return false if the file could not be opened and mapped
+    ///
+    bool open( LogFileOptions const &options );
+
+    ///
+    /// \brief close
+    ///
+    /// Stop writing, truncate the file to the length written and unmap it
+    ///
+    void close();
+
+    ///
+    /// \brief is_open
+    ///
+    bool is_open() const { return m_current.load() != nullptr; }
+
+    ///
+    /// \brief write
+    ///
+    /// Append text as it is. Text longer than the segment size is split
+    /// over several files, after a line ending where there is one
+    ///
+    /// \return false if the file is not open
+    ///
+    bool write( char const *text, size_t length );
+
+    ///
+    /// \brief write_line
+    ///
+    /// Append prefix, text and a line ending as one record
+    ///
+    /// \return false if the file is not open
+    ///
+    bool write_line( char const *prefix, char const *text, size_t length );
+
+    ///
+    /// \brief sync
+    ///
+    /// Flush the pages written so far according to the sync option
+    ///
+    void sync();
+
+    ///
+    /// \brief rotations
+    ///
+    /// \return the number of times the file was rotated
+    ///
+    uint64_t rotations() const { return m_rotations.load(); }
+
+  private:
+    ///
+    /// \brief The Segment struct
+    ///
+    /// One mapped file. A Segment is kept until the LogFile is destroyed,
+    /// because a writer may still be checking it after it was replaced
+    ///
+    struct Segment
+    {
+        int fd;
+        char *data;
+        size_t size;
+
+        /// The next offset to reserve. Reservations past size fail
+        std::atomic<size_t> offset;
+
+        /// The start of the first reservation which did not fit, where
+        /// the written text ends
+        std::atomic<size_t> end;
+
+        /// The number of writers between checking that this is the
+        /// current segment and finishing their copy
+        std::atomic<int> writers;
+
+        /// When to rotate by time, in steady clock nanoseconds, or 0
+        int64_t rotate_at;
+    };
+
+    ///
+    /// \brief append
+    ///
+    /// Reserve length bytes, at most the segment size, and let fill copy
+    /// into them
+    ///
+    template <typename FillT>
+    bool append( size_t length, FillT fill );
+
+    ///
+    /// \brief map_segment
+    ///
+    /// Open and map a file, with the first offset bytes already written
+    ///
+    /// \return the segment, or nullptr on failure
+    ///
+    Segment *map_segment( std::string const &path, size_t offset );
+
+    ///
+    /// \brief finish_segment
+    ///
+    /// Sync, unmap, truncate and close a segment no writer uses any more
+    ///
+    void finish_segment( Segment *s );
+
+    ///
+    /// \brief rotate
+    ///
+    /// Replace segment s with a new file, unless it was already replaced.
+    /// Called with m_mutex held
+    ///
+    /// \return false if the new file could not be opened, which closes the
+    /// LogFile
+    ///
+    bool rotate( Segment *s );
+
+    ///
+    /// \brief wait_for_writers
+    ///
+    /// Wait until no writer is copying into segment s
+    ///
+    static void wait_for_writers( Segment *s );
+
+    std::atomic<Segment *> m_current;
+    std::atomic<uint64_t> m_rotations;
+
+    /// The segment size of the open file, for splitting long writes
+    std::atomic<size_t> m_segment_size;
+
+    /// Guards the options and the segments, taken by open(), close(),
+    /// sync() and rotations but never by writes
+    std::mutex m_mutex;
+    LogFileOptions m_options;
+    std::vector<Segment *> m_segments;
+};
+
+///
+/// \brief log_file
+///
+/// \return the LogFile used by log_to_file()
+///
+LogFile &log_file();
+
+///
+/// \brief log_to_file
+///
+/// get or change the memory mapped log file mode
+///
+/// While it is on, log lines go to a LogFile instead of syslog or the log
+/// ostream, both from the calling thread and from the log writer thread in
+/// asynchronous mode
+///
+/// \param set set to true to change the mode via new_value
+/// \param new_value file logging enable flag
+/// \param options the file to write and how
+/// \return current file logging enable flag, false if the file could not be
+/// opened
+///
+bool log_to_file( bool set = false,
+                  bool new_value = false,
+                  LogFileOptions const &options = LogFileOptions() );
+}
+
+#endif // LAMBDASTEW_LOGFILE_HPP
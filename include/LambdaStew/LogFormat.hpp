@@ -0,0 +1,344 @@
+#ifndef LAMBDASTEW_LOGFORMAT_HPP
+#define LAMBDASTEW_LOGFORMAT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+///
+/// \brief LAMBDASTEW_FORMAT_INLINE_SIZE
+///
+/// The number of characters a FormatBuffer holds without allocating
+///
+#ifndef LAMBDASTEW_FORMAT_INLINE_SIZE
+#define LAMBDASTEW_FORMAT_INLINE_SIZE 512
+#endif
+
+namespace LambdaStew
+{
+
+///
+/// \brief The FormatBuffer class
+///
+/// A character buffer for formatting one log line. Lines up to
+/// LAMBDASTEW_FORMAT_INLINE_SIZE characters stay in the buffer itself, so a
+/// FormatBuffer on the stack formats them without any heap allocation;
+/// longer lines move to a std::string.
+///
+class FormatBuffer
+{
+  public:
+    static const size_t inline_size = LAMBDASTEW_FORMAT_INLINE_SIZE;
+
+    FormatBuffer() : m_size( 0 ), m_spilled( false ) {}
+
+    FormatBuffer( FormatBuffer const & ) = delete;
+    FormatBuffer &operator=( FormatBuffer const & ) = delete;
+
+    ///
+    /// \brief append
+    ///
+    /// Append length characters
+    ///
+    void append( char const *text, size_t length )
+    {
+        if ( !m_spilled && m_size + length <= inline_size )
+        {
+            memcpy( m_inline + m_size, text, length );
+        }
+        else
+        {
+            if ( !m_spilled )
+            {
+                m_spill.assign( m_inline, m_size );
+                m_spilled = true;
+            }
+            m_spill.append( text, length );
+        }
+        m_size += length;
+    }
+
+    void append( char c ) { append( &c, 1 ); }
+
+    char const *data() const { return m_spilled ? m_spill.data() : m_inline; }
+
+    size_t size() const { return m_size; }
+
+    std::string str() const { return std::string( data(), m_size ); }
+
+  private:
+    char m_inline[inline_size];
+    size_t m_size;
+    bool m_spilled;
+    std::string m_spill;
+};
+
+///
+/// \brief is_fast_formattable
+///
+/// True for the types which format_value() converts without an ostream:
+/// arithmetic types, object pointers, character arrays and std::string. A line
+/// with an argument of any other type, including ostream manipulators such
+/// as std::hex, is formatted with an ostream as a whole so that the
+/// manipulators keep working
+///
+template <typename T>
+struct is_fast_formattable
+    : std::integral_constant<
+          bool,
+          std::is_arithmetic<typename std::decay<T>::type>::value
+              || ( std::is_pointer<typename std::decay<T>::type>::value
+                   && !std::is_function<typename std::remove_pointer<
+                          typename std::decay<T>::type>::type>::value )
+              || std::is_same<typename std::decay<T>::type, std::string>::value>
+{
+};
+
+///
+/// \brief are_fast_formattable
+///
+/// True if every type in the list is_fast_formattable
+///
+template <typename... T>
+struct are_fast_formattable;
+
+template <>
+struct are_fast_formattable<> : std::true_type
+{
+};
+
+template <typename FirstT, typename... RestT>
+struct are_fast_formattable<FirstT, RestT...>
+    : std::integral_constant<bool,
+                             is_fast_formattable<FirstT>::value
+                                 && are_fast_formattable<RestT...>::value>
+{
+};
+
+///
+/// \brief format_unsigned
+///
+/// Append the decimal digits of v
+///
+void format_unsigned( FormatBuffer &dest, unsigned long long v );
+
+///
+/// \brief format_signed
+///
+/// Append v in decimal, with a '-' if it is negative
+///
+void format_signed( FormatBuffer &dest, long long v );
+
+///
+/// \brief format_double
+///
+/// Append v the way an ostream with default flags and the classic locale
+/// does, with 6 significant digits and a '.' whatever LC_NUMERIC says
+///
+void format_double( FormatBuffer &dest, double v );
+
+///
+/// \brief format_long_double
+///
+void format_long_double( FormatBuffer &dest, long double v );
+
+///
+/// \brief format_pointer
+///
+/// Append an address the way an ostream does: "0" for null, otherwise
+/// "0x" followed by hex digits
+///
+void format_pointer( FormatBuffer &dest, void const *v );
+
+///
+/// \brief format_value
+///
+/// Append one value formatted the way operator<< on a default ostream does
+///
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value
+                        && !std::is_same<T, char>::value
+                        && !std::is_same<T, signed char>::value>::type
+    format_value( FormatBuffer &dest, T v )
+{
+    format_signed( dest, v );
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value
+                        && !std::is_same<T, bool>::value
+                        && !std::is_same<T, unsigned char>::value>::type
+    format_value( FormatBuffer &dest, T v )
+{
+    format_unsigned( dest, v );
+}
+
+inline void format_value( FormatBuffer &dest, bool v )
+{
+    dest.append( v ? '1' : '0' );
+}
+
+inline void format_value( FormatBuffer &dest, char v ) { dest.append( v ); }
+
+inline void format_value( FormatBuffer &dest, signed char v )
+{
+    dest.append( char( v ) );
+}
+
+inline void format_value( FormatBuffer &dest, unsigned char v )
+{
+    dest.append( char( v ) );
+}
+
+inline void format_value( FormatBuffer &dest, float v )
+{
+    format_double( dest, v );
+}
+
+inline void format_value( FormatBuffer &dest, double v )
+{
+    format_double( dest, v );
+}
+
+inline void format_value( FormatBuffer &dest, long double v )
+{
+    format_long_double( dest, v );
+}
+
+inline void format_value( FormatBuffer &dest, char const *v )
+{
+    if ( v )
+    {
+        dest.append( v, strlen( v ) );
+    }
+}
+
+inline void format_value( FormatBuffer &dest, char *v )
+{
+    format_value( dest, (char const *)v );
+}
+
+inline void format_value( FormatBuffer &dest, signed char const *v )
+{
+    format_value( dest, (char const *)v );
+}
+
+inline void format_value( FormatBuffer &dest, unsigned char const *v )
+{
+    format_value( dest, (char const *)v );
+}
+
+inline void format_value( FormatBuffer &dest, signed char *v )
+{
+    format_value( dest, (char const *)v );
+}
+
+inline void format_value( FormatBuffer &dest, unsigned char *v )
+{
+    format_value( dest, (char const *)v );
+}
+
+inline void format_value( FormatBuffer &dest, std::string const &v )
+{
+    dest.append( v.data(), v.size() );
+}
+
+template <typename T>
+void format_value( FormatBuffer &dest, T *v )
+{
+    format_pointer( dest, (void const *)v );
+}
+
+///
+/// \brief format_values
+///
+/// Append a list of values
+///
+inline void format_values( FormatBuffer & ) {}
+
+template <typename FirstT, typename... RestT>
+void format_values( FormatBuffer &dest, FirstT const &first, RestT const &... rest )
+{
+    format_value( dest, first );
+    format_values( dest, rest... );
+}
+
+///
+/// \brief The FormatStreambuf class
+///
+/// A streambuf which appends to a FormatBuffer, so that an ostream can
+/// format into one
+///
+class FormatStreambuf : public std::streambuf
+{
+  public:
+    explicit FormatStreambuf( FormatBuffer *dest = nullptr ) : m_dest( dest ) {}
+
+    ///
+    /// \brief set_buffer
+    ///
+    /// Change the FormatBuffer which receives the output
+    ///
+    void set_buffer( FormatBuffer *dest ) { m_dest = dest; }
+
+  protected:
+    int overflow( int c ) override
+    {
+        if ( c != traits_type::eof() )
+        {
+            m_dest->append( char( c ) );
+        }
+        return traits_type::not_eof( c );
+    }
+
+    std::streamsize xsputn( char const *s, std::streamsize n ) override
+    {
+        m_dest->append( s, size_t( n ) );
+        return n;
+    }
+
+  private:
+    FormatBuffer *m_dest;
+};
+
+///
+/// \brief The FormatStream class
+///
+/// Lends the calling thread's ostream, writing to dest, for its lifetime.
+/// The stream has the classic locale, and whatever formatting flags the
+/// borrower sets are reset when it is given back. Constructing a stream
+/// costs more than formatting a typical line, so each thread keeps one; a
+/// FormatStream made while the thread's stream is lent out, by an
+/// operator<< which formats in turn, gets a stream of its own
+///
+class FormatStream
+{
+  public:
+    explicit FormatStream( FormatBuffer &dest );
+    ~FormatStream();
+
+    FormatStream( FormatStream const & ) = delete;
+    FormatStream &operator=( FormatStream const & ) = delete;
+
+    std::ostream &stream() { return *m_ostream; }
+
+  private:
+    struct Stream;
+
+    ///
+    /// \brief thread_stream
+    ///
+    /// \return the stream which the calling thread lends out
+    ///
+    static Stream &thread_stream();
+
+    Stream *m_stream;
+    std::ostream *m_ostream;
+    bool m_owned;
+};
+}
+
+#endif // LAMBDASTEW_LOGFORMAT_HPP
@@ -0,0 +1,160 @@
+#ifndef LAMBDASTEW_LOGRING_HPP
+#define LAMBDASTEW_LOGRING_HPP
+
+#include "MPMCRing.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The LogRing class
+///
+/// A bounded single-producer / single-consumer ring of variable sized
+/// records, used to hand log output from the thread which formats it to the
+/// log writer thread without locks.
+///
+/// Each record is an 8 byte header holding the payload size and a record
+/// type, followed by the payload padded to 8 bytes. A record never wraps
+/// around the end of the buffer: when it does not fit in the space left
+/// before the end, that space is filled with a padding record which the
+/// reader skips.
+///
+/// The producer reserves space with reserve(), writes the payload in place
+/// and publishes it with commit(). The consumer reads every published
+/// record with consume().
+///
+class LogRing
+{
+  public:
+    ///
+    /// \brief type_padding
+    ///
+    /// The record type of the filler at the end of the buffer
+    ///
+    static const uint32_t type_padding = 0xffffffff;
+
+    ///
+    /// \brief LogRing
+    ///
+    /// \param capacity minimum number of bytes in the ring, rounded up to a
+    /// power of two
+    ///
+    explicit LogRing( size_t capacity );
+
+    LogRing( LogRing const & ) = delete;
+    LogRing &operator=( LogRing const & ) = delete;
+
+    ///
+    /// \brief reserve
+    ///
+    /// Producer only. Reserve space for a record, which becomes visible to
+    /// the consumer on commit(). Only one record can be reserved at a time
+    ///
+    /// \param type the record type, anything but type_padding
+    /// \param size the payload size, at most max_record_size()
+    /// \return where to write the payload, or nullptr if the ring is full
+    ///
+    char *reserve( uint32_t type, size_t size );
+
+    ///
+    /// \brief commit
+    ///
+    /// Producer only. Publish the record returned by the last reserve()
+    ///
+    void commit() { m_head.store( m_reserved_head, std::memory_order_release ); }
+
+    ///
+    /// \brief consume
+    ///
+    /// Consumer only. Call f( type, data, size ) for every published record
+    /// in order, then release their space to the producer
+    ///
+    /// \return the number of records read
+    ///
+    template <typename F>
+    size_t consume( F &&f )
+    {
+        size_t tail = m_tail.load( std::memory_order_relaxed );
+        size_t const head = m_head.load( std::memory_order_acquire );
+        size_t count = 0;
+
+        while ( tail != head )
+        {
+            char const *p = m_buffer.get() + ( tail & m_mask );
+            Header header;
+            memcpy( &header, p, sizeof( header ) );
+            if ( header.type != type_padding )
+            {
+                f( header.type, p + sizeof( header ), (size_t)header.size );
+                ++count;
+            }
+            tail += record_size( header.size );
+        }
+
+        m_tail.store( tail, std::memory_order_release );
+        return count;
+    }
+
+    ///
+    /// \brief empty
+    ///
+    /// \return true if there are no published records left to consume
+    ///
+    bool empty() const
+    {
+        return m_tail.load( std::memory_order_acquire )
+               == m_head.load( std::memory_order_acquire );
+    }
+
+    ///
+    /// \brief capacity
+    ///
+    /// \return the size of the buffer in bytes
+    ///
+    size_t capacity() const { return m_mask + 1; }
+
+    ///
+    /// \brief max_record_size
+    ///
+    /// The largest payload which reserve() accepts. Half of the buffer, so
+    /// that a record always fits once the ring is empty, wherever the
+    /// free space starts
+    ///
+    size_t max_record_size() const
+    {
+        return capacity() / 2 - sizeof( Header );
+    }
+
+  private:
+    struct Header
+    {
+        uint32_t size;
+        uint32_t type;
+    };
+
+    static size_t record_size( size_t payload_size )
+    {
+        return sizeof( Header ) + ( ( payload_size + 7 ) & ~size_t( 7 ) );
+    }
+
+    size_t const m_mask;
+    std::unique_ptr<char[]> m_buffer;
+
+    /// Producer side: the published end and the end of the reserved record
+    std::atomic<size_t> m_head;
+    size_t m_reserved_head;
+    char m_head_padding[cache_line_size - sizeof( size_t ) * 2];
+
+    /// Consumer side: the start of the first unread record
+    std::atomic<size_t> m_tail;
+    char m_tail_padding[cache_line_size - sizeof( size_t )];
+};
+}
+
+#endif // LAMBDASTEW_LOGRING_HPP
@@ -0,0 +1,294 @@
+#ifndef LAMBDASTEW_LOGWRITER_HPP
+#define LAMBDASTEW_LOGWRITER_HPP
+
+#include "BinaryLog.hpp"
+#include "Log.hpp"
+#include "LogRing.hpp"
+#include "Signaler.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The LogWriter class
+///
+/// The background thread of asynchronous logging, see log_async().
+///
+/// Every thread which logs gets its own LogRing the first time it logs.
+/// The writer thread collects the records from all rings, joins them into
+/// one batch and writes the batch to the log ostream with one write and one
+/// flush, or passes each line to syslog. The rings of threads which have
+/// exited are released once they are empty.
+///
+/// Producers signal the writer after each record, which only costs a
+/// system call when the writer is parked; otherwise it finds new records
+/// on its next pass. A parked writer also polls every poll_interval as a
+/// safety net.
+///
+class LogWriter
+{
+  public:
+    ///
+    /// \brief poll_interval_ms
+    ///
+    /// The longest time the writer sleeps without checking the rings
+    ///
+    static const int poll_interval_ms = 100;
+
+    ///
+    /// \brief instance
+    ///
+    /// \return the single LogWriter of the process
+    ///
+    static LogWriter &instance();
+
+    LogWriter();
+    ~LogWriter();
+
+    LogWriter( LogWriter const & ) = delete;
+    LogWriter &operator=( LogWriter const & ) = delete;
+
+    ///
+    /// \brief enable
+    ///
+    /// Start or stop routing log lines to the writer thread. The thread is
+    /// started on first use and keeps running until the process exits, so
+    /// that lines which raced with disabling are still written
+    ///
+    void enable( bool new_value, LogOverflow overflow, size_t buffer_size );
+
+    ///
+    /// \brief enabled
+    ///
+    /// \return true if log lines are routed to the writer thread
+    ///
+    bool enabled() const { return m_enabled.load( std::memory_order_relaxed ); }
+
+    ///
+    /// \brief write
+    ///
+    /// Copy a line into the calling thread's ring
+    ///
+    /// \return false if asynchronous logging is off and the caller must
+    /// write the line itself
+    ///
+    bool write( LogLevel level, char const *text, size_t length );
+
+    ///
+    /// \brief enable_binary
+    ///
+    /// Start or stop writing binary records to a file, see log_binary()
+    ///
+    /// \return false if the file could not be opened
+    ///
+    bool enable_binary( bool new_value, std::string const &path );
+
+    ///
+    /// \brief binary_enabled
+    ///
+    /// \return true if binary records are written to a file
+    ///
+    bool binary_enabled() const
+    {
+        return m_binary_enabled.load( std::memory_order_relaxed );
+    }
+
+    ///
+    /// \brief reserve_binary
+    ///
+    /// Reserve a binary record in the calling thread's ring
+    ///
+    /// \return where to write the record, or nullptr if binary logging is
+    /// off or the record was dropped
+    ///
+    char *reserve_binary( LogLevel level, size_t size );
+
+    ///
+    /// \brief commit_binary
+    ///
+    /// Publish the record returned by reserve_binary()
+    ///
+    void commit_binary();
+
+    ///
+    /// \brief max_binary_size
+    ///
+    /// \return the largest record the calling thread's ring accepts
+    ///
+    size_t max_binary_size() { return thread_ring().ring.max_record_size(); }
+
+    ///
+    /// \brief flush
+    ///
+    /// Wait until every record published before the call has been written
+    ///
+    void flush();
+
+    ///
+    /// \brief dropped
+    ///
+    /// \return the number of lines discarded because a ring was full
+    ///
+    uint64_t dropped() const { return m_dropped.load(); }
+
+  private:
+    ///
+    /// \brief The ThreadRing struct
+    ///
+    /// The ring of one logging thread
+    ///
+    struct ThreadRing
+    {
+        explicit ThreadRing( size_t capacity )
+            : ring( capacity ), abandoned( false ), continuing( false )
+        {
+        }
+
+        LogRing ring;
+
+        /// Set when the thread has exited
+        std::atomic<bool> abandoned;
+
+        /// Writer only: the last record read was not the end of its line
+        bool continuing;
+
+        /// Writer only: the start of a line which is going to syslog
+        std::string pending;
+    };
+
+    ///
+    /// \brief The ThreadRingOwner struct
+    ///
+    /// The thread_local handle which marks the ring abandoned at thread exit
+    ///
+    struct ThreadRingOwner
+    {
+        ~ThreadRingOwner()
+        {
+            if ( ring )
+            {
+                ring->abandoned.store( true );
+            }
+        }
+        std::shared_ptr<ThreadRing> ring;
+    };
+
+    ///
+    /// \brief thread_ring
+    ///
+    /// \return the calling thread's ring, registering it on first use
+    ///
+    ThreadRing &thread_ring();
+
+    ///
+    /// \brief record_more, record_binary
+    ///
+    /// Flags of the record type, which also carries the level. record_more
+    /// marks a text line which continues in the next record, for lines
+    /// longer than LogRing::max_record_size()
+    ///
+    static const uint32_t record_more = 0x100;
+    static const uint32_t record_binary = 0x200;
+
+    ///
+    /// \brief reserve
+    ///
+    /// Reserve a record in a ring, waiting for room unless the overflow
+    /// policy and may_drop allow dropping it
+    ///
+    /// \return where to write the record, or nullptr if it was dropped
+    ///
+    char *reserve( ThreadRing &r, uint32_t type, size_t size, bool may_drop );
+
+    ///
+    /// \brief wake
+    ///
+    /// Wake the writer thread if it is parked. The signal count is bumped
+    /// even when no one waits yet, so that a writer which read the count
+    /// before this record and is about to park does not sleep through it.
+    /// The Signaler only makes a system call when there is a waiter
+    ///
+    void wake() { m_signaler.send_signal_one(); }
+
+    ///
+    /// \brief write_binary_sites
+    ///
+    /// Append the sites registered since the last call to the binary file
+    ///
+    void write_binary_sites();
+
+    ///
+    /// \brief write_binary_entry
+    ///
+    /// Append one binary record to the binary file
+    ///
+    void write_binary_entry( char const *data, size_t size );
+
+    ///
+    /// \brief start_thread
+    ///
+    /// Start the writer thread unless it is running
+    ///
+    void start_thread();
+
+    ///
+    /// \brief run
+    ///
+    /// The writer thread
+    ///
+    void run();
+
+    ///
+    /// \brief drain
+    ///
+    /// Write every published record from every ring
+    ///
+    /// \return the number of records written
+    ///
+    size_t drain();
+
+    std::atomic<bool> m_enabled;
+    std::atomic<bool> m_exit;
+    std::atomic<int> m_overflow;
+    std::atomic<size_t> m_buffer_size;
+    std::atomic<uint64_t> m_dropped;
+
+    /// Lines dropped which the writer has already reported
+    uint64_t m_dropped_reported;
+
+    /// Wakes the writer thread
+    Signaler m_signaler;
+
+    /// Counts flush() requests and the ones the writer has completed
+    std::atomic<uint64_t> m_flush_requested;
+    std::atomic<uint64_t> m_flush_completed;
+    Signaler m_flushed_signaler;
+
+    std::mutex m_rings_mutex;
+    std::vector<std::shared_ptr<ThreadRing> > m_rings;
+
+    std::mutex m_thread_mutex;
+    std::thread m_thread;
+
+    /// Writer only: the text of the current batch
+    std::string m_batch;
+
+    /// The binary file and the number of sites written to it, used by the
+    /// writer under m_binary_mutex
+    std::atomic<bool> m_binary_enabled;
+    std::mutex m_binary_mutex;
+    std::ofstream m_binary_file;
+    uint32_t m_binary_sites_written;
+    std::vector<BinaryLogSiteInfo> m_new_sites;
+};
+}
+
+#endif // LAMBDASTEW_LOGWRITER_HPP
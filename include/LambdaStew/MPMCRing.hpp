@@ -0,0 +1,215 @@
+#ifndef LAMBDASTEW_MPMCRING_HPP
+#define LAMBDASTEW_MPMCRING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace LambdaStew
+{
+
+///
+/// \brief cache_line_size
+///
+/// The assumed size of a cache line, used to keep independently written
+/// atomics from sharing a line
+///
+static const size_t cache_line_size = 64;
+
+///
+/// \brief The MPMCRing class
+///
+/// A bounded lock-free multi-producer / multi-consumer ring buffer.
+///
+/// Each slot carries a sequence number which tells producers and consumers
+/// whether the slot is ready to be written or read for the current lap
+/// around the ring. The enqueue and dequeue positions are kept on separate
+/// cache lines so that producers and consumers do not invalidate each
+/// other's lines.
+///
+/// The capacity is always rounded up to a power of two.
+///
+template <typename T>
+class MPMCRing
+{
+  public:
+    ///
+    /// \brief MPMCRing
+    ///
+    /// \param capacity minimum number of items the ring can hold
+    ///
+    explicit MPMCRing( size_t capacity )
+        : m_mask( round_up_to_power_of_two( capacity ) - 1 )
+        , m_slots( new Slot[m_mask + 1] )
+        , m_enqueue_pos( 0 )
+        , m_dequeue_pos( 0 )
+    {
+        for ( size_t i = 0; i <= m_mask; ++i )
+        {
+            m_slots[i].sequence.store( i, std::memory_order_relaxed );
+        }
+    }
+
+    MPMCRing( MPMCRing const & ) = delete;
+    MPMCRing &operator=( MPMCRing const & ) = delete;
+
+    ~MPMCRing()
+    {
+        T discard;
+        while ( try_pop( discard ) )
+        {
+        }
+    }
+
+    ///
+    /// \brief try_emplace
+    ///
+    /// Construct an item in the next free slot
+    ///
+    /// \return false if the ring is full
+    ///
+    template <typename... Args>
+    bool try_emplace( Args &&... args )
+    {
+        size_t pos = m_enqueue_pos.load( std::memory_order_relaxed );
+        Slot *slot;
+        while ( true )
+        {
+            slot = &m_slots[pos & m_mask];
+            size_t seq = slot->sequence.load( std::memory_order_acquire );
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if ( dif == 0 )
+            {
+                if ( m_enqueue_pos.compare_exchange_weak(
+                         pos, pos + 1, std::memory_order_relaxed ) )
+                {
+                    break;
+                }
+            }
+            else if ( dif < 0 )
+            {
+                // The slot still holds an item from the previous lap
+                return false;
+            }
+            else
+            {
+                pos = m_enqueue_pos.load( std::memory_order_relaxed );
+            }
+        }
+        new ( slot->item() ) T( std::forward<Args>( args )... );
+        slot->sequence.store( pos + 1, std::memory_order_release );
+        return true;
+    }
+
+    ///
+    /// \brief try_push
+    ///
+    /// Move an item into the next free slot
+    ///
+    /// \return false if the ring is full
+    ///
+    bool try_push( T &&item ) { return try_emplace( std::move( item ) ); }
+
+    ///
+    /// \brief try_pop
+    ///
+    /// Move the oldest item out of the ring
+    ///
+    /// \param item destination for the item
+    /// \return false if the ring is empty
+    ///
+    bool try_pop( T &item )
+    {
+        size_t pos = m_dequeue_pos.load( std::memory_order_relaxed );
+        Slot *slot;
+        while ( true )
+        {
+            slot = &m_slots[pos & m_mask];
+            size_t seq = slot->sequence.load( std::memory_order_acquire );
+            intptr_t dif = (intptr_t)seq - (intptr_t)( pos + 1 );
+            if ( dif == 0 )
+            {
+                if ( m_dequeue_pos.compare_exchange_weak(
+                         pos, pos + 1, std::memory_order_relaxed ) )
+                {
+                    break;
+                }
+            }
+            else if ( dif < 0 )
+            {
+                // The slot has not been written for this lap yet
+                return false;
+            }
+            else
+            {
+                pos = m_dequeue_pos.load( std::memory_order_relaxed );
+            }
+        }
+        item = std::move( *slot->item() );
+        slot->item()->~T();
+        slot->sequence.store( pos + m_mask + 1, std::memory_order_release );
+        return true;
+    }
+
+    ///
+    /// \brief capacity
+    ///
+    /// \return the maximum number of items the ring can hold
+    ///
+    size_t capacity() const { return m_mask + 1; }
+
+    ///
+    /// \brief size_approx
+    ///
+    /// \return the number of items in the ring. This is only a snapshot
+    /// and may be stale by the time it is used
+    ///
+    size_t size_approx() const
+    {
+        size_t tail = m_dequeue_pos.load( std::memory_order_acquire );
+        size_t head = m_enqueue_pos.load( std::memory_order_acquire );
+        return head > tail ? head - tail : 0;
+    }
+
+    ///
+    /// \brief empty_approx
+    ///
+    /// \return true if the ring appeared empty at the time of the call
+    ///
+    bool empty_approx() const { return size_approx() == 0; }
+
+  private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof( T ), alignof( T )>::type storage;
+
+        T *item() { return reinterpret_cast<T *>( &storage ); }
+    };
+
+    static size_t round_up_to_power_of_two( size_t v )
+    {
+        size_t r = 2;
+        while ( r < v )
+        {
+            r <<= 1;
+        }
+        return r;
+    }
+
+    size_t const m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+
+    char m_pad0[cache_line_size];
+    std::atomic<size_t> m_enqueue_pos;
+    char m_pad1[cache_line_size - sizeof( std::atomic<size_t> )];
+    std::atomic<size_t> m_dequeue_pos;
+    char m_pad2[cache_line_size - sizeof( std::atomic<size_t> )];
+};
+}
+
+#endif // LAMBDASTEW_MPMCRING_HPP
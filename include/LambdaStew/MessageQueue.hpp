@@ -3,21 +3,31 @@
 
 #include "Log.hpp"
 #include "Signaler.hpp"
+#include "MPMCRing.hpp"
+#include "Task.hpp"
+#include "StopToken.hpp"
+#include "QueueStats.hpp"
+#include "TimerScheduler.hpp"
 
 #include <functional>
 #include <vector>
 #include <algorithm>
 #include <thread>
-#include <queue>
+#include <deque>
 #include <future>
+#include <memory>
 
 namespace LambdaStew
 {
 using std::function;
-using std::queue;
+using std::deque;
 using std::vector;
 using std::swap;
 
+class ShardedMessageQueue;
+class WaitSet;
+class EventLoop;
+
 ///
 /// \brief The MessageQueue class
 ///
@@ -28,6 +38,219 @@ class MessageQueue
     {
     };
 
+    ///
+    /// \brief The Backend enum
+    ///
+    /// Selects how the items of a MessageQueue are stored
+    ///
+    enum class Backend
+    {
+        /// An unbounded std::deque guarded by a mutex
+        locked_queue,
+        /// A bounded lock-free multi-producer / multi-consumer ring
+        lock_free_ring
+    };
+
+    ///
+    /// \brief The Status enum
+    ///
+    /// The result of waiting on a MessageQueue
+    ///
+    enum class Status
+    {
+        /// A function was called
+        invoked,
+        /// No function arrived before the timeout
+        timeout,
+        /// The queue was closed and every queued function has been called
+        closed,
+        /// The queue was stopped, or the consumer's StopToken was triggered
+        stopped
+    };
+
+    ///
+    /// \brief The Overflow enum
+    ///
+    /// What a push does when the queue holds as many items as its capacity,
+    /// see set_capacity()
+    ///
+    enum class Overflow
+    {
+        /// Wait for a consumer to free a slot, up to the block timeout
+        block,
+        /// Fail the push
+        reject,
+        /// Drop the oldest item of the lowest non-empty lane to make room
+        drop_oldest,
+        /// Drop the item being pushed
+        drop_newest
+    };
+
+    ///
+    /// \brief default_ring_capacity
+    ///
+    /// The number of slots used for a lock_free_ring backend when no
+    /// capacity is given
+    ///
+    static const size_t default_ring_capacity = 1024;
+
+    ///
+    /// \brief max_lanes
+    ///
+    /// The most priority lanes a queue can have
+    ///
+    static const unsigned max_lanes = QueueStatsSnapshot::max_lanes;
+
+    ///
+    /// \brief MessageQueue
+    ///
+    /// \param backend the storage backend for this queue
+    /// \param ring_capacity the number of slots in the ring when backend is
+    /// Backend::lock_free_ring, rounded up to a power of two. Each lane has
+    /// a ring of its own
+    /// \param lanes the number of priority lanes, from 1 to max_lanes
+    ///
+    explicit MessageQueue( Backend backend = Backend::locked_queue,
+                           size_t ring_capacity = default_ring_capacity,
+                           unsigned lanes = 1 );
+
+    ///
+    /// \brief ~MessageQueue
+    ///
+    /// Cancels the timers which still target this queue
+    ///
+    ~MessageQueue();
+
+    MessageQueue( MessageQueue const & ) = delete;
+    MessageQueue &operator=( MessageQueue const & ) = delete;
+
+    ///
+    /// \brief backend
+    ///
+    /// \return the storage backend selected for this queue
+    ///
+    Backend backend() const
+    {
+        return m_rings.empty() ? Backend::locked_queue
+                               : Backend::lock_free_ring;
+    }
+
+    ///
+    /// \brief lanes
+    ///
+    /// \return the number of priority lanes of the queue
+    ///
+    unsigned lanes() const
+    {
+        return unsigned( m_rings.empty() ? m_lanes.size() : m_rings.size() );
+    }
+
+    ///
+    /// \brief lane_size
+    ///
+    /// \return the number of items in one lane. With the lock_free_ring
+    /// backend this is a snapshot only
+    ///
+    size_t lane_size( unsigned lane ) const;
+
+    ///
+    /// \brief set_aging
+    ///
+    /// Turn on anti-starvation aging. A non-empty lane which has not been
+    /// served for max_wait is served before the higher lanes, the one
+    /// waiting longest first. Zero, the default, turns aging off so that
+    /// the highest non-empty lane always goes first
+    ///
+    /// \param max_wait the longest a lane waits while higher lanes are busy
+    ///
+    template <typename DurationT>
+    void set_aging( DurationT max_wait )
+    {
+        set_aging_ns(
+            std::chrono::duration_cast<std::chrono::nanoseconds>( max_wait )
+                .count() );
+    }
+
+    ///
+    /// \brief set_capacity
+    ///
+    /// Bound the number of items in all lanes of the queue. A push which
+    /// finds the queue full does what overflow says; try_push() never
+    /// waits, so with Overflow::block it fails instead. Please-stop items,
+    /// timer tasks and strand runners are always admitted, so a full queue
+    /// can not hold up shutdown or the timer thread
+    ///
+    /// \param capacity the most items, or 0, the default, for no bound. The
+    /// lock_free_ring backend is also bounded by the size of its rings, and
+    /// producers racing for the last slot may overshoot it by a few items
+    /// \param overflow what a push does when the queue is full
+    /// \param block_timeout the longest a push waits with Overflow::block
+    /// before it fails
+    ///
+    template <typename DurationT>
+    void set_capacity( size_t capacity,
+                       Overflow overflow,
+                       DurationT block_timeout )
+    {
+        set_capacity_ns(
+            capacity,
+            overflow,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                block_timeout ).count() );
+    }
+
+    ///
+    /// \brief set_capacity
+    ///
+    /// As set_capacity( capacity, overflow, block_timeout ), with
+    /// Overflow::block waiting as long as it takes
+    ///
+    void set_capacity( size_t capacity, Overflow overflow = Overflow::block )
+    {
+        set_capacity_ns(
+            capacity, overflow, std::chrono::nanoseconds::max().count() );
+    }
+
+    ///
+    /// \brief capacity
+    ///
+    /// \return the capacity of set_capacity(), or 0 if there is none
+    ///
+    size_t capacity() const { return m_capacity.load(); }
+
+    ///
+    /// \brief overflow
+    ///
+    /// \return the overflow policy of set_capacity()
+    ///
+    Overflow overflow() const { return Overflow( m_overflow.load() ); }
+
+    ///
+    /// \brief dropped
+    ///
+    /// \return the number of items dropped by Overflow::drop_oldest and
+    /// Overflow::drop_newest
+    ///
+    uint64_t dropped() const { return m_dropped.load(); }
+
+    ///
+    /// \brief rejected
+    ///
+    /// \return the number of pushes which failed because the queue was full,
+    /// including those which timed out with Overflow::block
+    ///
+    uint64_t rejected() const { return m_rejected.load(); }
+
+    ///
+    /// \brief blocked_producers
+    ///
+    /// \return the number of threads currently waiting for a free slot
+    ///
+    size_t blocked_producers() const
+    {
+        return m_blocked_producers.load( std::memory_order_relaxed );
+    }
+
     ///
     /// \brief make_please_stop_item
     ///
@@ -42,47 +265,375 @@ class MessageQueue
     ///
     /// \brief push_back_please_stop
     ///
-    /// Put a 'please_stop' item into the queue to ask all consumers to stop
-    /// processing cleanly
+    /// Put a 'please_stop' item into the highest lane of the queue to ask
+    /// all consumers to stop processing cleanly
     ///
     void push_back_please_stop();
 
     ///
     /// \brief invoke
     ///
-    /// Call one function from the queue and remove it
+    /// Call one function from the queue and remove it, taking it from the
+    /// highest non-empty lane
     ///
     bool invoke();
 
+    ///
+    /// \brief invoke_batch
+    ///
+    /// Remove up to max_n functions from the front of the queue while
+    /// holding the lock once, then call them in order without the lock.
+    /// The batch takes from the lanes in the order invoke() would.
+    ///
+    /// If one of the functions throws, the functions of the batch which were
+    /// not yet called are put back at the front of their lanes before the
+    /// exception is re-thrown.
+    ///
+    /// \param max_n the maximum number of functions to call
+    /// \return the number of functions called
+    ///
+    size_t invoke_batch( size_t max_n );
+
+    ///
+    /// \brief drain
+    ///
+    /// Call every function which is in the queue at the time of the call.
+    /// Functions added while draining are left for a later call.
+    ///
+    /// \return the number of functions called
+    ///
+    size_t drain();
+
+    ///
+    /// \brief wait_and_invoke
+    ///
+    /// Call one function from the queue, waiting up to timeout for one to be
+    /// added if the queue is empty. The caller is counted as an idle consumer
+    /// while it waits, and every push wakes as many idle consumers as it
+    /// added items
+    ///
+    /// \param timeout the longest time to wait for an item
+    /// \return Status::invoked if a function was called, Status::timeout if
+    /// none arrived in time, Status::closed once a closed queue is empty or
+    /// Status::stopped once the queue is stopped
+    ///
+    template <typename TimeT>
+    Status wait_and_invoke( TimeT timeout )
+    {
+        return wait_and_invoke_ns(
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ),
+            nullptr );
+    }
+
+    ///
+    /// \brief wait_and_invoke
+    ///
+    /// As wait_and_invoke( timeout ), but also returns Status::stopped
+    /// as soon as stop_token is triggered through request_stop()
+    ///
+    template <typename TimeT>
+    Status wait_and_invoke( TimeT timeout, StopToken const &stop_token )
+    {
+        return wait_and_invoke_ns(
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ),
+            &stop_token );
+    }
+
+    ///
+    /// \brief close
+    ///
+    /// Reject all new functions. Consumers keep calling the functions which
+    /// are already queued, and wait_and_invoke() returns Status::closed once
+    /// the queue is empty
+    ///
+    void close();
+
+    ///
+    /// \brief stop
+    ///
+    /// Reject all new functions and release every consumer waiting in
+    /// wait_and_invoke() at once with Status::stopped. Functions still in the
+    /// queue are left there
+    ///
+    void stop();
+
+    ///
+    /// \brief drain_and_stop
+    ///
+    /// close() the queue, wait for the consumers to take every queued function
+    /// and to finish the batches taken by invoke_batch(), or for the deadline
+    /// to pass, then stop() the queue
+    ///
+    /// \param deadline the latest time to wait until
+    /// \return true if the queue was empty before the deadline
+    ///
+    bool drain_and_stop( std::chrono::steady_clock::time_point deadline );
+
+    ///
+    /// \brief is_closed
+    ///
+    /// \return true if the queue rejects new functions
+    ///
+    bool is_closed() const { return m_state.load() != state_open; }
+
+    ///
+    /// \brief is_stopped
+    ///
+    /// \return true if stop() or drain_and_stop() has completed
+    ///
+    bool is_stopped() const { return m_state.load() == state_stopped; }
+
+    ///
+    /// \brief request_stop
+    ///
+    /// Trigger stop_source and wake the consumers waiting on this queue so
+    /// that those holding one of its tokens return Status::stopped
+    ///
+    void request_stop( StopSource &stop_source );
+
+    ///
+    /// \brief idle_consumers
+    ///
+    /// \return the number of threads currently waiting in wait_and_invoke()
+    ///
+    size_t idle_consumers() const
+    {
+        return m_idle_consumers.load( std::memory_order_relaxed );
+    }
+
+    ///
+    /// \brief try_invoke
+    ///
+    /// Call one function from the queue and remove it, without ever
+    /// blocking. With the locked_queue backend this gives up if another
+    /// thread holds the queue lock.
+    ///
+    /// \return true if a function was called
+    ///
+    bool try_invoke();
+
     ///
     /// \brief empty
     ///
-    /// \return true if the queue is currently empty
+    /// \return true if the queue is currently empty. With the lock_free_ring
+    /// backend this is a snapshot only
     ///
     bool empty() const;
 
     ///
     /// \brief push_back
     ///
-    /// Add item to the queue
+    /// Move a task to the back of lane 0, the lowest priority lane. If the
+    /// queue is full this waits, fails or drops as set_capacity() says
+    ///
+    /// \param task the task to add
+    /// \param notify_all bool set to true to wake all threads, false to wake
+    /// only one
+    /// \return false if the queue is closed or the push was rejected, in
+    /// which case the task is left untouched. A task dropped by
+    /// Overflow::drop_newest is destroyed and counts as pushed
+    ///
+    bool push_back( Task &&task, bool notify_all = false )
+    {
+        return push_back_lane( 0, std::move( task ), notify_all );
+    }
+
+    ///
+    /// \brief push_back
+    ///
+    /// Add item to the queue. The callable is constructed directly inside a
+    /// Task, so closures that fit in Task::inline_size bytes are never copied
+    /// into a separate heap allocation
     ///
     /// \param func callable function which takes no parameters and returns void
     /// \param notify_all bool set to true to wake all threads, false to wake
     /// only one
+    /// \return false if the queue is closed or the push was rejected
     ///
-    void push_back( function<void()> func, bool notify_all = false );
+    template <typename F>
+    typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value,
+        bool>::type
+        push_back( F &&func, bool notify_all = false )
+    {
+        return push_back( Task( std::forward<F>( func ) ), notify_all );
+    }
 
     ///
-    /// \brief skip_next
+    /// \brief push_back_lane
     ///
-    /// Remove the next item from the queue without calling it
+    /// Move a task to the back of a priority lane. Higher lanes are served
+    /// first
+    ///
+    /// \param lane the lane, clamped to lanes() - 1
+    /// \param task the task to add
+    /// \param notify_all bool set to true to wake all threads, false to wake
+    /// only one
+    /// \return false if the queue is closed or the push was rejected, in
+    /// which case the task is left untouched
+    ///
+    bool push_back_lane( unsigned lane, Task &&task, bool notify_all = false )
+    {
+        return enqueue( lane, std::move( task ), notify_all, Admission::wait );
+    }
+
+    ///
+    /// \brief push_back_lane
+    ///
+    /// Add item to a priority lane, see push_back_lane( lane, Task && )
+    ///
+    template <typename F>
+    typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value,
+        bool>::type
+        push_back_lane( unsigned lane, F &&func, bool notify_all = false )
+    {
+        return push_back_lane(
+            lane, Task( std::forward<F>( func ) ), notify_all );
+    }
+
+    ///
+    /// \brief push_back_bulk
+    ///
+    /// Move all the tasks to the back of lane 0 while holding the lock
+    /// once, sending at most one signal.
+    ///
+    /// \param tasks the tasks to add. The vector is left empty but keeps its
+    /// capacity so that it can be refilled without allocating
+    /// \param notify_all bool set to true to wake all threads, false to wake
+    /// only as few as needed
+    /// \return false if the queue is closed or the push was rejected. The
+    /// tasks which were queued before that are removed from tasks and the
+    /// rest are left untouched
     ///
-    void skip_next()
+    bool push_back_bulk( vector<Task> &tasks, bool notify_all = false )
     {
-        lock_guard<mutex> guard( m_items_mutex );
-        m_items.pop();
+        return enqueue_bulk( tasks, notify_all, Admission::wait );
     }
 
+    ///
+    /// \brief push_back_range
+    ///
+    /// Add a Task constructed from each callable in [first, last) to the back
+    /// of the queue, in order, while holding the lock once. Use
+    /// std::make_move_iterator to move the callables instead of copying them
+    ///
+    /// \param first iterator to the first callable
+    /// \param last iterator past the last callable
+    /// \param notify_all bool set to true to wake all threads, false to wake
+    /// only as few as needed
+    /// \return false if the queue is closed
+    ///
+    template <typename Iterator>
+    bool push_back_range( Iterator first, Iterator last, bool notify_all = false )
+    {
+        vector<Task> &tasks = bulk_buffer();
+        tasks.clear();
+        for ( ; first != last; ++first )
+        {
+            tasks.emplace_back( *first );
+        }
+        bool r = push_back_bulk( tasks, notify_all );
+        tasks.clear();
+        return r;
+    }
+
+    ///
+    /// \brief try_push
+    ///
+    /// Move a task to the back of a lane without waiting for space.
+    /// The task is left untouched if it could not be added
+    ///
+    /// \param task the task to add
+    /// \param notify_all bool set to true to wake all threads, false to wake
+    /// only one
+    /// \param lane the lane, clamped to lanes() - 1
+    /// \return false if the queue is full and its overflow policy is
+    /// Overflow::block or Overflow::reject, if the lock_free_ring backend is
+    /// full, or if the queue is closed
+    ///
+    bool try_push( Task &&task, bool notify_all = false, unsigned lane = 0 )
+    {
+        return enqueue( lane, std::move( task ), notify_all, Admission::no_wait );
+    }
+
+    ///
+    /// \brief push_back_at
+    ///
+    /// Add func to the queue at a point in time, with the resolution of
+    /// TimerScheduler::tick_ns. The function is pushed by the timer thread
+    /// together with every other function due at the same tick
+    ///
+    /// \param when the time to add func at
+    /// \param func callable function which takes no parameters and returns void
+    /// \return the id of the timer for cancel_timer(), or 0 if the queue is
+    /// closed
+    ///
+    template <typename F>
+    TimerId push_back_at( std::chrono::steady_clock::time_point when, F &&func )
+    {
+        return schedule_at( when, Task( std::forward<F>( func ) ) );
+    }
+
+    ///
+    /// \brief push_back_after
+    ///
+    /// Add func to the queue once delay has passed, see push_back_at()
+    ///
+    template <typename DurationT, typename F>
+    TimerId push_back_after( DurationT delay, F &&func )
+    {
+        typedef std::chrono::steady_clock clock;
+        return schedule_at(
+            clock::now() + std::chrono::duration_cast<clock::duration>( delay ),
+            Task( std::forward<F>( func ) ) );
+    }
+
+    ///
+    /// \brief push_back_every
+    ///
+    /// Add a copy of func to the queue every period, starting one period
+    /// from now, until the timer is cancelled or the queue is closed. The
+    /// schedule does not drift with the time the copies take to run
+    ///
+    /// \param period the interval, at least TimerScheduler::tick_ns
+    /// \param func copyable callable function which takes no parameters and
+    /// returns void
+    /// \return the id of the timer for cancel_timer(), or 0 if the queue is
+    /// closed
+    ///
+    template <typename DurationT, typename F>
+    TimerId push_back_every( DurationT period, F &&func )
+    {
+        return schedule_every(
+            std::chrono::duration_cast<std::chrono::nanoseconds>( period ),
+            std::function<void()>( std::forward<F>( func ) ) );
+    }
+
+    ///
+    /// \brief cancel_timer
+    ///
+    /// Cancel a timer of push_back_at(), push_back_after() or
+    /// push_back_every()
+    ///
+    /// \return false if the timer already fired or was cancelled
+    ///
+    bool cancel_timer( TimerId id );
+
+    ///
+    /// \brief pending_timers
+    ///
+    /// \return the number of timers which will still add to this queue
+    ///
+    size_t pending_timers() const { return m_pending_timers.load(); }
+
+    ///
+    /// \brief skip_next
+    ///
+    /// Remove the next item from the queue without calling it
+    ///
+    void skip_next();
+
     ///
     /// \brief signaler
     ///
@@ -92,15 +643,410 @@ class MessageQueue
     ///
     Signaler &signaler() { return m_signaler; }
 
+    ///
+    /// \brief size
+    ///
+    /// \return the number of items in all lanes of the queue. With the
+    /// lock_free_ring backend this is a snapshot only
+    ///
     size_t size() const;
 
+    ///
+    /// \brief size_approx
+    ///
+    /// \return the number of items in all lanes of the queue, read without
+    /// taking the lock. It may be stale by the time it is used
+    ///
+    size_t size_approx() const;
+
+    ///
+    /// \brief enable_stats
+    ///
+    /// Start collecting QueueStats for this queue. Until this is called the
+    /// queue does no timing or counting at all. Items queued before the
+    /// call are counted but have no residency time
+    ///
+    void enable_stats();
+
+    ///
+    /// \brief stats_enabled
+    ///
+    /// \return true if enable_stats() has been called
+    ///
+    bool stats_enabled() const { return m_stats.load() != nullptr; }
+
+    ///
+    /// \brief stats_snapshot
+    ///
+    /// \return a copy of the statistics of the queue. Only depth is filled
+    /// in if stats are not enabled
+    ///
+    QueueStatsSnapshot stats_snapshot() const;
+
   private:
+    friend class TimerScheduler;
+    friend class Strand;
+    friend class ShardedMessageQueue;
+    friend class WaitSet;
+    friend class EventLoop;
+
+    ///
+    /// \brief The Item struct
+    ///
+    /// A queued task and the time it was queued, if stats were enabled
+    ///
+    struct Item
+    {
+        Item() : enqueued_at( 0 ), forced( false ) {}
+
+        Item( Task &&t, int64_t when, bool force = false )
+            : task( std::move( t ) ), enqueued_at( when ), forced( force )
+        {
+        }
+
+        Task task;
+        int64_t enqueued_at;
+
+        /// Admitted past the capacity, so Overflow::drop_oldest keeps it
+        bool forced;
+    };
+
+    ///
+    /// \brief The Admission enum
+    ///
+    /// How a push treats a full queue
+    ///
+    enum class Admission
+    {
+        /// Apply the overflow policy, waiting if it is Overflow::block
+        wait,
+        /// Apply the overflow policy, failing if it is Overflow::block
+        no_wait,
+        /// Ignore the capacity. Used for the queue's own items
+        force,
+        /// Ignore the capacity, but fail rather than wait for a full ring
+        force_no_wait
+    };
+
+    ///
+    /// \brief The Full enum
+    ///
+    /// What a push does next after finding the queue full
+    ///
+    enum class Full
+    {
+        /// Try to add the task again
+        retry,
+        /// Fail the push
+        reject,
+        /// Drop the task and the ones after it
+        discard
+    };
+
+    ///
+    /// The values of m_state
+    ///
+    static const int state_open = 0;
+    static const int state_closed = 1;
+    static const int state_stopped = 2;
+
+    ///
+    /// \brief wait_and_invoke_ns
+    ///
+    /// The implementation of wait_and_invoke()
+    ///
+    Status wait_and_invoke_ns( std::chrono::nanoseconds timeout,
+                               StopToken const *stop_token );
+
+    ///
+    /// \brief schedule_at
+    ///
+    /// The implementation of push_back_at() and push_back_after()
+    ///
+    TimerId schedule_at( std::chrono::steady_clock::time_point when,
+                         Task &&task );
+
+    ///
+    /// \brief schedule_every
+    ///
+    /// The implementation of push_back_every()
+    ///
+    TimerId schedule_every( std::chrono::nanoseconds period,
+                            std::function<void()> const &func );
+
+    ///
+    /// \brief set_aging_ns
+    ///
+    /// The implementation of set_aging()
+    ///
+    void set_aging_ns( int64_t max_wait_ns );
+
+    ///
+    /// \brief set_capacity_ns
+    ///
+    /// The implementation of set_capacity()
+    ///
+    void set_capacity_ns( size_t capacity,
+                          Overflow overflow,
+                          int64_t block_timeout_ns );
+
+    ///
+    /// \brief enqueue
+    ///
+    /// The implementation of push_back_lane() and try_push()
+    ///
+    bool enqueue( unsigned lane,
+                  Task &&task,
+                  bool notify_all,
+                  Admission admission );
+
+    ///
+    /// \brief enqueue_bulk
+    ///
+    /// The implementation of push_back_bulk()
+    ///
+    bool enqueue_bulk( vector<Task> &tasks,
+                       bool notify_all,
+                       Admission admission );
+
+    ///
+    /// \brief enqueue_tasks
+    ///
+    /// Move tasks to the back of a lane in order, applying the overflow
+    /// policy to each one which finds the queue full
+    ///
+    /// \param done set to the number of leading tasks which were queued or
+    /// dropped by Overflow::drop_newest. Dropped tasks are left in place for
+    /// the caller to destroy, and the tasks after done are untouched
+    /// \param dropped receives the items dropped by Overflow::drop_oldest,
+    /// so that the caller destroys them after the lock is released
+    /// \return false if the queue is closed or the push was rejected
+    ///
+    bool enqueue_tasks( unsigned lane,
+                        Task *tasks,
+                        size_t count,
+                        bool notify_all,
+                        Admission admission,
+                        vector<Item> &dropped,
+                        size_t &done );
+
+    ///
+    /// \brief announce
+    ///
+    /// items_added() for the tasks of a push which are queued so far, and
+    /// reset added. With the locked_queue backend the caller holds
+    /// m_items_mutex
+    ///
+    void announce( unsigned lane, size_t &added, bool notify_all );
+
+    ///
+    /// \brief on_full
+    ///
+    /// Apply the overflow policy for a push which found the queue full. With
+    /// the locked_queue backend guard holds m_items_mutex, and is unlocked
+    /// while waiting
+    ///
+    /// \param added the tasks of this push which are queued but not yet
+    /// announced to consumers. They are announced before waiting, and added
+    /// is reset
+    ///
+    Full on_full( unsigned lane,
+                  Admission admission,
+                  unique_lock<mutex> *guard,
+                  size_t &added,
+                  bool notify_all,
+                  std::chrono::steady_clock::time_point &deadline,
+                  vector<Item> &dropped );
+
+    ///
+    /// \brief wait_for_space
+    ///
+    /// Wait for a consumer to take an item from a full queue, see on_full()
+    ///
+    /// \param deadline the time to give up at, computed from the block
+    /// timeout on the first call of a push
+    /// \return false if the deadline had passed
+    ///
+    bool wait_for_space( unique_lock<mutex> *guard,
+                         std::chrono::steady_clock::time_point &deadline );
+
+    ///
+    /// \brief drop_oldest
+    ///
+    /// Move the oldest item of the lowest non-empty lane out of the queue,
+    /// passing over items admitted with Admission::force: please-stop items,
+    /// strand runners and timer tasks would leave their consumers, strands
+    /// or timers waiting forever if they were lost. With the locked_queue
+    /// backend the caller holds m_items_mutex
+    ///
+    /// \return true if there was an item which could be dropped
+    ///
+    bool drop_oldest( Item &item );
+
+    ///
+    /// \brief select_lane
+    ///
+    /// Choose the lane to serve next: the highest lane in bits, unless
+    /// aging is on and a lower lane in bits has waited too long
+    ///
+    /// \param bits the non-empty lanes, not 0
+    ///
+    unsigned select_lane( uint32_t bits ) const;
+
+    ///
+    /// \brief lane_served
+    ///
+    /// Record that a lane was served or became non-empty, when aging is on
+    ///
+    void lane_served( unsigned lane )
+    {
+        if ( m_aging_ns.load( std::memory_order_relaxed ) )
+        {
+            m_lane_served[lane].store( QueueStats::now_ns(),
+                                       std::memory_order_relaxed );
+        }
+    }
+
+    ///
+    /// \brief lane_added
+    ///
+    /// Mark a lane of a locked_queue queue non-empty. The caller holds
+    /// m_items_mutex
+    ///
+    void lane_added( unsigned lane )
+    {
+        m_lane_bits.store( m_lane_bits.load( std::memory_order_relaxed )
+                           | ( 1u << lane ) );
+        lane_served( lane );
+    }
+
+    ///
+    /// \brief ring_lane_added
+    ///
+    /// Mark a lane of a lock_free_ring queue non-empty after adding to its
+    /// ring
+    ///
+    void ring_lane_added( unsigned lane )
+    {
+        if ( m_rings.size() > 1 )
+        {
+            uint32_t const bit = 1u << lane;
+            if ( !( m_lane_bits.fetch_or( bit ) & bit ) )
+            {
+                lane_served( lane );
+            }
+        }
+    }
+
+    ///
+    /// \brief add_depth
+    ///
+    /// Adjust m_depth of a locked_queue queue. The caller holds
+    /// m_items_mutex, so a plain load and store is enough
+    ///
+    void add_depth( size_t n )
+    {
+        m_depth.store( m_depth.load( std::memory_order_relaxed ) + n,
+                       std::memory_order_relaxed );
+    }
+
+    void sub_depth( size_t n )
+    {
+        m_depth.store( m_depth.load( std::memory_order_relaxed ) - n,
+                       std::memory_order_relaxed );
+    }
+
+    ///
+    /// \brief locked_size
+    ///
+    /// \return the number of items in all lanes of a locked_queue queue. The
+    /// caller holds m_items_mutex
+    ///
+    size_t locked_size() const;
+
+    ///
+    /// \brief pop_ring
+    ///
+    /// Move the next item out of the rings of a lock_free_ring queue
+    ///
+    bool pop_ring( Item &item );
+
+    ///
+    /// \brief items_added
+    ///
+    /// Update the stats and wake waiting consumers after item_count items
+    /// were added
+    ///
+    /// \param item_count the number of items added
+    /// \param depth the size of the queue after adding them
+    /// \param notify_all true to wake every waiting consumer
+    ///
+    void items_added( size_t item_count, size_t depth, bool notify_all );
+
+    ///
+    /// \brief items_removed
+    ///
+    /// Update the stats after count items were taken, and wake
+    /// drain_and_stop() if a closed queue has been emptied
+    ///
+    void items_removed( size_t count, bool now_empty );
+
+    ///
+    /// \brief enqueue_time
+    ///
+    /// \return the time stamp for a new item, or 0 if stats are disabled
+    ///
+    int64_t enqueue_time() const;
+
+    ///
+    /// \brief bulk_buffer
+    ///
+    /// \return a per-thread vector used by push_back_range to gather tasks
+    /// without allocating on every call
+    ///
+    static vector<Task> &bulk_buffer();
+
+    ///
+    /// \brief pop_front
+    ///
+    /// Move the next item out of the queue
+    ///
+    /// \param item destination for the item
+    /// \param wait_for_lock false to give up if the lock is contended
+    /// \return true if an item was removed
+    ///
+    bool pop_front( Item &item, bool wait_for_lock );
+
+    ///
+    /// \brief batch_finished
+    ///
+    /// Called when invoke_batch() is done with a batch, to let
+    /// drain_and_stop() know once none is left
+    ///
+    void batch_finished();
+
     ///
-    /// \brief m_items
+    /// \brief call
     ///
-    /// The queue of functions to executed in a different thread context
+    /// Call an item which was removed from the queue, logging and
+    /// re-throwing any exception
     ///
-    queue<function<void()> > m_items;
+    void call( Task &item_to_execute );
+
+    ///
+    /// \brief run
+    ///
+    /// call() the task of an item, timing it if stats are enabled
+    ///
+    void run( Item &item );
+
+    ///
+    /// \brief m_lanes
+    ///
+    /// The queues of functions to executed in a different thread context,
+    /// one per priority lane
+    ///
+    vector<deque<Item> > m_lanes;
 
     ///
     /// \brief m_items_mutex
@@ -109,6 +1055,46 @@ class MessageQueue
     ///
     mutable mutex m_items_mutex;
 
+    ///
+    /// \brief m_depth
+    ///
+    /// The number of items in m_lanes, for size_approx(). Changed under
+    /// m_items_mutex
+    ///
+    std::atomic<size_t> m_depth;
+
+    ///
+    /// \brief m_rings
+    ///
+    /// The lock-free rings used instead of m_lanes when the backend is
+    /// Backend::lock_free_ring, one per priority lane
+    ///
+    vector<std::unique_ptr<MPMCRing<Item> > > m_rings;
+
+    ///
+    /// \brief m_lane_bits
+    ///
+    /// Bit n is set while lane n is non-empty. With the locked_queue
+    /// backend it is changed under m_items_mutex. A lock_free_ring queue with
+    /// one lane does not use it
+    ///
+    std::atomic<uint32_t> m_lane_bits;
+
+    ///
+    /// \brief m_lane_served
+    ///
+    /// The QueueStats::now_ns() at which each lane was last served or
+    /// became non-empty, kept while aging is on
+    ///
+    std::atomic<int64_t> m_lane_served[max_lanes];
+
+    ///
+    /// \brief m_aging_ns
+    ///
+    /// The aging time of set_aging(), or 0 if aging is off
+    ///
+    std::atomic<int64_t> m_aging_ns;
+
     ///
     /// \brief m_signaler
     ///
@@ -116,6 +1102,126 @@ class MessageQueue
     /// to be added to the queue
     ///
     Signaler m_signaler;
+
+    ///
+    /// \brief m_idle_consumers
+    ///
+    /// The number of threads waiting in wait_and_invoke()
+    ///
+    std::atomic<size_t> m_idle_consumers;
+
+    ///
+    /// \brief m_state
+    ///
+    /// One of state_open, state_closed or state_stopped
+    ///
+    std::atomic<int> m_state;
+
+    ///
+    /// \brief m_capacity
+    ///
+    /// The capacity of set_capacity(), or 0 for none
+    ///
+    std::atomic<size_t> m_capacity;
+
+    ///
+    /// \brief m_overflow
+    ///
+    /// The Overflow policy of set_capacity()
+    ///
+    std::atomic<int> m_overflow;
+
+    ///
+    /// \brief m_block_timeout_ns
+    ///
+    /// The block timeout of set_capacity()
+    ///
+    std::atomic<int64_t> m_block_timeout_ns;
+
+    ///
+    /// \brief m_space_signaler
+    ///
+    /// Signalled when consumers take items while producers are blocked on
+    /// a full queue
+    ///
+    Signaler m_space_signaler;
+
+    ///
+    /// \brief m_blocked_producers
+    ///
+    /// The number of threads waiting in wait_for_space()
+    ///
+    std::atomic<size_t> m_blocked_producers;
+
+    ///
+    /// \brief m_dropped
+    ///
+    /// The number of items dropped by the overflow policy
+    ///
+    std::atomic<uint64_t> m_dropped;
+
+    ///
+    /// \brief m_rejected
+    ///
+    /// The number of pushes rejected because the queue was full
+    ///
+    std::atomic<uint64_t> m_rejected;
+
+    ///
+    /// \brief m_drained_signaler
+    ///
+    /// Signalled when a consumer takes the last item from a closed queue
+    ///
+    Signaler m_drained_signaler;
+
+    ///
+    /// \brief m_stats
+    ///
+    /// The statistics block, or nullptr until enable_stats() is called
+    ///
+    std::atomic<QueueStats *> m_stats;
+    std::unique_ptr<QueueStats> m_stats_owner;
+
+    ///
+    /// \brief m_pending_timers
+    ///
+    /// The number of TimerScheduler timers targeting this queue, kept by
+    /// the TimerScheduler
+    ///
+    std::atomic<size_t> m_pending_timers;
+
+    ///
+    /// \brief m_group
+    ///
+    /// The ShardedMessageQueue this queue is a shard of, told about every
+    /// push so that its consumers wake, or nullptr
+    ///
+    ShardedMessageQueue *m_group;
+
+    ///
+    /// \brief m_wait_set
+    ///
+    /// The WaitSet this queue belongs to, told about every push, close()
+    /// and stop() so that its consumers wake, or nullptr
+    ///
+    WaitSet *m_wait_set;
+
+    ///
+    /// \brief m_event_loop
+    ///
+    /// The EventLoop which owns this queue, told about every push, close()
+    /// and stop() so that its thread leaves epoll_wait(), or nullptr
+    ///
+    EventLoop *m_event_loop;
+
+    ///
+    /// \brief m_batches_in_flight
+    ///
+    /// The number of batches taken by invoke_batch() which are still being
+    /// called. drain_and_stop() waits for them, as a throwing function puts
+    /// the rest of its batch back
+    ///
+    std::atomic<size_t> m_batches_in_flight;
 };
 }
 
@@ -0,0 +1,342 @@
+#ifndef LAMBDASTEW_QUEUESTATS_HPP
+#define LAMBDASTEW_QUEUESTATS_HPP
+
+#include "MPMCRing.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The ShardedCounter class
+///
+/// A counter which many threads can add to without fighting over one cache
+/// line. Each thread adds to one of a fixed number of padded shards, and
+/// reading the total sums them all
+///
+class ShardedCounter
+{
+  public:
+    static const size_t num_shards = 16;
+
+    ShardedCounter()
+    {
+        for ( size_t i = 0; i < num_shards; ++i )
+        {
+            m_shards[i].value.store( 0, std::memory_order_relaxed );
+        }
+    }
+
+    ShardedCounter( ShardedCounter const & ) = delete;
+    ShardedCounter &operator=( ShardedCounter const & ) = delete;
+
+    ///
+    /// \brief add
+    ///
+    /// Add to the shard of the calling thread
+    ///
+    void add( uint64_t n )
+    {
+        m_shards[thread_shard()].value.fetch_add( n,
+                                                  std::memory_order_relaxed );
+    }
+
+    ///
+    /// \brief total
+    ///
+    /// \return the sum of all the shards
+    ///
+    uint64_t total() const
+    {
+        uint64_t r = 0;
+        for ( size_t i = 0; i < num_shards; ++i )
+        {
+            r += m_shards[i].value.load( std::memory_order_relaxed );
+        }
+        return r;
+    }
+
+    ///
+    /// \brief thread_shard
+    ///
+    /// \return the shard index assigned to the calling thread
+    ///
+    static size_t thread_shard();
+
+  private:
+    struct Shard
+    {
+        std::atomic<uint64_t> value;
+        char pad[cache_line_size - sizeof( std::atomic<uint64_t> )];
+    };
+
+    Shard m_shards[num_shards];
+};
+
+///
+/// \brief The HistogramSnapshot struct
+///
+/// A copy of a LatencyHistogram at one point in time
+///
+struct HistogramSnapshot
+{
+    static const size_t num_buckets = 64;
+
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+
+    ///
+    /// \brief buckets
+    ///
+    /// buckets[0] counts samples of 0ns, buckets[i] counts samples in
+    /// [2^(i-1), 2^i) nanoseconds
+    ///
+    uint64_t buckets[num_buckets];
+
+    ///
+    /// \brief percentile
+    ///
+    /// \param p fraction between 0 and 1
+    /// \return the upper bound in nanoseconds of the bucket holding the
+    /// sample at that percentile
+    ///
+    uint64_t percentile( double p ) const;
+
+    ///
+    /// \brief mean_ns
+    ///
+    /// \return the mean sample in nanoseconds
+    ///
+    uint64_t mean_ns() const { return count ? sum_ns / count : 0; }
+};
+
+///
+/// \brief The LatencyHistogram class
+///
+/// Counts durations in power of two nanosecond buckets using relaxed atomic
+/// increments only
+///
+class LatencyHistogram
+{
+  public:
+    LatencyHistogram();
+
+    LatencyHistogram( LatencyHistogram const & ) = delete;
+    LatencyHistogram &operator=( LatencyHistogram const & ) = delete;
+
+    ///
+    /// \brief record
+    ///
+    /// Add one sample
+    ///
+    /// \param ns duration in nanoseconds
+    ///
+    void record( int64_t ns );
+
+    ///
+    /// \brief snapshot
+    ///
+    /// \return a copy of the current counts
+    ///
+    HistogramSnapshot snapshot() const;
+
+  private:
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum_ns;
+    std::atomic<uint64_t> m_max_ns;
+    std::atomic<uint64_t> m_buckets[HistogramSnapshot::num_buckets];
+};
+
+///
+/// \brief The QueueStatsSnapshot struct
+///
+/// A copy of all the QueueStats of one queue at one point in time
+///
+struct QueueStatsSnapshot
+{
+    ///
+    /// \brief max_lanes
+    ///
+    /// The most priority lanes a MessageQueue can have
+    ///
+    static const unsigned max_lanes = 8;
+
+    uint64_t enqueued;
+    uint64_t dequeued;
+    uint64_t depth;
+    uint64_t high_water;
+
+    ///
+    /// \brief capacity
+    ///
+    /// The capacity of the queue, or 0 if it is unbounded
+    ///
+    uint64_t capacity;
+
+    ///
+    /// \brief dropped
+    ///
+    /// Items dropped by the overflow policy of a full queue
+    ///
+    uint64_t dropped;
+
+    ///
+    /// \brief rejected
+    ///
+    /// Pushes which failed because the queue was full
+    ///
+    uint64_t rejected;
+
+    ///
+    /// \brief lanes
+    ///
+    /// The number of priority lanes of the queue
+    ///
+    unsigned lanes;
+
+    ///
+    /// \brief lane_depth
+    ///
+    /// The depth of each of the first lanes priority lanes
+    ///
+    uint64_t lane_depth[max_lanes];
+
+    ///
+    /// \brief residency
+    ///
+    /// Time from push until the start of execution
+    ///
+    HistogramSnapshot residency;
+
+    ///
+    /// \brief execution
+    ///
+    /// Time spent executing each task
+    ///
+    HistogramSnapshot execution;
+
+    ///
+    /// \brief idle_ns
+    ///
+    /// Total time consumers spent waiting in wait_and_invoke()
+    ///
+    uint64_t idle_ns;
+
+    ///
+    /// \brief busy_ns
+    ///
+    /// Total time consumers spent executing tasks
+    ///
+    uint64_t busy_ns;
+
+    ///
+    /// \brief print_json
+    ///
+    /// Write the snapshot as one JSON object
+    ///
+    std::ostream &print_json( std::ostream &o ) const;
+
+    ///
+    /// \brief to_json
+    ///
+    /// \return the snapshot as a JSON object
+    ///
+    std::string to_json() const;
+};
+
+///
+/// \brief The QueueStats class
+///
+/// The opt-in statistics block of a MessageQueue
+///
+class QueueStats
+{
+  public:
+    QueueStats() : m_high_water( 0 ) {}
+
+    QueueStats( QueueStats const & ) = delete;
+    QueueStats &operator=( QueueStats const & ) = delete;
+
+    ///
+    /// \brief now_ns
+    ///
+    /// \return the steady clock in nanoseconds, never 0
+    ///
+    static int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch() )
+                   .count()
+               | 1;
+    }
+
+    ///
+    /// \brief record_enqueue
+    ///
+    /// \param count the number of items added
+    /// \param depth the depth of the queue after adding them
+    ///
+    void record_enqueue( size_t count, size_t depth );
+
+    ///
+    /// \brief record_dequeue
+    ///
+    /// \param count the number of items removed
+    ///
+    void record_dequeue( size_t count ) { m_dequeued.add( count ); }
+
+    ///
+    /// \brief record_residency
+    ///
+    /// \param enqueued_at now_ns() at the time the item was added
+    /// \param started_at now_ns() at the start of the item's execution
+    ///
+    void record_residency( int64_t enqueued_at, int64_t started_at )
+    {
+        m_residency.record( started_at - enqueued_at );
+    }
+
+    ///
+    /// \brief record_execution
+    ///
+    /// \param ns time spent executing one item
+    ///
+    void record_execution( int64_t ns )
+    {
+        m_execution.record( ns );
+        m_busy_ns.add( (uint64_t)ns );
+    }
+
+    ///
+    /// \brief record_idle
+    ///
+    /// \param ns time a consumer spent waiting for an item
+    ///
+    void record_idle( int64_t ns ) { m_idle_ns.add( (uint64_t)ns ); }
+
+    ///
+    /// \brief snapshot
+    ///
+    /// \param depth the current depth of the queue
+    /// \return a copy of all the statistics
+    ///
+    QueueStatsSnapshot snapshot( size_t depth ) const;
+
+  private:
+    ShardedCounter m_enqueued;
+    ShardedCounter m_dequeued;
+    std::atomic<uint64_t> m_high_water;
+    LatencyHistogram m_residency;
+    LatencyHistogram m_execution;
+    ShardedCounter m_idle_ns;
+    ShardedCounter m_busy_ns;
+};
+}
+
+#endif // LAMBDASTEW_QUEUESTATS_HPP
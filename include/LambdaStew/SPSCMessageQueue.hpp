@@ -0,0 +1,284 @@
+#ifndef LAMBDASTEW_SPSCMESSAGEQUEUE_HPP
+#define LAMBDASTEW_SPSCMESSAGEQUEUE_HPP
+
+#include "MessageQueue.hpp"
+#include "SPSCRing.hpp"
+
+#include <atomic>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The SPSCMessageQueue class
+///
+/// A queue of Tasks from exactly one producer thread to exactly one
+/// consumer thread, with the push_back / invoke surface of MessageQueue.
+///
+/// Items live in an SPSCRing, so a push or an invoke is a handful of plain
+/// loads and stores with no lock and no read-modify-write. The Signaler is
+/// only touched when the consumer has announced that it is about to wait,
+/// and batch operations publish their index once per publish_interval
+/// items rather than once per item.
+///
+/// Using one from more than one producer or consumer thread at a time is
+/// undefined. close(), stop() and the queries may be called from any thread.
+///
+class SPSCMessageQueue
+{
+  public:
+    typedef MessageQueue::Status Status;
+
+    ///
+    /// \brief default_capacity
+    ///
+    /// The number of slots when no capacity is given
+    ///
+    static const size_t default_capacity = 1024;
+
+    ///
+    /// \brief publish_interval
+    ///
+    /// The most items a batch operation moves before it publishes its index
+    /// to the other side
+    ///
+    static const size_t publish_interval = 32;
+
+    ///
+    /// \brief SPSCMessageQueue
+    ///
+    /// \param capacity the number of slots, rounded up to a power of two.
+    /// A push to a full queue waits for the consumer to free a slot
+    ///
+    explicit SPSCMessageQueue( size_t capacity = default_capacity );
+
+    SPSCMessageQueue( SPSCMessageQueue const & ) = delete;
+    SPSCMessageQueue &operator=( SPSCMessageQueue const & ) = delete;
+
+    ///
+    /// \brief capacity
+    ///
+    /// \return the number of slots
+    ///
+    size_t capacity() const { return m_ring.capacity(); }
+
+    ///
+    /// \brief make_please_stop_item
+    ///
+    /// \return function which throws MessageQueue::PleaseStopException
+    ///
+    std::function<void()> make_please_stop_item() const;
+
+    ///
+    /// \brief push_back_please_stop
+    ///
+    /// Producer only. Ask the consumer to stop processing cleanly
+    ///
+    void push_back_please_stop();
+
+    ///
+    /// \brief push_back
+    ///
+    /// Producer only. Move a task to the back of the queue, waiting for a
+    /// free slot if the queue is full
+    ///
+    /// \return false if the queue is closed, in which case the task is left
+    /// untouched
+    ///
+    bool push_back( Task &&task );
+
+    ///
+    /// \brief push_back
+    ///
+    /// Producer only. Add a callable, constructed directly inside a Task
+    ///
+    /// \return false if the queue is closed
+    ///
+    template <typename F>
+    typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value,
+        bool>::type
+        push_back( F &&func )
+    {
+        return push_back( Task( std::forward<F>( func ) ) );
+    }
+
+    ///
+    /// \brief try_push
+    ///
+    /// Producer only. Move a task to the back of the queue without waiting
+    ///
+    /// \return false if the queue is full or closed, in which case the
+    /// task is left untouched
+    ///
+    bool try_push( Task &&task );
+
+    ///
+    /// \brief push_back_bulk
+    ///
+    /// Producer only. Move all the tasks to the back of the queue,
+    /// publishing them publish_interval at a time and waking the consumer
+    /// at most once per publication
+    ///
+    /// \param tasks the tasks to add. The vector is left empty but keeps its
+    /// capacity
+    /// \return false if the queue is closed. The tasks which were queued
+    /// before that are removed from tasks and the rest are left untouched
+    ///
+    bool push_back_bulk( vector<Task> &tasks );
+
+    ///
+    /// \brief invoke
+    ///
+    /// Consumer only. Call one function from the queue and remove it
+    ///
+    /// \return true if a function was called
+    ///
+    bool invoke();
+
+    ///
+    /// \brief invoke_batch
+    ///
+    /// Consumer only. Call up to max_n functions, giving their slots back
+    /// to the producer publish_interval at a time. If one throws, the slots
+    /// of those already taken are given back before the exception leaves
+    ///
+    /// \return the number of functions called
+    ///
+    size_t invoke_batch( size_t max_n );
+
+    ///
+    /// \brief drain
+    ///
+    /// Consumer only. Call every function which is in the queue at the time
+    /// of the call
+    ///
+    size_t drain() { return invoke_batch( size() ); }
+
+    ///
+    /// \brief wait_and_invoke
+    ///
+    /// Consumer only. Call one function, waiting up to timeout for one to
+    /// be added if the queue is empty, see MessageQueue::wait_and_invoke()
+    ///
+    template <typename TimeT>
+    Status wait_and_invoke( TimeT timeout )
+    {
+        return wait_and_invoke_ns(
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ),
+            nullptr );
+    }
+
+    template <typename TimeT>
+    Status wait_and_invoke( TimeT timeout, StopToken const &stop_token )
+    {
+        return wait_and_invoke_ns(
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ),
+            &stop_token );
+    }
+
+    ///
+    /// \brief close
+    ///
+    /// Reject all new functions. The consumer keeps calling the functions
+    /// which are already queued, and wait_and_invoke() returns
+    /// Status::closed once the queue is empty
+    ///
+    void close();
+
+    ///
+    /// \brief stop
+    ///
+    /// Reject all new functions and release the consumer at once with
+    /// Status::stopped
+    ///
+    void stop();
+
+    ///
+    /// \brief request_stop
+    ///
+    /// Trigger stop_source and wake the consumer so that it returns
+    /// Status::stopped if it holds one of its tokens
+    ///
+    void request_stop( StopSource &stop_source );
+
+    bool is_closed() const { return m_state.load() != state_open; }
+
+    bool is_stopped() const { return m_state.load() == state_stopped; }
+
+    ///
+    /// \brief empty
+    ///
+    /// \return true if the queue appeared empty at the time of the call
+    ///
+    bool empty() const { return m_ring.empty_approx(); }
+
+    ///
+    /// \brief size
+    ///
+    /// \return the number of items in the queue. This is a snapshot only
+    ///
+    size_t size() const { return m_ring.size_approx(); }
+
+  private:
+    static const int state_open = 0;
+    static const int state_closed = 1;
+    static const int state_stopped = 2;
+
+    ///
+    /// \brief wait_and_invoke_ns
+    ///
+    /// The implementation of wait_and_invoke()
+    ///
+    Status wait_and_invoke_ns( std::chrono::nanoseconds timeout,
+                               StopToken const *stop_token );
+
+    ///
+    /// \brief items_published
+    ///
+    /// Wake the consumer if it is waiting. Called after every publication
+    /// by the producer
+    ///
+    void items_published()
+    {
+        // Pairs with the fence in wait_and_invoke_ns(): either the consumer
+        // sees the new items or this sees the consumer waiting
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if ( m_consumer_waiting.load( std::memory_order_relaxed ) )
+        {
+            m_signaler.send_signal_one();
+        }
+    }
+
+    ///
+    /// \brief wait_for_slot
+    ///
+    /// Producer only. Publish what is deferred and wait for the consumer to
+    /// free a slot
+    ///
+    /// \return false if the queue was closed meanwhile
+    ///
+    bool wait_for_slot();
+
+    SPSCRing<Task> m_ring;
+
+    ///
+    /// \brief m_consumer_waiting
+    ///
+    /// Set by the consumer while it waits on m_signaler
+    ///
+    std::atomic<bool> m_consumer_waiting;
+
+    ///
+    /// \brief m_state
+    ///
+    /// One of state_open, state_closed or state_stopped
+    ///
+    std::atomic<int> m_state;
+
+    Signaler m_signaler;
+};
+}
+
+#endif // LAMBDASTEW_SPSCMESSAGEQUEUE_HPP
@@ -0,0 +1,273 @@
+#ifndef LAMBDASTEW_SPSCRING_HPP
+#define LAMBDASTEW_SPSCRING_HPP
+
+#include "MPMCRing.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The SPSCRing class
+///
+/// A bounded wait-free ring buffer for exactly one producer thread and one
+/// consumer thread.
+///
+/// Each side owns one index and keeps a cached copy of the other side's
+/// index on its own cache line. The producer only reads the consumer's
+/// index when its cached copy says the ring is full, and the consumer only
+/// reads the producer's index when its copy says the ring is empty, so in
+/// steady state neither side touches a line the other writes.
+///
+/// The deferred operations move the private index only; publish_push() and
+/// publish_pop() make a run of them visible to the other side with one
+/// store.
+///
+/// The capacity is always rounded up to a power of two.
+///
+template <typename T>
+class SPSCRing
+{
+  public:
+    ///
+    /// \brief SPSCRing
+    ///
+    /// \param capacity minimum number of items the ring can hold
+    ///
+    explicit SPSCRing( size_t capacity )
+        : m_mask( round_up_to_power_of_two( capacity ) - 1 )
+        , m_slots( new Slot[m_mask + 1] )
+        , m_tail( 0 )
+        , m_tail_private( 0 )
+        , m_head_cache( 0 )
+        , m_head( 0 )
+        , m_head_private( 0 )
+        , m_tail_cache( 0 )
+    {
+    }
+
+    SPSCRing( SPSCRing const & ) = delete;
+    SPSCRing &operator=( SPSCRing const & ) = delete;
+
+    ~SPSCRing()
+    {
+        // Deferred pops are already destroyed, deferred pushes are not
+        for ( size_t i = m_head_private; i != m_tail_private; ++i )
+        {
+            m_slots[i & m_mask].item()->~T();
+        }
+    }
+
+    ///
+    /// \brief try_emplace
+    ///
+    /// Producer only. Construct an item in the next free slot and publish
+    /// it, along with any deferred items before it
+    ///
+    /// \return false if the ring is full
+    ///
+    template <typename... Args>
+    bool try_emplace( Args &&... args )
+    {
+        if ( !try_emplace_deferred( std::forward<Args>( args )... ) )
+        {
+            return false;
+        }
+        publish_push();
+        return true;
+    }
+
+    ///
+    /// \brief try_emplace_deferred
+    ///
+    /// Producer only. Construct an item in the next free slot without
+    /// letting the consumer see it until publish_push()
+    ///
+    /// \return false if the ring is full
+    ///
+    template <typename... Args>
+    bool try_emplace_deferred( Args &&... args )
+    {
+        size_t const tail = m_tail_private;
+        if ( tail - m_head_cache > m_mask )
+        {
+            m_head_cache = m_head.load( std::memory_order_acquire );
+            if ( tail - m_head_cache > m_mask )
+            {
+                return false;
+            }
+        }
+        new ( m_slots[tail & m_mask].item() ) T( std::forward<Args>( args )... );
+        m_tail_private = tail + 1;
+        return true;
+    }
+
+    ///
+    /// \brief publish_push
+    ///
+    /// Producer only. Let the consumer see the deferred items
+    ///
+    void publish_push()
+    {
+        m_tail.store( m_tail_private, std::memory_order_release );
+    }
+
+    ///
+    /// \brief unpublished_pushes
+    ///
+    /// Producer only
+    ///
+    /// \return the number of deferred items not yet published
+    ///
+    size_t unpublished_pushes() const
+    {
+        return m_tail_private - m_tail.load( std::memory_order_relaxed );
+    }
+
+    ///
+    /// \brief try_pop
+    ///
+    /// Consumer only. Move the oldest item out of the ring and free its
+    /// slot for the producer
+    ///
+    /// \return false if the ring is empty
+    ///
+    bool try_pop( T &item )
+    {
+        if ( !try_pop_deferred( item ) )
+        {
+            return false;
+        }
+        publish_pop();
+        return true;
+    }
+
+    ///
+    /// \brief try_pop_deferred
+    ///
+    /// Consumer only. Move the oldest item out of the ring without giving
+    /// its slot back to the producer until publish_pop()
+    ///
+    /// \return false if the ring is empty
+    ///
+    bool try_pop_deferred( T &item )
+    {
+        size_t const head = m_head_private;
+        if ( head == m_tail_cache )
+        {
+            m_tail_cache = m_tail.load( std::memory_order_acquire );
+            if ( head == m_tail_cache )
+            {
+                return false;
+            }
+        }
+        T *slot = m_slots[head & m_mask].item();
+        item = std::move( *slot );
+        slot->~T();
+        m_head_private = head + 1;
+        return true;
+    }
+
+    ///
+    /// \brief publish_pop
+    ///
+    /// Consumer only. Give the slots of the deferred pops back to the
+    /// producer
+    ///
+    void publish_pop()
+    {
+        m_head.store( m_head_private, std::memory_order_release );
+    }
+
+    ///
+    /// \brief unpublished_pops
+    ///
+    /// Consumer only
+    ///
+    /// \return the number of deferred pops not yet published
+    ///
+    size_t unpublished_pops() const
+    {
+        return m_head_private - m_head.load( std::memory_order_relaxed );
+    }
+
+    ///
+    /// \brief capacity
+    ///
+    /// \return the maximum number of items the ring can hold
+    ///
+    size_t capacity() const { return m_mask + 1; }
+
+    ///
+    /// \brief size_approx
+    ///
+    /// \return the number of published items in the ring. This is only a
+    /// snapshot and may be stale by the time it is used
+    ///
+    size_t size_approx() const
+    {
+        size_t head = m_head.load( std::memory_order_acquire );
+        size_t tail = m_tail.load( std::memory_order_acquire );
+        return tail > head ? tail - head : 0;
+    }
+
+    ///
+    /// \brief empty_approx
+    ///
+    /// \return true if the ring appeared empty at the time of the call
+    ///
+    bool empty_approx() const
+    {
+        return m_tail.load( std::memory_order_acquire )
+               == m_head.load( std::memory_order_acquire );
+    }
+
+  private:
+    struct Slot
+    {
+        typename std::aligned_storage<sizeof( T ), alignof( T )>::type storage;
+
+        T *item() { return reinterpret_cast<T *>( &storage ); }
+    };
+
+    static size_t round_up_to_power_of_two( size_t v )
+    {
+        size_t r = 2;
+        while ( r < v )
+        {
+            r <<= 1;
+        }
+        return r;
+    }
+
+    size_t const m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+
+    /// Written by the producer
+    char m_pad0[cache_line_size];
+    std::atomic<size_t> m_tail;
+    char m_pad1[cache_line_size - sizeof( std::atomic<size_t> )];
+
+    /// Private to the producer
+    size_t m_tail_private;
+    size_t m_head_cache;
+    char m_pad2[cache_line_size - 2 * sizeof( size_t )];
+
+    /// Written by the consumer
+    std::atomic<size_t> m_head;
+    char m_pad3[cache_line_size - sizeof( std::atomic<size_t> )];
+
+    /// Private to the consumer
+    size_t m_head_private;
+    size_t m_tail_cache;
+    char m_pad4[cache_line_size - 2 * sizeof( size_t )];
+};
+}
+
+#endif // LAMBDASTEW_SPSCRING_HPP
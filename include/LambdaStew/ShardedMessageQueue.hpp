@@ -0,0 +1,496 @@
+#ifndef LAMBDASTEW_SHARDEDMESSAGEQUEUE_HPP
+#define LAMBDASTEW_SHARDEDMESSAGEQUEUE_HPP
+
+#include "MessageQueue.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The ShardedMessageQueue class
+///
+/// A MessageQueue split into shards, each an ordinary MessageQueue with a
+/// lock of its own on cache lines of its own, so that producers and
+/// consumers on different cores mostly take different locks.
+///
+/// A producer pushes to one shard, chosen by its thread or as the less
+/// loaded of two random shards. A consumer takes from its home shard first
+/// and then looks through the others, so every item is still run by
+/// whichever consumer gets to it first. Items pushed to the same shard run
+/// in order; there is no order between shards, and priority lanes only
+/// order the items of one shard.
+///
+/// Consumers which find every shard empty wait on one Signaler for the
+/// whole queue. A push only touches it when a consumer is waiting, so busy
+/// producers on different shards share no cache line.
+///
+class ShardedMessageQueue
+{
+  public:
+    typedef MessageQueue::Backend Backend;
+    typedef MessageQueue::Status Status;
+    typedef MessageQueue::Overflow Overflow;
+
+    ///
+    /// \brief The Dispatch enum
+    ///
+    /// How a producer picks the shard to push to
+    ///
+    enum class Dispatch
+    {
+        /// Always the home shard of the producer's thread
+        thread_affinity,
+        /// The less loaded of two shards picked at random
+        two_choices
+    };
+
+    ///
+    /// \brief ShardedMessageQueue
+    ///
+    /// \param shards the number of shards. 0 means one per hardware thread
+    /// \param dispatch how producers pick a shard
+    /// \param backend the storage backend of every shard
+    /// \param ring_capacity the ring size of every shard, see MessageQueue
+    /// \param lanes the number of priority lanes of every shard
+    ///
+    explicit ShardedMessageQueue(
+        size_t shards = 0,
+        Dispatch dispatch = Dispatch::two_choices,
+        Backend backend = Backend::locked_queue,
+        size_t ring_capacity = MessageQueue::default_ring_capacity,
+        unsigned lanes = 1 );
+
+    ShardedMessageQueue( ShardedMessageQueue const & ) = delete;
+    ShardedMessageQueue &operator=( ShardedMessageQueue const & ) = delete;
+
+    ///
+    /// \brief shards
+    ///
+    /// \return the number of shards
+    ///
+    size_t shards() const { return m_shards.size(); }
+
+    ///
+    /// \brief shard
+    ///
+    /// \return one shard, for example to give to a Strand or to submit().
+    /// Its consumers are those of the whole queue
+    ///
+    MessageQueue &shard( size_t index ) { return m_shards[index]->queue; }
+
+    ///
+    /// \brief dispatch_shard
+    ///
+    /// \return the shard the next push from this thread would go to
+    ///
+    MessageQueue &dispatch_shard() { return shard( pick_shard() ); }
+
+    ///
+    /// \brief home_shard
+    ///
+    /// \return the index of the shard the calling thread takes from first,
+    /// and pushes to with Dispatch::thread_affinity
+    ///
+    size_t home_shard() const;
+
+    ///
+    /// \brief lanes
+    ///
+    /// \return the number of priority lanes of each shard
+    ///
+    unsigned lanes() const { return m_shards[0]->queue.lanes(); }
+
+    ///
+    /// \brief set_aging
+    ///
+    /// MessageQueue::set_aging() for every shard
+    ///
+    template <typename DurationT>
+    void set_aging( DurationT max_wait )
+    {
+        for ( auto &shard : m_shards )
+        {
+            shard->queue.set_aging( max_wait );
+        }
+    }
+
+    ///
+    /// \brief set_capacity
+    ///
+    /// Give every shard an equal part of capacity, see
+    /// MessageQueue::set_capacity(). A shard can be full while others have
+    /// room
+    ///
+    template <typename DurationT>
+    void set_capacity( size_t capacity,
+                       Overflow overflow,
+                       DurationT block_timeout )
+    {
+        for ( auto &shard : m_shards )
+        {
+            shard->queue.set_capacity(
+                shard_capacity( capacity ), overflow, block_timeout );
+        }
+    }
+
+    void set_capacity( size_t capacity, Overflow overflow = Overflow::block )
+    {
+        for ( auto &shard : m_shards )
+        {
+            shard->queue.set_capacity( shard_capacity( capacity ), overflow );
+        }
+    }
+
+    ///
+    /// \brief enable_stats
+    ///
+    /// MessageQueue::enable_stats() for every shard. Read them with
+    /// shard( i ).stats_snapshot()
+    ///
+    void enable_stats();
+
+    ///
+    /// \brief make_please_stop_item
+    ///
+    /// \return function which throws an appropriate exception to trigger end
+    /// of thread
+    ///
+    std::function<void()> make_please_stop_item() const
+    {
+        return m_shards[0]->queue.make_please_stop_item();
+    }
+
+    ///
+    /// \brief push_back_please_stop
+    ///
+    /// Put a 'please_stop' item into one shard and wake every consumer.
+    /// Each consumer which runs it puts it back for the next
+    ///
+    void push_back_please_stop();
+
+    ///
+    /// \brief push_back
+    ///
+    /// Move a task to the back of lane 0 of a shard picked by the dispatch
+    /// policy
+    ///
+    /// \return false if the queue is closed or the push was rejected
+    ///
+    bool push_back( Task &&task, bool notify_all = false )
+    {
+        return dispatch_shard().push_back( std::move( task ), notify_all );
+    }
+
+    template <typename F>
+    typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value,
+        bool>::type
+        push_back( F &&func, bool notify_all = false )
+    {
+        return push_back( Task( std::forward<F>( func ) ), notify_all );
+    }
+
+    ///
+    /// \brief push_back_lane
+    ///
+    /// Move a task to the back of a priority lane of a shard picked by the
+    /// dispatch policy
+    ///
+    bool push_back_lane( unsigned lane, Task &&task, bool notify_all = false )
+    {
+        return dispatch_shard().push_back_lane(
+            lane, std::move( task ), notify_all );
+    }
+
+    template <typename F>
+    typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value,
+        bool>::type
+        push_back_lane( unsigned lane, F &&func, bool notify_all = false )
+    {
+        return push_back_lane(
+            lane, Task( std::forward<F>( func ) ), notify_all );
+    }
+
+    ///
+    /// \brief push_back_bulk
+    ///
+    /// Move all the tasks to one shard, see MessageQueue::push_back_bulk()
+    ///
+    bool push_back_bulk( vector<Task> &tasks, bool notify_all = false )
+    {
+        return dispatch_shard().push_back_bulk( tasks, notify_all );
+    }
+
+    ///
+    /// \brief push_back_range
+    ///
+    /// Add the callables in [first, last) to one shard, see
+    /// MessageQueue::push_back_range()
+    ///
+    template <typename Iterator>
+    bool push_back_range( Iterator first, Iterator last, bool notify_all = false )
+    {
+        return dispatch_shard().push_back_range( first, last, notify_all );
+    }
+
+    ///
+    /// \brief try_push
+    ///
+    /// MessageQueue::try_push() to a shard picked by the dispatch policy
+    ///
+    bool try_push( Task &&task, bool notify_all = false, unsigned lane = 0 )
+    {
+        return dispatch_shard().try_push( std::move( task ), notify_all, lane );
+    }
+
+    ///
+    /// \brief push_back_at
+    ///
+    /// MessageQueue::push_back_at() to a shard picked by the dispatch policy
+    ///
+    template <typename F>
+    TimerId push_back_at( std::chrono::steady_clock::time_point when, F &&func )
+    {
+        return dispatch_shard().push_back_at( when, std::forward<F>( func ) );
+    }
+
+    ///
+    /// \brief push_back_after
+    ///
+    /// MessageQueue::push_back_after() to a shard picked by the dispatch
+    /// policy
+    ///
+    template <typename DurationT, typename F>
+    TimerId push_back_after( DurationT delay, F &&func )
+    {
+        return dispatch_shard().push_back_after( delay,
+                                                 std::forward<F>( func ) );
+    }
+
+    ///
+    /// \brief push_back_every
+    ///
+    /// MessageQueue::push_back_every() to a shard picked by the dispatch
+    /// policy. Every copy goes to that shard
+    ///
+    template <typename DurationT, typename F>
+    TimerId push_back_every( DurationT period, F &&func )
+    {
+        return dispatch_shard().push_back_every( period,
+                                                 std::forward<F>( func ) );
+    }
+
+    ///
+    /// \brief cancel_timer
+    ///
+    /// Cancel a timer of push_back_at(), push_back_after() or
+    /// push_back_every()
+    ///
+    bool cancel_timer( TimerId id )
+    {
+        return m_shards[0]->queue.cancel_timer( id );
+    }
+
+    ///
+    /// \brief invoke
+    ///
+    /// Call one function, from the home shard if it has one and from the
+    /// first other shard which has one otherwise
+    ///
+    bool invoke();
+
+    ///
+    /// \brief try_invoke
+    ///
+    /// As invoke(), but skip the shards whose lock is contended
+    ///
+    bool try_invoke();
+
+    ///
+    /// \brief invoke_batch
+    ///
+    /// Call up to max_n functions, taking them from the home shard first
+    /// and then from the others, see MessageQueue::invoke_batch()
+    ///
+    size_t invoke_batch( size_t max_n );
+
+    ///
+    /// \brief drain
+    ///
+    /// Call every function which is in the queue at the time of the call
+    ///
+    size_t drain();
+
+    ///
+    /// \brief wait_and_invoke
+    ///
+    /// Call one function from any shard, waiting up to timeout for one to
+    /// be added if all are empty, see MessageQueue::wait_and_invoke()
+    ///
+    template <typename TimeT>
+    Status wait_and_invoke( TimeT timeout )
+    {
+        return wait_and_invoke_ns(
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ),
+            nullptr );
+    }
+
+    template <typename TimeT>
+    Status wait_and_invoke( TimeT timeout, StopToken const &stop_token )
+    {
+        return wait_and_invoke_ns(
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ),
+            &stop_token );
+    }
+
+    ///
+    /// \brief close
+    ///
+    /// Close every shard, see MessageQueue::close()
+    ///
+    void close();
+
+    ///
+    /// \brief stop
+    ///
+    /// Stop every shard, see MessageQueue::stop()
+    ///
+    void stop();
+
+    ///
+    /// \brief drain_and_stop
+    ///
+    /// close() the queue, wait for the consumers to take every queued function
+    /// or for the deadline to pass, then stop() the queue
+    ///
+    /// \return true if every shard was empty before the deadline
+    ///
+    bool drain_and_stop( std::chrono::steady_clock::time_point deadline );
+
+    bool is_closed() const { return m_state.load() != state_open; }
+
+    bool is_stopped() const { return m_state.load() == state_stopped; }
+
+    ///
+    /// \brief request_stop
+    ///
+    /// Trigger stop_source and wake the consumers waiting on this queue
+    ///
+    void request_stop( StopSource &stop_source );
+
+    ///
+    /// \brief idle_consumers
+    ///
+    /// \return the number of threads currently waiting in wait_and_invoke()
+    ///
+    size_t idle_consumers() const
+    {
+        return m_idle_consumers.load( std::memory_order_relaxed );
+    }
+
+    ///
+    /// \brief empty
+    ///
+    /// \return true if every shard is empty
+    ///
+    bool empty() const;
+
+    ///
+    /// \brief size
+    ///
+    /// \return the number of items in all shards
+    ///
+    size_t size() const;
+
+  private:
+    friend class MessageQueue;
+
+    ///
+    /// \brief The Shard struct
+    ///
+    /// A shard queue, padded so that no other object shares its first or
+    /// last cache line
+    ///
+    struct Shard
+    {
+        Shard( Backend backend, size_t ring_capacity, unsigned lanes )
+            : queue( backend, ring_capacity, lanes )
+        {
+        }
+
+        char pad0[cache_line_size];
+        MessageQueue queue;
+        char pad1[cache_line_size];
+    };
+
+    ///
+    /// The values of m_state, as in MessageQueue
+    ///
+    static const int state_open = 0;
+    static const int state_closed = 1;
+    static const int state_stopped = 2;
+
+    ///
+    /// \brief pick_shard
+    ///
+    /// \return the index of the shard to push to
+    ///
+    size_t pick_shard() const;
+
+    ///
+    /// \brief shard_capacity
+    ///
+    /// \return the part of capacity each shard gets, rounded up
+    ///
+    size_t shard_capacity( size_t capacity ) const
+    {
+        return ( capacity + m_shards.size() - 1 ) / m_shards.size();
+    }
+
+    ///
+    /// \brief items_added
+    ///
+    /// Called by a shard after every push, to wake waiting consumers
+    ///
+    void items_added( size_t item_count, bool notify_all );
+
+    ///
+    /// \brief wait_and_invoke_ns
+    ///
+    /// The implementation of wait_and_invoke()
+    ///
+    Status wait_and_invoke_ns( std::chrono::nanoseconds timeout,
+                               StopToken const *stop_token );
+
+    vector<std::unique_ptr<Shard> > m_shards;
+    Dispatch const m_dispatch;
+
+    ///
+    /// \brief m_signaler
+    ///
+    /// Wakes the consumers waiting in wait_and_invoke()
+    ///
+    Signaler m_signaler;
+
+    ///
+    /// \brief m_idle_consumers
+    ///
+    /// The number of threads waiting in wait_and_invoke()
+    ///
+    std::atomic<size_t> m_idle_consumers;
+
+    ///
+    /// \brief m_state
+    ///
+    /// One of state_open, state_closed or state_stopped
+    ///
+    std::atomic<int> m_state;
+};
+}
+
+#endif // LAMBDASTEW_SHARDEDMESSAGEQUEUE_HPP
@@ -3,10 +3,24 @@
 
 #include "Log.hpp"
 
+#include <atomic>
 #include <condition_variable>
 #include <chrono>
+#include <cstdint>
 #include <mutex>
 
+///
+/// \brief LAMBDASTEW_SIGNALER_FUTEX
+///
+/// Set to 1 when Signaler parks threads directly on a Linux futex. Define
+/// LAMBDASTEW_NO_FUTEX to use the portable condition variable implementation
+///
+#if defined( __linux__ ) && !defined( LAMBDASTEW_NO_FUTEX )
+#define LAMBDASTEW_SIGNALER_FUTEX 1
+#else
+#define LAMBDASTEW_SIGNALER_FUTEX 0
+#endif
+
 namespace LambdaStew
 {
 using std::lock_guard;
@@ -18,11 +32,49 @@ using std::condition_variable;
 ///
 /// Allows signalling between threads with atomic counting
 ///
+/// Sending a signal is an atomic increment of the signal count; the kernel
+/// is only entered when a thread is actually parked. Waiting threads first
+/// spin and then yield for a bounded number of rounds, and only then park,
+/// on a futex on Linux or on a condition variable elsewhere.
+///
 class Signaler
 {
   public:
     using signal_count_type = uint32_t;
 
+    ///
+    /// \brief default_spin_count
+    ///
+    /// The number of times a waiter polls the signal count with a cpu pause
+    /// before it starts yielding
+    ///
+    static const unsigned default_spin_count = 64;
+
+    ///
+    /// \brief default_yield_count
+    ///
+    /// The number of times a waiter yields its time slice before it parks
+    ///
+    static const unsigned default_yield_count = 4;
+
+    ///
+    /// \brief Signaler
+    ///
+    /// \param spin_count number of pause loop polls before yielding
+    /// \param yield_count number of yielding polls before parking
+    ///
+    explicit Signaler( unsigned spin_count = default_spin_count,
+                       unsigned yield_count = default_yield_count )
+        : m_signal_count( 0 )
+        , m_waiter_count( 0 )
+        , m_spin_count( spin_count )
+        , m_yield_count( yield_count )
+    {
+    }
+
+    Signaler( Signaler const & ) = delete;
+    Signaler &operator=( Signaler const & ) = delete;
+
     ///
     /// \brief get_count
     ///
@@ -35,22 +87,32 @@ class Signaler
     ///
     /// \brief send_signal_all
     ///
-    /// Use the condition variable to signal all threads waiting on it
+    /// Signal all threads waiting on it
     ///
     void send_signal_all();
 
     ///
     /// \brief send_signal_one
     ///
-    /// Use the condition variable to signal only one thread waiting on it
+    /// Signal only one thread waiting on it
     ///
     void send_signal_one();
 
+    ///
+    /// \brief send_signal_n
+    ///
+    /// Signal up to wake_count of the threads waiting on it. Threads which
+    /// are still spinning see the new count regardless
+    ///
+    /// \param wake_count the maximum number of parked threads to wake
+    ///
+    void send_signal_n( uint32_t wake_count );
+
     ///
     /// \brief send_signal
     ///
-    /// Use the condition variable to signal either all or one thread
-    /// waiting on it, depending on value of notify_all parameter
+    /// Signal either all or one thread waiting on it, depending on value of
+    /// notify_all parameter
     ///
     /// \param notify_all bool true to notify all threads, false to notify only
     /// one
@@ -70,7 +132,9 @@ class Signaler
     ///
     /// \brief wait_for_signal
     ///
-    /// Use the condition variable to wait for a signal
+    /// Wait until the signal count differs from last_signal_count
+    ///
+    /// \return the new signal count
     ///
     signal_count_type
         wait_for_signal( signal_count_type last_signal_count ) const;
@@ -78,25 +142,80 @@ class Signaler
     ///
     /// \brief wait_for_signal_for
     ///
-    /// Use the condition variable to wait for a signal for a specific amount of
-    /// time
+    /// Wait until the signal count differs from last_signal_count, for up to
+    /// a specific amount of time
+    ///
+    /// \return the current signal count, which equals last_signal_count if
+    /// the wait timed out
     ///
     template <typename TimeT>
     signal_count_type wait_for_signal_for( signal_count_type last_signal_count,
                                            TimeT t ) const
     {
-        std::unique_lock<mutex> guard( m_cv_mutex );
-        if ( m_signal_count == last_signal_count )
-        {
-            m_cv.wait_for( guard, t );
-        }
-        return m_signal_count;
+        return wait_for_signal_ns(
+            last_signal_count,
+            std::chrono::duration_cast<std::chrono::nanoseconds>( t ) );
+    }
+
+    ///
+    /// \brief waiter_count
+    ///
+    /// \return the number of threads currently parked or about to park
+    ///
+    uint32_t waiter_count() const
+    {
+        return m_waiter_count.load( std::memory_order_relaxed );
     }
 
   private:
+    ///
+    /// \brief spin_for_signal
+    ///
+    /// The bounded spin and yield phase of a wait
+    ///
+    /// \return true if the signal count changed while spinning
+    ///
+    bool spin_for_signal( signal_count_type last_signal_count ) const;
+
+    ///
+    /// \brief wait_for_signal_ns
+    ///
+    /// Wait until the signal count differs from last_signal_count, with a
+    /// timeout. A timeout of nanoseconds::max() waits forever
+    ///
+    signal_count_type
+        wait_for_signal_ns( signal_count_type last_signal_count,
+                            std::chrono::nanoseconds timeout ) const;
+
+    ///
+    /// \brief wake
+    ///
+    /// Wake up to wake_count parked threads
+    ///
+    void wake( uint32_t wake_count );
+
+    ///
+    /// \brief m_signal_count
+    ///
+    /// The number of signals sent. This is also the futex word
+    ///
+    std::atomic<signal_count_type> m_signal_count;
+
+    ///
+    /// \brief m_waiter_count
+    ///
+    /// The number of threads parked or about to park. Senders skip the
+    /// kernel entirely while this is zero
+    ///
+    mutable std::atomic<uint32_t> m_waiter_count;
+
+    unsigned const m_spin_count;
+    unsigned const m_yield_count;
+
+#if !LAMBDASTEW_SIGNALER_FUTEX
     mutable condition_variable m_cv;
     mutable mutex m_cv_mutex;
-    signal_count_type m_signal_count = 0;
+#endif
 };
 }
 
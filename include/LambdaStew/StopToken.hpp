@@ -0,0 +1,95 @@
+#ifndef LAMBDASTEW_STOPTOKEN_HPP
+#define LAMBDASTEW_STOPTOKEN_HPP
+
+#include <atomic>
+#include <memory>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The StopToken class
+///
+/// A cheap copyable view of a StopSource which a consumer polls to learn
+/// that it has been asked to stop. A default constructed token is never
+/// stopped
+///
+class StopToken
+{
+  public:
+    StopToken() {}
+
+    ///
+    /// \brief stop_requested
+    ///
+    /// \return true if the associated StopSource has requested a stop
+    ///
+    bool stop_requested() const
+    {
+        return m_state && m_state->load( std::memory_order_acquire );
+    }
+
+    ///
+    /// \brief stop_possible
+    ///
+    /// \return true if the token is associated with a StopSource
+    ///
+    bool stop_possible() const { return m_state != nullptr; }
+
+  private:
+    friend class StopSource;
+
+    explicit StopToken( std::shared_ptr<std::atomic<bool> > const &state )
+        : m_state( state )
+    {
+    }
+
+    std::shared_ptr<std::atomic<bool> > m_state;
+};
+
+///
+/// \brief The StopSource class
+///
+/// Owns a stop flag and hands out StopTokens which observe it
+///
+class StopSource
+{
+  public:
+    StopSource() : m_state( std::make_shared<std::atomic<bool> >( false ) ) {}
+
+    ///
+    /// \brief get_token
+    ///
+    /// \return a token observing this source
+    ///
+    StopToken get_token() const { return StopToken( m_state ); }
+
+    ///
+    /// \brief request_stop
+    ///
+    /// Ask every holder of a token from this source to stop
+    ///
+    /// \return true if this call made the request, false if it was already
+    /// made
+    ///
+    bool request_stop()
+    {
+        return !m_state->exchange( true, std::memory_order_acq_rel );
+    }
+
+    ///
+    /// \brief stop_requested
+    ///
+    /// \return true if a stop has been requested
+    ///
+    bool stop_requested() const
+    {
+        return m_state->load( std::memory_order_acquire );
+    }
+
+  private:
+    std::shared_ptr<std::atomic<bool> > m_state;
+};
+}
+
+#endif // LAMBDASTEW_STOPTOKEN_HPP
@@ -0,0 +1,175 @@
+#ifndef LAMBDASTEW_STRAND_HPP
+#define LAMBDASTEW_STRAND_HPP
+
+#include "MessageQueue.hpp"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The Strand class
+///
+/// Serializes tasks on a MessageQueue which is shared by many consumer
+/// threads. Tasks posted to one strand run in the order they were posted
+/// and never two at a time, but on whichever consumer takes them, so
+/// per-object state touched only from its strand needs no lock and no
+/// thread of its own.
+///
+/// The tasks of a strand wait in the strand, not in the queue. While the
+/// strand has tasks it has exactly one runner item in the queue; the runner
+/// calls up to max_batch tasks and then puts itself at the back of the
+/// queue if more are waiting, so a busy strand does not hold a consumer
+/// from the other strands and items of the queue.
+///
+/// Tasks which are still waiting when the Strand is destroyed still run,
+/// and so do those waiting when the queue is closed.
+///
+class Strand
+{
+  public:
+    ///
+    /// \brief default_max_batch
+    ///
+    /// The number of tasks a runner calls before it yields the consumer
+    ///
+    static const size_t default_max_batch = 64;
+
+    ///
+    /// \brief Strand
+    ///
+    /// \param queue the queue whose consumers run the tasks
+    /// \param lane the priority lane of the queue the runner goes to
+    /// \param max_batch the most tasks to call in one turn of the runner
+    ///
+    explicit Strand( MessageQueue &queue,
+                     unsigned lane = 0,
+                     size_t max_batch = default_max_batch );
+
+    Strand( Strand const & ) = delete;
+    Strand &operator=( Strand const & ) = delete;
+
+    ///
+    /// \brief post
+    ///
+    /// Add a task to the back of the strand
+    ///
+    /// \param task the task to add
+    /// \return false if the queue is closed, in which case the task will
+    /// not run
+    ///
+    bool post( Task &&task );
+
+    ///
+    /// \brief post
+    ///
+    /// Add a callable to the back of the strand
+    ///
+    /// \param func callable function which takes no parameters and returns
+    /// void
+    /// \return false if the queue is closed
+    ///
+    template <typename F>
+    typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value,
+        bool>::type
+        post( F &&func )
+    {
+        return post( Task( std::forward<F>( func ) ) );
+    }
+
+    ///
+    /// \brief running_in_this_thread
+    ///
+    /// \return true if the caller is a task of this strand
+    ///
+    bool running_in_this_thread() const;
+
+    ///
+    /// \brief pending
+    ///
+    /// \return the number of tasks waiting in the strand, not counting
+    /// those the runner has already taken
+    ///
+    size_t pending() const;
+
+    ///
+    /// \brief queue
+    ///
+    /// \return the queue whose consumers run the tasks
+    ///
+    MessageQueue &queue() { return m_state->queue; }
+
+  private:
+    ///
+    /// \brief The State struct
+    ///
+    /// The part of a strand the runner keeps alive while it is queued
+    ///
+    struct State
+    {
+        State( MessageQueue &q, unsigned l, size_t n )
+            : queue( q ), lane( l ), max_batch( n ), scheduled( false )
+        {
+        }
+
+        MessageQueue &queue;
+        unsigned const lane;
+        size_t const max_batch;
+
+        mutable std::mutex mutex;
+
+        /// The waiting tasks, guarded by mutex
+        std::deque<Task> tasks;
+
+        /// True while a runner is queued or running, guarded by mutex
+        bool scheduled;
+
+        /// Runner only: the tasks of the current turn
+        std::vector<Task> batch;
+    };
+
+    ///
+    /// \brief schedule
+    ///
+    /// Put a runner for state at the back of its queue
+    ///
+    /// \return false if the queue is closed
+    ///
+    static bool schedule( std::shared_ptr<State> const &state );
+
+    ///
+    /// \brief run
+    ///
+    /// The runner: call one turn of tasks and schedule the next turn
+    ///
+    static void run( std::shared_ptr<State> const &state );
+
+    ///
+    /// \brief next_turn
+    ///
+    /// Schedule the runner again if tasks are waiting, or mark the strand
+    /// idle
+    ///
+    /// \return true if tasks are waiting but the queue is closed, so the
+    /// current runner has to take the next turn itself
+    ///
+    static bool next_turn( std::shared_ptr<State> const &state );
+
+    ///
+    /// \brief give_back
+    ///
+    /// Put the tasks of the current turn from first on back at the front
+    /// of the strand, after one of them threw
+    ///
+    static void give_back( State &state, size_t first );
+
+    std::shared_ptr<State> m_state;
+};
+}
+
+#endif // LAMBDASTEW_STRAND_HPP
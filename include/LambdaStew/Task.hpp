@@ -0,0 +1,251 @@
+#ifndef LAMBDASTEW_TASK_HPP
+#define LAMBDASTEW_TASK_HPP
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+///
+/// \brief LAMBDASTEW_TASK_INLINE_SIZE
+///
+/// The number of bytes a Task can hold inline before it falls back to
+/// allocating its callable on the heap
+///
+#ifndef LAMBDASTEW_TASK_INLINE_SIZE
+#define LAMBDASTEW_TASK_INLINE_SIZE 48
+#endif
+
+namespace LambdaStew
+{
+
+///
+/// \brief The BasicTask class
+///
+/// A move-only type erased callable which takes no parameters and returns
+/// void.
+///
+/// Callables which fit in InlineSize bytes and are nothrow move
+/// constructible are stored inside the BasicTask itself, so creating,
+/// moving and destroying them never touches the heap. Larger callables are
+/// allocated once on construction and only their pointer is moved.
+///
+template <size_t InlineSize>
+class BasicTask
+{
+  public:
+    static const size_t inline_size = InlineSize;
+
+    ///
+    /// \brief BasicTask
+    ///
+    /// Create an empty task
+    ///
+    BasicTask() noexcept : m_ops( nullptr ) {}
+
+    BasicTask( std::nullptr_t ) noexcept : m_ops( nullptr ) {}
+
+    ///
+    /// \brief BasicTask
+    ///
+    /// Create a task by constructing a copy of the callable directly in the
+    /// task's storage. An empty std::function or null function pointer
+    /// creates an empty task
+    ///
+    /// \param f callable which takes no parameters
+    ///
+    template <typename F,
+              typename = typename std::enable_if<
+                  !std::is_same<typename std::decay<F>::type,
+                                BasicTask>::value>::type>
+    BasicTask( F &&f )
+        : m_ops( nullptr )
+    {
+        typedef typename std::decay<F>::type Callable;
+        if ( !is_null( f ) )
+        {
+            construct<Callable>(
+                std::integral_constant<bool, fits_inline<Callable>()>(),
+                std::forward<F>( f ) );
+        }
+    }
+
+    BasicTask( BasicTask &&other ) noexcept : m_ops( other.m_ops )
+    {
+        if ( m_ops )
+        {
+            m_ops->move( &m_storage, &other.m_storage );
+            other.m_ops = nullptr;
+        }
+    }
+
+    BasicTask &operator=( BasicTask &&other ) noexcept
+    {
+        if ( this != &other )
+        {
+            reset();
+            if ( other.m_ops )
+            {
+                other.m_ops->move( &m_storage, &other.m_storage );
+                m_ops = other.m_ops;
+                other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    BasicTask( BasicTask const & ) = delete;
+    BasicTask &operator=( BasicTask const & ) = delete;
+
+    ~BasicTask() { reset(); }
+
+    ///
+    /// \brief operator ()
+    ///
+    /// Call the callable. The task must not be empty
+    ///
+    void operator()() { m_ops->invoke( &m_storage ); }
+
+    ///
+    /// \brief operator bool
+    ///
+    /// \return true if the task holds a callable
+    ///
+    explicit operator bool() const noexcept { return m_ops != nullptr; }
+
+    ///
+    /// \brief reset
+    ///
+    /// Destroy the callable, leaving the task empty
+    ///
+    void reset() noexcept
+    {
+        if ( m_ops )
+        {
+            m_ops->destroy( &m_storage );
+            m_ops = nullptr;
+        }
+    }
+
+    ///
+    /// \brief is_inline
+    ///
+    /// \return true if the callable is held in the inline buffer
+    ///
+    bool is_inline() const noexcept { return m_ops && m_ops->is_inline; }
+
+  private:
+    typedef typename std::aligned_storage<InlineSize, alignof( void * ) * 2>::type
+        Storage;
+
+    struct Ops
+    {
+        void ( *invoke )( Storage * );
+        void ( *move )( Storage *dest, Storage *src );
+        void ( *destroy )( Storage * );
+        bool is_inline;
+    };
+
+    template <typename Callable>
+    static constexpr bool fits_inline()
+    {
+        return sizeof( Callable ) <= sizeof( Storage )
+               && alignof( Storage ) % alignof( Callable ) == 0
+               && std::is_nothrow_move_constructible<Callable>::value;
+    }
+
+    template <typename Callable>
+    struct InlineOps
+    {
+        static Callable *get( Storage *s )
+        {
+            return reinterpret_cast<Callable *>( s );
+        }
+
+        static void invoke( Storage *s ) { ( *get( s ) )(); }
+
+        static void move( Storage *dest, Storage *src )
+        {
+            new ( dest ) Callable( std::move( *get( src ) ) );
+            get( src )->~Callable();
+        }
+
+        static void destroy( Storage *s ) { get( s )->~Callable(); }
+
+        static Ops const *ops()
+        {
+            static Ops const o = {&invoke, &move, &destroy, true};
+            return &o;
+        }
+    };
+
+    template <typename Callable>
+    struct HeapOps
+    {
+        static Callable *&get( Storage *s )
+        {
+            return *reinterpret_cast<Callable **>( s );
+        }
+
+        static void invoke( Storage *s ) { ( *get( s ) )(); }
+
+        static void move( Storage *dest, Storage *src )
+        {
+            new ( dest ) Callable *( get( src ) );
+        }
+
+        static void destroy( Storage *s ) { delete get( s ); }
+
+        static Ops const *ops()
+        {
+            static Ops const o = {&invoke, &move, &destroy, false};
+            return &o;
+        }
+    };
+
+    template <typename Callable, typename F>
+    void construct( std::true_type, F &&f )
+    {
+        new ( &m_storage ) Callable( std::forward<F>( f ) );
+        m_ops = InlineOps<Callable>::ops();
+    }
+
+    template <typename Callable, typename F>
+    void construct( std::false_type, F &&f )
+    {
+        new ( &m_storage ) Callable *( new Callable( std::forward<F>( f ) ) );
+        m_ops = HeapOps<Callable>::ops();
+    }
+
+    template <typename F>
+    static bool is_null( F const & )
+    {
+        return false;
+    }
+
+    template <typename R, typename... Args>
+    static bool is_null( std::function<R( Args... )> const &f )
+    {
+        return !f;
+    }
+
+    template <typename R, typename... Args>
+    static bool is_null( R ( *f )( Args... ) )
+    {
+        return f == nullptr;
+    }
+
+    Storage m_storage;
+    Ops const *m_ops;
+};
+
+///
+/// \brief Task
+///
+/// The task type stored in a MessageQueue
+///
+typedef BasicTask<LAMBDASTEW_TASK_INLINE_SIZE> Task;
+}
+
+#endif // LAMBDASTEW_TASK_HPP
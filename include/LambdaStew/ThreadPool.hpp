@@ -0,0 +1,239 @@
+#ifndef LAMBDASTEW_THREADPOOL_HPP
+#define LAMBDASTEW_THREADPOOL_HPP
+
+#include "MessageQueue.hpp"
+#include "WorkStealingDeque.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The ThreadPool class
+///
+/// A fixed set of worker threads which execute Tasks.
+///
+/// Every worker owns a WorkStealingDeque. Tasks submitted from inside a
+/// worker go to that worker's deque, so work spawned by a task tends to run
+/// on the same core while its data is still in cache. Tasks submitted from
+/// any other thread go to a shared injection MessageQueue. An idle worker
+/// first drains its own deque, then the injection queue, and then tries to
+/// steal from the other workers, starting at a random victim.
+///
+/// The Tasks in the deques live in slots which are recycled through a free
+/// list per worker and a shared one, so a steady stream of submits from
+/// workers does not touch the heap.
+///
+class ThreadPool
+{
+  public:
+    ///
+    /// \brief ThreadPool
+    ///
+    /// Start the worker threads
+    ///
+    /// \param num_threads the number of workers. 0 means one per hardware
+    /// thread
+    ///
+    explicit ThreadPool( size_t num_threads = 0 );
+
+    ThreadPool( ThreadPool const & ) = delete;
+    ThreadPool &operator=( ThreadPool const & ) = delete;
+
+    ///
+    /// \brief ~ThreadPool
+    ///
+    /// Runs all tasks already submitted and then joins the workers. After a
+    /// please-stop item was pushed to injection_queue(), the tasks queued
+    /// behind it there are discarded instead
+    ///
+    ~ThreadPool();
+
+    ///
+    /// \brief submit
+    ///
+    /// Schedule a task on the pool
+    ///
+    /// \param task the task to run
+    ///
+    void submit( Task &&task );
+
+    ///
+    /// \brief submit
+    ///
+    /// Schedule a callable on the pool
+    ///
+    /// \param func callable function which takes no parameters and returns void
+    ///
+    template <typename F>
+    typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value>::type
+        submit( F &&func )
+    {
+        submit( Task( std::forward<F>( func ) ) );
+    }
+
+    ///
+    /// \brief shutdown
+    ///
+    /// Let the workers finish all queued tasks and wait for them to exit.
+    /// Tasks submitted after shutdown() returns are discarded.
+    ///
+    void shutdown();
+
+    ///
+    /// \brief size
+    ///
+    /// \return the number of worker threads
+    ///
+    size_t size() const { return m_workers.size(); }
+
+    ///
+    /// \brief injection_queue
+    ///
+    /// A please-stop item pushed here ends the workers one by one, as
+    /// MessageQueue::invoke() puts it back for the next worker. Each worker
+    /// still runs the tasks in its own deque before it exits
+    ///
+    /// \return the queue which receives tasks submitted from outside the pool
+    ///
+    MessageQueue &injection_queue() { return m_injection; }
+
+    ///
+    /// \brief current
+    ///
+    /// \return the pool that the calling thread is a worker of, or nullptr
+    ///
+    static ThreadPool *current();
+
+  private:
+    ///
+    /// \brief The TaskSlot union
+    ///
+    /// Storage for one Task in a deque, or a link in a free list
+    ///
+    union TaskSlot
+    {
+        TaskSlot *next;
+        typename std::aligned_storage<sizeof( Task ), alignof( Task )>::type
+            storage;
+    };
+
+    ///
+    /// \brief task_cache_limit
+    ///
+    /// The most free slots a worker keeps for itself. Half of them move to
+    /// the shared list when a worker frees more than this
+    ///
+    static const size_t task_cache_limit = 256;
+
+    struct Worker
+    {
+        Worker() : random_state( 0 ), free_slots( nullptr ), free_count( 0 ) {}
+
+        WorkStealingDeque<Task *> deque;
+        std::thread thread;
+        uint32_t random_state;
+
+        /// The free slots of this worker, only touched by its thread
+        TaskSlot *free_slots;
+        size_t free_count;
+        char pad[cache_line_size];
+    };
+
+    ///
+    /// \brief allocate_task
+    ///
+    /// Move a task into a slot from the worker's free list, refilling it
+    /// from the shared list or the heap when it is empty
+    ///
+    Task *allocate_task( Worker &self, Task &&task );
+
+    ///
+    /// \brief release_task
+    ///
+    /// Destroy a task and put its slot on the worker's free list
+    ///
+    void release_task( Worker &self, Task *task );
+
+    ///
+    /// \brief give_back_slots
+    ///
+    /// Move count slots from the worker's free list to the shared list
+    ///
+    void give_back_slots( Worker &self, size_t count );
+
+    ///
+    /// \brief worker_loop
+    ///
+    /// The body of each worker thread
+    ///
+    void worker_loop( size_t index );
+
+    ///
+    /// \brief run_one
+    ///
+    /// Find one task, from the local deque, the injection queue or a victim,
+    /// and run it
+    ///
+    /// \return false if no task was found anywhere
+    ///
+    bool run_one( Worker &self, size_t index );
+
+    ///
+    /// \brief run
+    ///
+    /// Run and release a task taken from a deque, logging any exception
+    ///
+    void run( Worker &self, Task *task );
+
+    ///
+    /// \brief has_work
+    ///
+    /// \return true if any queue in the pool appears to have a task
+    ///
+    bool has_work() const;
+
+    ///
+    /// \brief wake_idle_worker
+    ///
+    /// Signal one sleeping worker, if there is any
+    ///
+    void wake_idle_worker();
+
+    MessageQueue m_injection;
+    std::vector<std::unique_ptr<Worker> > m_workers;
+
+    ///
+    /// \brief m_work_signal
+    ///
+    /// Wakes idle workers when new tasks arrive or on shutdown
+    ///
+    Signaler m_work_signal;
+
+    ///
+    /// \brief m_idle_workers
+    ///
+    /// The number of workers which are about to sleep or are sleeping
+    ///
+    std::atomic<size_t> m_idle_workers;
+
+    std::atomic<bool> m_stopping;
+
+    ///
+    /// \brief m_shared_slots
+    ///
+    /// Free slots which any worker can take, a batch at a time, guarded by
+    /// m_slot_mutex
+    ///
+    std::mutex m_slot_mutex;
+    TaskSlot *m_shared_slots;
+};
+}
+
+#endif // LAMBDASTEW_THREADPOOL_HPP
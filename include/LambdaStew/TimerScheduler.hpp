@@ -0,0 +1,195 @@
+#ifndef LAMBDASTEW_TIMERSCHEDULER_HPP
+#define LAMBDASTEW_TIMERSCHEDULER_HPP
+
+#include "Signaler.hpp"
+#include "Task.hpp"
+#include "TimerWheel.hpp"
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LambdaStew
+{
+
+class MessageQueue;
+
+///
+/// \brief The TimerScheduler class
+///
+/// The timer thread behind MessageQueue::push_back_after(),
+/// push_back_at() and push_back_every().
+///
+/// Pending timers live in one TimerWheel with a tick of tick_ns. The thread
+/// sleeps on a Signaler until the next tick with work, advances the wheel,
+/// and pushes everything which expired to each target queue with one
+/// enqueue_bulk(), without holding the lock of the wheel. Tasks which find
+/// a full ring are due again on the next tick. Scheduling a timer only
+/// wakes the thread when the timer is due before the thread would wake
+/// anyway.
+///
+class TimerScheduler
+{
+  public:
+    typedef std::chrono::steady_clock clock;
+
+    ///
+    /// \brief tick_ns
+    ///
+    /// The resolution of timers. A timer never fires early, and fires at
+    /// most one tick late plus the wakeup latency of the thread
+    ///
+    static const int64_t tick_ns = 1000000;
+
+    ///
+    /// \brief instance
+    ///
+    /// \return the single TimerScheduler of the process
+    ///
+    static TimerScheduler &instance();
+
+    TimerScheduler();
+    ~TimerScheduler();
+
+    TimerScheduler( TimerScheduler const & ) = delete;
+    TimerScheduler &operator=( TimerScheduler const & ) = delete;
+
+    ///
+    /// \brief schedule
+    ///
+    /// Push task to queue at time when
+    ///
+    /// \return the id of the timer
+    ///
+    TimerId
+        schedule( MessageQueue &queue, clock::time_point when, Task &&task );
+
+    ///
+    /// \brief schedule_every
+    ///
+    /// Push a copy of func to queue at time first and then every period,
+    /// until the timer is cancelled or the queue is closed
+    ///
+    /// \return the id of the timer
+    ///
+    TimerId schedule_every( MessageQueue &queue,
+                            clock::time_point first,
+                            std::chrono::nanoseconds period,
+                            std::function<void()> const &func );
+
+    ///
+    /// \brief cancel
+    ///
+    /// Cancel a pending timer
+    ///
+    /// \return false if the timer already fired or was cancelled
+    ///
+    bool cancel( TimerId id );
+
+    ///
+    /// \brief cancel_all
+    ///
+    /// Cancel every timer of a queue. Once it returns the thread is not
+    /// pushing to the queue, waiting for a push which is under way
+    ///
+    void cancel_all( MessageQueue &queue );
+
+    ///
+    /// \brief pending
+    ///
+    /// \return the number of pending timers
+    ///
+    size_t pending() const;
+
+  private:
+    ///
+    /// \brief The Timer struct
+    ///
+    /// The target and the work of one timer
+    ///
+    struct Timer
+    {
+        Timer() : queue( nullptr ), period_ticks( 0 ) {}
+
+        MessageQueue *queue;
+
+        /// The task of a one shot timer
+        Task task;
+
+        /// The function a periodic timer pushes a copy of
+        std::function<void()> repeat;
+
+        /// The period, or 0 for a one shot timer
+        uint64_t period_ticks;
+    };
+
+    ///
+    /// \brief The Batch struct
+    ///
+    /// The expired tasks of one queue, and the number of its timers which
+    /// are done once the tasks are pushed, plus one for the batch itself
+    ///
+    struct Batch
+    {
+        Batch() : queue( nullptr ), finished( 0 ) {}
+
+        MessageQueue *queue;
+        std::vector<Task> tasks;
+        size_t finished;
+    };
+
+    ///
+    /// \brief tick_at
+    ///
+    /// \return the first tick at or after time when
+    ///
+    uint64_t tick_at( clock::time_point when ) const;
+
+    ///
+    /// \brief insert
+    ///
+    /// Add a timer to the wheel and wake the thread if it is due before
+    /// the thread's next wakeup
+    ///
+    TimerId insert( uint64_t tick, Timer &&timer );
+
+    ///
+    /// \brief batch_for
+    ///
+    /// \return the batch of a queue in this pass, starting a new one if needed
+    ///
+    Batch &batch_for( MessageQueue *queue );
+
+    ///
+    /// \brief run
+    ///
+    /// The timer thread
+    ///
+    void run();
+
+    clock::time_point const m_epoch;
+
+    mutable std::mutex m_mutex;
+    TimerWheel<Timer> m_wheel;
+
+    /// The tick the thread sleeps until, guarded by m_mutex
+    uint64_t m_wake_tick;
+    bool m_exit;
+    Signaler m_signaler;
+    std::thread m_thread;
+
+    /// Signalled each time the thread is done pushing a pass of batches
+    Signaler m_pushed;
+
+    /// Thread only: the expired tasks of the current pass, per queue
+    std::vector<Batch> m_batches;
+
+    /// Thread only: tasks which are destroyed once m_mutex is released, as
+    /// their destructors may call back into the scheduler
+    std::vector<Task> m_discarded;
+};
+}
+
+#endif // LAMBDASTEW_TIMERSCHEDULER_HPP
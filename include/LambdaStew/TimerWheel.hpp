@@ -0,0 +1,432 @@
+#ifndef LAMBDASTEW_TIMERWHEEL_HPP
+#define LAMBDASTEW_TIMERWHEEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief TimerId
+///
+/// Identifies a timer for cancelling it. 0 is never a valid id
+///
+typedef uint64_t TimerId;
+
+///
+/// \brief The TimerWheel class
+///
+/// A hierarchical timing wheel of values of type T, each due at a tick.
+///
+/// The wheel has levels of slots, each level covering slots times the span
+/// of the one below, so four levels of 256 slots cover 2^32 ticks. A timer
+/// goes into the slot of the lowest level which can hold its distance from
+/// the current tick, and moves down a level each time the level below wraps
+/// around, until it reaches level 0 and expires. Timers further away than
+/// the top level covers wait in its furthest slot.
+///
+/// Each slot is an intrusive doubly linked list over a vector of nodes, so
+/// insert() and cancel() are O(1) and do not allocate once the vector has
+/// grown. A bitmap of non-empty slots lets advance() skip empty ticks.
+///
+/// TimerWheel does no locking.
+///
+template <typename T>
+class TimerWheel
+{
+  public:
+    static const unsigned level_bits = 8;
+    static const unsigned levels = 4;
+    static const unsigned slots = 1u << level_bits;
+
+    explicit TimerWheel( uint64_t start_tick = 0 )
+        : m_free( npos ), m_current( start_tick ), m_size( 0 )
+    {
+        for ( unsigned i = 0; i < levels * slots; ++i )
+        {
+            m_heads[i] = npos;
+            m_tails[i] = npos;
+        }
+        for ( unsigned i = 0; i < levels * slots / 64; ++i )
+        {
+            m_occupied[i] = 0;
+        }
+    }
+
+    TimerWheel( TimerWheel const & ) = delete;
+    TimerWheel &operator=( TimerWheel const & ) = delete;
+
+    ///
+    /// \brief current_tick
+    ///
+    /// \return the tick the wheel has been advanced to
+    ///
+    uint64_t current_tick() const { return m_current; }
+
+    ///
+    /// \brief size
+    ///
+    /// \return the number of pending timers
+    ///
+    size_t size() const { return m_size; }
+
+    bool empty() const { return m_size == 0; }
+
+    ///
+    /// \brief insert
+    ///
+    /// Add a timer. A tick which is not after the current tick expires on
+    /// the next one
+    ///
+    /// \param tick the tick at which the timer expires
+    /// \param value the value passed to the expire function of advance()
+    /// \return the id of the timer
+    ///
+    TimerId insert( uint64_t tick, T &&value )
+    {
+        uint32_t const index = allocate();
+        Node &node = m_nodes[index];
+        node.value = std::move( value );
+        node.expiry = tick > m_current ? tick : m_current + 1;
+        link( index );
+        ++m_size;
+        return ( uint64_t( node.generation ) << 32 ) | ( index + 1 );
+    }
+
+    ///
+    /// \brief cancel
+    ///
+    /// Remove a pending timer
+    ///
+    /// \param id the id returned by insert()
+    /// \param value receives the value of the timer
+    /// \return false if the timer has expired or was cancelled already
+    ///
+    bool cancel( TimerId id, T &value )
+    {
+        uint32_t const index = uint32_t( id & 0xffffffff ) - 1;
+        if ( id == 0 || index >= m_nodes.size() )
+        {
+            return false;
+        }
+
+        Node &node = m_nodes[index];
+        if ( node.slot == npos || node.generation != uint32_t( id >> 32 ) )
+        {
+            return false;
+        }
+
+        unlink( index );
+        value = std::move( node.value );
+        release( index );
+        --m_size;
+        return true;
+    }
+
+    ///
+    /// \brief remove_if
+    ///
+    /// Cancel every pending timer whose value matches a predicate. This
+    /// visits every node, so it is meant for rare clean up
+    ///
+    /// \return the number of timers removed
+    ///
+    template <typename PredicateT>
+    size_t remove_if( PredicateT predicate )
+    {
+        size_t count = 0;
+        for ( uint32_t index = 0; index < m_nodes.size(); ++index )
+        {
+            Node &node = m_nodes[index];
+            if ( node.slot != npos && predicate( node.value ) )
+            {
+                unlink( index );
+                release( index );
+                --m_size;
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    ///
+    /// \brief advance
+    ///
+    /// Move the current tick forward to tick, calling expire( value, expiry )
+    /// for every timer which expires on the way, in expiry order.
+    ///
+    /// expire may set expiry to a later tick and return true to keep the
+    /// timer, with the same id, for periodic timers; otherwise the timer is
+    /// removed. expire must not insert or cancel timers
+    ///
+    /// \return the number of timers which expired
+    ///
+    template <typename ExpireT>
+    size_t advance( uint64_t tick, ExpireT &&expire )
+    {
+        size_t count = 0;
+        while ( m_current < tick )
+        {
+            uint64_t const next = next_tick();
+            if ( next > tick )
+            {
+                m_current = tick;
+                break;
+            }
+
+            m_current = next;
+            if ( ( m_current & ( slots - 1 ) ) == 0 )
+            {
+                cascade( 1 );
+            }
+            count += expire_slot( unsigned( m_current & ( slots - 1 ) ),
+                                  expire );
+        }
+        return count;
+    }
+
+    ///
+    /// \brief next_tick
+    ///
+    /// \return the earliest tick at which advance() may have work to do:
+    /// the next non-empty slot of level 0 or the next time level 0 wraps
+    /// around, or UINT64_MAX if there are no timers
+    ///
+    uint64_t next_tick() const
+    {
+        if ( m_size == 0 )
+        {
+            return UINT64_MAX;
+        }
+
+        unsigned const index = unsigned( m_current & ( slots - 1 ) );
+        uint64_t const base = m_current - index;
+        for ( unsigned word = ( index + 1 ) / 64; word < slots / 64; ++word )
+        {
+            uint64_t bits = m_occupied[word];
+            if ( word == ( index + 1 ) / 64 && ( index + 1 ) % 64 )
+            {
+                bits &= ~uint64_t( 0 ) << ( ( index + 1 ) % 64 );
+            }
+            if ( bits )
+            {
+                return base + word * 64 + unsigned( __builtin_ctzll( bits ) );
+            }
+        }
+        return base + slots;
+    }
+
+  private:
+    static const uint32_t npos = 0xffffffff;
+
+    struct Node
+    {
+        Node()
+            : expiry( 0 )
+            , prev( npos )
+            , next( npos )
+            , generation( 0 )
+            , slot( npos )
+        {
+        }
+
+        T value;
+        uint64_t expiry;
+        uint32_t prev;
+        uint32_t next;
+        uint32_t generation;
+
+        /// The slot whose list holds the node, or npos if it is free
+        uint32_t slot;
+    };
+
+    uint32_t allocate()
+    {
+        if ( m_free != npos )
+        {
+            uint32_t const index = m_free;
+            m_free = m_nodes[index].next;
+            return index;
+        }
+        m_nodes.emplace_back();
+        return uint32_t( m_nodes.size() - 1 );
+    }
+
+    void release( uint32_t index )
+    {
+        Node &node = m_nodes[index];
+        node.value = T();
+        node.slot = npos;
+        ++node.generation;
+        node.next = m_free;
+        m_free = index;
+    }
+
+    ///
+    /// \brief link
+    ///
+    /// Append a node to the slot for its expiry. A node due now goes to the
+    /// current slot of level 0, which advance() expires right after a
+    /// cascade
+    ///
+    void link( uint32_t index )
+    {
+        Node &node = m_nodes[index];
+        uint64_t const delta
+            = node.expiry > m_current ? node.expiry - m_current : 0;
+
+        unsigned level = 0;
+        while ( level + 1 < levels
+                && delta
+                       >= ( uint64_t( 1 ) << ( level_bits * ( level + 1 ) ) ) )
+        {
+            ++level;
+        }
+
+        uint64_t slot_tick = node.expiry > m_current ? node.expiry : m_current;
+        uint64_t const span = uint64_t( 1 ) << ( level_bits * levels );
+        if ( delta >= span )
+        {
+            slot_tick = m_current + span - 1;
+        }
+
+        uint32_t const slot
+            = level * slots
+              + uint32_t( ( slot_tick >> ( level_bits * level ) )
+                          & ( slots - 1 ) );
+
+        node.slot = slot;
+        node.next = npos;
+        node.prev = m_tails[slot];
+        if ( m_tails[slot] != npos )
+        {
+            m_nodes[m_tails[slot]].next = index;
+        }
+        else
+        {
+            m_heads[slot] = index;
+            m_occupied[slot / 64] |= uint64_t( 1 ) << ( slot % 64 );
+        }
+        m_tails[slot] = index;
+    }
+
+    void unlink( uint32_t index )
+    {
+        Node &node = m_nodes[index];
+        uint32_t const slot = node.slot;
+
+        if ( node.prev != npos )
+        {
+            m_nodes[node.prev].next = node.next;
+        }
+        else
+        {
+            m_heads[slot] = node.next;
+        }
+
+        if ( node.next != npos )
+        {
+            m_nodes[node.next].prev = node.prev;
+        }
+        else
+        {
+            m_tails[slot] = node.prev;
+        }
+
+        if ( m_heads[slot] == npos )
+        {
+            m_occupied[slot / 64] &= ~( uint64_t( 1 ) << ( slot % 64 ) );
+        }
+    }
+
+    ///
+    /// \brief take_slot
+    ///
+    /// Empty a slot
+    ///
+    /// \return the first node of its list
+    ///
+    uint32_t take_slot( uint32_t slot )
+    {
+        uint32_t const head = m_heads[slot];
+        m_heads[slot] = npos;
+        m_tails[slot] = npos;
+        m_occupied[slot / 64] &= ~( uint64_t( 1 ) << ( slot % 64 ) );
+        return head;
+    }
+
+    ///
+    /// \brief cascade
+    ///
+    /// Move the timers of the current slot of a level down to lower levels,
+    /// after cascading the level above if this level wrapped around too
+    ///
+    void cascade( unsigned level )
+    {
+        unsigned const index = unsigned(
+            ( m_current >> ( level_bits * level ) ) & ( slots - 1 ) );
+        if ( index == 0 && level + 1 < levels )
+        {
+            cascade( level + 1 );
+        }
+
+        uint32_t i = take_slot( level * slots + index );
+        while ( i != npos )
+        {
+            uint32_t const next = m_nodes[i].next;
+            link( i );
+            i = next;
+        }
+    }
+
+    template <typename ExpireT>
+    size_t expire_slot( unsigned slot, ExpireT &expire )
+    {
+        size_t count = 0;
+        uint32_t i = take_slot( slot );
+        while ( i != npos )
+        {
+            Node &node = m_nodes[i];
+            uint32_t const next = node.next;
+            ++count;
+            if ( expire( node.value, node.expiry ) )
+            {
+                if ( node.expiry <= m_current )
+                {
+                    node.expiry = m_current + 1;
+                }
+                link( i );
+            }
+            else
+            {
+                release( i );
+                --m_size;
+            }
+            i = next;
+        }
+        return count;
+    }
+
+    std::vector<Node> m_nodes;
+    uint32_t m_free;
+    uint32_t m_heads[levels * slots];
+    uint32_t m_tails[levels * slots];
+    uint64_t m_occupied[levels * slots / 64];
+    uint64_t m_current;
+    size_t m_size;
+};
+
+template <typename T>
+const unsigned TimerWheel<T>::level_bits;
+template <typename T>
+const unsigned TimerWheel<T>::levels;
+template <typename T>
+const unsigned TimerWheel<T>::slots;
+template <typename T>
+const uint32_t TimerWheel<T>::npos;
+}
+
+#endif // LAMBDASTEW_TIMERWHEEL_HPP
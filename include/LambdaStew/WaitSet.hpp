@@ -0,0 +1,260 @@
+#ifndef LAMBDASTEW_WAITSET_HPP
+#define LAMBDASTEW_WAITSET_HPP
+
+#include "MessageQueue.hpp"
+
+#include <atomic>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The WaitSet class
+///
+/// Lets one consumer thread serve several MessageQueues, for example a
+/// control queue and a data queue, blocking on all of them at once.
+///
+/// Every queue added to the set tells it about each push, close() and
+/// stop(). A consumer which finds every queue empty parks once on the
+/// Signaler of the set and a push only touches that Signaler when a
+/// consumer is parked, so serving N queues costs one park and one unpark
+/// per wakeup rather than N polling loops.
+///
+/// The queues are served in the order given by Order. A queue belongs to
+/// at most one WaitSet. add() and remove() must not run at the same time as
+/// a wait on the set, or as a push, close() or stop() on the queue being
+/// added or removed.
+///
+class WaitSet
+{
+  public:
+    typedef MessageQueue::Status Status;
+
+    ///
+    /// \brief The Order enum
+    ///
+    /// Which ready queue a consumer serves first
+    ///
+    enum class Order
+    {
+        /// Always the first ready queue in the order they were added, so
+        /// an earlier queue starves later ones while it has items
+        priority,
+        /// The first ready queue after the one served last, so every
+        /// ready queue gets a turn
+        round_robin
+    };
+
+    ///
+    /// \brief WaitSet
+    ///
+    /// \param order which ready queue is served first
+    ///
+    explicit WaitSet( Order order = Order::priority );
+
+    WaitSet( WaitSet const & ) = delete;
+    WaitSet &operator=( WaitSet const & ) = delete;
+
+    ///
+    /// \brief ~WaitSet
+    ///
+    /// Remove every queue from the set
+    ///
+    ~WaitSet();
+
+    ///
+    /// \brief add
+    ///
+    /// Add a queue to the end of the set
+    ///
+    /// \return the index of the queue within the set
+    /// \throws std::logic_error if the queue already belongs to a WaitSet
+    ///
+    size_t add( MessageQueue &queue );
+
+    ///
+    /// \brief remove
+    ///
+    /// Remove a queue from the set. The indices of the queues after it drop
+    /// by one
+    ///
+    /// \return false if the queue was not in the set
+    ///
+    bool remove( MessageQueue &queue );
+
+    ///
+    /// \brief size
+    ///
+    /// \return the number of queues in the set
+    ///
+    size_t size() const { return m_queues.size(); }
+
+    ///
+    /// \brief queue
+    ///
+    /// \return the queue at index
+    ///
+    MessageQueue &queue( size_t index ) const { return *m_queues[index]; }
+
+    Order order() const { return m_order; }
+
+    ///
+    /// \brief ready
+    ///
+    /// Find the queues which have a function to call, without waiting
+    ///
+    /// \param indices cleared and filled with the indices of the ready
+    /// queues, in the order they would be served
+    /// \return the number of ready queues
+    ///
+    size_t ready( vector<size_t> &indices ) const;
+
+    ///
+    /// \brief wait
+    ///
+    /// Wait up to timeout for at least one queue to have a function to call
+    ///
+    /// \param indices cleared and filled as for ready()
+    /// \return Status::invoked if a queue is ready, even though nothing has
+    /// been called, Status::closed once every queue is stopped or closed
+    /// and empty, or Status::timeout
+    ///
+    template <typename TimeT>
+    Status wait( vector<size_t> &indices, TimeT timeout )
+    {
+        return wait_ns(
+            &indices,
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ),
+            nullptr,
+            nullptr );
+    }
+
+    template <typename TimeT>
+    Status wait( vector<size_t> &indices,
+                 TimeT timeout,
+                 StopToken const &stop_token )
+    {
+        return wait_ns(
+            &indices,
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ),
+            &stop_token,
+            nullptr );
+    }
+
+    ///
+    /// \brief wait_and_invoke
+    ///
+    /// Call one function from the first ready queue, waiting up to timeout
+    /// for one to be added if every queue is empty
+    ///
+    /// \param index if not nullptr, set to the index of the queue whose
+    /// function was called
+    /// \return Status::invoked if a function was called, Status::closed once
+    /// every queue is stopped or closed and empty, Status::stopped if the
+    /// StopToken was triggered, or Status::timeout
+    ///
+    template <typename TimeT>
+    Status wait_and_invoke( TimeT timeout, size_t *index = nullptr )
+    {
+        return wait_ns(
+            nullptr,
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ),
+            nullptr,
+            index );
+    }
+
+    template <typename TimeT>
+    Status wait_and_invoke( TimeT timeout,
+                            StopToken const &stop_token,
+                            size_t *index = nullptr )
+    {
+        return wait_ns(
+            nullptr,
+            std::chrono::duration_cast<std::chrono::nanoseconds>( timeout ),
+            &stop_token,
+            index );
+    }
+
+    ///
+    /// \brief request_stop
+    ///
+    /// Trigger stop_source and wake the consumers waiting on the set so that
+    /// those holding one of its tokens return Status::stopped
+    ///
+    void request_stop( StopSource &stop_source );
+
+  private:
+    friend class MessageQueue;
+
+    ///
+    /// \brief queue_changed
+    ///
+    /// Called by a queue of the set after a push, close() or stop()
+    ///
+    /// \param notify_all true to wake every waiting consumer rather than one
+    ///
+    void queue_changed( bool notify_all );
+
+    ///
+    /// \brief first_index
+    ///
+    /// \return the index to start looking for a ready queue from
+    ///
+    size_t first_index() const
+    {
+        return m_order == Order::round_robin
+                   ? m_next.load( std::memory_order_relaxed ) % m_queues.size()
+                   : 0;
+    }
+
+    ///
+    /// \brief invoke
+    ///
+    /// Call one function from the first ready queue
+    ///
+    /// \return true if a function was called
+    ///
+    bool invoke( size_t *index );
+
+    ///
+    /// \brief done
+    ///
+    /// \return true if every queue is stopped, or closed and empty
+    ///
+    bool done() const;
+
+    ///
+    /// \brief wait_ns
+    ///
+    /// The implementation of wait() when indices is given, and of
+    /// wait_and_invoke() otherwise
+    ///
+    Status wait_ns( vector<size_t> *indices,
+                    std::chrono::nanoseconds timeout,
+                    StopToken const *stop_token,
+                    size_t *index );
+
+    Order const m_order;
+
+    vector<MessageQueue *> m_queues;
+
+    ///
+    /// \brief m_next
+    ///
+    /// For Order::round_robin, the index after the queue served last
+    ///
+    std::atomic<size_t> m_next;
+
+    ///
+    /// \brief m_idle_consumers
+    ///
+    /// The number of consumers waiting, or about to wait, on m_signaler
+    ///
+    std::atomic<size_t> m_idle_consumers;
+
+    Signaler m_signaler;
+};
+}
+
+#endif // LAMBDASTEW_WAITSET_HPP
@@ -0,0 +1,218 @@
+#ifndef LAMBDASTEW_WORKSTEALINGDEQUE_HPP
+#define LAMBDASTEW_WORKSTEALINGDEQUE_HPP
+
+#include "MPMCRing.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief The WorkStealingDeque class
+///
+/// A Chase-Lev work stealing deque.
+///
+/// Only the owning thread may call push() and pop(), which work on the
+/// bottom of the deque in LIFO order. Any thread may call steal(), which
+/// takes from the top in FIFO order. The backing array grows as needed;
+/// retired arrays are kept until the deque is destroyed so that a
+/// concurrent thief never reads freed memory.
+///
+/// T must be trivially copyable, typically a pointer.
+///
+template <typename T>
+class WorkStealingDeque
+{
+  public:
+    ///
+    /// \brief WorkStealingDeque
+    ///
+    /// \param initial_capacity the initial size of the array, rounded up to
+    /// a power of two
+    ///
+    explicit WorkStealingDeque( size_t initial_capacity = 256 )
+        : m_top( 0 ), m_bottom( 0 )
+    {
+        size_t capacity = 2;
+        while ( capacity < initial_capacity )
+        {
+            capacity <<= 1;
+        }
+        m_arrays.emplace_back( new Array( capacity ) );
+        m_array.store( m_arrays.back().get(), std::memory_order_relaxed );
+    }
+
+    WorkStealingDeque( WorkStealingDeque const & ) = delete;
+    WorkStealingDeque &operator=( WorkStealingDeque const & ) = delete;
+
+    ///
+    /// \brief push
+    ///
+    /// Add an item to the bottom of the deque. Owner thread only
+    ///
+    void push( T item )
+    {
+        int64_t b = m_bottom.load( std::memory_order_relaxed );
+        int64_t t = m_top.load( std::memory_order_acquire );
+        Array *a = m_array.load( std::memory_order_relaxed );
+        if ( b - t > (int64_t)a->capacity() - 1 )
+        {
+            a = grow( a, b, t );
+        }
+        a->put( b, item );
+        std::atomic_thread_fence( std::memory_order_release );
+        m_bottom.store( b + 1, std::memory_order_relaxed );
+    }
+
+    ///
+    /// \brief pop
+    ///
+    /// Remove the most recently pushed item. Owner thread only
+    ///
+    /// \param item destination for the item
+    /// \return false if the deque was empty
+    ///
+    bool pop( T &item )
+    {
+        int64_t b = m_bottom.load( std::memory_order_relaxed ) - 1;
+        Array *a = m_array.load( std::memory_order_relaxed );
+        m_bottom.store( b, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        int64_t t = m_top.load( std::memory_order_relaxed );
+
+        bool r = false;
+        if ( t <= b )
+        {
+            item = a->get( b );
+            r = true;
+            if ( t == b )
+            {
+                // The last item: race against thieves for it
+                if ( !m_top.compare_exchange_strong( t,
+                                                     t + 1,
+                                                     std::memory_order_seq_cst,
+                                                     std::memory_order_relaxed ) )
+                {
+                    r = false;
+                }
+                m_bottom.store( b + 1, std::memory_order_relaxed );
+            }
+        }
+        else
+        {
+            m_bottom.store( b + 1, std::memory_order_relaxed );
+        }
+        return r;
+    }
+
+    ///
+    /// \brief steal
+    ///
+    /// Remove the oldest item. May be called from any thread
+    ///
+    /// \param item destination for the item
+    /// \return false if the deque was empty or another thread won the race
+    /// for the item
+    ///
+    bool steal( T &item )
+    {
+        int64_t t = m_top.load( std::memory_order_acquire );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        int64_t b = m_bottom.load( std::memory_order_acquire );
+        if ( t < b )
+        {
+            Array *a = m_array.load( std::memory_order_acquire );
+            T x = a->get( t );
+            if ( !m_top.compare_exchange_strong( t,
+                                                 t + 1,
+                                                 std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed ) )
+            {
+                return false;
+            }
+            item = x;
+            return true;
+        }
+        return false;
+    }
+
+    ///
+    /// \brief size_approx
+    ///
+    /// \return the number of items in the deque at some recent moment
+    ///
+    size_t size_approx() const
+    {
+        int64_t b = m_bottom.load( std::memory_order_relaxed );
+        int64_t t = m_top.load( std::memory_order_relaxed );
+        return b > t ? (size_t)( b - t ) : 0;
+    }
+
+    ///
+    /// \brief empty_approx
+    ///
+    /// \return true if the deque appeared empty at the time of the call
+    ///
+    bool empty_approx() const { return size_approx() == 0; }
+
+  private:
+    class Array
+    {
+      public:
+        explicit Array( size_t capacity )
+            : m_mask( capacity - 1 ), m_items( new std::atomic<T>[capacity] )
+        {
+        }
+
+        size_t capacity() const { return m_mask + 1; }
+
+        T get( int64_t i ) const
+        {
+            return m_items[i & m_mask].load( std::memory_order_relaxed );
+        }
+
+        void put( int64_t i, T item )
+        {
+            m_items[i & m_mask].store( item, std::memory_order_relaxed );
+        }
+
+      private:
+        size_t const m_mask;
+        std::unique_ptr<std::atomic<T>[]> m_items;
+    };
+
+    Array *grow( Array *a, int64_t b, int64_t t )
+    {
+        Array *bigger = new Array( a->capacity() * 2 );
+        m_arrays.emplace_back( bigger );
+        for ( int64_t i = t; i < b; ++i )
+        {
+            bigger->put( i, a->get( i ) );
+        }
+        m_array.store( bigger, std::memory_order_release );
+        return bigger;
+    }
+
+    char m_pad0[cache_line_size];
+    std::atomic<int64_t> m_top;
+    char m_pad1[cache_line_size - sizeof( std::atomic<int64_t> )];
+    std::atomic<int64_t> m_bottom;
+    std::atomic<Array *> m_array;
+    char m_pad2[cache_line_size - sizeof( std::atomic<int64_t> )
+                - sizeof( std::atomic<Array *> )];
+
+    ///
+    /// \brief m_arrays
+    ///
+    /// Every array ever used by the deque, owned here so that retired arrays
+    /// outlive any thief still reading from them
+    ///
+    std::vector<std::unique_ptr<Array> > m_arrays;
+};
+}
+
+#endif // LAMBDASTEW_WORKSTEALINGDEQUE_HPP
@@ -0,0 +1,104 @@
+#include "LambdaStew/BinaryLog.hpp"
+#include "LambdaStew/LogWriter.hpp"
+
+namespace LambdaStew
+{
+
+///
+/// \brief binary_log_registry_mutex
+///
+/// Guards binary_log_registry()
+///
+static std::mutex &binary_log_registry_mutex()
+{
+    static std::mutex m;
+    return m;
+}
+
+///
+/// \brief binary_log_registry
+///
+/// Every registered call site, indexed by id - 1
+///
+static std::vector<BinaryLogSiteInfo> &binary_log_registry()
+{
+    static std::vector<BinaryLogSiteInfo> registry;
+    return registry;
+}
+
+bool log_binary( bool set, bool new_value, std::string const &path )
+{
+    LogWriter &writer = LogWriter::instance();
+
+    if ( set )
+    {
+        if ( !writer.enable_binary( new_value, path ) )
+        {
+            log_error( "log_binary() can not open ", path );
+        }
+    }
+
+    return writer.binary_enabled();
+}
+
+uint32_t binary_log_register( BinaryLogSite &site,
+                              char const *format,
+                              char const *arg_types )
+{
+    lock_guard<mutex> guard( binary_log_registry_mutex() );
+
+    // Another thread may have registered the site in the meantime
+    uint32_t id = site.id.load( std::memory_order_relaxed );
+    if ( id == 0 )
+    {
+        BinaryLogSiteInfo info;
+        info.level = site.level;
+        info.file = site.file;
+        info.line = site.line;
+        info.format = format;
+        info.arg_types = arg_types;
+
+        std::vector<BinaryLogSiteInfo> &registry = binary_log_registry();
+        registry.push_back( info );
+        id = uint32_t( registry.size() );
+        site.id.store( id, std::memory_order_release );
+    }
+    return id;
+}
+
+void binary_log_sites( uint32_t first_id,
+                       std::vector<BinaryLogSiteInfo> &sites )
+{
+    lock_guard<mutex> guard( binary_log_registry_mutex() );
+
+    std::vector<BinaryLogSiteInfo> const &registry = binary_log_registry();
+    for ( size_t i = first_id > 0 ? first_id - 1 : 0; i < registry.size(); ++i )
+    {
+        sites.push_back( registry[i] );
+    }
+}
+
+char *binary_log_reserve( LogLevel level, size_t size )
+{
+    return LogWriter::instance().reserve_binary( level, size );
+}
+
+void binary_log_commit() { LogWriter::instance().commit_binary(); }
+
+size_t binary_log_max_size() { return LogWriter::instance().max_binary_size(); }
+
+bool print_format( ostream &dest, char const *&format )
+{
+    char const *placeholder = strstr( format, "{}" );
+    if ( !placeholder )
+    {
+        dest << format;
+        format += strlen( format );
+        return false;
+    }
+
+    dest.write( format, placeholder - format );
+    format = placeholder + 2;
+    return true;
+}
+}
@@ -0,0 +1,357 @@
+#include "LambdaStew/EventLoop.hpp"
+
+#include <cerrno>
+#include <system_error>
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace LambdaStew
+{
+
+const int EventLoop::max_events;
+const size_t EventLoop::max_batch;
+
+namespace
+{
+
+///
+/// \brief wake_tag
+///
+/// The epoll data of the eventfd and the timerfd. Registrations use the
+/// fd in the low word and a generation in the high word, and fds are never
+/// negative, so these can not clash
+///
+uint64_t const wake_tag = UINT64_MAX;
+uint64_t const timer_tag = UINT64_MAX - 1;
+
+int check( int result, char const *what )
+{
+    if ( result < 0 )
+    {
+        throw std::system_error( errno, std::system_category(), what );
+    }
+    return result;
+}
+}
+
+EventLoop::EventLoop( MessageQueue::Backend backend,
+                      size_t ring_capacity,
+                      unsigned lanes )
+    : m_queue( backend, ring_capacity, lanes )
+    , m_epoll_fd( -1 )
+    , m_wake_fd( -1 )
+    , m_timer_fd( -1 )
+    , m_polling( false )
+    , m_wake_pending( false )
+    , m_stop( false )
+    , m_thread_id( std::thread::id() )
+    , m_next_generation( 0 )
+    , m_epoch( clock::now() )
+    , m_armed_tick( UINT64_MAX )
+{
+    try
+    {
+        m_epoll_fd = check( epoll_create1( EPOLL_CLOEXEC ), "epoll_create1" );
+        m_wake_fd = check( eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK ), "eventfd" );
+        m_timer_fd = check(
+            timerfd_create( CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK ),
+            "timerfd_create" );
+
+        epoll_event event = epoll_event();
+        event.events = EPOLLIN;
+        event.data.u64 = wake_tag;
+        check( epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &event ),
+               "epoll_ctl" );
+        event.data.u64 = timer_tag;
+        check( epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, m_timer_fd, &event ),
+               "epoll_ctl" );
+    }
+    catch ( ... )
+    {
+        for ( int fd : {m_timer_fd, m_wake_fd, m_epoll_fd} )
+        {
+            if ( fd >= 0 )
+            {
+                ::close( fd );
+            }
+        }
+        throw;
+    }
+
+    m_queue.m_event_loop = this;
+}
+
+EventLoop::~EventLoop()
+{
+    m_queue.m_event_loop = nullptr;
+    ::close( m_timer_fd );
+    ::close( m_wake_fd );
+    ::close( m_epoll_fd );
+}
+
+bool EventLoop::add_fd( int fd, uint32_t events, FdHandler handler )
+{
+    lock_guard<std::mutex> guard( m_fd_mutex );
+    Registration registration;
+    registration.generation = m_next_generation++;
+    registration.handler = std::make_shared<FdHandler>( std::move( handler ) );
+
+    epoll_event event = epoll_event();
+    event.events = events;
+    event.data.u64
+        = ( uint64_t( registration.generation ) << 32 ) | uint32_t( fd );
+    if ( epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, fd, &event ) < 0 )
+    {
+        return false;
+    }
+    m_fds[fd] = std::move( registration );
+    return true;
+}
+
+bool EventLoop::modify_fd( int fd, uint32_t events )
+{
+    lock_guard<std::mutex> guard( m_fd_mutex );
+    auto i = m_fds.find( fd );
+    if ( i == m_fds.end() )
+    {
+        errno = ENOENT;
+        return false;
+    }
+
+    epoll_event event = epoll_event();
+    event.events = events;
+    event.data.u64
+        = ( uint64_t( i->second.generation ) << 32 ) | uint32_t( fd );
+    return epoll_ctl( m_epoll_fd, EPOLL_CTL_MOD, fd, &event ) == 0;
+}
+
+bool EventLoop::remove_fd( int fd )
+{
+    lock_guard<std::mutex> guard( m_fd_mutex );
+    auto i = m_fds.find( fd );
+    if ( i == m_fds.end() )
+    {
+        return false;
+    }
+    // The fd may already be closed, which removed it from the epoll set
+    epoll_ctl( m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr );
+    m_fds.erase( i );
+    return true;
+}
+
+uint64_t EventLoop::tick_at( clock::time_point when ) const
+{
+    int64_t const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           when - m_epoch ).count();
+    int64_t const tick_ns = TimerScheduler::tick_ns;
+    return ns <= 0 ? 0 : uint64_t( ( ns + tick_ns - 1 ) / tick_ns );
+}
+
+TimerId EventLoop::run_at( clock::time_point when, Task &&task )
+{
+    Timer timer;
+    timer.task = std::move( task );
+    return insert_timer( tick_at( when ), std::move( timer ) );
+}
+
+TimerId EventLoop::run_every( clock::time_point first,
+                              std::chrono::nanoseconds period,
+                              std::function<void()> const &func )
+{
+    int64_t const tick_ns = TimerScheduler::tick_ns;
+    Timer timer;
+    timer.repeat = func;
+    timer.period_ticks = std::max<uint64_t>(
+        1, uint64_t( ( period.count() + tick_ns - 1 ) / tick_ns ) );
+    return insert_timer( tick_at( first ), std::move( timer ) );
+}
+
+TimerId EventLoop::insert_timer( uint64_t tick, Timer &&timer )
+{
+    lock_guard<std::mutex> guard( m_timer_mutex );
+    TimerId id = m_wheel.insert( tick, std::move( timer ) );
+    if ( m_wheel.next_tick() < m_armed_tick )
+    {
+        arm_locked();
+    }
+    return id;
+}
+
+bool EventLoop::cancel( TimerId id )
+{
+    Timer timer;
+    {
+        lock_guard<std::mutex> guard( m_timer_mutex );
+        if ( !m_wheel.cancel( id, timer ) )
+        {
+            return false;
+        }
+        if ( m_wheel.empty() )
+        {
+            arm_locked();
+        }
+    }
+    // The task is destroyed outside the lock, in case it owns a timer
+    return true;
+}
+
+void EventLoop::arm_locked()
+{
+    m_armed_tick = m_wheel.next_tick();
+
+    itimerspec spec = itimerspec();
+    if ( m_armed_tick != UINT64_MAX )
+    {
+        // steady_clock is CLOCK_MONOTONIC, so its epoch is the timerfd's
+        int64_t const ns
+            = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  m_epoch.time_since_epoch() ).count()
+              + int64_t( m_armed_tick ) * TimerScheduler::tick_ns;
+        spec.it_value.tv_sec = time_t( ns / 1000000000 );
+        spec.it_value.tv_nsec = long( ns % 1000000000 );
+    }
+    timerfd_settime( m_timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr );
+}
+
+size_t EventLoop::run_timers()
+{
+    uint64_t expirations;
+    if ( read( m_timer_fd, &expirations, sizeof( expirations ) ) < 0 )
+    {
+        // Rearmed for later since the event was reported
+        return 0;
+    }
+
+    {
+        lock_guard<std::mutex> guard( m_timer_mutex );
+
+        // The last tick which has fully started
+        uint64_t const now = uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - m_epoch ).count()
+            / TimerScheduler::tick_ns );
+
+        m_wheel.advance( now,
+                         [this]( Timer &timer, uint64_t &expiry ) -> bool
+                         {
+                             if ( timer.period_ticks )
+                             {
+                                 m_expired.emplace_back( timer.repeat );
+                                 expiry += timer.period_ticks;
+                                 return true;
+                             }
+                             m_expired.push_back( std::move( timer.task ) );
+                             return false;
+                         } );
+        arm_locked();
+    }
+
+    // Call the functions without the lock, so that they can add and cancel
+    // timers. If one throws, the rest are dropped with m_expired
+    struct ClearGuard
+    {
+        std::vector<Task> &expired;
+        ~ClearGuard() { expired.clear(); }
+    } guard{m_expired};
+
+    for ( auto &task : m_expired )
+    {
+        task();
+    }
+    return m_expired.size();
+}
+
+size_t EventLoop::run_once_ns( std::chrono::nanoseconds timeout )
+{
+    m_thread_id.store( std::this_thread::get_id(), std::memory_order_relaxed );
+
+    // Announce the wait before the final emptiness check. A push after the
+    // fence sees m_polling and writes the eventfd
+    m_polling.store( true, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+    int timeout_ms = 0;
+    if ( m_queue.empty() && !m_stop.load( std::memory_order_relaxed ) )
+    {
+        // Round up, so that the wait is never cut short
+        int64_t const ms = timeout.count() / 1000000
+                           + ( timeout.count() % 1000000 != 0 );
+        timeout_ms = ms > INT32_MAX ? -1 : int( std::max<int64_t>( ms, 0 ) );
+    }
+
+    epoll_event events[max_events];
+    int ready = epoll_wait( m_epoll_fd, events, max_events, timeout_ms );
+    m_polling.store( false, std::memory_order_relaxed );
+
+    size_t count = 0;
+    for ( int i = 0; i < ready; ++i )
+    {
+        uint64_t const data = events[i].data.u64;
+        if ( data == wake_tag )
+        {
+            uint64_t value;
+            if ( read( m_wake_fd, &value, sizeof( value ) ) > 0 )
+            {
+                m_wake_pending.store( false );
+            }
+            continue;
+        }
+        if ( data == timer_tag )
+        {
+            count += run_timers();
+            continue;
+        }
+
+        std::shared_ptr<FdHandler> handler;
+        {
+            lock_guard<std::mutex> guard( m_fd_mutex );
+            auto r = m_fds.find( int( data & 0xffffffff ) );
+            if ( r == m_fds.end() || r->second.generation != data >> 32 )
+            {
+                // Removed, or removed and added again, earlier in this pass
+                continue;
+            }
+            handler = r->second.handler;
+        }
+        ( *handler )( events[i].events );
+        ++count;
+    }
+
+    return count + m_queue.invoke_batch( max_batch );
+}
+
+void EventLoop::run()
+{
+    while ( !m_stop.load() )
+    {
+        run_once_ns( std::chrono::nanoseconds::max() );
+    }
+    m_stop.store( false );
+}
+
+void EventLoop::stop()
+{
+    m_stop.store( true );
+    m_wake_pending.store( true );
+    uint64_t const one = 1;
+    ssize_t written = write( m_wake_fd, &one, sizeof( one ) );
+    (void)written;
+}
+
+void EventLoop::wake()
+{
+    // Pairs with the fence in run_once_ns(): either the loop sees the push
+    // or this sees the loop polling
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( !m_polling.load( std::memory_order_relaxed )
+         || m_wake_pending.exchange( true ) )
+    {
+        return;
+    }
+    uint64_t const one = 1;
+    ssize_t written = write( m_wake_fd, &one, sizeof( one ) );
+    (void)written;
+}
+}
@@ -0,0 +1,296 @@
+#include "LambdaStew/Future.hpp"
+
+#include <mutex>
+#include <new>
+
+namespace LambdaStew
+{
+
+const uint32_t FutureStateBase::flag_ready;
+const uint32_t FutureStateBase::flag_continuation;
+const uint32_t FutureStateBase::flag_waiting;
+
+///
+/// \brief pool_granularity
+///
+/// The pool keeps blocks in multiples of this size, up to pool_classes
+/// times it. Larger states come straight from the heap
+///
+static const size_t pool_granularity = 64;
+static const size_t pool_classes = 8;
+
+///
+/// \brief pool_cache_limit
+///
+/// The most free blocks of one size a thread keeps for itself. Half of them
+/// move to the shared list when a thread frees more than this
+///
+static const size_t pool_cache_limit = 64;
+
+struct PoolBlock
+{
+    PoolBlock *next;
+};
+
+///
+/// \brief The SharedPool struct
+///
+/// Free blocks which any thread can take, a batch at a time
+///
+struct SharedPool
+{
+    SharedPool()
+    {
+        for ( size_t i = 0; i < pool_classes; ++i )
+        {
+            heads[i] = nullptr;
+        }
+    }
+
+    std::mutex mutex;
+    PoolBlock *heads[pool_classes];
+};
+
+///
+/// \brief shared_pool
+///
+/// Never destroyed, so that thread caches can return blocks to it however
+/// late the threads exit
+///
+static SharedPool &shared_pool()
+{
+    static SharedPool *pool = new SharedPool;
+    return *pool;
+}
+
+///
+/// \brief The PoolCache struct
+///
+/// The free blocks of one thread
+///
+struct PoolCache
+{
+    PoolCache()
+    {
+        for ( size_t i = 0; i < pool_classes; ++i )
+        {
+            heads[i] = nullptr;
+            counts[i] = 0;
+        }
+    }
+
+    ~PoolCache();
+
+    ///
+    /// \brief give_back
+    ///
+    /// Move count blocks of a size class to the shared pool
+    ///
+    void give_back( size_t size_class, size_t count )
+    {
+        if ( count == 0 )
+        {
+            return;
+        }
+
+        PoolBlock *first = heads[size_class];
+        PoolBlock *last = first;
+        for ( size_t i = 1; i < count; ++i )
+        {
+            last = last->next;
+        }
+        heads[size_class] = last->next;
+        counts[size_class] -= count;
+
+        SharedPool &pool = shared_pool();
+        lock_guard<std::mutex> guard( pool.mutex );
+        last->next = pool.heads[size_class];
+        pool.heads[size_class] = first;
+    }
+
+    ///
+    /// \brief refill
+    ///
+    /// Take up to half the cache limit of blocks of a size class from the
+    /// shared pool
+    ///
+    void refill( size_t size_class )
+    {
+        SharedPool &pool = shared_pool();
+        lock_guard<std::mutex> guard( pool.mutex );
+        while ( pool.heads[size_class]
+                && counts[size_class] < pool_cache_limit / 2 )
+        {
+            PoolBlock *block = pool.heads[size_class];
+            pool.heads[size_class] = block->next;
+            block->next = heads[size_class];
+            heads[size_class] = block;
+            ++counts[size_class];
+        }
+    }
+
+    PoolBlock *heads[pool_classes];
+    size_t counts[pool_classes];
+};
+
+static thread_local PoolCache t_pool_cache;
+
+///
+/// \brief t_pool_cache_destroyed
+///
+/// Set once t_pool_cache of the thread is destroyed. The destructor of a
+/// thread_local constructed before it runs later and can still free a
+/// state, which then goes straight to the shared pool. A bool needs no
+/// destructor, so it stays valid until the thread is gone
+///
+static thread_local bool t_pool_cache_destroyed = false;
+
+PoolCache::~PoolCache()
+{
+    for ( size_t i = 0; i < pool_classes; ++i )
+    {
+        give_back( i, counts[i] );
+    }
+    t_pool_cache_destroyed = true;
+}
+
+void *future_state_allocate( size_t size )
+{
+    size_t const size_class = ( size - 1 ) / pool_granularity;
+    if ( size_class >= pool_classes )
+    {
+        return ::operator new( size );
+    }
+
+    if ( t_pool_cache_destroyed )
+    {
+        return ::operator new( ( size_class + 1 ) * pool_granularity );
+    }
+
+    PoolCache &cache = t_pool_cache;
+    if ( !cache.heads[size_class] )
+    {
+        cache.refill( size_class );
+        if ( !cache.heads[size_class] )
+        {
+            return ::operator new( ( size_class + 1 ) * pool_granularity );
+        }
+    }
+
+    PoolBlock *block = cache.heads[size_class];
+    cache.heads[size_class] = block->next;
+    --cache.counts[size_class];
+    return block;
+}
+
+void future_state_deallocate( void *p, size_t size ) noexcept
+{
+    size_t const size_class = ( size - 1 ) / pool_granularity;
+    if ( size_class >= pool_classes )
+    {
+        ::operator delete( p );
+        return;
+    }
+
+    PoolBlock *block = static_cast<PoolBlock *>( p );
+    if ( t_pool_cache_destroyed )
+    {
+        SharedPool &pool = shared_pool();
+        lock_guard<std::mutex> guard( pool.mutex );
+        block->next = pool.heads[size_class];
+        pool.heads[size_class] = block;
+        return;
+    }
+
+    PoolCache &cache = t_pool_cache;
+    block->next = cache.heads[size_class];
+    cache.heads[size_class] = block;
+    if ( ++cache.counts[size_class] > pool_cache_limit )
+    {
+        cache.give_back( size_class, pool_cache_limit / 2 );
+    }
+}
+
+///
+/// \brief future_signaler
+///
+/// The futures share a small set of Signalers, picked by the address of
+/// the state, instead of carrying one each. A waiter woken for another
+/// state on the same Signaler checks its own state and waits again
+///
+static Signaler &future_signaler( void const *state )
+{
+    static Signaler signalers[64];
+    uintptr_t const address = reinterpret_cast<uintptr_t>( state );
+    return signalers[( address / pool_granularity ) % 64];
+}
+
+void FutureStateBase::complete()
+{
+    uint32_t const old = m_state.fetch_or( flag_ready );
+    if ( old & flag_waiting )
+    {
+        future_signaler( this ).send_signal_all();
+    }
+    if ( old & flag_continuation )
+    {
+        dispatch();
+    }
+}
+
+void FutureStateBase::set_continuation( MessageQueue &queue, Task &&task )
+{
+    m_continuation_queue = &queue;
+    m_continuation = std::move( task );
+    if ( m_state.fetch_or( flag_continuation ) & flag_ready )
+    {
+        dispatch();
+    }
+}
+
+void FutureStateBase::dispatch()
+{
+    // The continuation may hold the last reference to this state, so move
+    // it out before the queue can run it or it is dropped
+    Task task( std::move( m_continuation ) );
+    m_continuation_queue->push_back( std::move( task ) );
+}
+
+void FutureStateBase::wait()
+{
+    wait_for_ns( std::chrono::nanoseconds::max() );
+}
+
+bool FutureStateBase::wait_for_ns( std::chrono::nanoseconds timeout )
+{
+    if ( is_ready() )
+    {
+        return true;
+    }
+
+    typedef std::chrono::steady_clock clock;
+    clock::time_point const start = clock::now();
+    clock::time_point const deadline
+        = timeout >= clock::time_point::max() - start ? clock::time_point::max()
+                                                      : start + timeout;
+
+    Signaler &signaler = future_signaler( this );
+    while ( true )
+    {
+        // Read the count before announcing the waiter, so a complete()
+        // after the announcement changes it and the wait returns
+        Signaler::signal_count_type last_signal_count = signaler.get_count();
+        if ( m_state.fetch_or( flag_waiting ) & flag_ready )
+        {
+            return true;
+        }
+
+        clock::time_point const now = clock::now();
+        if ( now >= deadline )
+        {
+            return false;
+        }
+        signaler.wait_for_signal_for( last_signal_count, deadline - now );
+    }
+}
+}
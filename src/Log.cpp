@@ -1,4 +1,7 @@
 #include "LambdaStew/Log.hpp"
+#include "LambdaStew/LogCategory.hpp"
+#include "LambdaStew/LogFile.hpp"
+#include "LambdaStew/LogWriter.hpp"
 
 namespace LambdaStew
 {
@@ -21,109 +24,179 @@ std::ostream *log_ostream( bool set, std::ostream *o )
     return output_stream.load();
 }
 
-bool log_error_enable( bool set, bool new_value )
+std::atomic<uint32_t> log_enabled_levels(
+    ( 1u << int( LogLevel::crit ) ) | ( 1u << int( LogLevel::error ) )
+    | ( 1u << int( LogLevel::warning ) ) | ( 1u << int( LogLevel::notice ) )
+    | ( 1u << int( LogLevel::info ) ) );
+
+///
+/// \brief log_level_enable
+///
+/// get or change the runtime enable bit of one level
+///
+static bool log_level_enable( LogLevel level, bool set, bool new_value )
 {
-    static std::atomic<bool> current_value( true );
-
-    bool r = current_value;
+    uint32_t const bit = 1u << int( level );
 
     if ( set )
     {
-        current_value.store( new_value );
-        r = new_value;
+        if ( new_value )
+        {
+            log_enabled_levels.fetch_or( bit );
+        }
+        else
+        {
+            log_enabled_levels.fetch_and( ~bit );
+        }
+        log_categories_update();
+        return new_value;
     }
 
-    return r;
+    return ( log_enabled_levels.load() & bit ) != 0;
+}
+
+bool log_error_enable( bool set, bool new_value )
+{
+    return log_level_enable( LogLevel::error, set, new_value );
 }
 
 bool log_warning_enable( bool set, bool new_value )
 {
-    static std::atomic<bool> current_value( true );
+    return log_level_enable( LogLevel::warning, set, new_value );
+}
 
-    bool r = current_value;
+bool log_trace_enable( bool set, bool new_value )
+{
+    return log_level_enable( LogLevel::trace, set, new_value );
+}
 
-    if ( set )
-    {
-        current_value.store( new_value );
-        r = new_value;
-    }
+bool log_debug_enable( bool set, bool new_value )
+{
+    return log_level_enable( LogLevel::debug, set, new_value );
+}
 
-    return r;
+bool log_info_enable( bool set, bool new_value )
+{
+    return log_level_enable( LogLevel::info, set, new_value );
 }
 
-bool log_trace_enable( bool set, bool new_value )
+bool log_notice_enable( bool set, bool new_value )
 {
-    static std::atomic<bool> current_value( false );
+    return log_level_enable( LogLevel::notice, set, new_value );
+}
 
-    bool r = current_value;
+bool log_crit_enable( bool set, bool new_value )
+{
+    return log_level_enable( LogLevel::crit, set, new_value );
+}
 
-    if ( set )
+char const *log_level_prefix( LogLevel level )
+{
+    switch ( level )
     {
-        current_value.store( new_value );
-        r = new_value;
+    case LogLevel::crit:
+        return "CRIT   :";
+    case LogLevel::error:
+        return "ERROR  :";
+    case LogLevel::warning:
+        return "WARNING:";
+    case LogLevel::notice:
+        return "NOTICE :";
+    case LogLevel::info:
+        return "INFO   :";
+    case LogLevel::debug:
+        return "DEBUG  :";
+    case LogLevel::trace:
+        return "trace  :";
     }
-
-    return r;
+    return "";
 }
 
-bool log_debug_enable( bool set, bool new_value )
+bool log_async( bool set,
+                bool new_value,
+                LogOverflow overflow,
+                size_t buffer_size )
 {
-    static std::atomic<bool> current_value( false );
-
-    bool r = current_value;
+    LogWriter &writer = LogWriter::instance();
 
     if ( set )
     {
-        current_value.store( new_value );
-        r = new_value;
+        writer.enable( new_value, overflow, buffer_size );
     }
 
-    return r;
+    return writer.enabled();
 }
 
-bool log_info_enable( bool set, bool new_value )
+void log_flush()
 {
-    static std::atomic<bool> current_value( true );
+    LogWriter::instance().flush();
+    log_file().sync();
+}
 
-    bool r = current_value;
+uint64_t log_dropped() { return LogWriter::instance().dropped(); }
 
-    if ( set )
+void log_write( LogLevel level, char const *text, size_t length )
+{
+    if ( !LogWriter::instance().write( level, text, length ) )
     {
-        current_value.store( new_value );
-        r = new_value;
+        log_write_now( level, text, length );
     }
-
-    return r;
 }
 
-bool log_notice_enable( bool set, bool new_value )
-{
-    static std::atomic<bool> current_value( true );
-
-    bool r = current_value;
+#ifdef ENABLE_SYSLOG
 
-    if ( set )
+///
+/// \brief log_level_syslog_priority
+///
+/// \return the syslog priority of a log level
+///
+static int log_level_syslog_priority( LogLevel level )
+{
+    switch ( level )
     {
-        current_value.store( new_value );
-        r = new_value;
+    case LogLevel::crit:
+        return LOG_CRIT;
+    case LogLevel::error:
+        return LOG_ERR;
+    case LogLevel::warning:
+        return LOG_WARNING;
+    case LogLevel::notice:
+        return LOG_NOTICE;
+    case LogLevel::info:
+        return LOG_INFO;
+    case LogLevel::debug:
+    case LogLevel::trace:
+        return LOG_DEBUG;
     }
-
-    return r;
+    return LOG_INFO;
 }
 
-bool log_crit_enable( bool set, bool new_value )
-{
-    static std::atomic<bool> current_value( true );
+#endif
 
-    bool r = current_value;
+void log_write_now( LogLevel level, char const *text, size_t length )
+{
+    if ( log_file().write_line( log_level_prefix( level ), text, length ) )
+    {
+        return;
+    }
 
-    if ( set )
+#ifdef ENABLE_SYSLOG
+    if ( log_to_syslog() )
     {
-        current_value.store( new_value );
-        r = new_value;
+        lock_guard<mutex> guard( log_mutex() );
+        syslog( log_level_syslog_priority( level ),
+                "%.*s",
+                (int)length,
+                text );
+        return;
     }
+#endif
 
-    return r;
+    lock_guard<mutex> guard( log_mutex() );
+    std::ostream &o = *log_ostream();
+    o << log_level_prefix( level );
+    o.write( text, length );
+    o << std::endl;
 }
 
 #ifdef ENABLE_SYSLOG
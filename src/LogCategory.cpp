@@ -0,0 +1,125 @@
+#include "LambdaStew/LogCategory.hpp"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace LambdaStew
+{
+
+///
+/// \brief log_category_mutex
+///
+/// Guards creating categories and changing their levels
+///
+static std::mutex &log_category_mutex()
+{
+    static std::mutex m;
+    return m;
+}
+
+///
+/// \brief log_category_registry
+///
+/// Every category, each one after its parent
+///
+static std::vector<std::unique_ptr<LogCategory> > &log_category_registry()
+{
+    static std::vector<std::unique_ptr<LogCategory> > registry;
+    return registry;
+}
+
+///
+/// \brief log_category_find_or_create
+///
+/// log_category() with log_category_mutex() held
+///
+static LogCategory &log_category_find_or_create( std::string const &name )
+{
+    std::vector<std::unique_ptr<LogCategory> > &registry
+        = log_category_registry();
+
+    for ( auto const &c : registry )
+    {
+        if ( c->name() == name )
+        {
+            return *c;
+        }
+    }
+
+    LogCategory *parent = nullptr;
+    std::string::size_type dot = name.rfind( '.' );
+    if ( dot != std::string::npos )
+    {
+        parent = &log_category_find_or_create( name.substr( 0, dot ) );
+    }
+
+    registry.push_back(
+        std::unique_ptr<LogCategory>( new LogCategory( name, parent ) ) );
+    return *registry.back();
+}
+
+///
+/// Parents come before their children in the registry, so one pass reaches
+/// every category
+///
+void LogCategory::refresh_all()
+{
+    for ( auto const &c : log_category_registry() )
+    {
+        uint32_t levels;
+        if ( c->m_explicit )
+        {
+            levels = c->m_explicit_levels;
+        }
+        else if ( c->m_parent )
+        {
+            levels = c->m_parent->m_levels.load( std::memory_order_relaxed );
+        }
+        else
+        {
+            levels = log_enabled_levels.load( std::memory_order_relaxed );
+        }
+        c->m_levels.store( levels, std::memory_order_relaxed );
+    }
+}
+
+LogCategory::LogCategory( std::string const &name, LogCategory *parent )
+    : m_name( name )
+    , m_parent( parent )
+    , m_levels( parent ? parent->levels()
+                       : log_enabled_levels.load( std::memory_order_relaxed ) )
+    , m_explicit( false )
+    , m_explicit_levels( 0 )
+{
+}
+
+LogCategory &log_category( std::string const &name )
+{
+    std::lock_guard<std::mutex> guard( log_category_mutex() );
+    return log_category_find_or_create( name );
+}
+
+void log_category_levels( std::string const &name, uint32_t levels )
+{
+    std::lock_guard<std::mutex> guard( log_category_mutex() );
+    LogCategory &c = log_category_find_or_create( name );
+    c.m_explicit = true;
+    c.m_explicit_levels = levels;
+    LogCategory::refresh_all();
+}
+
+void log_category_inherit( std::string const &name )
+{
+    std::lock_guard<std::mutex> guard( log_category_mutex() );
+    LogCategory &c = log_category_find_or_create( name );
+    c.m_explicit = false;
+    LogCategory::refresh_all();
+}
+
+void log_categories_update()
+{
+    std::lock_guard<std::mutex> guard( log_category_mutex() );
+    LogCategory::refresh_all();
+}
+}
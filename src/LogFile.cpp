@@ -0,0 +1,394 @@
+#include "LambdaStew/LogFile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace LambdaStew
+{
+
+///
+/// \brief steady_now_ns
+///
+static int64_t steady_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+///
+/// \brief shift_rotated_files
+///
+/// Rename path to path.1, path.1 to path.2 and so on, dropping path.keep
+///
+static void shift_rotated_files( std::string const &path, unsigned keep )
+{
+    if ( keep == 0 )
+    {
+        unlink( path.c_str() );
+        return;
+    }
+
+    for ( unsigned i = keep; i > 1; --i )
+    {
+        std::string const from = path + "." + std::to_string( i - 1 );
+        std::string const to = path + "." + std::to_string( i );
+        rename( from.c_str(), to.c_str() );
+    }
+    rename( path.c_str(), ( path + ".1" ).c_str() );
+}
+
+///
+/// \brief log_rotation_failed
+///
+/// Report a failed rotation, which closed the file, on syslog or the log
+/// ostream
+///
+static void log_rotation_failed()
+{
+    static char const text[] = "LogFile rotation failed, the file is closed";
+    log_write_now( LogLevel::error, text, sizeof( text ) - 1 );
+}
+
+LogFile::LogFile()
+    : m_current( nullptr ), m_rotations( 0 ), m_segment_size( 0 )
+{
+}
+
+LogFile::~LogFile()
+{
+    close();
+    for ( Segment *s : m_segments )
+    {
+        delete s;
+    }
+}
+
+bool LogFile::open( LogFileOptions const &options )
+{
+    close();
+
+    lock_guard<std::mutex> guard( m_mutex );
+    m_options = options;
+    if ( m_options.segment_size == 0 )
+    {
+        m_options.segment_size = LogFileOptions().segment_size;
+    }
+    m_segment_size.store( m_options.segment_size );
+
+    // Append to an existing file which still has room
+    size_t offset = 0;
+    struct stat st;
+    if ( stat( m_options.path.c_str(), &st ) == 0 )
+    {
+        if ( size_t( st.st_size ) < m_options.segment_size )
+        {
+            offset = size_t( st.st_size );
+        }
+        else
+        {
+            shift_rotated_files( m_options.path, m_options.keep );
+        }
+    }
+
+    Segment *s = map_segment( m_options.path, offset );
+    m_current.store( s );
+    return s != nullptr;
+}
+
+void LogFile::close()
+{
+    lock_guard<std::mutex> guard( m_mutex );
+    Segment *s = m_current.exchange( nullptr );
+    if ( s )
+    {
+        wait_for_writers( s );
+        finish_segment( s );
+    }
+}
+
+bool LogFile::write( char const *text, size_t length )
+{
+    while ( length > 0 )
+    {
+        // Split text which does not fit in one file after a line ending
+        size_t chunk = length;
+        size_t const limit = m_segment_size.load();
+        if ( chunk > limit )
+        {
+            chunk = limit;
+            for ( size_t i = limit; i > 0; --i )
+            {
+                if ( text[i - 1] == '\n' )
+                {
+                    chunk = i;
+                    break;
+                }
+            }
+        }
+
+        bool const ok = append( chunk,
+                                [&]( char *dest, size_t n )
+                                {
+                                    memcpy( dest, text, n );
+                                } );
+        if ( !ok )
+        {
+            return false;
+        }
+        text += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+bool LogFile::write_line( char const *prefix, char const *text, size_t length )
+{
+    size_t const prefix_length = strlen( prefix );
+
+    return append( prefix_length + length + 1,
+                   [&]( char *dest, size_t n )
+                   {
+                       // A line longer than the segment loses the end of its
+                       // text, but keeps its line ending
+                       size_t const p = std::min( prefix_length, n - 1 );
+                       size_t const t = std::min( length, n - 1 - p );
+                       memcpy( dest, prefix, p );
+                       memcpy( dest + p, text, t );
+                       dest[p + t] = '\n';
+                   } );
+}
+
+void LogFile::sync()
+{
+    lock_guard<std::mutex> guard( m_mutex );
+    Segment *s = m_current.load();
+    if ( s && m_options.sync != LogFileSync::none )
+    {
+        size_t const used = std::min( s->offset.load(), s->size );
+        if ( used > 0 )
+        {
+            msync( s->data,
+                   used,
+                   m_options.sync == LogFileSync::sync ? MS_SYNC : MS_ASYNC );
+        }
+    }
+}
+
+template <typename FillT>
+bool LogFile::append( size_t length, FillT fill )
+{
+    while ( true )
+    {
+        Segment *s = m_current.load();
+        if ( !s )
+        {
+            return false;
+        }
+
+        if ( s->rotate_at && steady_now_ns() >= s->rotate_at )
+        {
+            // Time to rotate; if another thread is already rotating, keep
+            // writing to this segment until it is replaced
+            std::unique_lock<std::mutex> lock( m_mutex, std::try_to_lock );
+            if ( lock.owns_lock() )
+            {
+                bool const ok = rotate( s );
+                lock.unlock();
+                if ( !ok )
+                {
+                    log_rotation_failed();
+                }
+                continue;
+            }
+        }
+
+        // Announce the write before checking that s is still current, so
+        // that a rotation either sees the write or this thread sees the
+        // rotation
+        s->writers.fetch_add( 1 );
+        if ( m_current.load() != s )
+        {
+            s->writers.fetch_sub( 1 );
+            continue;
+        }
+
+        size_t const n = std::min( length, s->size );
+        size_t const start = s->offset.fetch_add( n );
+        if ( start + n <= s->size )
+        {
+            fill( s->data + start, n );
+            s->writers.fetch_sub( 1, std::memory_order_release );
+            return true;
+        }
+
+        // No room: the file ends where the first failed reservation starts
+        size_t end = s->end.load();
+        while ( start < end && !s->end.compare_exchange_weak( end, start ) )
+        {
+        }
+        s->writers.fetch_sub( 1, std::memory_order_release );
+
+        if ( start <= s->size )
+        {
+            // This reservation crossed the end, so this thread rotates
+            bool ok;
+            {
+                lock_guard<std::mutex> guard( m_mutex );
+                ok = rotate( s );
+            }
+            if ( !ok )
+            {
+                log_rotation_failed();
+            }
+        }
+        else
+        {
+            while ( m_current.load() == s )
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+LogFile::Segment *LogFile::map_segment( std::string const &path, size_t offset )
+{
+    int fd = ::open( path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+    if ( fd < 0 )
+    {
+        return nullptr;
+    }
+
+    // Allocate the blocks up front, so that running out of disk space
+    // fails here rather than as a SIGBUS in a writer
+    size_t const size = m_options.segment_size;
+    if ( posix_fallocate( fd, 0, off_t( size ) ) != 0
+         && ftruncate( fd, off_t( size ) ) != 0 )
+    {
+        ::close( fd );
+        return nullptr;
+    }
+
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    if ( m_options.prefault )
+    {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void *data = mmap( nullptr, size, PROT_READ | PROT_WRITE, flags, fd, 0 );
+    if ( data == MAP_FAILED )
+    {
+        ::close( fd );
+        return nullptr;
+    }
+    madvise( data, size, m_options.prefault ? MADV_WILLNEED : MADV_SEQUENTIAL );
+
+    Segment *s = new Segment;
+    s->fd = fd;
+    s->data = static_cast<char *>( data );
+    s->size = size;
+    s->offset.store( offset );
+    s->end.store( size );
+    s->writers.store( 0 );
+    s->rotate_at = m_options.rotate_interval.count() > 0
+                       ? steady_now_ns()
+                             + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   m_options.rotate_interval ).count()
+                       : 0;
+    m_segments.push_back( s );
+    return s;
+}
+
+void LogFile::finish_segment( Segment *s )
+{
+    size_t const used = std::min( s->offset.load(), s->end.load() );
+
+    if ( used > 0 && m_options.sync != LogFileSync::none )
+    {
+        msync( s->data,
+               used,
+               m_options.sync == LogFileSync::sync ? MS_SYNC : MS_ASYNC );
+    }
+    munmap( s->data, s->size );
+    if ( ftruncate( s->fd, off_t( used ) ) != 0 )
+    {
+        // The file keeps its NUL padding
+    }
+    ::close( s->fd );
+    s->data = nullptr;
+    s->fd = -1;
+}
+
+bool LogFile::rotate( Segment *s )
+{
+    if ( m_current.load() != s )
+    {
+        return true;
+    }
+
+    // Map the next file under a temporary name and switch writers to it
+    // first, so that they only wait for the open and the mapping
+    std::string const next_path = m_options.path + ".next";
+    Segment *next = map_segment( next_path, 0 );
+    m_current.store( next );
+
+    wait_for_writers( s );
+    finish_segment( s );
+
+    shift_rotated_files( m_options.path, m_options.keep );
+    if ( next )
+    {
+        rename( next_path.c_str(), m_options.path.c_str() );
+    }
+    else
+    {
+        unlink( next_path.c_str() );
+    }
+    m_rotations.fetch_add( 1 );
+    return next != nullptr;
+}
+
+void LogFile::wait_for_writers( Segment *s )
+{
+    while ( s->writers.load( std::memory_order_acquire ) != 0 )
+    {
+        std::this_thread::yield();
+    }
+}
+
+LogFile &log_file()
+{
+    static LogFile file;
+    return file;
+}
+
+bool log_to_file( bool set, bool new_value, LogFileOptions const &options )
+{
+    LogFile &file = log_file();
+
+    if ( set )
+    {
+        if ( new_value )
+        {
+            if ( !file.open( options ) )
+            {
+                log_error( "log_to_file() can not open ", options.path );
+            }
+        }
+        else
+        {
+            file.close();
+        }
+    }
+
+    return file.is_open();
+}
+}
@@ -0,0 +1,185 @@
+#include "LambdaStew/LogFormat.hpp"
+
+#include <clocale>
+#include <cstdio>
+#include <locale>
+
+namespace LambdaStew
+{
+
+///
+/// \brief digit_pairs
+///
+/// "00" to "99", to convert two digits at a time
+///
+static char const digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+void format_unsigned( FormatBuffer &dest, unsigned long long v )
+{
+    char buf[24];
+    char *end = buf + sizeof( buf );
+    char *p = end;
+
+    while ( v >= 100 )
+    {
+        unsigned i = unsigned( v % 100 ) * 2;
+        v /= 100;
+        *--p = digit_pairs[i + 1];
+        *--p = digit_pairs[i];
+    }
+    if ( v >= 10 )
+    {
+        unsigned i = unsigned( v ) * 2;
+        *--p = digit_pairs[i + 1];
+        *--p = digit_pairs[i];
+    }
+    else
+    {
+        *--p = char( '0' + v );
+    }
+    dest.append( p, size_t( end - p ) );
+}
+
+void format_signed( FormatBuffer &dest, long long v )
+{
+    if ( v < 0 )
+    {
+        dest.append( '-' );
+        // Negate in unsigned arithmetic so that the minimum value works
+        format_unsigned( dest, 0ULL - (unsigned long long)v );
+    }
+    else
+    {
+        format_unsigned( dest, (unsigned long long)v );
+    }
+}
+
+///
+/// \brief classic_decimal_point
+///
+/// snprintf() writes the decimal point of LC_NUMERIC. Put back the '.' of
+/// the classic locale, which the ostream path uses
+///
+/// \return the new length of the text in buf
+///
+static size_t classic_decimal_point( char *buf, size_t n )
+{
+    char const *point = localeconv()->decimal_point;
+    if ( point[0] == '.' && point[1] == '\0' )
+    {
+        return n;
+    }
+
+    size_t const length = strlen( point );
+    char *p = length ? strstr( buf, point ) : nullptr;
+    if ( !p )
+    {
+        return n;
+    }
+    *p = '.';
+    memmove( p + 1, p + length, size_t( buf + n - ( p + length ) ) + 1 );
+    return n - ( length - 1 );
+}
+
+void format_double( FormatBuffer &dest, double v )
+{
+    char buf[32];
+    int n = snprintf( buf, sizeof( buf ), "%g", v );
+    dest.append( buf, classic_decimal_point( buf, size_t( n ) ) );
+}
+
+void format_long_double( FormatBuffer &dest, long double v )
+{
+    char buf[48];
+    int n = snprintf( buf, sizeof( buf ), "%Lg", v );
+    dest.append( buf, classic_decimal_point( buf, size_t( n ) ) );
+}
+
+void format_pointer( FormatBuffer &dest, void const *v )
+{
+    if ( !v )
+    {
+        dest.append( '0' );
+        return;
+    }
+
+    static char const hex_digits[] = "0123456789abcdef";
+    char buf[2 + 2 * sizeof( uintptr_t )];
+    char *end = buf + sizeof( buf );
+    char *p = end;
+
+    for ( uintptr_t a = (uintptr_t)v; a != 0; a >>= 4 )
+    {
+        *--p = hex_digits[a & 0xf];
+    }
+    *--p = 'x';
+    *--p = '0';
+    dest.append( p, size_t( end - p ) );
+}
+
+///
+/// \brief The FormatStream::Stream struct
+///
+/// An ostream writing to a FormatStreambuf
+///
+struct FormatStream::Stream
+{
+    Stream() : ostream( &streambuf ), busy( false )
+    {
+        ostream.imbue( std::locale::classic() );
+    }
+
+    FormatStreambuf streambuf;
+    std::ostream ostream;
+
+    /// The stream is lent out, only used for the stream of a thread
+    bool busy;
+};
+
+FormatStream::Stream &FormatStream::thread_stream()
+{
+    static thread_local Stream stream;
+    return stream;
+}
+
+FormatStream::FormatStream( FormatBuffer &dest )
+    : m_stream( &thread_stream() ), m_owned( false )
+{
+    if ( m_stream->busy )
+    {
+        m_stream = new Stream;
+        m_owned = true;
+    }
+    m_stream->busy = true;
+    m_stream->streambuf.set_buffer( &dest );
+    m_ostream = &m_stream->ostream;
+}
+
+FormatStream::~FormatStream()
+{
+    if ( m_owned )
+    {
+        delete m_stream;
+        return;
+    }
+
+    // Leave the stream with its default formatting for the next line,
+    // whatever manipulators this one used
+    std::ostream &o = m_stream->ostream;
+    o.flags( std::ios_base::dec | std::ios_base::skipws );
+    o.precision( 6 );
+    o.fill( ' ' );
+    o.width( 0 );
+    o.clear();
+    m_stream->busy = false;
+}
+}
@@ -0,0 +1,60 @@
+#include "LambdaStew/LogRing.hpp"
+
+namespace LambdaStew
+{
+
+///
+/// \brief log_ring_size
+///
+/// \return capacity rounded up to a power of two, at least 64 bytes
+///
+static size_t log_ring_size( size_t capacity )
+{
+    size_t r = 64;
+    while ( r < capacity )
+    {
+        r <<= 1;
+    }
+    return r;
+}
+
+LogRing::LogRing( size_t capacity )
+    : m_mask( log_ring_size( capacity ) - 1 )
+    , m_buffer( new char[m_mask + 1] )
+    , m_head( 0 )
+    , m_reserved_head( 0 )
+    , m_tail( 0 )
+{
+}
+
+char *LogRing::reserve( uint32_t type, size_t size )
+{
+    size_t const needed = record_size( size );
+    size_t head = m_head.load( std::memory_order_relaxed );
+    size_t const tail = m_tail.load( std::memory_order_acquire );
+
+    // Records never wrap, so skip to the start of the buffer when this one
+    // does not fit before the end
+    size_t offset = head & m_mask;
+    size_t const to_end = capacity() - offset;
+    size_t const padding = needed > to_end ? to_end : 0;
+
+    if ( head + padding + needed - tail > capacity() )
+    {
+        return nullptr;
+    }
+
+    if ( padding )
+    {
+        Header filler = {uint32_t( to_end - sizeof( Header ) ), type_padding};
+        memcpy( m_buffer.get() + offset, &filler, sizeof( filler ) );
+        head += padding;
+        offset = 0;
+    }
+
+    Header header = {uint32_t( size ), type};
+    memcpy( m_buffer.get() + offset, &header, sizeof( header ) );
+    m_reserved_head = head + needed;
+    return m_buffer.get() + offset + sizeof( header );
+}
+}
@@ -0,0 +1,416 @@
+#include "LambdaStew/LogWriter.hpp"
+#include "LambdaStew/LogFile.hpp"
+
+#include <algorithm>
+
+namespace LambdaStew
+{
+
+const int LogWriter::poll_interval_ms;
+const uint32_t LogWriter::record_more;
+const uint32_t LogWriter::record_binary;
+
+LogWriter &LogWriter::instance()
+{
+    static LogWriter writer;
+    return writer;
+}
+
+LogWriter::LogWriter()
+    : m_enabled( false )
+    , m_exit( false )
+    , m_overflow( int( LogOverflow::block ) )
+    , m_buffer_size( 64 * 1024 )
+    , m_dropped( 0 )
+    , m_dropped_reported( 0 )
+    , m_flush_requested( 0 )
+    , m_flush_completed( 0 )
+    , m_binary_enabled( false )
+    , m_binary_sites_written( 0 )
+{
+    // The writer thread uses these until it is joined in our destructor, so
+    // they must be constructed first in order to be destroyed after us
+    log_mutex();
+    log_ostream();
+    log_file();
+}
+
+LogWriter::~LogWriter()
+{
+    m_enabled.store( false );
+
+    lock_guard<std::mutex> guard( m_thread_mutex );
+    if ( m_thread.joinable() )
+    {
+        m_exit.store( true );
+        m_signaler.send_signal_all();
+        m_thread.join();
+    }
+}
+
+void LogWriter::enable( bool new_value,
+                        LogOverflow overflow,
+                        size_t buffer_size )
+{
+    m_overflow.store( int( overflow ) );
+    m_buffer_size.store( buffer_size );
+
+    if ( new_value )
+    {
+        start_thread();
+        m_enabled.store( true );
+    }
+    else if ( m_enabled.exchange( false ) )
+    {
+        flush();
+    }
+}
+
+void LogWriter::start_thread()
+{
+    lock_guard<std::mutex> guard( m_thread_mutex );
+    if ( !m_thread.joinable() )
+    {
+        m_thread = std::thread( &LogWriter::run, this );
+    }
+}
+
+bool LogWriter::enable_binary( bool new_value, std::string const &path )
+{
+    // Write out everything logged to the current file before closing it
+    if ( m_binary_enabled.exchange( false ) )
+    {
+        flush();
+    }
+
+    lock_guard<std::mutex> guard( m_binary_mutex );
+    if ( m_binary_file.is_open() )
+    {
+        m_binary_file.close();
+    }
+
+    if ( !new_value )
+    {
+        return true;
+    }
+
+    m_binary_file.clear();
+    m_binary_file.open( path.c_str(),
+                        std::ios::binary | std::ios::out | std::ios::trunc );
+    if ( !m_binary_file )
+    {
+        return false;
+    }
+
+    int64_t const steady_ns
+        = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now().time_since_epoch() ).count();
+    int64_t const system_ns
+        = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::system_clock::now().time_since_epoch() ).count();
+    m_binary_file.write( binary_log_magic, sizeof( binary_log_magic ) );
+    m_binary_file.write( (char const *)&steady_ns, sizeof( steady_ns ) );
+    m_binary_file.write( (char const *)&system_ns, sizeof( system_ns ) );
+    m_binary_sites_written = 0;
+
+    start_thread();
+    m_binary_enabled.store( true );
+    return true;
+}
+
+LogWriter::ThreadRing &LogWriter::thread_ring()
+{
+    static thread_local ThreadRingOwner owner;
+
+    if ( !owner.ring )
+    {
+        owner.ring = std::make_shared<ThreadRing>( m_buffer_size.load() );
+        lock_guard<std::mutex> guard( m_rings_mutex );
+        m_rings.push_back( owner.ring );
+    }
+    return *owner.ring;
+}
+
+char *LogWriter::reserve( ThreadRing &r,
+                          uint32_t type,
+                          size_t size,
+                          bool may_drop )
+{
+    char *p;
+    while ( ( p = r.ring.reserve( type, size ) ) == nullptr )
+    {
+        if ( may_drop
+             && m_overflow.load( std::memory_order_relaxed )
+                    == int( LogOverflow::drop ) )
+        {
+            m_dropped.fetch_add( 1 );
+            return nullptr;
+        }
+        m_signaler.send_signal_one();
+        std::this_thread::yield();
+    }
+    return p;
+}
+
+bool LogWriter::write( LogLevel level, char const *text, size_t length )
+{
+    if ( !enabled() )
+    {
+        return false;
+    }
+
+    ThreadRing &r = thread_ring();
+    size_t const max_chunk = r.ring.max_record_size();
+    bool first = true;
+
+    // Lines longer than a record are split into several records which the
+    // writer joins again. Only whole lines are dropped; once a line is
+    // started its remaining records wait for room
+    do
+    {
+        size_t const chunk = std::min( length, max_chunk );
+        bool const more = chunk < length;
+        char *p = reserve(
+            r, uint32_t( level ) | ( more ? record_more : 0 ), chunk, first );
+        if ( !p )
+        {
+            return true;
+        }
+
+        memcpy( p, text, chunk );
+        r.ring.commit();
+        text += chunk;
+        length -= chunk;
+        first = false;
+    } while ( length > 0 );
+
+    wake();
+    return true;
+}
+
+char *LogWriter::reserve_binary( LogLevel level, size_t size )
+{
+    if ( !binary_enabled() )
+    {
+        return nullptr;
+    }
+    return reserve(
+        thread_ring(), uint32_t( level ) | record_binary, size, true );
+}
+
+void LogWriter::commit_binary()
+{
+    thread_ring().ring.commit();
+    wake();
+}
+
+void LogWriter::write_binary_sites()
+{
+    m_new_sites.clear();
+    binary_log_sites( m_binary_sites_written + 1, m_new_sites );
+
+    for ( auto const &site : m_new_sites )
+    {
+        uint32_t const id = ++m_binary_sites_written;
+        uint8_t const level = uint8_t( site.level );
+        uint32_t const line = uint32_t( site.line );
+        m_binary_file.put( char( binary_log_site ) );
+        m_binary_file.write( (char const *)&id, sizeof( id ) );
+        m_binary_file.write( (char const *)&level, sizeof( level ) );
+        m_binary_file.write( (char const *)&line, sizeof( line ) );
+
+        std::string const *strings[] = {&site.file, &site.format, &site.arg_types};
+        for ( auto str : strings )
+        {
+            uint32_t const length = uint32_t( str->size() );
+            m_binary_file.write( (char const *)&length, sizeof( length ) );
+            m_binary_file.write( str->data(), length );
+        }
+    }
+}
+
+void LogWriter::write_binary_entry( char const *data, size_t size )
+{
+    if ( !m_binary_file.is_open() )
+    {
+        return;
+    }
+
+    // The site of an entry is registered before the entry is published, so
+    // its description is available by now
+    uint32_t id;
+    memcpy( &id, data, sizeof( id ) );
+    if ( id > m_binary_sites_written )
+    {
+        write_binary_sites();
+    }
+
+    m_binary_file.put( char( binary_log_entry ) );
+    m_binary_file.write( data, size );
+}
+
+void LogWriter::flush()
+{
+    {
+        lock_guard<std::mutex> guard( m_thread_mutex );
+        if ( !m_thread.joinable() )
+        {
+            lock_guard<mutex> log_guard( log_mutex() );
+            log_ostream()->flush();
+            return;
+        }
+    }
+
+    uint64_t const ticket = m_flush_requested.fetch_add( 1 ) + 1;
+    m_signaler.send_signal_all();
+
+    while ( true )
+    {
+        Signaler::signal_count_type last_signal_count
+            = m_flushed_signaler.get_count();
+        if ( m_flush_completed.load() >= ticket )
+        {
+            break;
+        }
+        m_flushed_signaler.wait_for_signal_for(
+            last_signal_count, std::chrono::milliseconds( poll_interval_ms ) );
+    }
+}
+
+void LogWriter::run()
+{
+    while ( true )
+    {
+        // Read the flush request and the signal count before draining, so
+        // that every record published before either is part of this pass
+        uint64_t const flush_ticket = m_flush_requested.load();
+        Signaler::signal_count_type last_signal_count = m_signaler.get_count();
+        bool const exiting = m_exit.load();
+
+        size_t count = drain();
+
+        if ( flush_ticket != m_flush_completed.load() )
+        {
+            m_flush_completed.store( flush_ticket );
+            m_flushed_signaler.send_signal_all();
+        }
+
+        if ( count == 0 )
+        {
+            if ( exiting )
+            {
+                break;
+            }
+            m_signaler.wait_for_signal_for(
+                last_signal_count,
+                std::chrono::milliseconds( poll_interval_ms ) );
+        }
+    }
+}
+
+size_t LogWriter::drain()
+{
+    bool const to_file = log_file().is_open();
+#ifdef ENABLE_SYSLOG
+    bool const to_syslog = !to_file && log_to_syslog();
+#else
+    bool const to_syslog = false;
+#endif
+
+    auto write_line = [&]( LogLevel level, char const *text, size_t length )
+    {
+        if ( to_syslog )
+        {
+            log_write_now( level, text, length );
+        }
+        else
+        {
+            m_batch += log_level_prefix( level );
+            m_batch.append( text, length );
+            m_batch += '\n';
+        }
+    };
+
+    size_t count = 0;
+    {
+        lock_guard<std::mutex> binary_guard( m_binary_mutex );
+        lock_guard<std::mutex> guard( m_rings_mutex );
+        for ( auto i = m_rings.begin(); i != m_rings.end(); )
+        {
+            ThreadRing &r = **i;
+
+            // Everything a thread published happens before it is marked
+            // abandoned, so a ring read after seeing the mark is complete
+            bool const abandoned = r.abandoned.load();
+
+            count += r.ring.consume(
+                [&]( uint32_t type, char const *data, size_t size )
+                {
+                    if ( type & record_binary )
+                    {
+                        write_binary_entry( data, size );
+                        return;
+                    }
+
+                    LogLevel const level = LogLevel( type & 0xff );
+                    bool const more = ( type & record_more ) != 0;
+
+                    if ( !more && !r.continuing )
+                    {
+                        write_line( level, data, size );
+                    }
+                    else
+                    {
+                        // Keep split lines whole in the output
+                        r.pending.append( data, size );
+                        if ( !more )
+                        {
+                            write_line( level, r.pending.data(), r.pending.size() );
+                            r.pending.clear();
+                        }
+                    }
+                    r.continuing = more;
+                } );
+
+            if ( abandoned && r.ring.empty() )
+            {
+                i = m_rings.erase( i );
+            }
+            else
+            {
+                ++i;
+            }
+        }
+
+        if ( m_binary_file.is_open() )
+        {
+            m_binary_file.flush();
+        }
+    }
+
+    uint64_t const dropped = m_dropped.load();
+    if ( dropped != m_dropped_reported )
+    {
+        std::string const text = print_to_string(
+            "LogWriter dropped ", dropped - m_dropped_reported, " lines" );
+        write_line( LogLevel::warning, text.data(), text.size() );
+        m_dropped_reported = dropped;
+    }
+
+    if ( !m_batch.empty() && to_file
+         && log_file().write( m_batch.data(), m_batch.size() ) )
+    {
+        m_batch.clear();
+    }
+
+    if ( !m_batch.empty() )
+    {
+        lock_guard<mutex> guard( log_mutex() );
+        std::ostream &o = *log_ostream();
+        o.write( m_batch.data(), m_batch.size() );
+        o.flush();
+        m_batch.clear();
+    }
+    return count;
+}
+}
@@ -1,8 +1,94 @@
 #include "LambdaStew/MessageQueue.hpp"
+#include "LambdaStew/EventLoop.hpp"
+#include "LambdaStew/ShardedMessageQueue.hpp"
+#include "LambdaStew/WaitSet.hpp"
 
 namespace LambdaStew
 {
 
+const unsigned MessageQueue::max_lanes;
+
+MessageQueue::MessageQueue( Backend backend,
+                            size_t ring_capacity,
+                            unsigned lanes )
+    : m_depth( 0 )
+    , m_lane_bits( 0 )
+    , m_aging_ns( 0 )
+    , m_idle_consumers( 0 )
+    , m_state( state_open )
+    , m_capacity( 0 )
+    , m_overflow( int( Overflow::block ) )
+    , m_block_timeout_ns( std::chrono::nanoseconds::max().count() )
+    , m_blocked_producers( 0 )
+    , m_dropped( 0 )
+    , m_rejected( 0 )
+    , m_stats( nullptr )
+    , m_pending_timers( 0 )
+    , m_group( nullptr )
+    , m_wait_set( nullptr )
+    , m_event_loop( nullptr )
+    , m_batches_in_flight( 0 )
+{
+    lanes = std::max( 1u, std::min( lanes, max_lanes ) );
+    for ( unsigned i = 0; i < max_lanes; ++i )
+    {
+        m_lane_served[i].store( 0, std::memory_order_relaxed );
+    }
+
+    if ( backend == Backend::lock_free_ring )
+    {
+        for ( unsigned i = 0; i < lanes; ++i )
+        {
+            m_rings.emplace_back( new MPMCRing<Item>( ring_capacity ) );
+        }
+    }
+    else
+    {
+        // Items are move-only and deque may throw on move, so the lanes are
+        // built in place rather than grown with resize()
+        vector<deque<Item> >( lanes ).swap( m_lanes );
+    }
+}
+
+MessageQueue::~MessageQueue()
+{
+    if ( m_pending_timers.load() )
+    {
+        TimerScheduler::instance().cancel_all( *this );
+    }
+    if ( m_wait_set )
+    {
+        m_wait_set->remove( *this );
+    }
+}
+
+TimerId MessageQueue::schedule_at( std::chrono::steady_clock::time_point when,
+                                   Task &&task )
+{
+    if ( is_closed() )
+    {
+        return 0;
+    }
+    return TimerScheduler::instance().schedule(
+        *this, when, std::move( task ) );
+}
+
+TimerId MessageQueue::schedule_every( std::chrono::nanoseconds period,
+                                      std::function<void()> const &func )
+{
+    if ( is_closed() )
+    {
+        return 0;
+    }
+    return TimerScheduler::instance().schedule_every(
+        *this, std::chrono::steady_clock::now() + period, period, func );
+}
+
+bool MessageQueue::cancel_timer( TimerId id )
+{
+    return TimerScheduler::instance().cancel( id );
+}
+
 std::function<void()> MessageQueue::make_please_stop_item() const
 {
     return []()
@@ -14,60 +100,585 @@ std::function<void()> MessageQueue::make_please_stop_item() const
 void MessageQueue::push_back_please_stop()
 {
     // Notify all waiting threads to consume this function
-    push_back( make_please_stop_item(), true );
+    enqueue( lanes() - 1, make_please_stop_item(), true, Admission::force );
+}
+
+void MessageQueue::set_aging_ns( int64_t max_wait_ns )
+{
+    // Start every lane's wait now rather than at the epoch
+    int64_t const now = QueueStats::now_ns();
+    for ( unsigned i = 0; i < max_lanes; ++i )
+    {
+        m_lane_served[i].store( now, std::memory_order_relaxed );
+    }
+    m_aging_ns.store( std::max<int64_t>( max_wait_ns, 0 ) );
+}
+
+unsigned MessageQueue::select_lane( uint32_t bits ) const
+{
+    unsigned lane = 31 - unsigned( __builtin_clz( bits ) );
+    int64_t const aging = m_aging_ns.load( std::memory_order_relaxed );
+    uint32_t lower = bits & ( ( 1u << lane ) - 1 );
+    if ( !aging || !lower )
+    {
+        return lane;
+    }
+
+    // Serve the lower lane which has waited longest beyond the aging time
+    int64_t oldest = QueueStats::now_ns() - aging;
+    while ( lower )
+    {
+        unsigned const i = unsigned( __builtin_ctz( lower ) );
+        lower &= lower - 1;
+        int64_t const served
+            = m_lane_served[i].load( std::memory_order_relaxed );
+        if ( served < oldest )
+        {
+            oldest = served;
+            lane = i;
+        }
+    }
+    return lane;
+}
+
+void MessageQueue::set_capacity_ns( size_t capacity,
+                                    Overflow overflow,
+                                    int64_t block_timeout_ns )
+{
+    {
+        lock_guard<mutex> guard( m_items_mutex );
+        m_overflow.store( int( overflow ) );
+        m_block_timeout_ns.store( std::max<int64_t>( block_timeout_ns, 0 ) );
+        m_capacity.store( capacity );
+    }
+    // Let blocked producers see the new capacity or policy
+    m_space_signaler.send_signal_all();
+}
+
+void MessageQueue::enable_stats()
+{
+    lock_guard<mutex> guard( m_items_mutex );
+    if ( !m_stats_owner )
+    {
+        m_stats_owner.reset( new QueueStats );
+        m_stats.store( m_stats_owner.get() );
+    }
+}
+
+QueueStatsSnapshot MessageQueue::stats_snapshot() const
+{
+    QueueStats const *stats = m_stats.load();
+    QueueStatsSnapshot r = QueueStatsSnapshot();
+    if ( stats )
+    {
+        r = stats->snapshot( 0 );
+    }
+
+    r.capacity = m_capacity.load();
+    r.dropped = m_dropped.load();
+    r.rejected = m_rejected.load();
+    r.lanes = lanes();
+    r.depth = 0;
+    for ( unsigned i = 0; i < r.lanes; ++i )
+    {
+        r.lane_depth[i] = lane_size( i );
+        r.depth += r.lane_depth[i];
+    }
+    return r;
+}
+
+size_t MessageQueue::lane_size( unsigned lane ) const
+{
+    if ( lane >= lanes() )
+    {
+        return 0;
+    }
+    if ( !m_rings.empty() )
+    {
+        return m_rings[lane]->size_approx();
+    }
+
+    lock_guard<mutex> guard( m_items_mutex );
+    return m_lanes[lane].size();
+}
+
+int64_t MessageQueue::enqueue_time() const
+{
+    return m_stats.load( std::memory_order_relaxed ) ? QueueStats::now_ns() : 0;
+}
+
+void MessageQueue::items_removed( size_t count, bool now_empty )
+{
+    QueueStats *stats = m_stats.load( std::memory_order_relaxed );
+    if ( stats )
+    {
+        stats->record_dequeue( count );
+    }
+
+    // Wake producers blocked on a full queue. With the ring there is no lock
+    // to order the pop before the check, so fence against wait_for_space()
+    if ( m_capacity.load( std::memory_order_relaxed ) )
+    {
+        if ( !m_rings.empty() )
+        {
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+        }
+        if ( m_blocked_producers.load( std::memory_order_relaxed ) )
+        {
+            m_space_signaler.send_signal_n(
+                (uint32_t)std::min<size_t>( count, UINT32_MAX ) );
+        }
+    }
+
+    // Let drain_and_stop() know that a closed queue has been emptied
+    if ( now_empty && m_state.load() != state_open )
+    {
+        m_drained_signaler.send_signal_all();
+    }
+}
+
+bool MessageQueue::pop_ring( Item &item )
+{
+    if ( m_rings.size() == 1 )
+    {
+        return m_rings[0]->try_pop( item );
+    }
+
+    uint32_t bits = m_lane_bits.load();
+    while ( bits )
+    {
+        unsigned const lane = select_lane( bits );
+        if ( m_rings[lane]->try_pop( item ) )
+        {
+            lane_served( lane );
+            return true;
+        }
+
+        // The lane looks empty. Clear its bit, then set it again if a
+        // producer added to the ring before it could see the bit cleared
+        uint32_t const bit = 1u << lane;
+        m_lane_bits.fetch_and( ~bit );
+        if ( !m_rings[lane]->empty_approx() )
+        {
+            m_lane_bits.fetch_or( bit );
+        }
+        bits &= ~bit;
+    }
+    return false;
+}
+
+bool MessageQueue::pop_front( Item &item, bool wait_for_lock )
+{
+    bool now_empty;
+
+    if ( !m_rings.empty() )
+    {
+        if ( !pop_ring( item ) )
+        {
+            return false;
+        }
+        now_empty = empty();
+    }
+    else
+    {
+        unique_lock<mutex> guard( m_items_mutex, std::defer_lock );
+        if ( wait_for_lock )
+        {
+            guard.lock();
+        }
+        else if ( !guard.try_lock() )
+        {
+            return false;
+        }
+
+        uint32_t bits = m_lane_bits.load( std::memory_order_relaxed );
+        if ( !bits )
+        {
+            return false;
+        }
+        unsigned const lane = select_lane( bits );
+        deque<Item> &items = m_lanes[lane];
+        item = std::move( items.front() );
+        items.pop_front();
+        sub_depth( 1 );
+        lane_served( lane );
+        if ( items.empty() )
+        {
+            bits &= ~( 1u << lane );
+            m_lane_bits.store( bits );
+        }
+        now_empty = bits == 0;
+    }
+
+    items_removed( 1, now_empty );
+    return true;
+}
+
+void MessageQueue::call( Task &item_to_execute )
+{
+    try
+    {
+        item_to_execute();
+    }
+    catch ( PleaseStopException const &e )
+    {
+        // The message was to shut down the thread
+        log_info(
+            "MessageQueue::invoke() asked to end thread via "
+            "PleaseStopException" );
+
+        // put the item back on the item list for other threads to receive
+        enqueue( lanes() - 1,
+                 std::move( item_to_execute ),
+                 false,
+                 Admission::force );
+
+        // re-throw
+        throw;
+    }
+    catch ( std::exception const &e )
+    {
+        // An exception happened during the call
+        // log the exception info
+        log_info( "MessageQueue::invoke() caught exception: ", e.what() );
+
+        // Re-throw the exception
+        throw;
+    }
+    catch ( ... )
+    {
+        // An unknown exception
+        log_info( "MessageQueue::invoke() caught exception" );
+
+        // Re-throw the exception
+        throw;
+    }
+}
+
+void MessageQueue::run( Item &item )
+{
+    QueueStats *stats = m_stats.load( std::memory_order_relaxed );
+    if ( !stats )
+    {
+        call( item.task );
+        return;
+    }
+
+    int64_t started_at = QueueStats::now_ns();
+    if ( item.enqueued_at )
+    {
+        stats->record_residency( item.enqueued_at, started_at );
+    }
+
+    // Record the execution time even if the task throws
+    struct RecordExecution
+    {
+        ~RecordExecution()
+        {
+            stats->record_execution( QueueStats::now_ns() - started_at );
+        }
+        QueueStats *stats;
+        int64_t started_at;
+    } record_execution = {stats, started_at};
+
+    call( item.task );
 }
 
 bool MessageQueue::invoke()
 {
     // get the item to execute
 
-    function<void()> item_to_execute;
+    Item item_to_execute;
+
+    if ( pop_front( item_to_execute, true ) && item_to_execute.task )
+    {
+        run( item_to_execute );
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+size_t MessageQueue::invoke_batch( size_t max_n )
+{
+    if ( !m_rings.empty() )
+    {
+        // The ring is lock-free already, so there is nothing to amortize
+        size_t count = 0;
+        while ( count < max_n && invoke() )
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    deque<Item> batch;
+
+    // The batch holds a run of items from each lane it took from, in the
+    // order of the runs. Each lane is taken from at most once
+    unsigned run_lane[max_lanes];
+    size_t run_end[max_lanes];
+    unsigned runs = 0;
 
     {
         lock_guard<mutex> guard( m_items_mutex );
-        if ( m_items.size() > 0 )
+        uint32_t bits = m_lane_bits.load( std::memory_order_relaxed );
+        while ( bits && batch.size() < max_n )
         {
-            item_to_execute = m_items.front();
-            m_items.pop();
+            unsigned const lane = select_lane( bits );
+            deque<Item> &items = m_lanes[lane];
+            size_t const n = std::min( max_n - batch.size(), items.size() );
+            if ( n == items.size() && batch.empty() )
+            {
+                swap( batch, items );
+            }
+            else
+            {
+                std::move( items.begin(),
+                           items.begin() + n,
+                           std::back_inserter( batch ) );
+                items.erase( items.begin(), items.begin() + n );
+            }
+            run_lane[runs] = lane;
+            run_end[runs++] = batch.size();
+            lane_served( lane );
+            if ( items.empty() )
+            {
+                bits &= ~( 1u << lane );
+            }
         }
+        if ( !batch.empty() )
+        {
+            // Counted before the lane bits change, so that drain_and_stop()
+            // can not see the queue empty without seeing the batch
+            m_batches_in_flight.fetch_add( 1 );
+        }
+        m_lane_bits.store( bits );
+        sub_depth( batch.size() );
+        items_removed( batch.size(), bits == 0 );
+    }
+    if ( batch.empty() )
+    {
+        return 0;
     }
 
-    if ( item_to_execute )
+    size_t count = 0;
+    try
+    {
+        for ( ; count < batch.size(); ++count )
+        {
+            if ( batch[count].task )
+            {
+                run( batch[count] );
+            }
+        }
+    }
+    catch ( ... )
     {
-        try
+        // Put the functions which were not called back at the front of
+        // their lanes so that they keep their order relative to the rest
+        size_t requeued = 0;
+        size_t depth = 0;
         {
-            item_to_execute();
+            lock_guard<mutex> guard( m_items_mutex );
+            uint32_t bits = m_lane_bits.load( std::memory_order_relaxed );
+            for ( unsigned i = 0; i < runs; ++i )
+            {
+                size_t const begin
+                    = std::max( i ? run_end[i - 1] : 0, count + 1 );
+                if ( begin < run_end[i] )
+                {
+                    deque<Item> &items = m_lanes[run_lane[i]];
+                    items.insert(
+                        items.begin(),
+                        std::make_move_iterator( batch.begin() + begin ),
+                        std::make_move_iterator( batch.begin() + run_end[i] ) );
+                    add_depth( run_end[i] - begin );
+                    requeued += run_end[i] - begin;
+                    bits |= 1u << run_lane[i];
+                }
+            }
+            m_lane_bits.store( bits );
+            depth = locked_size();
         }
-        catch ( PleaseStopException const &e )
+
+        // The consumers which parked when the batch was taken have not heard
+        // of these items
+        if ( requeued )
         {
-            // The message was to shut down the thread
-            log_info(
-                "MessageQueue::invoke() asked to end thread via "
-                "PleaseStopException" );
+            items_added( requeued, depth, false );
+        }
+        batch_finished();
+        throw;
+    }
+    batch_finished();
+    return count;
+}
+
+void MessageQueue::batch_finished()
+{
+    if ( m_batches_in_flight.fetch_sub( 1 ) == 1
+         && m_state.load() != state_open )
+    {
+        m_drained_signaler.send_signal_all();
+    }
+}
+
+size_t MessageQueue::drain()
+{
+    return invoke_batch( size() );
+}
 
-            // put the item back on the item list for other threads to receive
-            push_back( item_to_execute );
+MessageQueue::Status
+    MessageQueue::wait_and_invoke_ns( std::chrono::nanoseconds timeout,
+                                      StopToken const *stop_token )
+{
+    typedef std::chrono::steady_clock clock;
+    clock::time_point const start = clock::now();
+    clock::time_point const deadline
+        = timeout >= clock::time_point::max() - start ? clock::time_point::max()
+                                                      : start + timeout;
 
-            // re-throw
-            throw;
+    while ( true )
+    {
+        if ( m_state.load() == state_stopped
+             || ( stop_token && stop_token->stop_requested() ) )
+        {
+            return Status::stopped;
         }
-        catch ( std::exception const &e )
+
+        if ( invoke() )
         {
-            // An exception happened during the call
-            // log the exception info
-            log_info( "MessageQueue::invoke() caught exception: ", e.what() );
+            return Status::invoked;
+        }
+
+        // Read the signal count before the final emptiness check. A push,
+        // close() or stop() after this point changes the count, so the wait
+        // below returns immediately instead of missing it
+        Signaler::signal_count_type last_signal_count = signaler().get_count();
+        m_idle_consumers.fetch_add( 1 );
 
-            // Re-throw the exception
-            throw;
+        if ( !empty() )
+        {
+            m_idle_consumers.fetch_sub( 1 );
+            continue;
         }
-        catch ( ... )
+
+        int state = m_state.load();
+        if ( state != state_open
+             || ( stop_token && stop_token->stop_requested() ) )
         {
-            // An unknown exception
-            log_info( "MessageQueue::invoke() caught exception" );
+            m_idle_consumers.fetch_sub( 1 );
+            return state == state_closed ? Status::closed : Status::stopped;
+        }
 
-            // Re-throw the exception
-            throw;
+        clock::time_point now = clock::now();
+        if ( now >= deadline )
+        {
+            m_idle_consumers.fetch_sub( 1 );
+            return Status::timeout;
         }
+
+        signaler().wait_for_signal_for( last_signal_count, deadline - now );
+        m_idle_consumers.fetch_sub( 1 );
+
+        QueueStats *stats = m_stats.load( std::memory_order_relaxed );
+        if ( stats )
+        {
+            stats->record_idle(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    clock::now() - now ).count() );
+        }
+    }
+}
+
+void MessageQueue::close()
+{
+    {
+        lock_guard<mutex> guard( m_items_mutex );
+        int expected = state_open;
+        m_state.compare_exchange_strong( expected, state_closed );
+    }
+    // Release waiters so that they see the new state, and anyone already in
+    // drain_and_stop() in case the queue was empty
+    signaler().send_signal_all();
+    m_drained_signaler.send_signal_all();
+    m_space_signaler.send_signal_all();
+    if ( m_wait_set )
+    {
+        m_wait_set->queue_changed( true );
+    }
+    if ( m_event_loop )
+    {
+        m_event_loop->wake();
+    }
+}
+
+void MessageQueue::stop()
+{
+    {
+        lock_guard<mutex> guard( m_items_mutex );
+        m_state.store( state_stopped );
+    }
+    signaler().send_signal_all();
+    m_drained_signaler.send_signal_all();
+    m_space_signaler.send_signal_all();
+    if ( m_wait_set )
+    {
+        m_wait_set->queue_changed( true );
+    }
+    if ( m_event_loop )
+    {
+        m_event_loop->wake();
+    }
+}
+
+bool MessageQueue::drain_and_stop( std::chrono::steady_clock::time_point deadline )
+{
+    close();
+
+    bool drained = false;
+    while ( true )
+    {
+        Signaler::signal_count_type last_signal_count
+            = m_drained_signaler.get_count();
+
+        // A batch which is still running may put items back if one of its
+        // functions throws
+        if ( empty() && m_batches_in_flight.load() == 0 )
+        {
+            drained = true;
+            break;
+        }
+        std::chrono::steady_clock::time_point now
+            = std::chrono::steady_clock::now();
+        if ( now >= deadline )
+        {
+            break;
+        }
+        m_drained_signaler.wait_for_signal_for( last_signal_count,
+                                                deadline - now );
+    }
+
+    stop();
+    return drained;
+}
+
+void MessageQueue::request_stop( StopSource &stop_source )
+{
+    stop_source.request_stop();
+    signaler().send_signal_all();
+}
+
+bool MessageQueue::try_invoke()
+{
+    Item item_to_execute;
+
+    if ( pop_front( item_to_execute, false ) && item_to_execute.task )
+    {
+        run( item_to_execute );
         return true;
     }
     else
@@ -78,25 +689,462 @@ bool MessageQueue::invoke()
 
 bool MessageQueue::empty() const
 {
-    lock_guard<mutex> guard( m_items_mutex );
-    return m_items.empty();
+    if ( m_rings.empty() )
+    {
+        // Changed under the lock, so a single load is exact
+        return m_lane_bits.load() == 0;
+    }
+
+    for ( auto const &ring : m_rings )
+    {
+        if ( !ring->empty_approx() )
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
-void MessageQueue::push_back( function<void()> func, bool notify_all )
+bool MessageQueue::enqueue( unsigned lane,
+                            Task &&task,
+                            bool notify_all,
+                            Admission admission )
 {
-    lock_guard<mutex> guard( m_items_mutex );
-    m_items.push( func );
-    // send the signal to waiting threads only if the number of items
-    // transitioned from 0 to 1
-    if ( m_items.size() == 1 )
+    // Destroyed after the lock is released, in case a dropped task pushes
+    // to this queue from its destructor
+    vector<Item> dropped;
+    size_t done;
+
+    if ( !enqueue_tasks(
+             lane, &task, 1, notify_all, admission, dropped, done ) )
     {
-        signaler().send_signal( notify_all );
+        return false;
+    }
+
+    // Destroy the task if Overflow::drop_newest left it in place
+    task.reset();
+    return true;
+}
+
+bool MessageQueue::enqueue_bulk( vector<Task> &tasks,
+                                 bool notify_all,
+                                 Admission admission )
+{
+    vector<Item> dropped;
+    size_t done;
+
+    bool r = enqueue_tasks(
+        0, tasks.data(), tasks.size(), notify_all, admission, dropped, done );
+    tasks.erase( tasks.begin(), tasks.begin() + done );
+    return r;
+}
+
+bool MessageQueue::enqueue_tasks( unsigned lane,
+                                  Task *tasks,
+                                  size_t count,
+                                  bool notify_all,
+                                  Admission admission,
+                                  vector<Item> &dropped,
+                                  size_t &done )
+{
+    std::chrono::steady_clock::time_point deadline
+        = std::chrono::steady_clock::time_point::min();
+    int64_t enqueued_at = enqueue_time();
+    bool const forced = admission == Admission::force
+                        || admission == Admission::force_no_wait;
+    size_t added = 0;
+    size_t depth = 0;
+    bool r = true;
+
+    done = 0;
+    lane = std::min( lane, lanes() - 1 );
+
+    unique_lock<mutex> guard( m_items_mutex, std::defer_lock );
+    if ( m_rings.empty() )
+    {
+        guard.lock();
+    }
+
+    while ( done < count )
+    {
+        if ( is_closed() )
+        {
+            r = false;
+            break;
+        }
+
+        size_t const capacity
+            = forced ? 0 : m_capacity.load( std::memory_order_relaxed );
+        bool const room
+            = !capacity
+              || ( m_rings.empty() ? locked_size() : size() ) < capacity;
+
+        if ( room && m_rings.empty() )
+        {
+            deque<Item> &items = m_lanes[lane];
+            items.emplace_back( std::move( tasks[done] ), enqueued_at, forced );
+            add_depth( 1 );
+            if ( items.size() == 1 )
+            {
+                lane_added( lane );
+            }
+            ++done;
+            ++added;
+            continue;
+        }
+
+        // try_emplace() only moves from the task when it succeeds
+        if ( room
+             && m_rings[lane]->try_emplace(
+                    std::move( tasks[done] ), enqueued_at, forced ) )
+        {
+            ++done;
+            ++added;
+            continue;
+        }
+
+        if ( !capacity )
+        {
+            // Only the ring itself is full. Let the consumers at what was
+            // added so far, and wait for them to free a slot
+            if ( admission == Admission::no_wait )
+            {
+                m_rejected.fetch_add( 1 );
+                r = false;
+                break;
+            }
+            if ( admission == Admission::force_no_wait )
+            {
+                r = false;
+                break;
+            }
+            announce( lane, added, notify_all );
+            std::this_thread::yield();
+            continue;
+        }
+
+        Full const full = on_full( lane,
+                                   admission,
+                                   guard.owns_lock() ? &guard : nullptr,
+                                   added,
+                                   notify_all,
+                                   deadline,
+                                   dropped );
+        if ( full == Full::retry )
+        {
+            continue;
+        }
+        if ( full == Full::discard )
+        {
+            m_dropped.fetch_add( count - done );
+            done = count;
+        }
+        else
+        {
+            r = false;
+        }
+        break;
+    }
+
+    if ( added )
+    {
+        if ( m_rings.empty() )
+        {
+            depth = locked_size();
+        }
+        else
+        {
+            ring_lane_added( lane );
+            depth = size();
+        }
     }
+    if ( guard.owns_lock() )
+    {
+        guard.unlock();
+    }
+
+    // One signal for all the items, waking as many waiting threads as there
+    // are new items
+    if ( added )
+    {
+        items_added( added, depth, notify_all );
+    }
+    return r;
+}
+
+void MessageQueue::announce( unsigned lane, size_t &added, bool notify_all )
+{
+    if ( !added )
+    {
+        return;
+    }
+
+    size_t depth;
+    if ( m_rings.empty() )
+    {
+        depth = locked_size();
+    }
+    else
+    {
+        ring_lane_added( lane );
+        depth = size();
+    }
+    items_added( added, depth, notify_all );
+    added = 0;
+}
+
+MessageQueue::Full
+    MessageQueue::on_full( unsigned lane,
+                           Admission admission,
+                           unique_lock<mutex> *guard,
+                           size_t &added,
+                           bool notify_all,
+                           std::chrono::steady_clock::time_point &deadline,
+                           vector<Item> &dropped )
+{
+    switch ( Overflow( m_overflow.load( std::memory_order_relaxed ) ) )
+    {
+    case Overflow::block:
+        if ( admission == Admission::wait )
+        {
+            // Consumers can only free slots for the items they know about
+            announce( lane, added, notify_all );
+            if ( wait_for_space( guard, deadline ) )
+            {
+                return Full::retry;
+            }
+        }
+        break;
+
+    case Overflow::reject:
+        break;
+
+    case Overflow::drop_oldest:
+        dropped.emplace_back();
+        if ( drop_oldest( dropped.back() ) )
+        {
+            m_dropped.fetch_add( 1 );
+            return Full::retry;
+        }
+        dropped.pop_back();
+
+        // Either a consumer emptied the queue first, or only items which
+        // must not be dropped are left, and then the push is rejected
+        if ( ( guard ? locked_size() : size() )
+             < m_capacity.load( std::memory_order_relaxed ) )
+        {
+            return Full::retry;
+        }
+        break;
+
+    case Overflow::drop_newest:
+        return Full::discard;
+    }
+
+    m_rejected.fetch_add( 1 );
+    return Full::reject;
+}
+
+bool MessageQueue::wait_for_space(
+    unique_lock<mutex> *guard,
+    std::chrono::steady_clock::time_point &deadline )
+{
+    typedef std::chrono::steady_clock clock;
+    clock::time_point const now = clock::now();
+    if ( deadline == clock::time_point::min() )
+    {
+        std::chrono::nanoseconds const timeout(
+            m_block_timeout_ns.load( std::memory_order_relaxed ) );
+        deadline = timeout >= clock::time_point::max() - now
+                       ? clock::time_point::max()
+                       : now + timeout;
+    }
+    if ( now >= deadline )
+    {
+        return false;
+    }
+
+    // Read the count before the producer is announced. A consumer which
+    // takes an item after that sees the announcement and changes the count
+    Signaler::signal_count_type last_signal_count
+        = m_space_signaler.get_count();
+    m_blocked_producers.fetch_add( 1 );
+
+    bool full = true;
+    if ( guard )
+    {
+        guard->unlock();
+    }
+    else
+    {
+        // A ring consumer may have taken an item before it could see the
+        // announcement, so look again
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        full = size() >= m_capacity.load();
+    }
+
+    if ( full )
+    {
+        m_space_signaler.wait_for_signal_for( last_signal_count,
+                                              deadline - now );
+    }
+    else
+    {
+        std::this_thread::yield();
+    }
+
+    m_blocked_producers.fetch_sub( 1 );
+    if ( guard )
+    {
+        guard->lock();
+    }
+    return true;
+}
+
+bool MessageQueue::drop_oldest( Item &item )
+{
+    if ( !m_rings.empty() )
+    {
+        for ( unsigned lane = 0; lane < m_rings.size(); ++lane )
+        {
+            // A ring only gives up its front item, so a forced one goes to
+            // the back of its lane. Look at each item there was at most once
+            MPMCRing<Item> &ring = *m_rings[lane];
+            for ( size_t n = ring.size_approx(); n && ring.try_pop( item );
+                  --n )
+            {
+                if ( !item.forced )
+                {
+                    return true;
+                }
+
+                // The slot just freed may be taken by another forced push,
+                // in which case wait for a consumer to free one
+                while ( !ring.try_emplace( std::move( item ) ) )
+                {
+                    std::this_thread::yield();
+                }
+                ring_lane_added( lane );
+
+                // A consumer which found the ring empty in between may have
+                // parked
+                signaler().send_signal( false );
+            }
+        }
+        return false;
+    }
+
+    uint32_t const bits = m_lane_bits.load( std::memory_order_relaxed );
+    for ( uint32_t left = bits; left; )
+    {
+        unsigned const lane = unsigned( __builtin_ctz( left ) );
+        deque<Item> &items = m_lanes[lane];
+        for ( auto it = items.begin(); it != items.end(); ++it )
+        {
+            if ( !it->forced )
+            {
+                item = std::move( *it );
+                items.erase( it );
+                sub_depth( 1 );
+                if ( items.empty() )
+                {
+                    m_lane_bits.store( bits & ~( 1u << lane ) );
+                }
+                return true;
+            }
+        }
+        left &= ~( 1u << lane );
+    }
+    return false;
+}
+
+void MessageQueue::items_added( size_t item_count,
+                                size_t depth,
+                                bool notify_all )
+{
+    QueueStats *stats = m_stats.load( std::memory_order_relaxed );
+    if ( stats )
+    {
+        stats->record_enqueue( item_count, depth );
+    }
+
+    // Every push changes the signal count, so a consumer which read the count
+    // before finding the queue empty can never sleep through this item. The
+    // Signaler only enters the kernel when a consumer is parked
+    if ( notify_all )
+    {
+        signaler().send_signal_all();
+    }
+    else
+    {
+        signaler().send_signal_n(
+            (uint32_t)std::min<size_t>( item_count, UINT32_MAX ) );
+    }
+
+    if ( m_group )
+    {
+        m_group->items_added( item_count, notify_all );
+    }
+    if ( m_wait_set )
+    {
+        m_wait_set->queue_changed( notify_all );
+    }
+    if ( m_event_loop )
+    {
+        m_event_loop->wake();
+    }
+}
+
+void MessageQueue::skip_next()
+{
+    Item discard;
+    pop_front( discard, true );
+}
+
+vector<Task> &MessageQueue::bulk_buffer()
+{
+    static thread_local vector<Task> buffer;
+    return buffer;
 }
 
 size_t MessageQueue::size() const
 {
+    size_t r = 0;
+    if ( !m_rings.empty() )
+    {
+        for ( auto const &ring : m_rings )
+        {
+            r += ring->size_approx();
+        }
+        return r;
+    }
+
     lock_guard<mutex> guard( m_items_mutex );
-    return m_items.size();
+    return locked_size();
+}
+
+size_t MessageQueue::size_approx() const
+{
+    if ( m_rings.empty() )
+    {
+        return m_depth.load( std::memory_order_relaxed );
+    }
+
+    size_t r = 0;
+    for ( auto const &ring : m_rings )
+    {
+        r += ring->size_approx();
+    }
+    return r;
+}
+
+size_t MessageQueue::locked_size() const
+{
+    size_t r = 0;
+    for ( auto const &items : m_lanes )
+    {
+        r += items.size();
+    }
+    return r;
 }
 }
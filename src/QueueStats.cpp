@@ -0,0 +1,155 @@
+#include "LambdaStew/QueueStats.hpp"
+
+#include <sstream>
+
+namespace LambdaStew
+{
+
+const unsigned QueueStatsSnapshot::max_lanes;
+
+size_t ShardedCounter::thread_shard()
+{
+    static std::atomic<size_t> next_shard( 0 );
+    static thread_local size_t shard = next_shard++ % num_shards;
+    return shard;
+}
+
+uint64_t HistogramSnapshot::percentile( double p ) const
+{
+    if ( count == 0 )
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)( p * ( count - 1 ) ) + 1;
+    uint64_t seen = 0;
+    for ( size_t i = 0; i < num_buckets; ++i )
+    {
+        seen += buckets[i];
+        if ( seen >= rank )
+        {
+            uint64_t upper = i == 0 ? 0 : ( uint64_t( 1 ) << i );
+            return upper < max_ns ? upper : max_ns;
+        }
+    }
+    return max_ns;
+}
+
+LatencyHistogram::LatencyHistogram() : m_count( 0 ), m_sum_ns( 0 ), m_max_ns( 0 )
+{
+    for ( size_t i = 0; i < HistogramSnapshot::num_buckets; ++i )
+    {
+        m_buckets[i].store( 0, std::memory_order_relaxed );
+    }
+}
+
+void LatencyHistogram::record( int64_t ns )
+{
+    uint64_t v = ns > 0 ? (uint64_t)ns : 0;
+    size_t bucket = v == 0 ? 0 : 64 - __builtin_clzll( v );
+    if ( bucket >= HistogramSnapshot::num_buckets )
+    {
+        bucket = HistogramSnapshot::num_buckets - 1;
+    }
+    m_buckets[bucket].fetch_add( 1, std::memory_order_relaxed );
+    m_count.fetch_add( 1, std::memory_order_relaxed );
+    m_sum_ns.fetch_add( v, std::memory_order_relaxed );
+
+    uint64_t current = m_max_ns.load( std::memory_order_relaxed );
+    while ( v > current
+            && !m_max_ns.compare_exchange_weak(
+                   current, v, std::memory_order_relaxed ) )
+    {
+    }
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const
+{
+    HistogramSnapshot r;
+    r.count = m_count.load( std::memory_order_relaxed );
+    r.sum_ns = m_sum_ns.load( std::memory_order_relaxed );
+    r.max_ns = m_max_ns.load( std::memory_order_relaxed );
+    for ( size_t i = 0; i < HistogramSnapshot::num_buckets; ++i )
+    {
+        r.buckets[i] = m_buckets[i].load( std::memory_order_relaxed );
+    }
+    return r;
+}
+
+void QueueStats::record_enqueue( size_t count, size_t depth )
+{
+    m_enqueued.add( count );
+
+    uint64_t current = m_high_water.load( std::memory_order_relaxed );
+    while ( depth > current
+            && !m_high_water.compare_exchange_weak(
+                   current, depth, std::memory_order_relaxed ) )
+    {
+    }
+}
+
+QueueStatsSnapshot QueueStats::snapshot( size_t depth ) const
+{
+    QueueStatsSnapshot r = QueueStatsSnapshot();
+    r.enqueued = m_enqueued.total();
+    r.dequeued = m_dequeued.total();
+    r.depth = depth;
+    r.lanes = 1;
+    r.lane_depth[0] = depth;
+    r.high_water = m_high_water.load( std::memory_order_relaxed );
+    r.residency = m_residency.snapshot();
+    r.execution = m_execution.snapshot();
+    r.idle_ns = m_idle_ns.total();
+    r.busy_ns = m_busy_ns.total();
+    return r;
+}
+
+///
+/// \brief print_histogram_json
+///
+/// Write the summary of a histogram as a JSON object
+///
+static std::ostream &print_histogram_json( std::ostream &o,
+                                           HistogramSnapshot const &h )
+{
+    o << "{\"count\":" << h.count << ",\"mean_ns\":" << h.mean_ns()
+      << ",\"p50_ns\":" << h.percentile( 0.50 )
+      << ",\"p99_ns\":" << h.percentile( 0.99 )
+      << ",\"p999_ns\":" << h.percentile( 0.999 ) << ",\"max_ns\":" << h.max_ns
+      << "}";
+    return o;
+}
+
+std::ostream &QueueStatsSnapshot::print_json( std::ostream &o ) const
+{
+    o << "{\"enqueued\":" << enqueued << ",\"dequeued\":" << dequeued
+      << ",\"depth\":" << depth;
+    if ( lanes > 1 )
+    {
+        o << ",\"lane_depths\":[";
+        for ( unsigned i = 0; i < lanes && i < max_lanes; ++i )
+        {
+            o << ( i ? "," : "" ) << lane_depth[i];
+        }
+        o << "]";
+    }
+    o << ",\"high_water\":" << high_water;
+    if ( capacity )
+    {
+        o << ",\"capacity\":" << capacity << ",\"dropped\":" << dropped
+          << ",\"rejected\":" << rejected;
+    }
+    o << ",\"residency\":";
+    print_histogram_json( o, residency );
+    o << ",\"execution\":";
+    print_histogram_json( o, execution );
+    o << ",\"idle_ns\":" << idle_ns << ",\"busy_ns\":" << busy_ns << "}";
+    return o;
+}
+
+std::string QueueStatsSnapshot::to_json() const
+{
+    std::ostringstream o;
+    print_json( o );
+    return o.str();
+}
+}
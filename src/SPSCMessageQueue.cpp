@@ -0,0 +1,221 @@
+#include "LambdaStew/SPSCMessageQueue.hpp"
+
+#include <thread>
+
+namespace LambdaStew
+{
+
+const size_t SPSCMessageQueue::default_capacity;
+const size_t SPSCMessageQueue::publish_interval;
+
+SPSCMessageQueue::SPSCMessageQueue( size_t capacity )
+    : m_ring( capacity ), m_consumer_waiting( false ), m_state( state_open )
+{
+}
+
+std::function<void()> SPSCMessageQueue::make_please_stop_item() const
+{
+    return []()
+    {
+        throw MessageQueue::PleaseStopException();
+    };
+}
+
+void SPSCMessageQueue::push_back_please_stop()
+{
+    push_back( make_please_stop_item() );
+}
+
+bool SPSCMessageQueue::wait_for_slot()
+{
+    if ( m_ring.unpublished_pushes() )
+    {
+        // The consumer may be parked waiting for exactly these items
+        m_ring.publish_push();
+        items_published();
+    }
+    if ( m_state.load( std::memory_order_relaxed ) != state_open )
+    {
+        return false;
+    }
+    std::this_thread::yield();
+    return true;
+}
+
+bool SPSCMessageQueue::push_back( Task &&task )
+{
+    if ( m_state.load( std::memory_order_relaxed ) != state_open )
+    {
+        return false;
+    }
+    while ( !m_ring.try_emplace( std::move( task ) ) )
+    {
+        if ( !wait_for_slot() )
+        {
+            return false;
+        }
+    }
+    items_published();
+    return true;
+}
+
+bool SPSCMessageQueue::try_push( Task &&task )
+{
+    if ( m_state.load( std::memory_order_relaxed ) != state_open
+         || !m_ring.try_emplace( std::move( task ) ) )
+    {
+        return false;
+    }
+    items_published();
+    return true;
+}
+
+bool SPSCMessageQueue::push_back_bulk( vector<Task> &tasks )
+{
+    if ( m_state.load( std::memory_order_relaxed ) != state_open )
+    {
+        return false;
+    }
+
+    size_t done = 0;
+    bool accepted = true;
+    while ( done < tasks.size() )
+    {
+        if ( !m_ring.try_emplace_deferred( std::move( tasks[done] ) ) )
+        {
+            if ( !wait_for_slot() )
+            {
+                accepted = false;
+                break;
+            }
+            continue;
+        }
+        if ( ++done % publish_interval == 0 )
+        {
+            m_ring.publish_push();
+            items_published();
+        }
+    }
+
+    if ( m_ring.unpublished_pushes() )
+    {
+        m_ring.publish_push();
+        items_published();
+    }
+    tasks.erase( tasks.begin(), tasks.begin() + done );
+    return accepted;
+}
+
+bool SPSCMessageQueue::invoke()
+{
+    Task task;
+    if ( !m_ring.try_pop( task ) )
+    {
+        return false;
+    }
+    task();
+    return true;
+}
+
+size_t SPSCMessageQueue::invoke_batch( size_t max_n )
+{
+    // Give back the slots taken so far, even if a task throws
+    struct PublishGuard
+    {
+        SPSCRing<Task> &ring;
+        ~PublishGuard() { ring.publish_pop(); }
+    } guard{m_ring};
+
+    Task task;
+    size_t r = 0;
+    while ( r < max_n && m_ring.try_pop_deferred( task ) )
+    {
+        if ( ++r % publish_interval == 0 )
+        {
+            m_ring.publish_pop();
+        }
+        Task current( std::move( task ) );
+        current();
+    }
+    return r;
+}
+
+SPSCMessageQueue::Status
+    SPSCMessageQueue::wait_and_invoke_ns( std::chrono::nanoseconds timeout,
+                                          StopToken const *stop_token )
+{
+    typedef std::chrono::steady_clock clock;
+    clock::time_point const start = clock::now();
+    clock::time_point const deadline
+        = timeout >= clock::time_point::max() - start ? clock::time_point::max()
+                                                      : start + timeout;
+
+    while ( true )
+    {
+        if ( m_state.load() == state_stopped
+             || ( stop_token && stop_token->stop_requested() ) )
+        {
+            return Status::stopped;
+        }
+
+        if ( invoke() )
+        {
+            return Status::invoked;
+        }
+
+        // Read the signal count before announcing the wait. A publication
+        // after the announcement sees it and changes the count
+        Signaler::signal_count_type last_signal_count = m_signaler.get_count();
+        m_consumer_waiting.store( true, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        if ( !m_ring.empty_approx() )
+        {
+            m_consumer_waiting.store( false, std::memory_order_relaxed );
+            continue;
+        }
+
+        int state = m_state.load();
+        if ( state != state_open
+             || ( stop_token && stop_token->stop_requested() ) )
+        {
+            m_consumer_waiting.store( false, std::memory_order_relaxed );
+            if ( state == state_closed && !m_ring.empty_approx() )
+            {
+                // A push landed just before the queue was closed
+                continue;
+            }
+            return state == state_closed ? Status::closed : Status::stopped;
+        }
+
+        clock::time_point now = clock::now();
+        if ( now >= deadline )
+        {
+            m_consumer_waiting.store( false, std::memory_order_relaxed );
+            return Status::timeout;
+        }
+
+        m_signaler.wait_for_signal_for( last_signal_count, deadline - now );
+        m_consumer_waiting.store( false, std::memory_order_relaxed );
+    }
+}
+
+void SPSCMessageQueue::close()
+{
+    int expected = state_open;
+    m_state.compare_exchange_strong( expected, state_closed );
+    m_signaler.send_signal_all();
+}
+
+void SPSCMessageQueue::stop()
+{
+    m_state.store( state_stopped );
+    m_signaler.send_signal_all();
+}
+
+void SPSCMessageQueue::request_stop( StopSource &stop_source )
+{
+    stop_source.request_stop();
+    m_signaler.send_signal_all();
+}
+}
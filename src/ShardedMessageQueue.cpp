@@ -0,0 +1,271 @@
+#include "LambdaStew/ShardedMessageQueue.hpp"
+
+namespace LambdaStew
+{
+
+ShardedMessageQueue::ShardedMessageQueue( size_t shards,
+                                          Dispatch dispatch,
+                                          Backend backend,
+                                          size_t ring_capacity,
+                                          unsigned lanes )
+    : m_dispatch( dispatch ), m_idle_consumers( 0 ), m_state( state_open )
+{
+    if ( shards == 0 )
+    {
+        shards = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+
+    for ( size_t i = 0; i < shards; ++i )
+    {
+        m_shards.emplace_back( new Shard( backend, ring_capacity, lanes ) );
+        m_shards.back()->queue.m_group = this;
+    }
+}
+
+size_t ShardedMessageQueue::home_shard() const
+{
+    static std::atomic<size_t> next_thread( 0 );
+    static thread_local size_t thread_index = next_thread++;
+    return thread_index % m_shards.size();
+}
+
+size_t ShardedMessageQueue::pick_shard() const
+{
+    size_t const count = m_shards.size();
+    if ( m_dispatch == Dispatch::thread_affinity || count == 1 )
+    {
+        return home_shard();
+    }
+
+    // xorshift32 to pick the two candidates
+    static thread_local uint32_t random_state
+        = (uint32_t)( ( home_shard() + 1 ) * 2654435761u ) | 1;
+    uint32_t x = random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    random_state = x;
+
+    size_t const a = ( x & 0xffff ) % count;
+    size_t b = ( x >> 16 ) % count;
+    if ( b == a )
+    {
+        b = ( a + 1 ) % count;
+    }
+    return m_shards[b]->queue.size_approx() < m_shards[a]->queue.size_approx()
+               ? b
+               : a;
+}
+
+void ShardedMessageQueue::enable_stats()
+{
+    for ( auto &shard : m_shards )
+    {
+        shard->queue.enable_stats();
+    }
+}
+
+void ShardedMessageQueue::push_back_please_stop()
+{
+    m_shards[home_shard()]->queue.push_back_please_stop();
+}
+
+void ShardedMessageQueue::items_added( size_t item_count, bool notify_all )
+{
+    // Pairs with the fence in wait_and_invoke_ns(): either the consumer sees
+    // the new item or this sees the consumer
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( !m_idle_consumers.load( std::memory_order_relaxed ) )
+    {
+        return;
+    }
+
+    if ( notify_all )
+    {
+        m_signaler.send_signal_all();
+    }
+    else
+    {
+        m_signaler.send_signal_n(
+            (uint32_t)std::min<size_t>( item_count, UINT32_MAX ) );
+    }
+}
+
+bool ShardedMessageQueue::invoke()
+{
+    size_t const count = m_shards.size();
+    size_t const home = home_shard();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        // Check before locking, so that scanning empty shards is cheap
+        MessageQueue &queue = m_shards[( home + i ) % count]->queue;
+        if ( !queue.empty() && queue.invoke() )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ShardedMessageQueue::try_invoke()
+{
+    size_t const count = m_shards.size();
+    size_t const home = home_shard();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        MessageQueue &queue = m_shards[( home + i ) % count]->queue;
+        if ( !queue.empty() && queue.try_invoke() )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t ShardedMessageQueue::invoke_batch( size_t max_n )
+{
+    size_t const count = m_shards.size();
+    size_t const home = home_shard();
+    size_t r = 0;
+    for ( size_t i = 0; i < count && r < max_n; ++i )
+    {
+        MessageQueue &queue = m_shards[( home + i ) % count]->queue;
+        if ( !queue.empty() )
+        {
+            r += queue.invoke_batch( max_n - r );
+        }
+    }
+    return r;
+}
+
+size_t ShardedMessageQueue::drain()
+{
+    return invoke_batch( size() );
+}
+
+ShardedMessageQueue::Status
+    ShardedMessageQueue::wait_and_invoke_ns( std::chrono::nanoseconds timeout,
+                                             StopToken const *stop_token )
+{
+    typedef std::chrono::steady_clock clock;
+    clock::time_point const start = clock::now();
+    clock::time_point const deadline
+        = timeout >= clock::time_point::max() - start ? clock::time_point::max()
+                                                      : start + timeout;
+
+    while ( true )
+    {
+        if ( m_state.load() == state_stopped
+             || ( stop_token && stop_token->stop_requested() ) )
+        {
+            return Status::stopped;
+        }
+
+        if ( invoke() )
+        {
+            return Status::invoked;
+        }
+
+        // Read the signal count before announcing the consumer. A push to
+        // any shard after the announcement sees it and changes the count
+        Signaler::signal_count_type last_signal_count = m_signaler.get_count();
+        m_idle_consumers.fetch_add( 1 );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        if ( !empty() )
+        {
+            m_idle_consumers.fetch_sub( 1 );
+            continue;
+        }
+
+        int state = m_state.load();
+        if ( state != state_open
+             || ( stop_token && stop_token->stop_requested() ) )
+        {
+            m_idle_consumers.fetch_sub( 1 );
+            if ( state == state_closed && !empty() )
+            {
+                // A push landed before its shard was closed
+                continue;
+            }
+            return state == state_closed ? Status::closed : Status::stopped;
+        }
+
+        clock::time_point now = clock::now();
+        if ( now >= deadline )
+        {
+            m_idle_consumers.fetch_sub( 1 );
+            return Status::timeout;
+        }
+
+        m_signaler.wait_for_signal_for( last_signal_count, deadline - now );
+        m_idle_consumers.fetch_sub( 1 );
+    }
+}
+
+void ShardedMessageQueue::close()
+{
+    // Close the shards first, so that a consumer which sees the queue
+    // closed also sees every item which was accepted
+    for ( auto &shard : m_shards )
+    {
+        shard->queue.close();
+    }
+    int expected = state_open;
+    m_state.compare_exchange_strong( expected, state_closed );
+    m_signaler.send_signal_all();
+}
+
+void ShardedMessageQueue::stop()
+{
+    for ( auto &shard : m_shards )
+    {
+        shard->queue.stop();
+    }
+    m_state.store( state_stopped );
+    m_signaler.send_signal_all();
+}
+
+bool ShardedMessageQueue::drain_and_stop(
+    std::chrono::steady_clock::time_point deadline )
+{
+    close();
+
+    bool drained = true;
+    for ( auto &shard : m_shards )
+    {
+        drained = shard->queue.drain_and_stop( deadline ) && drained;
+    }
+
+    stop();
+    return drained;
+}
+
+void ShardedMessageQueue::request_stop( StopSource &stop_source )
+{
+    stop_source.request_stop();
+    m_signaler.send_signal_all();
+}
+
+bool ShardedMessageQueue::empty() const
+{
+    for ( auto const &shard : m_shards )
+    {
+        if ( !shard->queue.empty() )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t ShardedMessageQueue::size() const
+{
+    size_t r = 0;
+    for ( auto const &shard : m_shards )
+    {
+        r += shard->queue.size();
+    }
+    return r;
+}
+}
@@ -1,36 +1,205 @@
 #include "LambdaStew/Signaler.hpp"
 
+#include <algorithm>
+#include <thread>
+
+#if LAMBDASTEW_SIGNALER_FUTEX
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace LambdaStew
 {
 
+///
+/// \brief cpu_relax
+///
+/// Tell the cpu that we are in a spin loop
+///
+static inline void cpu_relax()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    __builtin_ia32_pause();
+#elif defined( __aarch64__ ) || defined( __arm__ )
+    asm volatile( "yield" );
+#endif
+}
+
+#if LAMBDASTEW_SIGNALER_FUTEX
+
+///
+/// \brief futex_word
+///
+/// \return the address of the signal count as the int the futex syscall uses
+///
+static inline int *
+    futex_word( std::atomic<Signaler::signal_count_type> const &count )
+{
+    static_assert( sizeof( count ) == sizeof( int ),
+                   "signal count must be usable as a futex" );
+    return reinterpret_cast<int *>(
+        const_cast<std::atomic<Signaler::signal_count_type> *>( &count ) );
+}
+
+static inline void futex_wait( int *addr, int expected, timespec const *rel )
+{
+    syscall( SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, rel, nullptr, 0 );
+}
+
+static inline void futex_wake( int *addr, int count )
+{
+    syscall( SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0 );
+}
+
+#endif
+
 Signaler::signal_count_type Signaler::get_count() const
 {
-    unique_lock<mutex> guard( m_cv_mutex );
-    return m_signal_count;
+    return m_signal_count.load( std::memory_order_acquire );
 }
 
 void Signaler::send_signal_all()
 {
-    unique_lock<mutex> guard( m_cv_mutex );
-    ++m_signal_count;
-    m_cv.notify_all();
+    send_signal_n( UINT32_MAX );
 }
 
 void Signaler::send_signal_one()
 {
-    unique_lock<mutex> guard( m_cv_mutex );
-    ++m_signal_count;
-    m_cv.notify_one();
+    send_signal_n( 1 );
+}
+
+void Signaler::send_signal_n( uint32_t wake_count )
+{
+    m_signal_count.fetch_add( 1 );
+    uint32_t waiters = m_waiter_count.load();
+    if ( waiters > 0 && wake_count > 0 )
+    {
+        wake( std::min( waiters, wake_count ) );
+    }
+}
+
+void Signaler::wake( uint32_t wake_count )
+{
+#if LAMBDASTEW_SIGNALER_FUTEX
+    futex_wake( futex_word( m_signal_count ),
+                wake_count > (uint32_t)INT_MAX ? INT_MAX : (int)wake_count );
+#else
+    // Taking the mutex orders this notify after a waiter which has already
+    // checked the count has started waiting
+    lock_guard<mutex> guard( m_cv_mutex );
+    if ( wake_count >= m_waiter_count.load() )
+    {
+        m_cv.notify_all();
+    }
+    else
+    {
+        for ( uint32_t i = 0; i < wake_count; ++i )
+        {
+            m_cv.notify_one();
+        }
+    }
+#endif
+}
+
+bool Signaler::spin_for_signal( signal_count_type last_signal_count ) const
+{
+    for ( unsigned i = 0; i < m_spin_count; ++i )
+    {
+        if ( m_signal_count.load( std::memory_order_acquire )
+             != last_signal_count )
+        {
+            return true;
+        }
+        cpu_relax();
+    }
+    for ( unsigned i = 0; i < m_yield_count; ++i )
+    {
+        if ( m_signal_count.load( std::memory_order_acquire )
+             != last_signal_count )
+        {
+            return true;
+        }
+        std::this_thread::yield();
+    }
+    return m_signal_count.load( std::memory_order_acquire )
+           != last_signal_count;
 }
 
 Signaler::signal_count_type Signaler::wait_for_signal(
     Signaler::signal_count_type last_signal_count ) const
 {
-    std::unique_lock<mutex> guard( m_cv_mutex );
-    if ( m_signal_count == last_signal_count )
+    return wait_for_signal_ns( last_signal_count,
+                               std::chrono::nanoseconds::max() );
+}
+
+Signaler::signal_count_type Signaler::wait_for_signal_ns(
+    Signaler::signal_count_type last_signal_count,
+    std::chrono::nanoseconds timeout ) const
+{
+    typedef std::chrono::steady_clock clock;
+
+    if ( spin_for_signal( last_signal_count ) )
     {
-        m_cv.wait( guard );
+        return get_count();
     }
-    return m_signal_count;
+
+    clock::time_point const now = clock::now();
+    bool const forever = timeout >= clock::time_point::max() - now;
+    clock::time_point const deadline
+        = forever ? clock::time_point::max() : now + timeout;
+
+    // Announce the waiter before the final check of the count, so that a
+    // sender either sees the waiter or we see its new count
+    m_waiter_count.fetch_add( 1 );
+
+#if LAMBDASTEW_SIGNALER_FUTEX
+    while ( m_signal_count.load() == last_signal_count )
+    {
+        if ( forever )
+        {
+            futex_wait( futex_word( m_signal_count ),
+                        (int)last_signal_count,
+                        nullptr );
+        }
+        else
+        {
+            clock::time_point current = clock::now();
+            if ( current >= deadline )
+            {
+                break;
+            }
+            std::chrono::nanoseconds remaining = deadline - current;
+            timespec rel;
+            rel.tv_sec = (time_t)( remaining.count() / 1000000000 );
+            rel.tv_nsec = (long)( remaining.count() % 1000000000 );
+            futex_wait( futex_word( m_signal_count ),
+                        (int)last_signal_count,
+                        &rel );
+        }
+    }
+#else
+    {
+        unique_lock<mutex> guard( m_cv_mutex );
+        while ( m_signal_count.load() == last_signal_count )
+        {
+            if ( forever )
+            {
+                m_cv.wait( guard );
+            }
+            else if ( m_cv.wait_until( guard, deadline )
+                      == std::cv_status::timeout )
+            {
+                break;
+            }
+        }
+    }
+#endif
+
+    m_waiter_count.fetch_sub( 1 );
+    return get_count();
 }
 }
@@ -0,0 +1,182 @@
+#include "LambdaStew/Strand.hpp"
+
+namespace LambdaStew
+{
+
+const size_t Strand::default_max_batch;
+
+///
+/// \brief t_current_strand
+///
+/// The state of the strand whose runner is active on the calling thread
+///
+static thread_local void const *t_current_strand = nullptr;
+
+Strand::Strand( MessageQueue &queue, unsigned lane, size_t max_batch )
+    : m_state( std::make_shared<State>(
+          queue, lane, std::max<size_t>( max_batch, 1 ) ) )
+{
+}
+
+bool Strand::post( Task &&task )
+{
+    if ( m_state->queue.is_closed() )
+    {
+        return false;
+    }
+
+    // Destroyed after the mutex is released, in case its destructor posts
+    Task rejected;
+    {
+        lock_guard<std::mutex> guard( m_state->mutex );
+        m_state->tasks.push_back( std::move( task ) );
+        if ( m_state->scheduled )
+        {
+            // The runner will get to it
+            return true;
+        }
+
+        // Schedule under the mutex, so that no other post() can add to the
+        // strand between a failed schedule() and taking the task back
+        if ( schedule( m_state ) )
+        {
+            m_state->scheduled = true;
+            return true;
+        }
+
+        // The queue was closed under us, so nothing will run the task. The
+        // strand was idle, so it is the only one
+        rejected = std::move( m_state->tasks.back() );
+        m_state->tasks.pop_back();
+    }
+    return false;
+}
+
+bool Strand::running_in_this_thread() const
+{
+    return t_current_strand == m_state.get();
+}
+
+size_t Strand::pending() const
+{
+    lock_guard<std::mutex> guard( m_state->mutex );
+    return m_state->tasks.size();
+}
+
+bool Strand::schedule( std::shared_ptr<State> const &state )
+{
+    std::shared_ptr<State> runner_state( state );
+    // The runner carries tasks which were already accepted, so it is
+    // admitted past the capacity of the queue
+    return state->queue.enqueue( state->lane,
+                                 [runner_state]()
+                                 {
+                                     run( runner_state );
+                                 },
+                                 false,
+                                 MessageQueue::Admission::force );
+}
+
+void Strand::run( std::shared_ptr<State> const &state )
+{
+    // Restore the outer strand when returning, in case a consumer runs
+    // this one from inside a task of another
+    struct CurrentStrand
+    {
+        explicit CurrentStrand( void const *strand )
+            : previous( t_current_strand )
+        {
+            t_current_strand = strand;
+        }
+        ~CurrentStrand() { t_current_strand = previous; }
+        void const *previous;
+    } current_strand( state.get() );
+
+    std::vector<Task> &batch = state->batch;
+    do
+    {
+        {
+            lock_guard<std::mutex> guard( state->mutex );
+            size_t const n
+                = std::min( state->max_batch, state->tasks.size() );
+            std::move( state->tasks.begin(),
+                       state->tasks.begin() + n,
+                       std::back_inserter( batch ) );
+            state->tasks.erase( state->tasks.begin(),
+                                state->tasks.begin() + n );
+        }
+
+        size_t count = 0;
+        try
+        {
+            for ( ; count < batch.size(); ++count )
+            {
+                batch[count]();
+            }
+        }
+        catch ( MessageQueue::PleaseStopException const & )
+        {
+            // MessageQueue::call() puts this runner back in the queue for
+            // the other consumers, so it stays scheduled and takes the next
+            // turn
+            give_back( *state, count + 1 );
+            throw;
+        }
+        catch ( ... )
+        {
+            // Keep the order of the strand: the runner comes back for the
+            // tasks which were not called before the exception goes on to
+            // the consumer.
+            //
+            // give_back() has to come before next_turn(): the runner that
+            // next_turn() queues can start on another consumer at once, and
+            // it must find the tasks not yet called at the front of tasks
+            // and the batch empty. The other order would let it run later
+            // tasks first, or see no tasks and mark the strand idle
+            give_back( *state, count + 1 );
+            if ( next_turn( state ) )
+            {
+                // A closed queue takes no runner, and this consumer is
+                // leaving, so the rest of the strand can not run
+                std::deque<Task> dropped;
+                {
+                    lock_guard<std::mutex> guard( state->mutex );
+                    dropped.swap( state->tasks );
+                    state->scheduled = false;
+                }
+            }
+            throw;
+        }
+        batch.clear();
+    } while ( next_turn( state ) );
+}
+
+void Strand::give_back( State &state, size_t first )
+{
+    std::vector<Task> &batch = state.batch;
+    if ( first < batch.size() )
+    {
+        lock_guard<std::mutex> guard( state.mutex );
+        state.tasks.insert( state.tasks.begin(),
+                            std::make_move_iterator( batch.begin() + first ),
+                            std::make_move_iterator( batch.end() ) );
+    }
+    batch.clear();
+}
+
+bool Strand::next_turn( std::shared_ptr<State> const &state )
+{
+    {
+        lock_guard<std::mutex> guard( state->mutex );
+        if ( state->tasks.empty() )
+        {
+            state->scheduled = false;
+            return false;
+        }
+    }
+
+    // Once the queue is closed it takes no new runner, but its consumers
+    // still run what was queued before, so the strand finishes here
+    return !schedule( state );
+}
+}
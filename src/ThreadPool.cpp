@@ -0,0 +1,318 @@
+#include "LambdaStew/ThreadPool.hpp"
+
+namespace LambdaStew
+{
+
+///
+/// \brief t_current_pool
+///
+/// The pool which owns the calling thread, if it is a worker
+///
+static thread_local ThreadPool *t_current_pool = nullptr;
+
+///
+/// \brief t_current_index
+///
+/// The index of the calling worker thread in its pool
+///
+static thread_local size_t t_current_index = 0;
+
+const size_t ThreadPool::task_cache_limit;
+
+ThreadPool::ThreadPool( size_t num_threads )
+    : m_idle_workers( 0 ), m_stopping( false ), m_shared_slots( nullptr )
+{
+    if ( num_threads == 0 )
+    {
+        num_threads = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+
+    for ( size_t i = 0; i < num_threads; ++i )
+    {
+        m_workers.emplace_back( new Worker );
+        m_workers.back()->random_state = (uint32_t)( i * 2654435761u ) | 1;
+    }
+
+    for ( size_t i = 0; i < num_threads; ++i )
+    {
+        m_workers[i]->thread = std::thread( &ThreadPool::worker_loop, this, i );
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    shutdown();
+
+    // The workers have given their free slots back on exit
+    while ( m_shared_slots )
+    {
+        TaskSlot *slot = m_shared_slots;
+        m_shared_slots = slot->next;
+        delete slot;
+    }
+}
+
+ThreadPool *ThreadPool::current()
+{
+    return t_current_pool;
+}
+
+void ThreadPool::submit( Task &&task )
+{
+    if ( t_current_pool == this )
+    {
+        Worker &self = *m_workers[t_current_index];
+        self.deque.push( allocate_task( self, std::move( task ) ) );
+    }
+    else
+    {
+        m_injection.push_back( std::move( task ) );
+    }
+    wake_idle_worker();
+}
+
+void ThreadPool::shutdown()
+{
+    m_stopping = true;
+    m_work_signal.send_signal_all();
+
+    for ( auto &worker : m_workers )
+    {
+        if ( worker->thread.joinable() )
+        {
+            worker->thread.join();
+        }
+    }
+
+    // Discard anything submitted while the workers were exiting
+    for ( auto &worker : m_workers )
+    {
+        Task *task;
+        while ( worker->deque.pop( task ) )
+        {
+            task->~Task();
+            TaskSlot *slot = reinterpret_cast<TaskSlot *>( task );
+            lock_guard<std::mutex> guard( m_slot_mutex );
+            slot->next = m_shared_slots;
+            m_shared_slots = slot;
+        }
+    }
+    while ( !m_injection.empty() )
+    {
+        m_injection.skip_next();
+    }
+}
+
+Task *ThreadPool::allocate_task( Worker &self, Task &&task )
+{
+    if ( !self.free_slots )
+    {
+        lock_guard<std::mutex> guard( m_slot_mutex );
+        while ( m_shared_slots && self.free_count < task_cache_limit / 2 )
+        {
+            TaskSlot *slot = m_shared_slots;
+            m_shared_slots = slot->next;
+            slot->next = self.free_slots;
+            self.free_slots = slot;
+            ++self.free_count;
+        }
+    }
+
+    TaskSlot *slot;
+    if ( self.free_slots )
+    {
+        slot = self.free_slots;
+        self.free_slots = slot->next;
+        --self.free_count;
+    }
+    else
+    {
+        slot = new TaskSlot;
+    }
+    return new ( &slot->storage ) Task( std::move( task ) );
+}
+
+void ThreadPool::release_task( Worker &self, Task *task )
+{
+    task->~Task();
+    TaskSlot *slot = reinterpret_cast<TaskSlot *>( task );
+    slot->next = self.free_slots;
+    self.free_slots = slot;
+    if ( ++self.free_count > task_cache_limit )
+    {
+        give_back_slots( self, task_cache_limit / 2 );
+    }
+}
+
+void ThreadPool::give_back_slots( Worker &self, size_t count )
+{
+    if ( count == 0 )
+    {
+        return;
+    }
+
+    TaskSlot *first = self.free_slots;
+    TaskSlot *last = first;
+    for ( size_t i = 1; i < count; ++i )
+    {
+        last = last->next;
+    }
+    self.free_slots = last->next;
+    self.free_count -= count;
+
+    lock_guard<std::mutex> guard( m_slot_mutex );
+    last->next = m_shared_slots;
+    m_shared_slots = first;
+}
+
+void ThreadPool::wake_idle_worker()
+{
+    // Pairs with the increment of m_idle_workers in worker_loop(): either the
+    // worker sees the new task, or we see the idle worker
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( m_idle_workers.load( std::memory_order_relaxed ) > 0 )
+    {
+        m_work_signal.send_signal_one();
+    }
+}
+
+bool ThreadPool::has_work() const
+{
+    if ( !m_injection.empty() )
+    {
+        return true;
+    }
+    for ( auto const &worker : m_workers )
+    {
+        if ( !worker->deque.empty_approx() )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run( Worker &self, Task *task )
+{
+    try
+    {
+        ( *task )();
+    }
+    catch ( std::exception const &e )
+    {
+        log_error( "ThreadPool task caught exception: ", e.what() );
+    }
+    catch ( ... )
+    {
+        log_error( "ThreadPool task caught exception" );
+    }
+    release_task( self, task );
+}
+
+bool ThreadPool::run_one( Worker &self, size_t index )
+{
+    Task *task;
+
+    if ( self.deque.pop( task ) )
+    {
+        run( self, task );
+        return true;
+    }
+
+    try
+    {
+        if ( m_injection.invoke() )
+        {
+            return true;
+        }
+    }
+    catch ( MessageQueue::PleaseStopException const & )
+    {
+        // invoke() has put the item back for the next worker, so swallowing
+        // it here would spin on it forever
+        throw;
+    }
+    catch ( ... )
+    {
+        // MessageQueue::invoke() has logged it already
+        return true;
+    }
+
+    size_t const count = m_workers.size();
+    if ( count > 1 )
+    {
+        // xorshift32 to pick the first victim
+        uint32_t x = self.random_state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        self.random_state = x;
+
+        size_t victim = x % count;
+        for ( size_t i = 0; i < count; ++i, victim = ( victim + 1 ) % count )
+        {
+            if ( victim != index && m_workers[victim]->deque.steal( task ) )
+            {
+                run( self, task );
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop( size_t index )
+{
+    Worker &self = *m_workers[index];
+    t_current_pool = this;
+    t_current_index = index;
+
+    while ( true )
+    {
+        try
+        {
+            if ( run_one( self, index ) )
+            {
+                continue;
+            }
+        }
+        catch ( MessageQueue::PleaseStopException const & )
+        {
+            // Hand the please-stop item on to a sleeping worker, and run
+            // what was spawned on this worker's deque before leaving, as no
+            // thief may be left to take it
+            m_work_signal.send_signal_all();
+            Task *task;
+            while ( self.deque.pop( task ) )
+            {
+                run( self, task );
+            }
+            break;
+        }
+
+        // Announce that this worker is going idle before looking for work
+        // one last time, so that a concurrent submit() will signal us
+        Signaler::signal_count_type last_signal_count
+            = m_work_signal.get_count();
+        m_idle_workers.fetch_add( 1 );
+
+        if ( has_work() )
+        {
+            m_idle_workers.fetch_sub( 1 );
+            continue;
+        }
+
+        if ( m_stopping )
+        {
+            m_idle_workers.fetch_sub( 1 );
+            break;
+        }
+
+        m_work_signal.wait_for_signal( last_signal_count );
+        m_idle_workers.fetch_sub( 1 );
+    }
+
+    give_back_slots( self, self.free_count );
+    t_current_pool = nullptr;
+}
+}
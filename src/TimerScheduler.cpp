@@ -0,0 +1,285 @@
+#include "LambdaStew/TimerScheduler.hpp"
+#include "LambdaStew/MessageQueue.hpp"
+
+namespace LambdaStew
+{
+
+const int64_t TimerScheduler::tick_ns;
+
+TimerScheduler &TimerScheduler::instance()
+{
+    static TimerScheduler scheduler;
+    return scheduler;
+}
+
+TimerScheduler::TimerScheduler()
+    : m_epoch( clock::now() ), m_wake_tick( UINT64_MAX ), m_exit( false )
+{
+}
+
+TimerScheduler::~TimerScheduler()
+{
+    {
+        lock_guard<std::mutex> guard( m_mutex );
+        m_exit = true;
+    }
+    m_signaler.send_signal_all();
+    if ( m_thread.joinable() )
+    {
+        m_thread.join();
+    }
+}
+
+uint64_t TimerScheduler::tick_at( clock::time_point when ) const
+{
+    int64_t const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           when - m_epoch ).count();
+    return ns <= 0 ? 0 : uint64_t( ( ns + tick_ns - 1 ) / tick_ns );
+}
+
+TimerId TimerScheduler::schedule( MessageQueue &queue,
+                                  clock::time_point when,
+                                  Task &&task )
+{
+    Timer timer;
+    timer.queue = &queue;
+    timer.task = std::move( task );
+    return insert( tick_at( when ), std::move( timer ) );
+}
+
+TimerId TimerScheduler::schedule_every( MessageQueue &queue,
+                                        clock::time_point first,
+                                        std::chrono::nanoseconds period,
+                                        std::function<void()> const &func )
+{
+    Timer timer;
+    timer.queue = &queue;
+    timer.repeat = func;
+    timer.period_ticks = std::max<uint64_t>(
+        1, uint64_t( ( period.count() + tick_ns - 1 ) / tick_ns ) );
+    return insert( tick_at( first ), std::move( timer ) );
+}
+
+TimerId TimerScheduler::insert( uint64_t tick, Timer &&timer )
+{
+    MessageQueue *queue = timer.queue;
+    bool wake = false;
+    TimerId id;
+    {
+        lock_guard<std::mutex> guard( m_mutex );
+        id = m_wheel.insert( tick, std::move( timer ) );
+        queue->m_pending_timers.fetch_add( 1 );
+
+        if ( !m_thread.joinable() )
+        {
+            m_thread = std::thread( [this]() { run(); } );
+        }
+
+        // The wheel may have moved the expiry to the next tick
+        tick = std::max( tick, m_wheel.current_tick() + 1 );
+        if ( tick < m_wake_tick )
+        {
+            m_wake_tick = tick;
+            wake = true;
+        }
+    }
+    if ( wake )
+    {
+        m_signaler.send_signal_one();
+    }
+    return id;
+}
+
+bool TimerScheduler::cancel( TimerId id )
+{
+    lock_guard<std::mutex> guard( m_mutex );
+    Timer timer;
+    if ( !m_wheel.cancel( id, timer ) )
+    {
+        return false;
+    }
+    timer.queue->m_pending_timers.fetch_sub( 1 );
+    return true;
+}
+
+void TimerScheduler::cancel_all( MessageQueue &queue )
+{
+    MessageQueue *target = &queue;
+    unique_lock<std::mutex> lock( m_mutex );
+    while ( true )
+    {
+        size_t const removed
+            = m_wheel.remove_if( [target]( Timer const &timer )
+                                 {
+                                     return timer.queue == target;
+                                 } );
+        queue.m_pending_timers.fetch_sub( removed );
+
+        // What is left are the timers of a batch the thread is pushing to
+        // the queue right now. It counts them down once it is done
+        if ( !queue.m_pending_timers.load() )
+        {
+            return;
+        }
+        Signaler::signal_count_type const last_signal_count
+            = m_pushed.get_count();
+        lock.unlock();
+        if ( queue.m_pending_timers.load() )
+        {
+            m_pushed.wait_for_signal( last_signal_count );
+        }
+        lock.lock();
+    }
+}
+
+size_t TimerScheduler::pending() const
+{
+    lock_guard<std::mutex> guard( m_mutex );
+    return m_wheel.size();
+}
+
+TimerScheduler::Batch &TimerScheduler::batch_for( MessageQueue *queue )
+{
+    Batch *batch = nullptr;
+    for ( auto &used : m_batches )
+    {
+        if ( used.queue == queue )
+        {
+            return used;
+        }
+        if ( !used.queue )
+        {
+            batch = &used;
+            break;
+        }
+    }
+    if ( !batch )
+    {
+        m_batches.push_back( Batch() );
+        batch = &m_batches.back();
+    }
+
+    // The batch holds a count of its own, so that the queue outlives the
+    // push even if all of its timers are cancelled in the meantime
+    batch->queue = queue;
+    batch->finished = 1;
+    queue->m_pending_timers.fetch_add( 1 );
+    return *batch;
+}
+
+void TimerScheduler::run()
+{
+    unique_lock<std::mutex> lock( m_mutex );
+    while ( !m_exit )
+    {
+        // The last tick which has fully started
+        uint64_t const now = uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - m_epoch ).count() / tick_ns );
+
+        m_wheel.advance( now,
+                         [this]( Timer &timer, uint64_t &expiry ) -> bool
+                         {
+                             MessageQueue *queue = timer.queue;
+                             Batch &batch = batch_for( queue );
+                             if ( timer.period_ticks && !queue->is_closed() )
+                             {
+                                 batch.tasks.push_back( Task( timer.repeat ) );
+                                 expiry += timer.period_ticks;
+                                 return true;
+                             }
+                             if ( timer.period_ticks )
+                             {
+                                 m_discarded.push_back(
+                                     Task( std::move( timer.repeat ) ) );
+                             }
+                             else
+                             {
+                                 batch.tasks.push_back(
+                                     std::move( timer.task ) );
+                             }
+                             // Counted down only after the push, so that the
+                             // queue can not be destroyed in the meantime
+                             ++batch.finished;
+                             return false;
+                         } );
+
+        // Push without the lock, so that a full queue does not hold up
+        // insert(), cancel() or the consumers calling them. The finished
+        // timers of a batch are still counted, so cancel_all() waits for the
+        // push before its queue can be destroyed
+        lock.unlock();
+        for ( auto &batch : m_batches )
+        {
+            if ( !batch.queue )
+            {
+                break;
+            }
+            if ( !batch.tasks.empty() )
+            {
+                batch.queue->enqueue_bulk(
+                    batch.tasks,
+                    false,
+                    MessageQueue::Admission::force_no_wait );
+            }
+        }
+        lock.lock();
+
+        bool const pushed = !m_batches.empty() && m_batches.front().queue;
+        for ( auto &batch : m_batches )
+        {
+            if ( !batch.queue )
+            {
+                break;
+            }
+
+            // The tasks which found a full ring wait in the wheel for the
+            // next tick rather than stalling the timers of other queues. A
+            // closed queue leaves its tasks behind
+            for ( auto &task : batch.tasks )
+            {
+                if ( batch.queue->is_closed() )
+                {
+                    m_discarded.push_back( std::move( task ) );
+                    continue;
+                }
+                Timer timer;
+                timer.queue = batch.queue;
+                timer.task = std::move( task );
+                m_wheel.insert( now, std::move( timer ) );
+                batch.queue->m_pending_timers.fetch_add( 1 );
+            }
+            batch.queue->m_pending_timers.fetch_sub( batch.finished );
+            batch.tasks.clear();
+            batch.queue = nullptr;
+            batch.finished = 0;
+        }
+        if ( pushed )
+        {
+            m_pushed.send_signal_all();
+        }
+
+        // Sleep until the next tick with work, but at most max_sleep_ticks
+        // so that the time arithmetic can not overflow
+        uint64_t const max_sleep_ticks = 3600 * 1000;
+        m_wake_tick = m_wheel.next_tick();
+        if ( m_wake_tick - now > max_sleep_ticks )
+        {
+            m_wake_tick = now + max_sleep_ticks;
+        }
+        Signaler::signal_count_type last_signal_count = m_signaler.get_count();
+        clock::duration const wait
+            = m_epoch
+              + std::chrono::nanoseconds( int64_t( m_wake_tick ) * tick_ns )
+              - clock::now();
+
+        lock.unlock();
+        m_discarded.clear();
+        if ( wait > clock::duration::zero() )
+        {
+            m_signaler.wait_for_signal_for( last_signal_count, wait );
+        }
+        lock.lock();
+    }
+}
+}
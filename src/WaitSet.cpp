@@ -0,0 +1,186 @@
+#include "LambdaStew/WaitSet.hpp"
+
+#include <stdexcept>
+
+namespace LambdaStew
+{
+
+WaitSet::WaitSet( Order order )
+    : m_order( order ), m_next( 0 ), m_idle_consumers( 0 )
+{
+}
+
+WaitSet::~WaitSet()
+{
+    for ( auto queue : m_queues )
+    {
+        queue->m_wait_set = nullptr;
+    }
+}
+
+size_t WaitSet::add( MessageQueue &queue )
+{
+    if ( queue.m_wait_set )
+    {
+        throw std::logic_error( "MessageQueue already belongs to a WaitSet" );
+    }
+    queue.m_wait_set = this;
+    m_queues.push_back( &queue );
+
+    // Items pushed before the queue joined may have no consumer waiting
+    queue_changed( true );
+    return m_queues.size() - 1;
+}
+
+bool WaitSet::remove( MessageQueue &queue )
+{
+    auto i = std::find( m_queues.begin(), m_queues.end(), &queue );
+    if ( i == m_queues.end() )
+    {
+        return false;
+    }
+    queue.m_wait_set = nullptr;
+    m_queues.erase( i );
+    return true;
+}
+
+size_t WaitSet::ready( vector<size_t> &indices ) const
+{
+    indices.clear();
+    size_t const count = m_queues.size();
+    size_t const first = count ? first_index() : 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        size_t const index = ( first + i ) % count;
+        MessageQueue const &queue = *m_queues[index];
+        if ( !queue.empty() && !queue.is_stopped() )
+        {
+            indices.push_back( index );
+        }
+    }
+    return indices.size();
+}
+
+void WaitSet::request_stop( StopSource &stop_source )
+{
+    stop_source.request_stop();
+    m_signaler.send_signal_all();
+}
+
+void WaitSet::queue_changed( bool notify_all )
+{
+    // Pairs with the fence in wait_ns(): either the consumer sees the change
+    // or this sees the consumer
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( !m_idle_consumers.load( std::memory_order_relaxed ) )
+    {
+        return;
+    }
+    m_signaler.send_signal( notify_all );
+}
+
+bool WaitSet::invoke( size_t *index )
+{
+    size_t const count = m_queues.size();
+    size_t const first = count ? first_index() : 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        size_t const n = ( first + i ) % count;
+        MessageQueue &queue = *m_queues[n];
+
+        // Check before locking, so that skipping empty queues is cheap
+        if ( queue.empty() || queue.is_stopped() )
+        {
+            continue;
+        }
+        if ( m_order == Order::round_robin )
+        {
+            m_next.store( n + 1, std::memory_order_relaxed );
+        }
+        if ( queue.invoke() )
+        {
+            if ( index )
+            {
+                *index = n;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WaitSet::done() const
+{
+    for ( auto queue : m_queues )
+    {
+        if ( !queue->is_stopped() && !( queue->is_closed() && queue->empty() ) )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+WaitSet::Status WaitSet::wait_ns( vector<size_t> *indices,
+                                  std::chrono::nanoseconds timeout,
+                                  StopToken const *stop_token,
+                                  size_t *index )
+{
+    typedef std::chrono::steady_clock clock;
+    clock::time_point const start = clock::now();
+    clock::time_point const deadline
+        = timeout >= clock::time_point::max() - start ? clock::time_point::max()
+                                                      : start + timeout;
+
+    while ( true )
+    {
+        if ( stop_token && stop_token->stop_requested() )
+        {
+            return Status::stopped;
+        }
+
+        if ( indices ? ready( *indices ) != 0 : invoke( index ) )
+        {
+            return Status::invoked;
+        }
+
+        // Read the signal count before announcing the consumer. A push to
+        // any queue after the announcement sees it and changes the count
+        Signaler::signal_count_type last_signal_count = m_signaler.get_count();
+        m_idle_consumers.fetch_add( 1 );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        bool any_ready = false;
+        for ( auto queue : m_queues )
+        {
+            if ( !queue->empty() && !queue->is_stopped() )
+            {
+                any_ready = true;
+                break;
+            }
+        }
+        if ( any_ready )
+        {
+            m_idle_consumers.fetch_sub( 1 );
+            continue;
+        }
+
+        if ( done() || ( stop_token && stop_token->stop_requested() ) )
+        {
+            m_idle_consumers.fetch_sub( 1 );
+            return stop_token && stop_token->stop_requested() ? Status::stopped
+                                                              : Status::closed;
+        }
+
+        clock::time_point now = clock::now();
+        if ( now >= deadline )
+        {
+            m_idle_consumers.fetch_sub( 1 );
+            return Status::timeout;
+        }
+
+        m_signaler.wait_for_signal_for( last_signal_count, deadline - now );
+        m_idle_consumers.fetch_sub( 1 );
+    }
+}
+}
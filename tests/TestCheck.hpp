@@ -0,0 +1,47 @@
+#ifndef LAMBDASTEW_TESTCHECK_HPP
+#define LAMBDASTEW_TESTCHECK_HPP
+
+#include <cstdio>
+#include <cstdlib>
+
+///
+/// \brief LAMBDASTEW_CHECK
+///
+/// Fail the test program if cond is false. Unlike assert() this is kept in
+/// release builds, where the tests also run
+///
+#define LAMBDASTEW_CHECK( cond )                                               \
+    do                                                                         \
+    {                                                                          \
+        if ( !( cond ) )                                                       \
+        {                                                                      \
+            std::fprintf( stderr,                                              \
+                          "%s:%d: check failed: %s\n",                         \
+                          __FILE__,                                            \
+                          __LINE__,                                            \
+                          #cond );                                             \
+            std::exit( EXIT_FAILURE );                                         \
+        }                                                                      \
+    } while ( 0 )
+
+///
+/// \brief LAMBDASTEW_CHECK_THROWS
+///
+/// Fail the test program unless expr throws an exception of type E
+///
+#define LAMBDASTEW_CHECK_THROWS( expr, E )                                     \
+    do                                                                         \
+    {                                                                          \
+        bool threw = false;                                                    \
+        try                                                                    \
+        {                                                                      \
+            expr;                                                              \
+        }                                                                      \
+        catch ( E const & )                                                    \
+        {                                                                      \
+            threw = true;                                                      \
+        }                                                                      \
+        LAMBDASTEW_CHECK( threw );                                             \
+    } while ( 0 )
+
+#endif // LAMBDASTEW_TESTCHECK_HPP
@@ -0,0 +1,156 @@
+#include "LambdaStew/Log.hpp"
+#include "TestCheck.hpp"
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+///
+/// \brief lines
+///
+/// \return the lines of text, without their line endings
+///
+static vector<std::string> lines( std::string const &text )
+{
+    vector<std::string> r;
+    std::istringstream in( text );
+    std::string line;
+    while ( std::getline( in, line ) )
+    {
+        r.push_back( line );
+    }
+    return r;
+}
+
+///
+/// \brief test_threads
+///
+/// Lines from several threads all reach the log ostream, each thread's
+/// lines in order, once log_flush() returns
+///
+static void test_threads()
+{
+    int const threads = 4;
+    int const per_thread = 2000;
+
+    std::ostringstream out;
+    log_ostream( true, &out );
+    log_async( true, true, LogOverflow::block, 4096 );
+    LAMBDASTEW_CHECK( log_async() );
+
+    vector<std::thread> loggers;
+    for ( int t = 0; t < threads; ++t )
+    {
+        loggers.emplace_back( [t]()
+                              {
+                                  for ( int i = 0; i < per_thread; ++i )
+                                  {
+                                      log_info( "thread ", t, " line ", i );
+                                  }
+                              } );
+    }
+    for ( auto &logger : loggers )
+    {
+        logger.join();
+    }
+    log_flush();
+
+    vector<std::string> const written = lines( out.str() );
+    LAMBDASTEW_CHECK( written.size() == size_t( threads * per_thread ) );
+
+    vector<int> next( threads, 0 );
+    for ( auto const &line : written )
+    {
+        int t = -1;
+        int i = -1;
+        LAMBDASTEW_CHECK(
+            sscanf( line.c_str(), "INFO   :thread %d line %d", &t, &i ) == 2 );
+        LAMBDASTEW_CHECK( t >= 0 && t < threads );
+        LAMBDASTEW_CHECK( i == next[t] );
+        ++next[t];
+    }
+
+    log_async( true, false );
+    LAMBDASTEW_CHECK( !log_async() );
+    log_ostream( true, &std::clog );
+}
+
+///
+/// \brief test_drop
+///
+/// With LogOverflow::drop a full buffer loses lines instead of waiting,
+/// and every line is either written or counted as dropped
+///
+static void test_drop()
+{
+    int const count = 20000;
+
+    std::ostringstream out;
+    log_ostream( true, &out );
+    uint64_t const dropped_before = log_dropped();
+
+    // A thread which has not logged yet gets a buffer of the new size
+    log_async( true, true, LogOverflow::drop, 1024 );
+    std::thread logger( []()
+                        {
+                            for ( int i = 0; i < count; ++i )
+                            {
+                                log_info( "line ", i );
+                            }
+                        } );
+    logger.join();
+    log_flush();
+
+    // The writer reports the drops in a line of its own
+    size_t written = 0;
+    for ( auto const &line : lines( out.str() ) )
+    {
+        if ( line.compare( 0, 13, "INFO   :line " ) == 0 )
+        {
+            ++written;
+        }
+    }
+    uint64_t const dropped = log_dropped() - dropped_before;
+    LAMBDASTEW_CHECK( written + dropped == size_t( count ) );
+
+    log_async( true, false );
+    log_ostream( true, &std::clog );
+}
+
+///
+/// \brief test_disable_writes_buffered
+///
+/// Turning asynchronous mode off writes what was already buffered, and
+/// later lines are written at once by the calling thread
+///
+static void test_disable_writes_buffered()
+{
+    std::ostringstream out;
+    log_ostream( true, &out );
+    log_async( true, true );
+    for ( int i = 0; i < 100; ++i )
+    {
+        log_info( "async ", i );
+    }
+    log_async( true, false );
+    LAMBDASTEW_CHECK( lines( out.str() ).size() == 100 );
+
+    log_info( "sync" );
+    vector<std::string> const written = lines( out.str() );
+    LAMBDASTEW_CHECK( written.size() == 101 );
+    LAMBDASTEW_CHECK( written.back() == "INFO   :sync" );
+    log_ostream( true, &std::clog );
+}
+
+int main()
+{
+    test_threads();
+    test_drop();
+    test_disable_writes_buffered();
+    return 0;
+}
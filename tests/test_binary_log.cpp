@@ -0,0 +1,150 @@
+#include "LambdaStew/BinaryLog.hpp"
+#include "TestCheck.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+using namespace LambdaStew;
+
+///
+/// \brief The Reader struct
+///
+/// Reads the values of a binary log file in order
+///
+struct Reader
+{
+    template <typename T>
+    T value()
+    {
+        T v;
+        LAMBDASTEW_CHECK( pos + sizeof( v ) <= data.size() );
+        memcpy( &v, data.data() + pos, sizeof( v ) );
+        pos += sizeof( v );
+        return v;
+    }
+
+    std::string string()
+    {
+        uint32_t const length = value<uint32_t>();
+        LAMBDASTEW_CHECK( pos + length <= data.size() );
+        std::string r( data, pos, length );
+        pos += length;
+        return r;
+    }
+
+    std::string data;
+    size_t pos;
+};
+
+///
+/// \brief test_print_formatted
+///
+/// Placeholders are replaced in order, extra arguments appended and
+/// missing ones left as they are
+///
+static void test_print_formatted()
+{
+    std::ostringstream o;
+    print_formatted( o, "a {} b {}", 1, "x" );
+    LAMBDASTEW_CHECK( o.str() == "a 1 b x" );
+
+    o.str( "" );
+    print_formatted( o, "{}-", 1, 2 );
+    LAMBDASTEW_CHECK( o.str() == "1-2" );
+
+    o.str( "" );
+    print_formatted( o, "{} and {}", 1 );
+    LAMBDASTEW_CHECK( o.str() == "1 and {}" );
+}
+
+///
+/// \brief test_text
+///
+/// With binary logging off a binary call site logs formatted text
+///
+static void test_text()
+{
+    std::ostringstream out;
+    log_ostream( true, &out );
+    LAMBDASTEW_CHECK( !log_binary() );
+    LAMBDASTEW_LOG_BINARY( LogLevel::info, "pushed {} items to {}", 3, "q" );
+    log_ostream( true, &std::clog );
+    LAMBDASTEW_CHECK( out.str() == "INFO   :pushed 3 items to q\n" );
+}
+
+///
+/// \brief test_file
+///
+/// With binary logging on a call site is written once, followed by an
+/// entry with the raw arguments for each line it logs
+///
+static void test_file()
+{
+    char const *const path = "test_binary_log.bin";
+    LAMBDASTEW_CHECK( log_binary( true, true, path ) );
+    LAMBDASTEW_CHECK( log_binary() );
+
+    LogLevel const level = LogLevel::warning;
+    char const *const format = "{} {} {} {} {} {}";
+    std::string const text( "text" );
+    int line = 0;
+    for ( int i = 0; i < 3; ++i )
+    {
+        unsigned const u = i;
+        double const d = 1.5 * i;
+        bool const b = i == 1;
+        LAMBDASTEW_LOG_BINARY( level, format, -i, u, d, 'c', b, text );
+        line = __LINE__ - 1;
+    }
+    log_binary( true, false );
+    LAMBDASTEW_CHECK( !log_binary() );
+
+    std::ifstream in( path, std::ios::binary );
+    Reader r;
+    r.data.assign( std::istreambuf_iterator<char>( in ),
+                   std::istreambuf_iterator<char>() );
+    r.pos = 0;
+    in.close();
+    std::remove( path );
+
+    LAMBDASTEW_CHECK( r.data.compare( 0, 8, binary_log_magic, 8 ) == 0 );
+    r.pos = 8 + 2 * sizeof( int64_t );
+
+    LAMBDASTEW_CHECK( r.value<uint8_t>() == binary_log_site );
+    uint32_t const id = r.value<uint32_t>();
+    LAMBDASTEW_CHECK( r.value<uint8_t>() == uint8_t( level ) );
+    LAMBDASTEW_CHECK( r.value<uint32_t>() == uint32_t( line ) );
+    LAMBDASTEW_CHECK( r.string() == __FILE__ );
+    LAMBDASTEW_CHECK( r.string() == format );
+    LAMBDASTEW_CHECK( r.string() == "iudcbs" );
+
+    int64_t last = 0;
+    for ( int i = 0; i < 3; ++i )
+    {
+        LAMBDASTEW_CHECK( r.value<uint8_t>() == binary_log_entry );
+        LAMBDASTEW_CHECK( r.value<uint32_t>() == id );
+        LAMBDASTEW_CHECK( r.value<uint32_t>() == 8 + 8 + 8 + 1 + 1 + 4 + 4 );
+        int64_t const timestamp = r.value<int64_t>();
+        LAMBDASTEW_CHECK( timestamp >= last );
+        last = timestamp;
+
+        LAMBDASTEW_CHECK( r.value<int64_t>() == -i );
+        LAMBDASTEW_CHECK( r.value<uint64_t>() == uint64_t( i ) );
+        LAMBDASTEW_CHECK( r.value<double>() == 1.5 * i );
+        LAMBDASTEW_CHECK( r.value<char>() == 'c' );
+        LAMBDASTEW_CHECK( r.value<uint8_t>() == ( i == 1 ) );
+        LAMBDASTEW_CHECK( r.string() == text );
+    }
+    LAMBDASTEW_CHECK( r.pos == r.data.size() );
+}
+
+int main()
+{
+    test_print_formatted();
+    test_text();
+    test_file();
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include "LambdaStew/Channel.hpp"
+#include "TestCheck.hpp"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+///
+/// \brief The Counted struct
+///
+/// A value which counts the live instances of its type
+///
+struct Counted
+{
+    Counted() { ++live; }
+    Counted( Counted const & ) { ++live; }
+    ~Counted() { --live; }
+
+    static int live;
+};
+
+int Counted::live = 0;
+
+///
+/// \brief test_order
+///
+/// Values come out in the order they were sent, across growing and
+/// wrapping of the ring
+///
+static void test_order()
+{
+    Channel<int> channel( 4 );
+    int next_sent = 0;
+    int next_received = 0;
+    int out[3];
+    for ( int round = 0; round < 20; ++round )
+    {
+        for ( int i = 0; i < round; ++i )
+        {
+            LAMBDASTEW_CHECK( channel.send( next_sent++ ) );
+        }
+        size_t const n = channel.receive( out, 3 );
+        for ( size_t i = 0; i < n; ++i )
+        {
+            LAMBDASTEW_CHECK( out[i] == next_received++ );
+        }
+    }
+
+    vector<int> rest;
+    size_t const left = channel.size();
+    LAMBDASTEW_CHECK( channel.receive( rest, 1000 ) == left );
+    for ( int v : rest )
+    {
+        LAMBDASTEW_CHECK( v == next_received++ );
+    }
+    LAMBDASTEW_CHECK( next_received == next_sent );
+    LAMBDASTEW_CHECK( channel.empty() );
+    LAMBDASTEW_CHECK( channel.receive( out, 3 ) == 0 );
+}
+
+///
+/// \brief test_values
+///
+/// Move-only values can be sent, in bulk too, and the values left in a
+/// channel are destroyed with it
+///
+static void test_values()
+{
+    Channel<std::unique_ptr<int> > channel;
+    LAMBDASTEW_CHECK( channel.send( std::unique_ptr<int>( new int( 1 ) ) ) );
+    LAMBDASTEW_CHECK( channel.emplace( new int( 2 ) ) );
+    vector<std::unique_ptr<int> > bulk;
+    bulk.emplace_back( new int( 3 ) );
+    bulk.emplace_back( new int( 4 ) );
+    LAMBDASTEW_CHECK( channel.send_bulk( bulk.begin(), bulk.end() ) );
+
+    vector<std::unique_ptr<int> > out;
+    LAMBDASTEW_CHECK( channel.receive( out, 10 ) == 4 );
+    for ( int i = 0; i < 4; ++i )
+    {
+        LAMBDASTEW_CHECK( *out[i] == i + 1 );
+    }
+
+    {
+        Channel<Counted> counted( 2 );
+        for ( int i = 0; i < 5; ++i )
+        {
+            counted.emplace();
+        }
+        LAMBDASTEW_CHECK( Counted::live == 5 );
+        vector<Counted> taken;
+        counted.receive( taken, 2 );
+        LAMBDASTEW_CHECK( Counted::live == 5 );
+    }
+    LAMBDASTEW_CHECK( Counted::live == 0 );
+}
+
+///
+/// \brief test_close
+///
+/// A closed channel rejects values but hands out those it has, and a
+/// stopped one releases its consumers at once
+///
+static void test_close()
+{
+    Channel<int> channel;
+    LAMBDASTEW_CHECK( channel.send( 1 ) );
+    channel.close();
+    LAMBDASTEW_CHECK( channel.is_closed() && !channel.is_stopped() );
+    LAMBDASTEW_CHECK( !channel.send( 2 ) );
+    int const more[] = {3, 4};
+    LAMBDASTEW_CHECK( !channel.send_bulk( more, more + 2 ) );
+
+    typedef Channel<int>::Status Status;
+    std::chrono::seconds const forever( 60 );
+    vector<int> out;
+    LAMBDASTEW_CHECK( channel.wait_and_receive( out, 10, forever )
+                      == Status::received );
+    LAMBDASTEW_CHECK( out.size() == 1 && out[0] == 1 );
+    LAMBDASTEW_CHECK( channel.wait_and_receive( out, 10, forever )
+                      == Status::closed );
+
+    Channel<int> idle;
+    LAMBDASTEW_CHECK(
+        idle.wait_and_receive( out, 10, std::chrono::milliseconds( 1 ) )
+        == Status::timeout );
+
+    StopSource stop_source;
+    std::thread consumer( [&idle, &stop_source]()
+                          {
+                              vector<int> values;
+                              LAMBDASTEW_CHECK(
+                                  idle.wait_and_receive(
+                                      values,
+                                      10,
+                                      std::chrono::seconds( 60 ),
+                                      stop_source.get_token() )
+                                  == Status::stopped );
+                          } );
+    idle.request_stop( stop_source );
+    consumer.join();
+
+    idle.stop();
+    LAMBDASTEW_CHECK( idle.is_stopped() );
+    LAMBDASTEW_CHECK( !idle.send( 5 ) );
+    LAMBDASTEW_CHECK( idle.wait_and_receive( out, 10, forever )
+                      == Status::stopped );
+}
+
+///
+/// \brief test_threads
+///
+/// Every value sent by several producers is received once by one of
+/// several waiting consumers, each producer's values in order
+///
+static void test_threads()
+{
+    int const threads = 4;
+    int const per_thread = 20000;
+    Channel<int> channel( 16 );
+    vector<vector<int> > received( threads );
+
+    vector<std::thread> consumers;
+    for ( int t = 0; t < threads; ++t )
+    {
+        consumers.emplace_back( [&channel, &received, t]()
+                                {
+                                    while ( channel.wait_and_receive(
+                                                received[t],
+                                                64,
+                                                std::chrono::seconds( 60 ) )
+                                            == Channel<int>::Status::received )
+                                    {
+                                    }
+                                } );
+    }
+
+    vector<std::thread> producers;
+    for ( int t = 0; t < threads; ++t )
+    {
+        producers.emplace_back( [&channel, t]()
+                                {
+                                    for ( int i = 0; i < per_thread; ++i )
+                                    {
+                                        channel.send( t * per_thread + i );
+                                    }
+                                } );
+    }
+    for ( auto &producer : producers )
+    {
+        producer.join();
+    }
+    channel.close();
+    for ( auto &consumer : consumers )
+    {
+        consumer.join();
+    }
+
+    vector<int> seen( threads * per_thread, 0 );
+    for ( auto const &values : received )
+    {
+        vector<int> last( threads, -1 );
+        for ( int v : values )
+        {
+            ++seen[v];
+            LAMBDASTEW_CHECK( v > last[v / per_thread] );
+            last[v / per_thread] = v;
+        }
+    }
+    for ( int count : seen )
+    {
+        LAMBDASTEW_CHECK( count == 1 );
+    }
+}
+
+int main()
+{
+    test_order();
+    test_values();
+    test_close();
+    test_threads();
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "LambdaStew/EventLoop.hpp"
+#include "TestCheck.hpp"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+///
+/// \brief test_post
+///
+/// Functions posted from other threads run on the loop thread, in order,
+/// and stop() ends run()
+///
+static void test_post()
+{
+    EventLoop loop;
+    LAMBDASTEW_CHECK( !loop.in_loop_thread() );
+    std::thread runner( [&loop]() { loop.run(); } );
+
+    int const count = 10000;
+    vector<int> order;
+    std::atomic<int> outside( 0 );
+    for ( int i = 0; i < count; ++i )
+    {
+        LAMBDASTEW_CHECK( loop.post( [&loop, &order, &outside, i]()
+                                     {
+                                         if ( !loop.in_loop_thread() )
+                                         {
+                                             ++outside;
+                                         }
+                                         order.push_back( i );
+                                     } ) );
+    }
+    loop.post( [&loop]() { loop.stop(); } );
+    runner.join();
+
+    LAMBDASTEW_CHECK( outside == 0 );
+    LAMBDASTEW_CHECK( order.size() == size_t( count ) );
+    for ( int i = 0; i < count; ++i )
+    {
+        LAMBDASTEW_CHECK( order[i] == i );
+    }
+}
+
+///
+/// \brief test_fd
+///
+/// The handler of a watched file descriptor is called when it is ready,
+/// and no longer once it is removed
+///
+static void test_fd()
+{
+    int fds[2];
+    LAMBDASTEW_CHECK( pipe( fds ) == 0 );
+
+    EventLoop loop;
+    std::string received;
+    LAMBDASTEW_CHECK( loop.add_fd( fds[0],
+                                   EPOLLIN,
+                                   [&received, fds]( uint32_t events )
+                                   {
+                                       LAMBDASTEW_CHECK( events & EPOLLIN );
+                                       char buf[16];
+                                       ssize_t n = read( fds[0], buf, 16 );
+                                       received.append( buf, size_t( n ) );
+                                   } ) );
+    LAMBDASTEW_CHECK( !loop.add_fd( fds[0], EPOLLIN, []( uint32_t ) {} ) );
+    LAMBDASTEW_CHECK( loop.run_once( std::chrono::milliseconds( 1 ) ) == 0 );
+
+    LAMBDASTEW_CHECK( write( fds[1], "abc", 3 ) == 3 );
+    LAMBDASTEW_CHECK( loop.run_once( std::chrono::seconds( 60 ) ) == 1 );
+    LAMBDASTEW_CHECK( received == "abc" );
+
+    LAMBDASTEW_CHECK( loop.remove_fd( fds[0] ) );
+    LAMBDASTEW_CHECK( !loop.remove_fd( fds[0] ) );
+    LAMBDASTEW_CHECK( write( fds[1], "d", 1 ) == 1 );
+    LAMBDASTEW_CHECK( loop.run_once( std::chrono::milliseconds( 1 ) ) == 0 );
+    LAMBDASTEW_CHECK( received == "abc" );
+
+    close( fds[0] );
+    close( fds[1] );
+}
+
+///
+/// \brief test_timers
+///
+/// Timers run on the loop thread in time order, periodic ones until they
+/// are cancelled, and cancelled ones not at all
+///
+static void test_timers()
+{
+    EventLoop loop;
+    vector<int> order;
+    std::atomic<int> ticks( 0 );
+
+    loop.run_after( std::chrono::milliseconds( 20 ),
+                    [&order]() { order.push_back( 2 ); } );
+    loop.run_after( std::chrono::milliseconds( 5 ),
+                    [&order]() { order.push_back( 1 ); } );
+    TimerId cancelled = loop.run_after( std::chrono::milliseconds( 10 ),
+                                        [&order]() { order.push_back( 0 ); } );
+    LAMBDASTEW_CHECK( loop.cancel( cancelled ) );
+    LAMBDASTEW_CHECK( !loop.cancel( cancelled ) );
+
+    TimerId every
+        = loop.run_every( EventLoop::clock::now(),
+                          std::chrono::milliseconds( 2 ),
+                          [&loop, &ticks]()
+                          {
+                              LAMBDASTEW_CHECK( loop.in_loop_thread() );
+                              ++ticks;
+                          } );
+    loop.run_after( std::chrono::milliseconds( 40 ),
+                    [&loop]() { loop.stop(); } );
+    loop.run();
+
+    LAMBDASTEW_CHECK( order.size() == 2 && order[0] == 1 && order[1] == 2 );
+    LAMBDASTEW_CHECK( ticks >= 3 );
+    LAMBDASTEW_CHECK( loop.cancel( every ) );
+
+    int const last = ticks;
+    loop.run_once( std::chrono::milliseconds( 10 ) );
+    LAMBDASTEW_CHECK( ticks == last );
+}
+
+int main()
+{
+    test_post();
+    test_fd();
+    test_timers();
+    return 0;
+}
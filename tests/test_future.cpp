@@ -0,0 +1,222 @@
+#include "LambdaStew/Future.hpp"
+#include "TestCheck.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+
+///
+/// \brief The ThrowingCopy struct
+///
+/// A value whose copies throw if the original says so
+///
+struct ThrowingCopy
+{
+    explicit ThrowingCopy( bool fail ) : fail_copy( fail ) {}
+    ThrowingCopy( ThrowingCopy const &other ) : fail_copy( false )
+    {
+        if ( other.fail_copy )
+        {
+            throw std::runtime_error( "copy failed" );
+        }
+    }
+
+    bool fail_copy;
+};
+
+static void test_value()
+{
+    MessageQueue queue;
+    Future<int> future = submit( queue, []() { return 42; } );
+    LAMBDASTEW_CHECK( future.valid() );
+    LAMBDASTEW_CHECK( !future.is_ready() );
+    LAMBDASTEW_CHECK( queue.invoke() );
+    LAMBDASTEW_CHECK( future.is_ready() );
+    LAMBDASTEW_CHECK( future.get() == 42 );
+    LAMBDASTEW_CHECK( !future.valid() );
+    LAMBDASTEW_CHECK_THROWS( future.get(), FutureError );
+
+    Future<void> done = submit( queue, []() {} );
+    std::thread consumer( [&queue]() { queue.invoke(); } );
+    done.get();
+    consumer.join();
+}
+
+static void test_exception()
+{
+    MessageQueue queue;
+    Future<std::string> future = submit(
+        queue, []() -> std::string { throw std::runtime_error( "failed" ); } );
+    queue.invoke();
+    LAMBDASTEW_CHECK_THROWS( future.get(), std::runtime_error );
+}
+
+static void test_broken_promise()
+{
+    Future<int> future;
+    {
+        Promise<int> promise;
+        future = promise.get_future();
+        LAMBDASTEW_CHECK_THROWS( promise.get_future(), FutureError );
+    }
+    LAMBDASTEW_CHECK( future.is_ready() );
+    LAMBDASTEW_CHECK_THROWS( future.get(), FutureError );
+
+    // A task which never runs breaks its promise when it is destroyed
+    Future<int> dropped;
+    {
+        MessageQueue queue;
+        dropped = submit( queue, []() { return 1; } );
+    }
+    LAMBDASTEW_CHECK_THROWS( dropped.get(), FutureError );
+
+    Promise<int> promise;
+    promise.set_value( 1 );
+    LAMBDASTEW_CHECK( !promise.valid() );
+    LAMBDASTEW_CHECK_THROWS( promise.set_value( 2 ), FutureError );
+}
+
+static void test_throwing_value()
+{
+    // A value which can not be copied leaves the promise to be completed
+    // with an exception instead
+    Promise<ThrowingCopy> promise;
+    Future<ThrowingCopy> future = promise.get_future();
+    ThrowingCopy value( true );
+    LAMBDASTEW_CHECK_THROWS( promise.set_value( value ), std::runtime_error );
+    LAMBDASTEW_CHECK( promise.valid() );
+    LAMBDASTEW_CHECK( !future.is_ready() );
+
+    promise.set_exception(
+        std::make_exception_ptr( std::logic_error( "no value" ) ) );
+    LAMBDASTEW_CHECK_THROWS( future.get(), std::logic_error );
+
+    MessageQueue queue;
+    Future<ThrowingCopy> copied
+        = submit( queue, []() { return ThrowingCopy( true ); } );
+    queue.invoke();
+    LAMBDASTEW_CHECK_THROWS( copied.get(), std::runtime_error );
+}
+
+static void test_then()
+{
+    MessageQueue first;
+    MessageQueue second;
+
+    Future<int> future = submit( first, []() { return 20; } );
+    Future<int> next
+        = future.then( second, []( Future<int> f ) { return f.get() + 1; } );
+    LAMBDASTEW_CHECK( !future.valid() );
+
+    // The continuation goes to the second queue once the first has run
+    LAMBDASTEW_CHECK( !second.invoke() );
+    LAMBDASTEW_CHECK( first.invoke() );
+    LAMBDASTEW_CHECK( second.invoke() );
+    LAMBDASTEW_CHECK( next.get() == 21 );
+
+    // Attached after the result is ready it is pushed at once
+    Future<int> ready = submit( first, []() { return 1; } );
+    first.invoke();
+    Future<int> later
+        = ready.then( second, []( Future<int> f ) { return f.get() * 2; } );
+    LAMBDASTEW_CHECK( second.invoke() );
+    LAMBDASTEW_CHECK( later.get() == 2 );
+}
+
+static void test_then_closed_queue()
+{
+    MessageQueue queue;
+    MessageQueue closed;
+    closed.close();
+
+    Future<int> future = submit( queue, []() { return 1; } );
+    bool called = false;
+    Future<int> next = future.then( closed,
+                                    [&called]( Future<int> f )
+                                    {
+                                        called = true;
+                                        return f.get();
+                                    } );
+    queue.invoke();
+    LAMBDASTEW_CHECK( next.is_ready() );
+    LAMBDASTEW_CHECK_THROWS( next.get(), FutureError );
+    LAMBDASTEW_CHECK( !called );
+
+    // submit() to a closed queue is ready at once with the same error
+    Future<int> rejected = submit( closed, []() { return 1; } );
+    LAMBDASTEW_CHECK( rejected.is_ready() );
+    LAMBDASTEW_CHECK_THROWS( rejected.get(), FutureError );
+}
+
+static void test_wait_for()
+{
+    Promise<int> promise;
+    Future<int> future = promise.get_future();
+    LAMBDASTEW_CHECK( !future.wait_for( std::chrono::milliseconds( 1 ) ) );
+
+    std::thread producer( [&promise]() { promise.set_value( 5 ); } );
+    LAMBDASTEW_CHECK( future.wait_for( std::chrono::seconds( 60 ) ) );
+    producer.join();
+    LAMBDASTEW_CHECK( future.get() == 5 );
+}
+
+///
+/// \brief The LateFutures struct
+///
+/// A thread_local which outlives the pool cache of its thread, and
+/// allocates and frees states in its destructor
+///
+struct LateFutures
+{
+    ~LateFutures()
+    {
+        futures.clear();
+        Promise<int> promise;
+        promise.get_future();
+    }
+
+    std::vector<Future<int> > futures;
+};
+
+static void test_thread_exit()
+{
+    std::thread thread( []()
+                        {
+                            // Constructed before the pool cache, so it is
+                            // destroyed after it
+                            static thread_local LateFutures late;
+                            for ( int i = 0; i < 100; ++i )
+                            {
+                                Promise<int> promise;
+                                late.futures.push_back( promise.get_future() );
+                                promise.set_value( i );
+                            }
+                        } );
+    thread.join();
+
+    // The blocks freed after the cache went to the shared pool, where
+    // this thread finds them
+    std::vector<Promise<int> > promises( 100 );
+    for ( auto &promise : promises )
+    {
+        Future<int> future = promise.get_future();
+        promise.set_value( 1 );
+        LAMBDASTEW_CHECK( future.get() == 1 );
+    }
+}
+
+int main()
+{
+    test_value();
+    test_exception();
+    test_broken_promise();
+    test_throwing_value();
+    test_then();
+    test_then_closed_queue();
+    test_wait_for();
+    test_thread_exit();
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "LambdaStew/LogCategory.hpp"
+#include "TestCheck.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+///
+/// \brief lines
+///
+/// \return the lines of text, without their line endings
+///
+static vector<std::string> lines( std::string const &text )
+{
+    vector<std::string> r;
+    std::istringstream in( text );
+    std::string line;
+    while ( std::getline( in, line ) )
+    {
+        r.push_back( line );
+    }
+    return r;
+}
+
+///
+/// \brief test_levels
+///
+/// Categories follow their parent's levels until given levels of their
+/// own, and top level categories follow the global levels
+///
+static void test_levels()
+{
+    LogCategory &net = log_category( "net" );
+    LogCategory &tcp = log_category( "net.tcp" );
+    LogCategory &deep = log_category( "net.tcp.deep" );
+    LAMBDASTEW_CHECK( &log_category( "net.tcp" ) == &tcp );
+    LAMBDASTEW_CHECK( tcp.parent() == &net );
+    LAMBDASTEW_CHECK( net.parent() == nullptr );
+    LAMBDASTEW_CHECK( deep.name() == "net.tcp.deep" );
+
+    log_trace_enable( true, false );
+    LAMBDASTEW_CHECK( !deep.enabled( LogLevel::trace ) );
+    log_trace_enable( true, true );
+    LAMBDASTEW_CHECK( net.enabled( LogLevel::trace ) );
+    LAMBDASTEW_CHECK( deep.enabled( LogLevel::trace ) );
+
+    log_category_levels( "net.tcp", log_level_mask( LogLevel::warning ) );
+    LAMBDASTEW_CHECK( net.enabled( LogLevel::info ) );
+    LAMBDASTEW_CHECK( tcp.enabled( LogLevel::warning ) );
+    LAMBDASTEW_CHECK( !tcp.enabled( LogLevel::notice ) );
+    LAMBDASTEW_CHECK( deep.levels() == log_level_mask( LogLevel::warning ) );
+
+    // Global changes reach only the categories which inherit them
+    log_trace_enable( true, false );
+    LAMBDASTEW_CHECK( !net.enabled( LogLevel::trace ) );
+    LAMBDASTEW_CHECK( deep.levels() == log_level_mask( LogLevel::warning ) );
+
+    log_category_inherit( "net.tcp" );
+    LAMBDASTEW_CHECK( deep.levels() == net.levels() );
+    LAMBDASTEW_CHECK( deep.enabled( LogLevel::info ) );
+    LAMBDASTEW_CHECK( !deep.enabled( LogLevel::trace ) );
+}
+
+///
+/// \brief test_macros
+///
+/// Lines are prefixed with the category name, and disabled lines do not
+/// evaluate their arguments
+///
+static void test_macros()
+{
+    LogCategory &db = log_category( "db" );
+    log_category_levels( "db", log_level_mask( LogLevel::info ) );
+
+    std::ostringstream out;
+    log_ostream( true, &out );
+
+    int evaluated = 0;
+    LAMBDASTEW_LOG_CATEGORY( db, LogLevel::info, "open ", ++evaluated );
+    LAMBDASTEW_LOG_CATEGORY( db, LogLevel::debug, "query ", ++evaluated );
+    LAMBDASTEW_CHECK( evaluated == 1 );
+
+    for ( int i = 0; i < 10; ++i )
+    {
+        LAMBDASTEW_LOG_SAMPLED( db, LogLevel::info, 4, "sample ", i );
+    }
+
+    // A long interval, so that only the burst gets through
+    for ( int i = 0; i < 5; ++i )
+    {
+        LAMBDASTEW_LOG_RATE_LIMITED( db, LogLevel::info, 0.001, 2, "rate ", i );
+    }
+
+    log_ostream( true, &std::clog );
+
+    vector<std::string> const written = lines( out.str() );
+    LAMBDASTEW_CHECK( written.size() == 6 );
+    LAMBDASTEW_CHECK( written[0] == "INFO   :[db] open 1" );
+    LAMBDASTEW_CHECK( written[1] == "INFO   :[db] sample 0" );
+    LAMBDASTEW_CHECK( written[2] == "INFO   :[db] sample 4" );
+    LAMBDASTEW_CHECK( written[3] == "INFO   :[db] sample 8" );
+    LAMBDASTEW_CHECK( written[4] == "INFO   :[db] rate 0" );
+    LAMBDASTEW_CHECK( written[5] == "INFO   :[db] rate 1" );
+}
+
+///
+/// \brief test_rate_limiter
+///
+/// A refused line is counted and reported with the next allowed one
+///
+static void test_rate_limiter()
+{
+    LogRateLimiter limiter( 1e6, 1 );
+    uint64_t suppressed = 99;
+    LAMBDASTEW_CHECK( limiter.allow( suppressed ) );
+    LAMBDASTEW_CHECK( suppressed == 0 );
+
+    // Refused until the microsecond interval has passed
+    uint64_t refused = 0;
+    while ( !limiter.allow( suppressed ) )
+    {
+        ++refused;
+    }
+    LAMBDASTEW_CHECK( suppressed == refused );
+}
+
+int main()
+{
+    test_levels();
+    test_macros();
+    test_rate_limiter();
+    return 0;
+}
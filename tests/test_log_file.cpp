@@ -0,0 +1,194 @@
+#include "LambdaStew/LogFile.hpp"
+#include "TestCheck.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+static char const *const path = "test_log_file.log";
+
+///
+/// \brief rotated_path
+///
+/// \return the name of the n-th rotated file, or of the file itself for 0
+///
+static std::string rotated_path( unsigned n )
+{
+    return n ? std::string( path ) + "." + std::to_string( n ) : path;
+}
+
+///
+/// \brief read_file
+///
+/// \return the contents of the file, empty if it does not exist
+///
+static std::string read_file( std::string const &name )
+{
+    std::ifstream in( name.c_str(), std::ios::binary );
+    return std::string( std::istreambuf_iterator<char>( in ),
+                        std::istreambuf_iterator<char>() );
+}
+
+///
+/// \brief remove_files
+///
+/// Remove the file and up to count rotated files
+///
+static void remove_files( unsigned count )
+{
+    for ( unsigned n = 0; n <= count; ++n )
+    {
+        std::remove( rotated_path( n ).c_str() );
+    }
+}
+
+///
+/// \brief test_append
+///
+/// Opening a file with room left appends to it, and closing it truncates
+/// it to the length written
+///
+static void test_append()
+{
+    remove_files( 0 );
+    LogFileOptions options;
+    options.path = path;
+    options.segment_size = 4096;
+
+    LogFile file;
+    LAMBDASTEW_CHECK( !file.write( "x", 1 ) );
+    LAMBDASTEW_CHECK( file.open( options ) );
+    LAMBDASTEW_CHECK( file.is_open() );
+    LAMBDASTEW_CHECK( file.write_line( "1:", "first", 5 ) );
+    file.close();
+    LAMBDASTEW_CHECK( !file.is_open() );
+    LAMBDASTEW_CHECK( read_file( path ) == "1:first\n" );
+
+    LAMBDASTEW_CHECK( file.open( options ) );
+    LAMBDASTEW_CHECK( file.write( "second\n", 7 ) );
+    file.sync();
+    file.close();
+    LAMBDASTEW_CHECK( read_file( path ) == "1:first\nsecond\n" );
+    LAMBDASTEW_CHECK( file.rotations() == 0 );
+    remove_files( 0 );
+}
+
+///
+/// \brief test_rotation
+///
+/// Lines written by several threads over many rotations each land in one
+/// file, whole and in order, and the oldest files beyond keep are removed
+///
+static void test_rotation()
+{
+    int const threads = 4;
+    int const per_thread = 2000;
+    unsigned const keep = 1000;
+    remove_files( keep );
+
+    LogFileOptions options;
+    options.path = path;
+    options.segment_size = 4096;
+    options.keep = keep;
+    options.sync = LogFileSync::none;
+
+    {
+        LogFile file;
+        LAMBDASTEW_CHECK( file.open( options ) );
+
+        vector<std::thread> writers;
+        for ( int t = 0; t < threads; ++t )
+        {
+            writers.emplace_back( [&file, t]()
+                                  {
+                                      for ( int i = 0; i < per_thread; ++i )
+                                      {
+                                          std::string const text
+                                              = std::to_string( t ) + " "
+                                                + std::to_string( i );
+                                          file.write_line(
+                                              "", text.data(), text.size() );
+                                      }
+                                  } );
+        }
+        for ( auto &writer : writers )
+        {
+            writer.join();
+        }
+        LAMBDASTEW_CHECK( file.rotations() > 10 );
+        LAMBDASTEW_CHECK( file.rotations() < keep );
+    }
+
+    vector<int> next( threads, 0 );
+    for ( unsigned n = keep; n-- > 0; )
+    {
+        std::string const text = read_file( rotated_path( n ) );
+        LAMBDASTEW_CHECK( text.size() <= options.segment_size );
+        LAMBDASTEW_CHECK( text.find( '\0' ) == std::string::npos );
+
+        std::istringstream in( text );
+        int t;
+        int i;
+        while ( in >> t >> i )
+        {
+            LAMBDASTEW_CHECK( t >= 0 && t < threads );
+            LAMBDASTEW_CHECK( i == next[t] );
+            ++next[t];
+        }
+        LAMBDASTEW_CHECK( in.eof() );
+    }
+    for ( int t = 0; t < threads; ++t )
+    {
+        LAMBDASTEW_CHECK( next[t] == per_thread );
+    }
+
+    // Opening a full file rotates it, and only keep files are kept
+    remove_files( keep );
+    options.keep = 2;
+    LogFile file;
+    LAMBDASTEW_CHECK( file.open( options ) );
+    std::string const line( 99, 'x' );
+    for ( int i = 0; i < 200; ++i )
+    {
+        file.write_line( "", line.data(), line.size() );
+    }
+    file.close();
+    LAMBDASTEW_CHECK( !read_file( rotated_path( 2 ) ).empty() );
+    LAMBDASTEW_CHECK( read_file( rotated_path( 3 ) ).empty() );
+    remove_files( 3 );
+}
+
+///
+/// \brief test_log_to_file
+///
+/// While file logging is on, log lines go to the file
+///
+static void test_log_to_file()
+{
+    remove_files( 0 );
+    LogFileOptions options;
+    options.path = path;
+    options.segment_size = 4096;
+
+    LAMBDASTEW_CHECK( log_to_file( true, true, options ) );
+    LAMBDASTEW_CHECK( log_to_file() );
+    log_info( "to file ", 1 );
+    LAMBDASTEW_CHECK( !log_to_file( true, false ) );
+    LAMBDASTEW_CHECK( read_file( path ) == "INFO   :to file 1\n" );
+    remove_files( 0 );
+}
+
+int main()
+{
+    test_append();
+    test_rotation();
+    test_log_to_file();
+    return 0;
+}
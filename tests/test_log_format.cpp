@@ -0,0 +1,174 @@
+#include "LambdaStew/Log.hpp"
+#include "TestCheck.hpp"
+
+#include <clocale>
+#include <climits>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+using namespace LambdaStew;
+
+///
+/// \brief format
+///
+/// \return the parameters formatted with format_to()
+///
+template <typename... ArgsT>
+static std::string format( ArgsT &&... args )
+{
+    FormatBuffer buffer;
+    format_to( buffer, args... );
+    return buffer.str();
+}
+
+///
+/// \brief stream
+///
+/// \return the parameters printed to a default ostream
+///
+template <typename... ArgsT>
+static std::string stream( ArgsT &&... args )
+{
+    std::ostringstream o;
+    o.imbue( std::locale::classic() );
+    print( o, args... );
+    return o.str();
+}
+
+///
+/// \brief The Nested struct
+///
+/// A type whose operator<< formats a line of its own
+///
+struct Nested
+{
+    int value;
+};
+
+static std::ostream &operator<<( std::ostream &o, Nested const &nested )
+{
+    return o << print_to_string( "[", std::hex, nested.value, "]" );
+}
+
+///
+/// \brief test_numbers
+///
+/// Numbers format exactly as an ostream prints them
+///
+static void test_numbers()
+{
+    LAMBDASTEW_CHECK( format( 0 ) == "0" );
+    LAMBDASTEW_CHECK( format( INT_MIN ) == stream( INT_MIN ) );
+    LAMBDASTEW_CHECK( format( LLONG_MIN ) == stream( LLONG_MIN ) );
+    LAMBDASTEW_CHECK( format( ULLONG_MAX ) == stream( ULLONG_MAX ) );
+    LAMBDASTEW_CHECK( format( uint16_t( 65535 ) ) == "65535" );
+    LAMBDASTEW_CHECK( format( true, false ) == "10" );
+
+    for ( long long v = -100000; v <= 100000; v += 997 )
+    {
+        LAMBDASTEW_CHECK( format( v ) == stream( v ) );
+    }
+
+    double const doubles[] = {0.0, 1.5, -2.25, 1e-7, 1e20, 123456789.0, 0.1};
+    for ( double v : doubles )
+    {
+        LAMBDASTEW_CHECK( format( v ) == stream( v ) );
+        LAMBDASTEW_CHECK( format( float( v ) ) == stream( float( v ) ) );
+        LAMBDASTEW_CHECK( format( (long double)v ) == stream( (long double)v ) );
+    }
+}
+
+///
+/// \brief test_text
+///
+/// Characters print as characters and character pointers of every
+/// signedness as strings, while other pointers print as addresses
+///
+static void test_text()
+{
+    char text[] = "abc";
+    signed char signed_text[] = {'d', 'e', 0};
+    unsigned char unsigned_text[] = {'f', 'g', 0};
+    signed char *signed_ptr = signed_text;
+    unsigned char *unsigned_ptr = unsigned_text;
+    char const *null_text = nullptr;
+
+    LAMBDASTEW_CHECK( format( 'x', (signed char)'y', (unsigned char)'z' )
+                      == "xyz" );
+    LAMBDASTEW_CHECK( format( text, " ", std::string( "str" ) ) == "abc str" );
+    LAMBDASTEW_CHECK( format( signed_ptr, unsigned_ptr ) == "defg" );
+    LAMBDASTEW_CHECK( format( (signed char const *)signed_ptr ) == "de" );
+    LAMBDASTEW_CHECK( format( null_text ) == "" );
+
+    int value = 0;
+    void *null_ptr = nullptr;
+    LAMBDASTEW_CHECK( format( &value ) == stream( &value ) );
+    LAMBDASTEW_CHECK( format( null_ptr ) == "0" );
+}
+
+///
+/// \brief test_stream
+///
+/// Lines with other types go through the thread's stream, whose
+/// manipulators do not leak into the next line, and an operator<< which
+/// formats in turn gets a stream of its own
+///
+static void test_stream()
+{
+    LAMBDASTEW_CHECK( format( std::hex, 255, " ", std::showbase, 16 )
+                      == "ff 0x10" );
+    LAMBDASTEW_CHECK( format( std::setprecision( 2 ), 3.14159 ) == "3.1" );
+    LAMBDASTEW_CHECK( format( std::setw( 4 ), std::setfill( '*' ), 7 )
+                      == "***7" );
+    LAMBDASTEW_CHECK( format( std::dec, 255, " ", 3.14159, " ", 7 )
+                      == "255 3.14159 7" );
+
+    Nested const nested = {255};
+    LAMBDASTEW_CHECK( format( "a", nested, 255, std::hex ) == "a[ff]255" );
+    LAMBDASTEW_CHECK( print_to_string( nested, 1.5 ) == "[ff]1.5" );
+}
+
+///
+/// \brief test_long_line
+///
+/// A line longer than the inline buffer moves to the heap intact
+///
+static void test_long_line()
+{
+    std::string const part( 300, 'x' );
+    std::string const line = format( part, 12345, part );
+    LAMBDASTEW_CHECK( line.size() == 605 );
+    LAMBDASTEW_CHECK( line == part + "12345" + part );
+}
+
+///
+/// \brief test_locale
+///
+/// Doubles keep their '.' under a C locale with a decimal comma, if the
+/// system has one
+///
+static void test_locale()
+{
+    char const *const names[] = {"de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8"};
+    for ( char const *name : names )
+    {
+        if ( setlocale( LC_NUMERIC, name ) )
+        {
+            LAMBDASTEW_CHECK( format( 1.5 ) == "1.5" );
+            LAMBDASTEW_CHECK( format( 1.5, std::hex ) == "1.5" );
+            setlocale( LC_NUMERIC, "C" );
+            return;
+        }
+    }
+}
+
+int main()
+{
+    test_numbers();
+    test_text();
+    test_stream();
+    test_long_line();
+    test_locale();
+    return 0;
+}
@@ -0,0 +1,220 @@
+#include "LambdaStew/MPMCRing.hpp"
+#include "LambdaStew/MessageQueue.hpp"
+#include "TestCheck.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+///
+/// \brief check_each_seen_once
+///
+/// Check that every value from 0 to count was taken exactly once
+///
+static void check_each_seen_once( vector<vector<int> > const &taken,
+                                  size_t count )
+{
+    vector<int> seen( count, 0 );
+    for ( auto const &values : taken )
+    {
+        for ( int value : values )
+        {
+            LAMBDASTEW_CHECK( value >= 0 && size_t( value ) < count );
+            ++seen[value];
+        }
+    }
+    for ( size_t i = 0; i < count; ++i )
+    {
+        LAMBDASTEW_CHECK( seen[i] == 1 );
+    }
+}
+
+static void test_mpmc_single_thread()
+{
+    MPMCRing<int> ring( 3 );
+    LAMBDASTEW_CHECK( ring.capacity() == 4 );
+    LAMBDASTEW_CHECK( ring.empty_approx() );
+
+    int value = -1;
+    LAMBDASTEW_CHECK( !ring.try_pop( value ) );
+
+    // Wrap around the ring a few times
+    for ( int round = 0; round < 5; ++round )
+    {
+        for ( int i = 0; i < 4; ++i )
+        {
+            LAMBDASTEW_CHECK( ring.try_push( round * 10 + i ) );
+        }
+        LAMBDASTEW_CHECK( !ring.try_push( 99 ) );
+        LAMBDASTEW_CHECK( ring.size_approx() == 4 );
+        for ( int i = 0; i < 4; ++i )
+        {
+            LAMBDASTEW_CHECK( ring.try_pop( value ) );
+            LAMBDASTEW_CHECK( value == round * 10 + i );
+        }
+        LAMBDASTEW_CHECK( !ring.try_pop( value ) );
+    }
+
+    // Items still in the ring are destroyed with it
+    std::shared_ptr<int> shared = std::make_shared<int>( 1 );
+    {
+        MPMCRing<std::shared_ptr<int> > owner( 4 );
+        LAMBDASTEW_CHECK( owner.try_emplace( shared ) );
+        LAMBDASTEW_CHECK( shared.use_count() == 2 );
+    }
+    LAMBDASTEW_CHECK( shared.use_count() == 1 );
+}
+
+static void test_mpmc_threads()
+{
+    int const producers = 4;
+    int const consumers = 4;
+    int const per_producer = 50000;
+    size_t const count = size_t( producers ) * per_producer;
+
+    MPMCRing<int> ring( 64 );
+    std::atomic<size_t> popped( 0 );
+    vector<vector<int> > taken( consumers );
+    vector<std::thread> threads;
+
+    for ( int p = 0; p < producers; ++p )
+    {
+        threads.emplace_back( [&ring, p]()
+                              {
+                                  for ( int i = 0; i < per_producer; ++i )
+                                  {
+                                      while ( !ring.try_push(
+                                          p * per_producer + i ) )
+                                      {
+                                          std::this_thread::yield();
+                                      }
+                                  }
+                              } );
+    }
+    for ( int c = 0; c < consumers; ++c )
+    {
+        threads.emplace_back( [&ring, &popped, &taken, c, count]()
+                              {
+                                  int value;
+                                  while ( popped.load() < count )
+                                  {
+                                      if ( ring.try_pop( value ) )
+                                      {
+                                          taken[c].push_back( value );
+                                          popped.fetch_add( 1 );
+                                      }
+                                      else
+                                      {
+                                          std::this_thread::yield();
+                                      }
+                                  }
+                              } );
+    }
+    for ( auto &thread : threads )
+    {
+        thread.join();
+    }
+
+    check_each_seen_once( taken, count );
+
+    // Values of one producer reach one consumer in the order they were
+    // pushed
+    for ( auto const &values : taken )
+    {
+        vector<int> last( producers, -1 );
+        for ( int value : values )
+        {
+            LAMBDASTEW_CHECK( value > last[value / per_producer] );
+            last[value / per_producer] = value;
+        }
+    }
+}
+
+///
+/// \brief test_queue_ring
+///
+/// A MessageQueue on the lock_free_ring backend runs its functions in
+/// order, try_push() fails on a full ring, and functions from several
+/// producers each run once with several consumers
+///
+static void test_queue_ring()
+{
+    typedef MessageQueue::Backend Backend;
+    MessageQueue queue( Backend::lock_free_ring, 4 );
+    LAMBDASTEW_CHECK( queue.backend() == Backend::lock_free_ring );
+
+    vector<int> order;
+    for ( int i = 0; i < 4; ++i )
+    {
+        queue.push_back( [&order, i]() { order.push_back( i ); } );
+    }
+    LAMBDASTEW_CHECK( queue.size() == 4 );
+    LAMBDASTEW_CHECK( !queue.try_push( []() {} ) );
+    while ( queue.try_invoke() )
+    {
+    }
+    LAMBDASTEW_CHECK( queue.empty() );
+    LAMBDASTEW_CHECK( order.size() == 4 );
+    for ( int i = 0; i < 4; ++i )
+    {
+        LAMBDASTEW_CHECK( order[i] == i );
+    }
+
+    int const producers = 3;
+    int const per_producer = 20000;
+    size_t const count = size_t( producers ) * per_producer;
+    MessageQueue shared( Backend::lock_free_ring, 64 );
+    vector<std::atomic<int> > seen( count );
+    std::atomic<size_t> ran( 0 );
+    vector<std::thread> threads;
+
+    for ( int p = 0; p < producers; ++p )
+    {
+        threads.emplace_back(
+            [&shared, &seen, &ran, p]()
+            {
+                for ( int i = 0; i < per_producer; ++i )
+                {
+                    int const value = p * per_producer + i;
+                    shared.push_back( [&seen, &ran, value]()
+                                      {
+                                          seen[value].fetch_add( 1 );
+                                          ran.fetch_add( 1 );
+                                      } );
+                }
+            } );
+    }
+    for ( int c = 0; c < 3; ++c )
+    {
+        threads.emplace_back( [&shared, &ran, count]()
+                              {
+                                  while ( ran.load() < count )
+                                  {
+                                      if ( !shared.invoke() )
+                                      {
+                                          std::this_thread::yield();
+                                      }
+                                  }
+                              } );
+    }
+    for ( auto &thread : threads )
+    {
+        thread.join();
+    }
+    for ( size_t i = 0; i < count; ++i )
+    {
+        LAMBDASTEW_CHECK( seen[i].load() == 1 );
+    }
+}
+
+int main()
+{
+    test_mpmc_single_thread();
+    test_mpmc_threads();
+    test_queue_ring();
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "LambdaStew/MessageQueue.hpp"
+#include "TestCheck.hpp"
+
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+typedef MessageQueue::Backend Backend;
+
+///
+/// \brief test_bulk
+///
+/// push_back_bulk() and push_back_range() queue their tasks in order, and
+/// invoke_batch() and drain() call them in order
+///
+static void test_bulk( Backend backend )
+{
+    MessageQueue queue( backend, 64 );
+    vector<int> order;
+
+    vector<Task> tasks;
+    for ( int i = 0; i < 10; ++i )
+    {
+        tasks.emplace_back( [&order, i]() { order.push_back( i ); } );
+    }
+    queue.push_back_bulk( tasks );
+    LAMBDASTEW_CHECK( tasks.empty() );
+    LAMBDASTEW_CHECK( queue.size() == 10 );
+
+    vector<std::function<void()> > funcs;
+    for ( int i = 10; i < 15; ++i )
+    {
+        funcs.push_back( [&order, i]() { order.push_back( i ); } );
+    }
+    queue.push_back_range( funcs.begin(), funcs.end() );
+    LAMBDASTEW_CHECK( queue.size() == 15 );
+
+    LAMBDASTEW_CHECK( queue.invoke_batch( 4 ) == 4 );
+    LAMBDASTEW_CHECK( order.size() == 4 );
+    LAMBDASTEW_CHECK( queue.drain() == 11 );
+    LAMBDASTEW_CHECK( queue.empty() );
+    LAMBDASTEW_CHECK( queue.invoke_batch( 4 ) == 0 );
+
+    LAMBDASTEW_CHECK( order.size() == 15 );
+    for ( int i = 0; i < 15; ++i )
+    {
+        LAMBDASTEW_CHECK( order[i] == i );
+    }
+}
+
+///
+/// \brief test_drain_leaves_new
+///
+/// Functions added while draining are left for a later call
+///
+static void test_drain_leaves_new( Backend backend )
+{
+    MessageQueue queue( backend, 64 );
+    int ran = 0;
+    for ( int i = 0; i < 3; ++i )
+    {
+        queue.push_back( [&queue, &ran]()
+                         {
+                             ++ran;
+                             queue.push_back( [&ran]() { ++ran; } );
+                         } );
+    }
+    LAMBDASTEW_CHECK( queue.drain() == 3 );
+    LAMBDASTEW_CHECK( queue.size() == 3 );
+    LAMBDASTEW_CHECK( queue.drain() == 3 );
+    LAMBDASTEW_CHECK( ran == 6 );
+}
+
+///
+/// \brief test_throwing_batch
+///
+/// The functions of a batch after one which throws are put back at the
+/// front of the queue, still in order
+///
+static void test_throwing_batch( Backend backend )
+{
+    MessageQueue queue( backend, 64 );
+    vector<int> order;
+    for ( int i = 0; i < 5; ++i )
+    {
+        queue.push_back( [&order, i]()
+                         {
+                             order.push_back( i );
+                             if ( i == 1 )
+                             {
+                                 throw std::runtime_error( "task failed" );
+                             }
+                         } );
+    }
+    queue.push_back( [&order]() { order.push_back( 5 ); } );
+
+    LAMBDASTEW_CHECK_THROWS( queue.invoke_batch( 4 ), std::runtime_error );
+    LAMBDASTEW_CHECK( order.size() == 2 );
+    LAMBDASTEW_CHECK( queue.size() == 4 );
+    LAMBDASTEW_CHECK( queue.drain() == 4 );
+
+    LAMBDASTEW_CHECK( order.size() == 6 );
+    for ( int i = 0; i < 6; ++i )
+    {
+        LAMBDASTEW_CHECK( order[i] == i );
+    }
+}
+
+int main()
+{
+    Backend const backends[]
+        = {Backend::locked_queue, Backend::lock_free_ring};
+    for ( Backend backend : backends )
+    {
+        test_bulk( backend );
+        test_drain_leaves_new( backend );
+        test_throwing_batch( backend );
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+#include "LambdaStew/Strand.hpp"
+#include "TestCheck.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+typedef MessageQueue::Backend Backend;
+typedef MessageQueue::Overflow Overflow;
+
+///
+/// \brief run_all
+///
+/// Call the functions in queue until it is empty
+///
+/// \return the number of functions called
+///
+static size_t run_all( MessageQueue &queue )
+{
+    size_t count = 0;
+    while ( queue.invoke() )
+    {
+        ++count;
+    }
+    return count;
+}
+
+static void test_reject( Backend backend )
+{
+    MessageQueue queue( backend, 64 );
+    queue.set_capacity( 2, Overflow::reject );
+    LAMBDASTEW_CHECK( queue.capacity() == 2 );
+    LAMBDASTEW_CHECK( queue.overflow() == Overflow::reject );
+
+    LAMBDASTEW_CHECK( queue.push_back( []() {} ) );
+    LAMBDASTEW_CHECK( queue.push_back( []() {} ) );
+    Task task( []() {} );
+    LAMBDASTEW_CHECK( !queue.push_back( std::move( task ) ) );
+    LAMBDASTEW_CHECK( bool( task ) );
+    LAMBDASTEW_CHECK( queue.rejected() == 1 );
+    LAMBDASTEW_CHECK( queue.dropped() == 0 );
+
+    LAMBDASTEW_CHECK( queue.invoke() );
+    LAMBDASTEW_CHECK( queue.push_back( std::move( task ) ) );
+    LAMBDASTEW_CHECK( queue.size() == 2 );
+
+    // Please-stop items are admitted past the capacity
+    queue.push_back_please_stop();
+    LAMBDASTEW_CHECK( queue.size() == 3 );
+    LAMBDASTEW_CHECK( queue.invoke() && queue.invoke() );
+    LAMBDASTEW_CHECK_THROWS( queue.invoke(),
+                             MessageQueue::PleaseStopException );
+}
+
+static void test_drop_newest( Backend backend )
+{
+    MessageQueue queue( backend, 64 );
+    queue.set_capacity( 2, Overflow::drop_newest );
+    vector<int> order;
+    for ( int i = 0; i < 4; ++i )
+    {
+        LAMBDASTEW_CHECK(
+            queue.push_back( [&order, i]() { order.push_back( i ); } ) );
+    }
+    LAMBDASTEW_CHECK( queue.dropped() == 2 );
+    LAMBDASTEW_CHECK( queue.rejected() == 0 );
+    LAMBDASTEW_CHECK( run_all( queue ) == 2 );
+    LAMBDASTEW_CHECK( order.size() == 2 && order[0] == 0 && order[1] == 1 );
+}
+
+static void test_drop_oldest( Backend backend )
+{
+    MessageQueue queue( backend, 64 );
+    queue.set_capacity( 2, Overflow::drop_oldest );
+    vector<int> order;
+    for ( int i = 0; i < 4; ++i )
+    {
+        LAMBDASTEW_CHECK(
+            queue.push_back( [&order, i]() { order.push_back( i ); } ) );
+    }
+    LAMBDASTEW_CHECK( queue.dropped() == 2 );
+    LAMBDASTEW_CHECK( run_all( queue ) == 2 );
+    LAMBDASTEW_CHECK( order.size() == 2 && order[0] == 2 && order[1] == 3 );
+}
+
+///
+/// \brief test_drop_oldest_strand
+///
+/// Overflow::drop_oldest passes over a strand's runner, which would leave
+/// the strand scheduled forever if it was lost, and rejects the push once
+/// nothing else is left to drop
+///
+static void test_drop_oldest_strand( Backend backend )
+{
+    MessageQueue queue( backend, 64 );
+    queue.set_capacity( 2, Overflow::drop_oldest );
+    Strand strand( queue );
+    vector<int> order;
+
+    LAMBDASTEW_CHECK( strand.post( [&order]() { order.push_back( 0 ); } ) );
+    for ( int i = 1; i < 4; ++i )
+    {
+        LAMBDASTEW_CHECK(
+            queue.push_back( [&order, i]() { order.push_back( i ); } ) );
+    }
+    LAMBDASTEW_CHECK( queue.dropped() == 2 );
+    LAMBDASTEW_CHECK( run_all( queue ) == 2 );
+    LAMBDASTEW_CHECK( order.size() == 2 && order[0] == 0 && order[1] == 3 );
+    LAMBDASTEW_CHECK( strand.pending() == 0 );
+
+    // The strand still runs what is posted to it
+    LAMBDASTEW_CHECK( strand.post( [&order]() { order.push_back( 4 ); } ) );
+    LAMBDASTEW_CHECK( run_all( queue ) == 1 );
+    LAMBDASTEW_CHECK( order.size() == 3 && order[2] == 4 );
+
+    queue.set_capacity( 1, Overflow::drop_oldest );
+    LAMBDASTEW_CHECK( strand.post( [&order]() { order.push_back( 5 ); } ) );
+    LAMBDASTEW_CHECK(
+        !queue.push_back( [&order]() { order.push_back( 6 ); } ) );
+    LAMBDASTEW_CHECK( queue.rejected() == 1 );
+    LAMBDASTEW_CHECK( run_all( queue ) == 1 );
+    LAMBDASTEW_CHECK( order.size() == 4 && order[3] == 5 );
+}
+
+///
+/// \brief test_drop_oldest_please_stop
+///
+/// A please-stop item on a full queue is never the one dropped, so it still
+/// ends its consumer
+///
+static void test_drop_oldest_please_stop( Backend backend )
+{
+    MessageQueue queue( backend, 64 );
+    queue.set_capacity( 1, Overflow::drop_oldest );
+    int ran = 0;
+
+    LAMBDASTEW_CHECK( queue.push_back( [&ran]() { ++ran; } ) );
+    queue.push_back_please_stop();
+    LAMBDASTEW_CHECK( !queue.push_back( [&ran]() { ++ran; } ) );
+    LAMBDASTEW_CHECK( queue.dropped() == 1 );
+    LAMBDASTEW_CHECK( queue.rejected() == 1 );
+    LAMBDASTEW_CHECK( queue.size() == 1 );
+    LAMBDASTEW_CHECK_THROWS( queue.invoke(),
+                             MessageQueue::PleaseStopException );
+    LAMBDASTEW_CHECK( ran == 0 );
+}
+
+static void test_block( Backend backend )
+{
+    MessageQueue queue( backend, 64 );
+    queue.set_capacity( 1, Overflow::block, std::chrono::milliseconds( 1 ) );
+    LAMBDASTEW_CHECK( queue.push_back( []() {} ) );
+
+    // Times out while the queue stays full, and try_push() does not wait
+    LAMBDASTEW_CHECK( !queue.push_back( []() {} ) );
+    LAMBDASTEW_CHECK( !queue.try_push( Task( []() {} ) ) );
+    LAMBDASTEW_CHECK( queue.rejected() == 2 );
+
+    // A blocked producer goes on once a consumer makes room
+    queue.set_capacity( 1, Overflow::block );
+    bool pushed = false;
+    std::thread producer( [&queue, &pushed]()
+                          {
+                              pushed = queue.push_back( []() {} );
+                          } );
+    while ( queue.blocked_producers() == 0 )
+    {
+        std::this_thread::yield();
+    }
+    LAMBDASTEW_CHECK( queue.invoke() );
+    producer.join();
+    LAMBDASTEW_CHECK( pushed );
+    LAMBDASTEW_CHECK( queue.size() == 1 );
+
+    // close() releases a blocked producer with a failure
+    producer = std::thread( [&queue, &pushed]()
+                            {
+                                pushed = queue.push_back( []() {} );
+                            } );
+    while ( queue.blocked_producers() == 0 )
+    {
+        std::this_thread::yield();
+    }
+    queue.close();
+    producer.join();
+    LAMBDASTEW_CHECK( !pushed );
+}
+
+int main()
+{
+    Backend const backends[]
+        = {Backend::locked_queue, Backend::lock_free_ring};
+    for ( Backend backend : backends )
+    {
+        test_reject( backend );
+        test_drop_newest( backend );
+        test_drop_oldest( backend );
+        test_drop_oldest_strand( backend );
+        test_drop_oldest_please_stop( backend );
+        test_block( backend );
+    }
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include "LambdaStew/MessageQueue.hpp"
+#include "TestCheck.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+typedef MessageQueue::Backend Backend;
+typedef MessageQueue::Status Status;
+
+///
+/// \brief run_all
+///
+/// Call the functions in queue until it is empty
+///
+/// \return the number of functions called
+///
+static size_t run_all( MessageQueue &queue )
+{
+    size_t count = 0;
+    while ( queue.invoke() )
+    {
+        ++count;
+    }
+    return count;
+}
+
+static void test_order( Backend backend )
+{
+    MessageQueue queue( backend, 64 );
+    vector<int> order;
+    for ( int i = 0; i < 10; ++i )
+    {
+        LAMBDASTEW_CHECK(
+            queue.push_back( [&order, i]() { order.push_back( i ); } ) );
+    }
+    LAMBDASTEW_CHECK( queue.size() == 10 );
+    LAMBDASTEW_CHECK( run_all( queue ) == 10 );
+    for ( int i = 0; i < 10; ++i )
+    {
+        LAMBDASTEW_CHECK( order[i] == i );
+    }
+    LAMBDASTEW_CHECK( queue.empty() );
+}
+
+static void test_close( Backend backend )
+{
+    MessageQueue queue( backend, 64 );
+    int ran = 0;
+    LAMBDASTEW_CHECK( queue.push_back( [&ran]() { ++ran; } ) );
+    LAMBDASTEW_CHECK( queue.push_back( [&ran]() { ++ran; } ) );
+
+    queue.close();
+    LAMBDASTEW_CHECK( queue.is_closed() );
+    LAMBDASTEW_CHECK( !queue.is_stopped() );
+    LAMBDASTEW_CHECK( !queue.push_back( [&ran]() { ++ran; } ) );
+    LAMBDASTEW_CHECK( !queue.try_push( Task( [&ran]() { ++ran; } ) ) );
+
+    // The functions queued before close() still run
+    LAMBDASTEW_CHECK( queue.wait_and_invoke( std::chrono::seconds( 0 ) )
+                      == Status::invoked );
+    LAMBDASTEW_CHECK( queue.wait_and_invoke( std::chrono::seconds( 0 ) )
+                      == Status::invoked );
+    LAMBDASTEW_CHECK( queue.wait_and_invoke( std::chrono::seconds( 60 ) )
+                      == Status::closed );
+    LAMBDASTEW_CHECK( ran == 2 );
+}
+
+static void test_close_wakes_consumers()
+{
+    MessageQueue queue;
+    vector<std::thread> consumers;
+    std::atomic<int> closed( 0 );
+    for ( int i = 0; i < 3; ++i )
+    {
+        consumers.emplace_back( [&queue, &closed]()
+                                {
+                                    if ( queue.wait_and_invoke(
+                                             std::chrono::seconds( 60 ) )
+                                         == Status::closed )
+                                    {
+                                        ++closed;
+                                    }
+                                } );
+    }
+    queue.close();
+    for ( auto &consumer : consumers )
+    {
+        consumer.join();
+    }
+    LAMBDASTEW_CHECK( closed == 3 );
+}
+
+static void test_stop( Backend backend )
+{
+    MessageQueue queue( backend, 64 );
+    int ran = 0;
+    queue.push_back( [&ran]() { ++ran; } );
+
+    std::thread consumer;
+    {
+        // Block a consumer on a second, empty queue to check that stop()
+        // releases waiters
+        MessageQueue idle( backend, 64 );
+        Status status = Status::invoked;
+        consumer = std::thread( [&idle, &status]()
+                                {
+                                    status = idle.wait_and_invoke(
+                                        std::chrono::seconds( 60 ) );
+                                } );
+        while ( idle.idle_consumers() == 0 )
+        {
+            std::this_thread::yield();
+        }
+        idle.stop();
+        consumer.join();
+        LAMBDASTEW_CHECK( status == Status::stopped );
+    }
+
+    queue.stop();
+    LAMBDASTEW_CHECK( queue.is_stopped() );
+    LAMBDASTEW_CHECK( !queue.push_back( [&ran]() { ++ran; } ) );
+    LAMBDASTEW_CHECK( queue.wait_and_invoke( std::chrono::seconds( 60 ) )
+                      == Status::stopped );
+
+    // stop() leaves the queued functions in place
+    LAMBDASTEW_CHECK( queue.size() == 1 );
+    LAMBDASTEW_CHECK( ran == 0 );
+}
+
+static void test_drain_and_stop()
+{
+    MessageQueue queue;
+    std::atomic<int> ran( 0 );
+    for ( int i = 0; i < 100; ++i )
+    {
+        queue.push_back( [&ran]() { ++ran; } );
+    }
+
+    std::thread consumer( [&queue]()
+                          {
+                              while ( queue.wait_and_invoke(
+                                          std::chrono::seconds( 60 ) )
+                                      == Status::invoked )
+                              {
+                              }
+                          } );
+    LAMBDASTEW_CHECK( queue.drain_and_stop( std::chrono::steady_clock::now()
+                                            + std::chrono::seconds( 60 ) ) );
+    consumer.join();
+    LAMBDASTEW_CHECK( ran == 100 );
+    LAMBDASTEW_CHECK( queue.is_stopped() );
+}
+
+///
+/// \brief test_drain_after_batches
+///
+/// Batches which threw, and batches taken from an empty queue, do not keep
+/// drain_and_stop() waiting
+///
+static void test_drain_after_batches()
+{
+    MessageQueue queue;
+    int ran = 0;
+    queue.push_back( []() { throw std::runtime_error( "batch" ); } );
+    queue.push_back( [&ran]() { ++ran; } );
+    LAMBDASTEW_CHECK_THROWS( queue.invoke_batch( 2 ), std::runtime_error );
+    LAMBDASTEW_CHECK( queue.drain() == 1 );
+    LAMBDASTEW_CHECK( queue.drain() == 0 );
+    LAMBDASTEW_CHECK( ran == 1 );
+    LAMBDASTEW_CHECK( queue.drain_and_stop( std::chrono::steady_clock::now()
+                                            + std::chrono::seconds( 60 ) ) );
+}
+
+///
+/// \brief test_stop_token
+///
+/// request_stop() releases only the consumers holding a token of the
+/// source, and the queue stays open for the others
+///
+static void test_stop_token()
+{
+    MessageQueue queue;
+    StopSource source;
+    StopToken const token = source.get_token();
+
+    Status status = Status::invoked;
+    std::thread consumer( [&queue, &token, &status]()
+                          {
+                              status = queue.wait_and_invoke(
+                                  std::chrono::seconds( 60 ), token );
+                          } );
+    while ( queue.idle_consumers() == 0 )
+    {
+        std::this_thread::yield();
+    }
+    queue.request_stop( source );
+    consumer.join();
+    LAMBDASTEW_CHECK( status == Status::stopped );
+    LAMBDASTEW_CHECK( !queue.is_closed() );
+
+    LAMBDASTEW_CHECK( queue.wait_and_invoke( std::chrono::milliseconds( 1 ) )
+                      == Status::timeout );
+    LAMBDASTEW_CHECK( queue.push_back( []() {} ) );
+    LAMBDASTEW_CHECK( queue.wait_and_invoke( std::chrono::seconds( 0 ) )
+                      == Status::invoked );
+}
+
+int main()
+{
+    Backend const backends[]
+        = {Backend::locked_queue, Backend::lock_free_ring};
+    for ( Backend backend : backends )
+    {
+        test_order( backend );
+        test_close( backend );
+        test_stop( backend );
+    }
+    test_close_wakes_consumers();
+    test_drain_and_stop();
+    test_drain_after_batches();
+    test_stop_token();
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "LambdaStew/MessageQueue.hpp"
+#include "TestCheck.hpp"
+
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+typedef MessageQueue::Backend Backend;
+
+///
+/// \brief run_all
+///
+/// Call the functions in queue until it is empty
+///
+/// \return the number of functions called
+///
+static size_t run_all( MessageQueue &queue )
+{
+    size_t count = 0;
+    while ( queue.invoke() )
+    {
+        ++count;
+    }
+    return count;
+}
+
+///
+/// \brief test_lanes
+///
+/// Higher lanes run first, each in order, and a lane past the last one
+/// goes to the last one
+///
+static void test_lanes( Backend backend )
+{
+    MessageQueue queue( backend, 64, 3 );
+    LAMBDASTEW_CHECK( queue.lanes() == 3 );
+    vector<int> order;
+    queue.push_back_lane( 0, [&order]() { order.push_back( 0 ); } );
+    queue.push_back_lane( 2, [&order]() { order.push_back( 2 ); } );
+    queue.push_back_lane( 1, [&order]() { order.push_back( 1 ); } );
+    queue.push_back_lane( 7, [&order]() { order.push_back( 3 ); } );
+    LAMBDASTEW_CHECK( queue.lane_size( 2 ) == 2 );
+    LAMBDASTEW_CHECK( run_all( queue ) == 4 );
+    LAMBDASTEW_CHECK( order.size() == 4 );
+    LAMBDASTEW_CHECK( order[0] == 2 && order[1] == 3 );
+    LAMBDASTEW_CHECK( order[2] == 1 && order[3] == 0 );
+}
+
+static void test_please_stop( Backend backend )
+{
+    MessageQueue queue( backend, 64, 2 );
+    int ran = 0;
+    queue.push_back( [&ran]() { ++ran; } );
+    queue.push_back_please_stop();
+
+    // The please-stop item goes to the highest lane and is put back for the
+    // next consumer once it has ended one
+    LAMBDASTEW_CHECK_THROWS( queue.invoke(),
+                             MessageQueue::PleaseStopException );
+    LAMBDASTEW_CHECK_THROWS( queue.invoke(),
+                             MessageQueue::PleaseStopException );
+    LAMBDASTEW_CHECK( ran == 0 );
+    LAMBDASTEW_CHECK( queue.size() == 2 );
+}
+
+int main()
+{
+    Backend const backends[]
+        = {Backend::locked_queue, Backend::lock_free_ring};
+    for ( Backend backend : backends )
+    {
+        test_lanes( backend );
+        test_please_stop( backend );
+    }
+    return 0;
+}
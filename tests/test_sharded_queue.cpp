@@ -0,0 +1,208 @@
+#include "LambdaStew/ShardedMessageQueue.hpp"
+#include "TestCheck.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+typedef ShardedMessageQueue::Dispatch Dispatch;
+typedef ShardedMessageQueue::Status Status;
+
+///
+/// \brief test_affinity
+///
+/// With Dispatch::thread_affinity a thread's pushes all go to its home
+/// shard and run in order, and a consumer of another home takes them too
+///
+static void test_affinity()
+{
+    ShardedMessageQueue queue( 4, Dispatch::thread_affinity );
+    LAMBDASTEW_CHECK( queue.shards() == 4 );
+    size_t const home = queue.home_shard();
+    LAMBDASTEW_CHECK( &queue.dispatch_shard() == &queue.shard( home ) );
+
+    vector<int> order;
+    for ( int i = 0; i < 100; ++i )
+    {
+        LAMBDASTEW_CHECK(
+            queue.push_back( [&order, i]() { order.push_back( i ); } ) );
+    }
+    LAMBDASTEW_CHECK( queue.size() == 100 );
+    LAMBDASTEW_CHECK( queue.shard( home ).size() == 100 );
+
+    std::thread other( [&queue, home]()
+                       {
+                           LAMBDASTEW_CHECK( queue.home_shard() != home );
+                           LAMBDASTEW_CHECK( queue.invoke() );
+                       } );
+    other.join();
+    LAMBDASTEW_CHECK( queue.drain() == 99 );
+    LAMBDASTEW_CHECK( queue.empty() );
+    for ( int i = 0; i < 100; ++i )
+    {
+        LAMBDASTEW_CHECK( order[i] == i );
+    }
+}
+
+///
+/// \brief test_two_choices
+///
+/// With Dispatch::two_choices one producer spreads its pushes over every
+/// shard
+///
+static void test_two_choices()
+{
+    ShardedMessageQueue queue( 4, Dispatch::two_choices );
+    for ( int i = 0; i < 400; ++i )
+    {
+        LAMBDASTEW_CHECK( queue.push_back( []() {} ) );
+    }
+    for ( size_t s = 0; s < queue.shards(); ++s )
+    {
+        LAMBDASTEW_CHECK( queue.shard( s ).size() > 50 );
+    }
+    LAMBDASTEW_CHECK( queue.drain() == 400 );
+}
+
+///
+/// \brief test_consumers
+///
+/// Every function pushed by several producers is called once by one of
+/// several waiting consumers, which all end once the queue is closed
+///
+static void test_consumers( MessageQueue::Backend backend )
+{
+    int const threads = 4;
+    int const per_thread = 10000;
+    ShardedMessageQueue queue( 4, Dispatch::two_choices, backend, 256 );
+    std::atomic<int> ran( 0 );
+    std::atomic<int> closed( 0 );
+
+    vector<std::thread> consumers;
+    for ( int t = 0; t < threads; ++t )
+    {
+        consumers.emplace_back( [&queue, &closed]()
+                                {
+                                    Status status;
+                                    do
+                                    {
+                                        status = queue.wait_and_invoke(
+                                            std::chrono::seconds( 60 ) );
+                                    } while ( status == Status::invoked );
+                                    if ( status == Status::closed )
+                                    {
+                                        ++closed;
+                                    }
+                                } );
+    }
+
+    vector<std::thread> producers;
+    for ( int t = 0; t < threads; ++t )
+    {
+        producers.emplace_back( [&queue, &ran]()
+                                {
+                                    for ( int i = 0; i < per_thread; ++i )
+                                    {
+                                        queue.push_back( [&ran]() { ++ran; } );
+                                    }
+                                } );
+    }
+    for ( auto &producer : producers )
+    {
+        producer.join();
+    }
+
+    queue.close();
+    LAMBDASTEW_CHECK( queue.is_closed() );
+    LAMBDASTEW_CHECK( !queue.push_back( [&ran]() { ++ran; } ) );
+    for ( auto &consumer : consumers )
+    {
+        consumer.join();
+    }
+    LAMBDASTEW_CHECK( ran == threads * per_thread );
+    LAMBDASTEW_CHECK( closed == threads );
+    LAMBDASTEW_CHECK( queue.idle_consumers() == 0 );
+}
+
+///
+/// \brief test_please_stop
+///
+/// One please-stop item ends every consumer, each passing it on
+///
+static void test_please_stop()
+{
+    ShardedMessageQueue queue( 4 );
+    std::atomic<int> stopped( 0 );
+
+    vector<std::thread> consumers;
+    for ( int t = 0; t < 4; ++t )
+    {
+        consumers.emplace_back( [&queue, &stopped]()
+                                {
+                                    try
+                                    {
+                                        while ( true )
+                                        {
+                                            queue.wait_and_invoke(
+                                                std::chrono::seconds( 60 ) );
+                                        }
+                                    }
+                                    catch ( MessageQueue::PleaseStopException
+                                                const & )
+                                    {
+                                        ++stopped;
+                                    }
+                                } );
+    }
+    queue.push_back_please_stop();
+    for ( auto &consumer : consumers )
+    {
+        consumer.join();
+    }
+    LAMBDASTEW_CHECK( stopped == 4 );
+}
+
+///
+/// \brief test_capacity
+///
+/// Each shard gets its part of the capacity, and drain_and_stop() runs
+/// what is left before stopping
+///
+static void test_capacity()
+{
+    ShardedMessageQueue queue( 4, Dispatch::thread_affinity );
+    queue.set_capacity( 7, ShardedMessageQueue::Overflow::reject );
+    int ran = 0;
+    LAMBDASTEW_CHECK( queue.push_back( [&ran]() { ++ran; } ) );
+    LAMBDASTEW_CHECK( queue.push_back( [&ran]() { ++ran; } ) );
+    LAMBDASTEW_CHECK( !queue.push_back( [&ran]() { ++ran; } ) );
+    LAMBDASTEW_CHECK( queue.shard( queue.home_shard() ).rejected() == 1 );
+
+    std::thread consumer( [&queue]()
+                          {
+                              while ( queue.wait_and_invoke(
+                                          std::chrono::seconds( 60 ) )
+                                      == Status::invoked )
+                              {
+                              }
+                          } );
+    LAMBDASTEW_CHECK( queue.drain_and_stop( std::chrono::steady_clock::now()
+                                            + std::chrono::seconds( 60 ) ) );
+    consumer.join();
+    LAMBDASTEW_CHECK( queue.is_stopped() );
+    LAMBDASTEW_CHECK( ran == 2 );
+}
+
+int main()
+{
+    test_affinity();
+    test_two_choices();
+    test_consumers( MessageQueue::Backend::locked_queue );
+    test_consumers( MessageQueue::Backend::lock_free_ring );
+    test_please_stop();
+    test_capacity();
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include "LambdaStew/SPSCMessageQueue.hpp"
+#include "LambdaStew/SPSCRing.hpp"
+#include "TestCheck.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+static void test_spsc_single_thread()
+{
+    SPSCRing<int> ring( 4 );
+    LAMBDASTEW_CHECK( ring.capacity() == 4 );
+
+    int value = -1;
+    LAMBDASTEW_CHECK( !ring.try_pop( value ) );
+    for ( int round = 0; round < 5; ++round )
+    {
+        for ( int i = 0; i < 4; ++i )
+        {
+            LAMBDASTEW_CHECK( ring.try_emplace( round * 10 + i ) );
+        }
+        LAMBDASTEW_CHECK( !ring.try_emplace( 99 ) );
+        for ( int i = 0; i < 4; ++i )
+        {
+            LAMBDASTEW_CHECK( ring.try_pop( value ) );
+            LAMBDASTEW_CHECK( value == round * 10 + i );
+        }
+        LAMBDASTEW_CHECK( !ring.try_pop( value ) );
+    }
+
+    // Deferred pushes are invisible to the consumer until published
+    LAMBDASTEW_CHECK( ring.try_emplace_deferred( 1 ) );
+    LAMBDASTEW_CHECK( ring.try_emplace_deferred( 2 ) );
+    LAMBDASTEW_CHECK( ring.unpublished_pushes() == 2 );
+    LAMBDASTEW_CHECK( !ring.try_pop( value ) );
+    ring.publish_push();
+    LAMBDASTEW_CHECK( ring.unpublished_pushes() == 0 );
+
+    // Deferred pops keep their slots from the producer until published
+    LAMBDASTEW_CHECK( ring.try_pop_deferred( value ) && value == 1 );
+    LAMBDASTEW_CHECK( ring.try_pop_deferred( value ) && value == 2 );
+    LAMBDASTEW_CHECK( ring.unpublished_pops() == 2 );
+    for ( int i = 0; i < 2; ++i )
+    {
+        LAMBDASTEW_CHECK( ring.try_emplace( i ) );
+    }
+    LAMBDASTEW_CHECK( !ring.try_emplace( 99 ) );
+    ring.publish_pop();
+    LAMBDASTEW_CHECK( ring.try_emplace( 2 ) );
+}
+
+static void test_spsc_threads()
+{
+    int const count = 200000;
+    SPSCRing<int> ring( 128 );
+
+    std::thread producer( [&ring]()
+                          {
+                              for ( int i = 0; i < count; ++i )
+                              {
+                                  while ( !ring.try_emplace( i ) )
+                                  {
+                                      std::this_thread::yield();
+                                  }
+                              }
+                          } );
+
+    int expected = 0;
+    int value;
+    while ( expected < count )
+    {
+        if ( ring.try_pop( value ) )
+        {
+            LAMBDASTEW_CHECK( value == expected );
+            ++expected;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    LAMBDASTEW_CHECK( !ring.try_pop( value ) );
+}
+
+///
+/// \brief test_queue
+///
+/// An SPSCMessageQueue hands functions from its producer to its consumer in
+/// order, in single pushes and in bulk, and ends with close()
+///
+static void test_queue()
+{
+    int const count = 100000;
+    SPSCMessageQueue queue( 64 );
+    LAMBDASTEW_CHECK( queue.capacity() == 64 );
+
+    vector<int> order;
+    order.reserve( count );
+    std::thread producer( [&queue, &order]()
+                          {
+                              vector<Task> tasks;
+                              for ( int i = 0; i < count; )
+                              {
+                                  if ( i % 1000 < 500 )
+                                  {
+                                      LAMBDASTEW_CHECK( queue.push_back(
+                                          [&order, i]()
+                                          {
+                                              order.push_back( i );
+                                          } ) );
+                                      ++i;
+                                      continue;
+                                  }
+                                  for ( int n = 0; n < 100; ++n, ++i )
+                                  {
+                                      tasks.emplace_back( [&order, i]()
+                                                          {
+                                                              order.push_back(
+                                                                  i );
+                                                          } );
+                                  }
+                                  LAMBDASTEW_CHECK(
+                                      queue.push_back_bulk( tasks ) );
+                                  LAMBDASTEW_CHECK( tasks.empty() );
+                              }
+                              queue.close();
+                          } );
+
+    while ( queue.wait_and_invoke( std::chrono::seconds( 60 ) )
+            == SPSCMessageQueue::Status::invoked )
+    {
+    }
+    producer.join();
+
+    LAMBDASTEW_CHECK( order.size() == size_t( count ) );
+    for ( int i = 0; i < count; ++i )
+    {
+        LAMBDASTEW_CHECK( order[i] == i );
+    }
+    LAMBDASTEW_CHECK( !queue.push_back( []() {} ) );
+}
+
+int main()
+{
+    test_spsc_single_thread();
+    test_spsc_threads();
+    test_queue();
+    return 0;
+}
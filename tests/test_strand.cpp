@@ -0,0 +1,197 @@
+#include "LambdaStew/Strand.hpp"
+#include "TestCheck.hpp"
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+///
+/// \brief consume
+///
+/// Run consumers of queue on several threads until it is closed and empty
+///
+static void consume( MessageQueue &queue, int threads )
+{
+    vector<std::thread> consumers;
+    for ( int i = 0; i < threads; ++i )
+    {
+        consumers.emplace_back(
+            [&queue]()
+            {
+                while ( queue.wait_and_invoke( std::chrono::milliseconds( 10 ) )
+                        != MessageQueue::Status::closed )
+                {
+                }
+            } );
+    }
+    for ( auto &consumer : consumers )
+    {
+        consumer.join();
+    }
+}
+
+///
+/// \brief The StrandLog struct
+///
+/// What the tasks of one strand saw. order is only touched by the tasks of
+/// the strand, so it needs no lock if they never overlap
+///
+struct StrandLog
+{
+    StrandLog() : active( 0 ), overlaps( 0 ), outside( 0 ) {}
+
+    vector<int> order;
+    std::atomic<int> active;
+    std::atomic<int> overlaps;
+    std::atomic<int> outside;
+};
+
+///
+/// \brief test_order_and_exclusion
+///
+/// Several strands, each fed by its own producer, share a queue with
+/// several consumers. The tasks of each strand run one at a time, in the
+/// order they were posted
+///
+static void test_order_and_exclusion()
+{
+    int const strands = 4;
+    int const per_strand = 20000;
+
+    MessageQueue queue;
+    vector<std::unique_ptr<Strand> > strand;
+    vector<std::unique_ptr<StrandLog> > log;
+    for ( int s = 0; s < strands; ++s )
+    {
+        // Small batches so that the runner changes thread often
+        strand.emplace_back( new Strand( queue, 0, 3 ) );
+        log.emplace_back( new StrandLog );
+    }
+
+    vector<std::thread> producers;
+    for ( int s = 0; s < strands; ++s )
+    {
+        producers.emplace_back(
+            [&strand, &log, s]()
+            {
+                Strand &own = *strand[s];
+                StrandLog &own_log = *log[s];
+                for ( int i = 0; i < per_strand; ++i )
+                {
+                    bool const posted = own.post(
+                        [&own, &own_log, i]()
+                        {
+                            if ( own_log.active.fetch_add( 1 ) != 0 )
+                            {
+                                ++own_log.overlaps;
+                            }
+                            if ( !own.running_in_this_thread() )
+                            {
+                                ++own_log.outside;
+                            }
+                            own_log.order.push_back( i );
+                            own_log.active.fetch_sub( 1 );
+                        } );
+                    LAMBDASTEW_CHECK( posted );
+                }
+            } );
+    }
+
+    std::thread closer( [&producers, &queue]()
+                        {
+                            for ( auto &producer : producers )
+                            {
+                                producer.join();
+                            }
+                            queue.close();
+                        } );
+    consume( queue, 4 );
+    closer.join();
+
+    for ( int s = 0; s < strands; ++s )
+    {
+        LAMBDASTEW_CHECK( log[s]->overlaps == 0 );
+        LAMBDASTEW_CHECK( log[s]->outside == 0 );
+        LAMBDASTEW_CHECK( log[s]->order.size() == size_t( per_strand ) );
+        for ( int i = 0; i < per_strand; ++i )
+        {
+            LAMBDASTEW_CHECK( log[s]->order[i] == i );
+        }
+        LAMBDASTEW_CHECK( strand[s]->pending() == 0 );
+        LAMBDASTEW_CHECK( !strand[s]->running_in_this_thread() );
+    }
+}
+
+///
+/// \brief test_throwing_task
+///
+/// A task which throws does not lose the tasks after it, which still run
+/// in order once the exception has reached the consumer
+///
+static void test_throwing_task()
+{
+    MessageQueue queue;
+    Strand strand( queue );
+    vector<int> order;
+
+    for ( int i = 0; i < 5; ++i )
+    {
+        strand.post( [&order, i]()
+                     {
+                         order.push_back( i );
+                         if ( i == 1 )
+                         {
+                             throw std::runtime_error( "task failed" );
+                         }
+                     } );
+    }
+    LAMBDASTEW_CHECK_THROWS( queue.invoke(), std::runtime_error );
+    LAMBDASTEW_CHECK( order.size() == 2 );
+    while ( queue.invoke() )
+    {
+    }
+
+    LAMBDASTEW_CHECK( order.size() == 5 );
+    for ( int i = 0; i < 5; ++i )
+    {
+        LAMBDASTEW_CHECK( order[i] == i );
+    }
+}
+
+///
+/// \brief test_closed
+///
+/// A strand on a closed queue rejects new tasks, and the tasks it accepted
+/// before the queue closed still run
+///
+static void test_closed()
+{
+    MessageQueue queue;
+    Strand strand( queue );
+    int ran = 0;
+
+    LAMBDASTEW_CHECK( strand.post( [&ran]() { ++ran; } ) );
+    LAMBDASTEW_CHECK( strand.post( [&ran]() { ++ran; } ) );
+    queue.close();
+    LAMBDASTEW_CHECK( !strand.post( [&ran]() { ++ran; } ) );
+
+    while ( queue.invoke() )
+    {
+    }
+    LAMBDASTEW_CHECK( ran == 2 );
+    LAMBDASTEW_CHECK( !strand.post( [&ran]() { ++ran; } ) );
+    LAMBDASTEW_CHECK( strand.pending() == 0 );
+}
+
+int main()
+{
+    test_order_and_exclusion();
+    test_throwing_task();
+    test_closed();
+    return 0;
+}
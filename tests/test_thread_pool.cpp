@@ -0,0 +1,96 @@
+#include "LambdaStew/ThreadPool.hpp"
+#include "TestCheck.hpp"
+
+#include <atomic>
+#include <stdexcept>
+
+using namespace LambdaStew;
+
+///
+/// \brief test_nested
+///
+/// Tasks submitted from inside the pool go to the worker's own deque and
+/// are run, or stolen, like the rest. The destructor runs everything
+///
+static void test_nested()
+{
+    std::atomic<int> ran( 0 );
+    std::atomic<int> outside( 0 );
+    {
+        ThreadPool pool( 4 );
+        LAMBDASTEW_CHECK( pool.size() == 4 );
+        LAMBDASTEW_CHECK( ThreadPool::current() == nullptr );
+
+        for ( int i = 0; i < 100; ++i )
+        {
+            pool.submit( [&pool, &ran, &outside]()
+                         {
+                             if ( ThreadPool::current() != &pool )
+                             {
+                                 ++outside;
+                             }
+                             for ( int j = 0; j < 50; ++j )
+                             {
+                                 pool.submit( [&ran]() { ++ran; } );
+                             }
+                             ++ran;
+                         } );
+        }
+    }
+    LAMBDASTEW_CHECK( ran == 100 * 51 );
+    LAMBDASTEW_CHECK( outside == 0 );
+}
+
+///
+/// \brief test_exception
+///
+/// A task which throws does not end its worker
+///
+static void test_exception()
+{
+    std::atomic<int> ran( 0 );
+    {
+        ThreadPool pool( 1 );
+        pool.submit( []() { throw std::runtime_error( "task failed" ); } );
+        pool.submit( [&pool, &ran]()
+                     {
+                         pool.submit(
+                             []() { throw std::runtime_error( "nested" ); } );
+                         pool.submit( [&ran]() { ++ran; } );
+                         ++ran;
+                     } );
+    }
+    LAMBDASTEW_CHECK( ran == 2 );
+}
+
+///
+/// \brief test_please_stop
+///
+/// A please-stop item ends every worker, after the tasks queued before it
+/// and the tasks they spawned
+///
+static void test_please_stop()
+{
+    std::atomic<int> ran( 0 );
+    {
+        ThreadPool pool( 4 );
+        for ( int i = 0; i < 100; ++i )
+        {
+            pool.submit( [&pool, &ran]()
+                         {
+                             pool.submit( [&ran]() { ++ran; } );
+                             ++ran;
+                         } );
+        }
+        pool.injection_queue().push_back_please_stop();
+    }
+    LAMBDASTEW_CHECK( ran == 200 );
+}
+
+int main()
+{
+    test_nested();
+    test_exception();
+    test_please_stop();
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include "LambdaStew/MessageQueue.hpp"
+#include "TestCheck.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+typedef MessageQueue::Backend Backend;
+typedef MessageQueue::Status Status;
+
+///
+/// \brief wait_for_timers
+///
+/// Call the functions in queue until its timers are done and it is empty
+///
+static void wait_for_timers( MessageQueue &queue )
+{
+    while ( queue.pending_timers() || !queue.empty() )
+    {
+        queue.wait_and_invoke( std::chrono::milliseconds( 10 ) );
+    }
+}
+
+///
+/// \brief test_after
+///
+/// Timers fire in the order they are due, and not before
+///
+static void test_after()
+{
+    MessageQueue queue;
+    vector<int> order;
+    auto const start = std::chrono::steady_clock::now();
+
+    LAMBDASTEW_CHECK( queue.push_back_after( std::chrono::milliseconds( 20 ),
+                                             [&order]()
+                                             {
+                                                 order.push_back( 2 );
+                                             } ) );
+    LAMBDASTEW_CHECK( queue.push_back_after( std::chrono::milliseconds( 5 ),
+                                             [&order]()
+                                             {
+                                                 order.push_back( 1 );
+                                             } ) );
+    LAMBDASTEW_CHECK( queue.pending_timers() == 2 );
+    wait_for_timers( queue );
+
+    LAMBDASTEW_CHECK( std::chrono::steady_clock::now() - start
+                      >= std::chrono::milliseconds( 20 ) );
+    LAMBDASTEW_CHECK( order.size() == 2 && order[0] == 1 && order[1] == 2 );
+}
+
+///
+/// \brief test_cancel
+///
+/// A cancelled timer never fires, and a closed queue takes no new timers
+///
+static void test_cancel()
+{
+    MessageQueue queue;
+    bool fired = false;
+    TimerId const id = queue.push_back_after( std::chrono::milliseconds( 5 ),
+                                              [&fired]() { fired = true; } );
+    LAMBDASTEW_CHECK( queue.cancel_timer( id ) );
+    LAMBDASTEW_CHECK( !queue.cancel_timer( id ) );
+    LAMBDASTEW_CHECK( queue.pending_timers() == 0 );
+
+    std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+    LAMBDASTEW_CHECK( !queue.invoke() );
+    LAMBDASTEW_CHECK( !fired );
+
+    queue.close();
+    LAMBDASTEW_CHECK( !queue.push_back_after( std::chrono::milliseconds( 1 ),
+                                              []() {} ) );
+}
+
+///
+/// \brief test_every
+///
+/// A periodic timer keeps firing until it is cancelled
+///
+static void test_every()
+{
+    MessageQueue queue;
+    int ran = 0;
+    TimerId const id = queue.push_back_every( std::chrono::milliseconds( 1 ),
+                                              [&ran]() { ++ran; } );
+    while ( ran < 5 )
+    {
+        queue.wait_and_invoke( std::chrono::milliseconds( 10 ) );
+    }
+    LAMBDASTEW_CHECK( queue.cancel_timer( id ) );
+    LAMBDASTEW_CHECK( !queue.cancel_timer( id ) );
+
+    // A copy may still be on its way to the queue
+    wait_for_timers( queue );
+    int const last = ran;
+    std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    LAMBDASTEW_CHECK( !queue.invoke() );
+    LAMBDASTEW_CHECK( ran == last );
+}
+
+///
+/// \brief test_full_ring
+///
+/// Many timers due at once on a small ring. The timer thread must not stall
+/// while the ring is full, or the consumer, which schedules timers of its
+/// own as it goes, would never get to empty it
+///
+static void test_full_ring()
+{
+    int const count = 200;
+    MessageQueue queue( Backend::lock_free_ring, 4 );
+    std::atomic<int> ran( 0 );
+    std::atomic<int> rescheduled( 0 );
+
+    for ( int i = 0; i < count; ++i )
+    {
+        queue.push_back_after( std::chrono::milliseconds( 1 ),
+                               [&queue, &ran, &rescheduled]()
+                               {
+                                   ++ran;
+                                   queue.push_back_after(
+                                       std::chrono::milliseconds( 1 ),
+                                       [&rescheduled]() { ++rescheduled; } );
+                               } );
+    }
+
+    // Another queue's timers keep firing while the ring is full
+    MessageQueue other;
+    std::atomic<bool> other_ran( false );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+    other.push_back_after( std::chrono::milliseconds( 1 ),
+                           [&other_ran]() { other_ran = true; } );
+    while ( !other_ran )
+    {
+        other.wait_and_invoke( std::chrono::milliseconds( 10 ) );
+    }
+
+    wait_for_timers( queue );
+    LAMBDASTEW_CHECK( ran == count );
+    LAMBDASTEW_CHECK( rescheduled == count );
+}
+
+///
+/// \brief test_destroy_pending
+///
+/// Destroying a queue cancels its timers, even while the timer thread is
+/// pushing to it
+///
+static void test_destroy_pending()
+{
+    for ( int round = 0; round < 50; ++round )
+    {
+        MessageQueue queue( Backend::lock_free_ring, 4 );
+        for ( int i = 0; i < 20; ++i )
+        {
+            queue.push_back_after( std::chrono::microseconds( 500 ), []() {} );
+        }
+        queue.push_back_every( std::chrono::milliseconds( 1 ), []() {} );
+        std::this_thread::sleep_for( std::chrono::microseconds( round * 40 ) );
+    }
+}
+
+int main()
+{
+    test_after();
+    test_cancel();
+    test_every();
+    test_full_ring();
+    test_destroy_pending();
+    return 0;
+}
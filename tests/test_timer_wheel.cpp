@@ -0,0 +1,234 @@
+#include "LambdaStew/TimerWheel.hpp"
+#include "TestCheck.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+using namespace LambdaStew;
+using std::pair;
+using std::vector;
+
+///
+/// \brief The Expired struct
+///
+/// An expire function for TimerWheel<int> which records what expired and
+/// checks that the wheel is at the expiry tick when it does
+///
+struct Expired
+{
+    explicit Expired( TimerWheel<int> &w ) : wheel( w ) {}
+
+    bool operator()( int &value, uint64_t &expiry )
+    {
+        LAMBDASTEW_CHECK( wheel.current_tick() == expiry );
+        values.push_back( std::make_pair( expiry, value ) );
+        return false;
+    }
+
+    TimerWheel<int> &wheel;
+    vector<pair<uint64_t, int> > values;
+};
+
+///
+/// \brief check_expires_at
+///
+/// Insert one timer at tick and check that it expires exactly there
+///
+static void check_expires_at( uint64_t start, uint64_t tick )
+{
+    TimerWheel<int> wheel( start );
+    Expired expired( wheel );
+
+    wheel.insert( tick, 7 );
+    LAMBDASTEW_CHECK( wheel.advance( tick - 1, expired ) == 0 );
+    LAMBDASTEW_CHECK( wheel.size() == 1 );
+    LAMBDASTEW_CHECK( wheel.advance( tick, expired ) == 1 );
+    LAMBDASTEW_CHECK( expired.values.size() == 1 );
+    LAMBDASTEW_CHECK( expired.values[0].first == tick );
+    LAMBDASTEW_CHECK( expired.values[0].second == 7 );
+    LAMBDASTEW_CHECK( wheel.empty() );
+    LAMBDASTEW_CHECK( wheel.next_tick() == UINT64_MAX );
+}
+
+///
+/// \brief test_cascade
+///
+/// Timers on either side of the level 1 and level 2 boundaries, and
+/// starting just before them, expire on their own tick
+///
+static void test_cascade()
+{
+    uint64_t const boundaries[] = {256, 65536};
+    for ( uint64_t boundary : boundaries )
+    {
+        for ( uint64_t tick = boundary - 2; tick <= boundary + 2; ++tick )
+        {
+            check_expires_at( 0, tick );
+            check_expires_at( boundary - 3, tick );
+        }
+        check_expires_at( 0, boundary * 3 + 17 );
+    }
+    check_expires_at( 65535, 65536 + 256 );
+    check_expires_at( 1000, 1000 + ( uint64_t( 1 ) << 24 ) + 1 );
+}
+
+///
+/// \brief test_order
+///
+/// Many timers spread over three levels expire in expiry order, each on its
+/// own tick, while the wheel is advanced in uneven steps
+///
+static void test_order()
+{
+    TimerWheel<int> wheel;
+    Expired expired( wheel );
+
+    vector<pair<uint64_t, int> > expected;
+    uint32_t x = 12345;
+    for ( int i = 0; i < 3000; ++i )
+    {
+        x = x * 1103515245u + 12345u;
+        uint64_t const tick = 1 + ( x >> 8 ) % 200000;
+        wheel.insert( tick, int( i ) );
+        expected.push_back( std::make_pair( tick, i ) );
+    }
+    std::stable_sort( expected.begin(),
+                      expected.end(),
+                      []( pair<uint64_t, int> const &a,
+                          pair<uint64_t, int> const &b )
+                      {
+                          return a.first < b.first;
+                      } );
+
+    uint64_t tick = 0;
+    while ( !wheel.empty() )
+    {
+        x = x * 1103515245u + 12345u;
+        tick += 1 + ( x >> 8 ) % 700;
+        wheel.advance( tick, expired );
+    }
+
+    LAMBDASTEW_CHECK( expired.values.size() == expected.size() );
+    for ( size_t i = 0; i < expected.size(); ++i )
+    {
+        LAMBDASTEW_CHECK( expired.values[i].first == expected[i].first );
+    }
+
+    // Timers of the same tick may expire in any order, but every one of them
+    // exactly once
+    std::sort( expired.values.begin(), expired.values.end() );
+    std::sort( expected.begin(), expected.end() );
+    LAMBDASTEW_CHECK( expired.values == expected );
+}
+
+///
+/// \brief test_cancel
+///
+/// Cancel returns the value of a pending timer, and fails after the timer
+/// expired or was cancelled
+///
+static void test_cancel()
+{
+    TimerWheel<int> wheel;
+    Expired expired( wheel );
+    int value = 0;
+
+    TimerId const fired = wheel.insert( 10, 1 );
+    TimerId const pending = wheel.insert( 300, 2 );
+    LAMBDASTEW_CHECK( wheel.advance( 10, expired ) == 1 );
+    LAMBDASTEW_CHECK( !wheel.cancel( fired, value ) );
+
+    LAMBDASTEW_CHECK( wheel.cancel( pending, value ) );
+    LAMBDASTEW_CHECK( value == 2 );
+    LAMBDASTEW_CHECK( !wheel.cancel( pending, value ) );
+    LAMBDASTEW_CHECK( wheel.empty() );
+    LAMBDASTEW_CHECK( wheel.advance( 1000, expired ) == 0 );
+
+    LAMBDASTEW_CHECK( !wheel.cancel( 0, value ) );
+    LAMBDASTEW_CHECK( !wheel.cancel( 12345, value ) );
+}
+
+///
+/// \brief test_generation_reuse
+///
+/// A node freed by cancel or expiry is reused under a new id, so the old id
+/// can not cancel the new timer
+///
+static void test_generation_reuse()
+{
+    TimerWheel<int> wheel;
+    Expired expired( wheel );
+    int value = 0;
+
+    TimerId const first = wheel.insert( 5, 1 );
+    LAMBDASTEW_CHECK( wheel.cancel( first, value ) );
+
+    TimerId const second = wheel.insert( 5, 2 );
+    LAMBDASTEW_CHECK( second != first );
+    LAMBDASTEW_CHECK( ( second & 0xffffffff ) == ( first & 0xffffffff ) );
+    LAMBDASTEW_CHECK( !wheel.cancel( first, value ) );
+    LAMBDASTEW_CHECK( wheel.size() == 1 );
+
+    LAMBDASTEW_CHECK( wheel.advance( 5, expired ) == 1 );
+    TimerId const third = wheel.insert( 20, 3 );
+    LAMBDASTEW_CHECK( third != second );
+    LAMBDASTEW_CHECK( !wheel.cancel( second, value ) );
+    LAMBDASTEW_CHECK( wheel.cancel( third, value ) );
+    LAMBDASTEW_CHECK( value == 3 );
+}
+
+///
+/// \brief test_periodic
+///
+/// An expire function which moves the expiry keeps the timer, under the
+/// same id
+///
+static void test_periodic()
+{
+    TimerWheel<int> wheel;
+    vector<uint64_t> ticks;
+    TimerId const id = wheel.insert( 100, 1 );
+
+    wheel.advance( 1000,
+                   [&ticks]( int &, uint64_t &expiry ) -> bool
+                   {
+                       ticks.push_back( expiry );
+                       expiry += 250;
+                       return true;
+                   } );
+    LAMBDASTEW_CHECK( ticks.size() == 4 );
+    LAMBDASTEW_CHECK( ticks[0] == 100 && ticks[3] == 850 );
+    LAMBDASTEW_CHECK( wheel.size() == 1 );
+
+    int value = 0;
+    LAMBDASTEW_CHECK( wheel.cancel( id, value ) );
+    LAMBDASTEW_CHECK( wheel.empty() );
+}
+
+///
+/// \brief test_past_tick
+///
+/// A timer inserted at or before the current tick expires on the next one
+///
+static void test_past_tick()
+{
+    TimerWheel<int> wheel( 500 );
+    Expired expired( wheel );
+
+    wheel.insert( 100, 1 );
+    wheel.insert( 500, 2 );
+    LAMBDASTEW_CHECK( wheel.next_tick() == 501 );
+    LAMBDASTEW_CHECK( wheel.advance( 501, expired ) == 2 );
+}
+
+int main()
+{
+    test_cascade();
+    test_order();
+    test_cancel();
+    test_generation_reuse();
+    test_periodic();
+    test_past_tick();
+    return 0;
+}
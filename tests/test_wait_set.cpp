@@ -0,0 +1,176 @@
+#include "LambdaStew/WaitSet.hpp"
+#include "TestCheck.hpp"
+
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+typedef WaitSet::Status Status;
+
+static std::chrono::seconds const forever( 60 );
+
+///
+/// \brief test_membership
+///
+/// A queue belongs to one set at a time, and leaves it when removed or
+/// when the set is destroyed
+///
+static void test_membership()
+{
+    MessageQueue a;
+    MessageQueue b;
+    {
+        WaitSet set;
+        LAMBDASTEW_CHECK( set.add( a ) == 0 );
+        LAMBDASTEW_CHECK( set.add( b ) == 1 );
+        LAMBDASTEW_CHECK( set.size() == 2 );
+        LAMBDASTEW_CHECK( &set.queue( 1 ) == &b );
+
+        WaitSet other;
+        LAMBDASTEW_CHECK_THROWS( other.add( a ), std::logic_error );
+        LAMBDASTEW_CHECK( set.remove( a ) );
+        LAMBDASTEW_CHECK( !set.remove( a ) );
+        LAMBDASTEW_CHECK( &set.queue( 0 ) == &b );
+        LAMBDASTEW_CHECK( other.add( a ) == 0 );
+    }
+
+    // b left the destroyed set, so pushing to it is still safe
+    LAMBDASTEW_CHECK( b.push_back( []() {} ) );
+    WaitSet set;
+    LAMBDASTEW_CHECK( set.add( b ) == 0 );
+}
+
+///
+/// \brief test_order
+///
+/// Order::priority serves the first ready queue until it is empty, and
+/// Order::round_robin takes turns
+///
+static void test_order()
+{
+    MessageQueue a;
+    MessageQueue b;
+    vector<char> served;
+    for ( int i = 0; i < 2; ++i )
+    {
+        a.push_back( [&served]() { served.push_back( 'a' ); } );
+        b.push_back( [&served]() { served.push_back( 'b' ); } );
+    }
+
+    {
+        WaitSet set( WaitSet::Order::priority );
+        set.add( a );
+        set.add( b );
+        vector<size_t> indices;
+        LAMBDASTEW_CHECK( set.ready( indices ) == 2 );
+        LAMBDASTEW_CHECK( indices[0] == 0 && indices[1] == 1 );
+
+        size_t index = 99;
+        LAMBDASTEW_CHECK( set.wait_and_invoke( forever, &index )
+                          == Status::invoked );
+        LAMBDASTEW_CHECK( index == 0 );
+        LAMBDASTEW_CHECK( set.wait_and_invoke( forever ) == Status::invoked );
+        LAMBDASTEW_CHECK( set.wait_and_invoke( forever, &index )
+                          == Status::invoked );
+        LAMBDASTEW_CHECK( index == 1 );
+    }
+    LAMBDASTEW_CHECK( served == vector<char>( {'a', 'a', 'b'} ) );
+    b.invoke();
+
+    served.clear();
+    for ( int i = 0; i < 2; ++i )
+    {
+        a.push_back( [&served]() { served.push_back( 'a' ); } );
+        b.push_back( [&served]() { served.push_back( 'b' ); } );
+    }
+    WaitSet set( WaitSet::Order::round_robin );
+    set.add( a );
+    set.add( b );
+    for ( int i = 0; i < 4; ++i )
+    {
+        LAMBDASTEW_CHECK( set.wait_and_invoke( forever ) == Status::invoked );
+    }
+    LAMBDASTEW_CHECK( served == vector<char>( {'a', 'b', 'a', 'b'} ) );
+    LAMBDASTEW_CHECK( set.wait_and_invoke( std::chrono::milliseconds( 1 ) )
+                      == Status::timeout );
+}
+
+///
+/// \brief test_wake
+///
+/// A consumer parked on the set wakes for a push to any of its queues,
+/// and ends once every queue is closed and empty
+///
+static void test_wake()
+{
+    MessageQueue control;
+    MessageQueue data( MessageQueue::Backend::lock_free_ring, 64 );
+    WaitSet set;
+    set.add( control );
+    set.add( data );
+
+    vector<size_t> order;
+    Status last = Status::invoked;
+    std::thread consumer( [&set, &order, &last]()
+                          {
+                              size_t index;
+                              while ( ( last = set.wait_and_invoke( forever,
+                                                                    &index ) )
+                                      == Status::invoked )
+                              {
+                                  order.push_back( index );
+                              }
+                          } );
+
+    for ( int i = 0; i < 1000; ++i )
+    {
+        data.push_back( []() {} );
+        if ( i % 100 == 0 )
+        {
+            control.push_back( []() {} );
+        }
+    }
+    control.close();
+    data.close();
+    consumer.join();
+    LAMBDASTEW_CHECK( last == Status::closed );
+    LAMBDASTEW_CHECK( order.size() == 1010 );
+
+    // wait() reports the ready queues without calling anything
+    MessageQueue a;
+    MessageQueue b;
+    WaitSet other;
+    other.add( a );
+    other.add( b );
+    vector<size_t> indices;
+    LAMBDASTEW_CHECK( other.wait( indices, std::chrono::milliseconds( 1 ) )
+                      == Status::timeout );
+    int ran = 0;
+    b.push_back( [&ran]() { ++ran; } );
+    LAMBDASTEW_CHECK( other.wait( indices, forever ) == Status::invoked );
+    LAMBDASTEW_CHECK( indices.size() == 1 && indices[0] == 1 );
+    LAMBDASTEW_CHECK( ran == 0 && b.size() == 1 );
+
+    StopSource stop_source;
+    b.invoke();
+    std::thread waiter( [&other, &stop_source]()
+                        {
+                            LAMBDASTEW_CHECK(
+                                other.wait_and_invoke(
+                                    forever, stop_source.get_token() )
+                                == Status::stopped );
+                        } );
+    other.request_stop( stop_source );
+    waiter.join();
+}
+
+int main()
+{
+    test_membership();
+    test_order();
+    test_wake();
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include "LambdaStew/WorkStealingDeque.hpp"
+#include "TestCheck.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace LambdaStew;
+using std::vector;
+
+///
+/// \brief check_each_seen_once
+///
+/// Check that every value from 0 to count was taken exactly once
+///
+static void check_each_seen_once( vector<vector<int> > const &taken,
+                                  size_t count )
+{
+    vector<int> seen( count, 0 );
+    for ( auto const &values : taken )
+    {
+        for ( int value : values )
+        {
+            LAMBDASTEW_CHECK( value >= 0 && size_t( value ) < count );
+            ++seen[value];
+        }
+    }
+    for ( size_t i = 0; i < count; ++i )
+    {
+        LAMBDASTEW_CHECK( seen[i] == 1 );
+    }
+}
+
+static void test_deque_single_thread()
+{
+    // Start small so that the pushes grow the array
+    WorkStealingDeque<int> deque( 4 );
+    int value = -1;
+    LAMBDASTEW_CHECK( !deque.pop( value ) );
+    LAMBDASTEW_CHECK( !deque.steal( value ) );
+
+    for ( int i = 0; i < 100; ++i )
+    {
+        deque.push( i );
+    }
+    LAMBDASTEW_CHECK( deque.size_approx() == 100 );
+
+    // The owner takes the newest, thieves the oldest
+    LAMBDASTEW_CHECK( deque.pop( value ) && value == 99 );
+    LAMBDASTEW_CHECK( deque.steal( value ) && value == 0 );
+    LAMBDASTEW_CHECK( deque.steal( value ) && value == 1 );
+    LAMBDASTEW_CHECK( deque.pop( value ) && value == 98 );
+
+    for ( int i = 97; i >= 2; --i )
+    {
+        LAMBDASTEW_CHECK( deque.pop( value ) && value == i );
+    }
+    LAMBDASTEW_CHECK( !deque.pop( value ) );
+    LAMBDASTEW_CHECK( !deque.steal( value ) );
+    LAMBDASTEW_CHECK( deque.empty_approx() );
+}
+
+static void test_deque_threads()
+{
+    int const thieves = 3;
+    int const count = 200000;
+
+    WorkStealingDeque<int> deque( 16 );
+    std::atomic<bool> done( false );
+    vector<vector<int> > taken( thieves + 1 );
+    vector<std::thread> threads;
+
+    for ( int t = 0; t < thieves; ++t )
+    {
+        threads.emplace_back( [&deque, &done, &taken, t]()
+                              {
+                                  int value;
+                                  while ( true )
+                                  {
+                                      bool const last = done.load();
+                                      while ( deque.steal( value ) )
+                                      {
+                                          taken[t].push_back( value );
+                                      }
+                                      if ( last )
+                                      {
+                                          break;
+                                      }
+                                      std::this_thread::yield();
+                                  }
+                              } );
+    }
+
+    // The owner pushes in bursts and pops some back, racing the thieves
+    // for the last items
+    int value;
+    for ( int i = 0; i < count; )
+    {
+        for ( int burst = 0; burst < 7 && i < count; ++burst, ++i )
+        {
+            deque.push( i );
+        }
+        for ( int burst = 0; burst < 3; ++burst )
+        {
+            if ( deque.pop( value ) )
+            {
+                taken[thieves].push_back( value );
+            }
+        }
+    }
+    while ( deque.pop( value ) )
+    {
+        taken[thieves].push_back( value );
+    }
+    done = true;
+    for ( auto &thread : threads )
+    {
+        thread.join();
+    }
+
+    check_each_seen_once( taken, count );
+}
+
+int main()
+{
+    test_deque_single_thread();
+    test_deque_threads();
+    return 0;
+}
@@ -0,0 +1,265 @@
+#include "LambdaStew/BinaryLog.hpp"
+
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <map>
+
+using namespace LambdaStew;
+
+using std::string;
+using std::vector;
+
+///
+/// \brief read_value
+///
+/// Read one fixed size value from the file
+///
+template <typename T>
+static bool read_value( std::istream &in, T &v )
+{
+    return (bool)in.read( (char *)&v, sizeof( v ) );
+}
+
+///
+/// \brief read_string
+///
+/// Read a uint32_t length and that many characters
+///
+static bool read_string( std::istream &in, string &s )
+{
+    uint32_t length;
+    if ( !read_value( in, length ) )
+    {
+        return false;
+    }
+    s.resize( length );
+    return length == 0 || (bool)in.read( &s[0], length );
+}
+
+///
+/// \brief decode_arg
+///
+/// Decode one argument of type tag at p and print it like operator<< does
+///
+/// \return the position after the argument, or nullptr if it runs past end
+///
+static char const *
+    decode_arg( std::ostream &o, char tag, char const *p, char const *end )
+{
+    switch ( tag )
+    {
+    case binary_log_tag_signed:
+    {
+        int64_t v;
+        if ( end - p < (ptrdiff_t)sizeof( v ) )
+        {
+            return nullptr;
+        }
+        memcpy( &v, p, sizeof( v ) );
+        o << v;
+        return p + sizeof( v );
+    }
+    case binary_log_tag_unsigned:
+    case binary_log_tag_pointer:
+    {
+        uint64_t v;
+        if ( end - p < (ptrdiff_t)sizeof( v ) )
+        {
+            return nullptr;
+        }
+        memcpy( &v, p, sizeof( v ) );
+        if ( tag == binary_log_tag_pointer )
+        {
+            o << "0x" << std::hex << v << std::dec;
+        }
+        else
+        {
+            o << v;
+        }
+        return p + sizeof( v );
+    }
+    case binary_log_tag_double:
+    {
+        double v;
+        if ( end - p < (ptrdiff_t)sizeof( v ) )
+        {
+            return nullptr;
+        }
+        memcpy( &v, p, sizeof( v ) );
+        o << v;
+        return p + sizeof( v );
+    }
+    case binary_log_tag_bool:
+    case binary_log_tag_char:
+    {
+        if ( end - p < 1 )
+        {
+            return nullptr;
+        }
+        if ( tag == binary_log_tag_bool )
+        {
+            o << ( *p != 0 );
+        }
+        else
+        {
+            o << *p;
+        }
+        return p + 1;
+    }
+    case binary_log_tag_string:
+    {
+        uint32_t length;
+        if ( end - p < (ptrdiff_t)sizeof( length ) )
+        {
+            return nullptr;
+        }
+        memcpy( &length, p, sizeof( length ) );
+        p += sizeof( length );
+        if ( end - p < (ptrdiff_t)length )
+        {
+            return nullptr;
+        }
+        o.write( p, length );
+        return p + length;
+    }
+    }
+    return nullptr;
+}
+
+///
+/// \brief print_time
+///
+/// Print a system clock time in nanoseconds as local date and time
+///
+static void print_time( std::ostream &o, int64_t system_ns )
+{
+    time_t seconds = time_t( system_ns / 1000000000 );
+    long nanoseconds = long( system_ns % 1000000000 );
+    struct tm local;
+    localtime_r( &seconds, &local );
+
+    char buf[64];
+    size_t n = strftime( buf, sizeof( buf ), "%Y-%m-%d %H:%M:%S", &local );
+    snprintf( buf + n, sizeof( buf ) - n, ".%09ld", nanoseconds );
+    o << buf;
+}
+
+int main( int argc, char *argv[] )
+{
+    bool with_source = false;
+    char const *path = nullptr;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( strcmp( argv[i], "--with-source" ) == 0 )
+        {
+            with_source = true;
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if ( !path )
+    {
+        std::cerr << "usage: " << argv[0] << " [--with-source] binary-log-file"
+                  << std::endl;
+        return 1;
+    }
+
+    std::ifstream in( path, std::ios::binary );
+    char magic[sizeof( binary_log_magic )];
+    int64_t steady_ns;
+    int64_t system_ns;
+    if ( !in.read( magic, sizeof( magic ) )
+         || memcmp( magic, binary_log_magic, sizeof( magic ) ) != 0
+         || !read_value( in, steady_ns ) || !read_value( in, system_ns ) )
+    {
+        std::cerr << path << ": not a binary log file" << std::endl;
+        return 1;
+    }
+
+    std::map<uint32_t, BinaryLogSiteInfo> sites;
+    vector<char> args;
+    std::ostream &o = std::cout;
+    char kind;
+
+    while ( in.get( kind ) )
+    {
+        if ( kind == char( binary_log_site ) )
+        {
+            uint32_t id;
+            uint8_t level;
+            uint32_t line;
+            BinaryLogSiteInfo site;
+            if ( !read_value( in, id ) || !read_value( in, level )
+                 || !read_value( in, line ) || !read_string( in, site.file )
+                 || !read_string( in, site.format )
+                 || !read_string( in, site.arg_types ) )
+            {
+                break;
+            }
+            site.level = LogLevel( level );
+            site.line = int( line );
+            sites[id] = site;
+        }
+        else if ( kind == char( binary_log_entry ) )
+        {
+            uint32_t id;
+            uint32_t args_size;
+            int64_t timestamp;
+            if ( !read_value( in, id ) || !read_value( in, args_size )
+                 || !read_value( in, timestamp ) )
+            {
+                break;
+            }
+            args.resize( args_size );
+            if ( args_size > 0 && !in.read( &args[0], args_size ) )
+            {
+                break;
+            }
+
+            auto site = sites.find( id );
+            if ( site == sites.end() )
+            {
+                std::cerr << path << ": entry of unknown site " << id
+                          << std::endl;
+                continue;
+            }
+
+            print_time( o, system_ns + ( timestamp - steady_ns ) );
+            o << " " << log_level_prefix( site->second.level );
+
+            char const *format = site->second.format.c_str();
+            char const *p = args.data();
+            char const *end = p + args.size();
+            for ( char tag : site->second.arg_types )
+            {
+                print_format( o, format );
+                p = decode_arg( o, tag, p, end );
+                if ( !p )
+                {
+                    o << "<truncated>";
+                    break;
+                }
+            }
+            print_formatted( o, format );
+
+            if ( with_source )
+            {
+                o << " (" << site->second.file << ":" << site->second.line
+                  << ")";
+            }
+            o << "\n";
+        }
+        else
+        {
+            std::cerr << path << ": unknown record kind " << int( kind )
+                      << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}